@@ -0,0 +1,37 @@
+#ifndef plane_calibration_BENCHMARK_BENCHMARK_HPP_
+#define plane_calibration_BENCHMARK_BENCHMARK_HPP_
+
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+namespace plane_calibration
+{
+
+// Mean wall time of one call in [ms], after one warm up call
+template<typename Function>
+double benchmarkMilliseconds(const Function& function, const int& repetitions = 100)
+{
+  function();
+
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  for (int i = 0; i < repetitions; ++i)
+  {
+    function();
+  }
+  std::chrono::duration<double, std::milli> duration = std::chrono::steady_clock::now() - start;
+
+  return duration.count() / repetitions;
+}
+
+inline void printBenchmark(const std::string& name, const double& baseline_ms, const double& optimized_ms)
+{
+  std::cout << std::left << std::setw(40) << name << std::right << std::fixed << std::setprecision(3)
+      << std::setw(10) << baseline_ms << " ms" << std::setw(10) << optimized_ms << " ms" << std::setw(8)
+      << std::setprecision(2) << baseline_ms / optimized_ms << "x" << std::endl;
+}
+
+} /* end namespace */
+
+#endif
@@ -0,0 +1,171 @@
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <Eigen/Dense>
+
+#include "benchmark.hpp"
+#include "plane_calibration/depth_kernels.hpp"
+#include "plane_calibration/plane_to_depth_image.hpp"
+
+using namespace plane_calibration;
+
+// volatile sink, so the compiler can't drop the benchmarked calls
+static volatile double sink;
+
+typedef float (*SquaredDistanceFunction)(const float*, const float*, const int&);
+typedef DepthKernels::DifferenceStatistics (*DifferenceStatisticsFunction)(const float*, const float*, const int&,
+                                                                           const float&, const float&);
+typedef void (*CountNansAndZerosFunction)(const float*, const int&, int&, int&);
+typedef std::int64_t (*MillimeterSquaredDistanceFunction)(const unsigned short*, const unsigned short*, const int&);
+
+// one image, row by row like the callers
+void benchmarkLevel(const std::string& level, const DepthMatrix& plane, const DepthMatrix& depth,
+                    const SquaredDistanceFunction& squared_distance,
+                    const DifferenceStatisticsFunction& difference_statistics,
+                    const CountNansAndZerosFunction& count_nans_and_zeros, const double& squared_distance_baseline,
+                    const double& difference_statistics_baseline, const double& count_baseline)
+{
+  printBenchmark("squaredDistance " + level, squared_distance_baseline, benchmarkMilliseconds([&]()
+  {
+    double distance = 0.0;
+    for (int row = 0; row < depth.rows(); ++row)
+    {
+      distance += squared_distance(plane.row(row).data(), depth.row(row).data(), depth.cols());
+    }
+    sink = distance;
+  }));
+
+  printBenchmark("differenceStatistics " + level, difference_statistics_baseline, benchmarkMilliseconds([&]()
+  {
+    DepthKernels::DifferenceStatistics statistics;
+    for (int row = 0; row < depth.rows(); ++row)
+    {
+      statistics += difference_statistics(plane.row(row).data(), depth.row(row).data(), depth.cols(), -0.01f,
+                                          0.04f);
+    }
+    sink = statistics.sum;
+  }));
+
+  printBenchmark("countNansAndZeros " + level, count_baseline, benchmarkMilliseconds([&]()
+  {
+    int nans = 0;
+    for (int row = 0; row < depth.rows(); ++row)
+    {
+      int row_nans;
+      int row_zeros;
+      count_nans_and_zeros(depth.row(row).data(), depth.cols(), row_nans, row_zeros);
+      nans += row_nans + row_zeros;
+    }
+    sink = nans;
+  }));
+}
+
+// the integer distance of the millimeter pipeline, the baseline is the scalar loop
+double benchmarkMillimeterLevel(const MillimeterDepthMatrix& plane, const MillimeterDepthMatrix& depth,
+                                const MillimeterSquaredDistanceFunction& squared_distance)
+{
+  return benchmarkMilliseconds([&]()
+  {
+    std::int64_t distance = 0;
+    for (int row = 0; row < depth.rows(); ++row)
+    {
+      distance += squared_distance(plane.row(row).data(), depth.row(row).data(), depth.cols());
+    }
+    sink = distance;
+  });
+}
+
+void benchmarkMillimeters(const DepthMatrix& plane, const DepthMatrix& depth)
+{
+  MillimeterDepthMatrix millimeter_plane;
+  MillimeterDepthMatrix millimeter_depth;
+  PlaneToDepthImage::quantize(plane, millimeter_plane);
+  PlaneToDepthImage::quantize(depth, millimeter_depth);
+
+  double baseline = benchmarkMillimeterLevel(millimeter_plane, millimeter_depth,
+                                             &DepthKernels::millimeterSquaredDistanceScalar);
+  printBenchmark("millimeterSquaredDistance scalar", baseline, baseline);
+  if (DepthKernels::hasSSE2())
+  {
+    printBenchmark("millimeterSquaredDistance SSE2", baseline,
+                   benchmarkMillimeterLevel(millimeter_plane, millimeter_depth,
+                                            &DepthKernels::millimeterSquaredDistanceSSE2));
+  }
+  if (DepthKernels::hasAVX2())
+  {
+    printBenchmark("millimeterSquaredDistance AVX2", baseline,
+                   benchmarkMillimeterLevel(millimeter_plane, millimeter_depth,
+                                            &DepthKernels::millimeterSquaredDistanceAVX2));
+  }
+  if (DepthKernels::hasAVX512())
+  {
+    printBenchmark("millimeterSquaredDistance AVX512", baseline,
+                   benchmarkMillimeterLevel(millimeter_plane, millimeter_depth,
+                                            &DepthKernels::millimeterSquaredDistanceAVX512));
+  }
+}
+
+void benchmarkResolution(const CameraModel::Parameters& parameters)
+{
+  Eigen::Affine3d transform = Eigen::Translation3d(0.0, -0.16, 0.96)
+      * Eigen::AngleAxisd(-0.6, Eigen::Vector3d::UnitX());
+
+  DepthMatrix plane = PlaneToDepthImage::convert(transform, parameters);
+  DepthMatrix depth = plane + 0.02 * DepthMatrix::Random(plane.rows(), plane.cols());
+  depth.block(0, 0, depth.rows() / 4, depth.cols() / 2).setConstant(NAN);
+
+  std::cout << parameters.width_ << "x" << parameters.height_ << std::setw(43) << "eigen" << std::setw(13)
+      << "kernel" << std::endl;
+
+  // the expressions the kernels replace
+  double squared_distance_baseline = benchmarkMilliseconds([&]()
+  {
+    DepthMatrix difference = (depth - plane).cwiseAbs2();
+    sink = (difference.array() == difference.array()).select(difference, 0.0f).sum();
+  });
+  double difference_statistics_baseline = benchmarkMilliseconds([&]()
+  {
+    DepthMatrix difference = plane - depth;
+    int not_nan_count = (difference.array() == difference.array()).count();
+    difference = (difference.array() == difference.array()).select(difference, 0.0f);
+    sink = difference.sum() / not_nan_count + (difference.array() < -0.01f).count()
+        + (difference.array().abs() > 0.04f).count() + difference.cwiseAbs().maxCoeff();
+  });
+  double count_baseline = benchmarkMilliseconds([&]()
+  {
+    sink = (depth.array() != depth.array()).count() + (depth.array() == 0.0).count();
+  });
+
+  benchmarkLevel("scalar", plane, depth, &DepthKernels::squaredDistanceScalar,
+                 &DepthKernels::differenceStatisticsScalar, &DepthKernels::countNansAndZerosScalar,
+                 squared_distance_baseline, difference_statistics_baseline, count_baseline);
+  if (DepthKernels::hasSSE2())
+  {
+    benchmarkLevel("SSE2", plane, depth, &DepthKernels::squaredDistanceSSE2, &DepthKernels::differenceStatisticsSSE2,
+                   &DepthKernels::countNansAndZerosSSE2, squared_distance_baseline, difference_statistics_baseline,
+                   count_baseline);
+  }
+  if (DepthKernels::hasAVX2())
+  {
+    benchmarkLevel("AVX2", plane, depth, &DepthKernels::squaredDistanceAVX2, &DepthKernels::differenceStatisticsAVX2,
+                   &DepthKernels::countNansAndZerosAVX2, squared_distance_baseline, difference_statistics_baseline,
+                   count_baseline);
+  }
+  if (DepthKernels::hasAVX512())
+  {
+    benchmarkLevel("AVX512", plane, depth, &DepthKernels::squaredDistanceAVX512,
+                   &DepthKernels::differenceStatisticsAVX512, &DepthKernels::countNansAndZerosAVX512,
+                   squared_distance_baseline, difference_statistics_baseline, count_baseline);
+  }
+
+  benchmarkMillimeters(plane, depth);
+
+  std::cout << std::endl;
+}
+
+int main()
+{
+  benchmarkResolution(CameraModel::Parameters(321.3, 212, 570.3422, 570.3422, 640, 480));
+  benchmarkResolution(CameraModel::Parameters(160.15, 105.75, 285.1711, 285.1711, 320, 240));
+  return 0;
+}
@@ -0,0 +1,67 @@
+#include <iostream>
+#include <vector>
+#include <Eigen/Dense>
+
+#include "benchmark.hpp"
+#include "plane_calibration/fixed_size_kernels.hpp"
+#include "plane_calibration/plane_to_depth_image.hpp"
+
+using namespace plane_calibration;
+
+// volatile sink, so the compiler can't drop the benchmarked calls
+static volatile double sink;
+
+void benchmarkResolution(const CameraModel::Parameters& parameters)
+{
+  const FixedSizeKernels::Resolution dynamic = FixedSizeKernels::DYNAMIC_RESOLUTION;
+  const FixedSizeKernels::Resolution fixed = FixedSizeKernels::select(parameters);
+
+  Eigen::Affine3d transform = Eigen::Translation3d(0.0, -0.16, 0.96)
+      * Eigen::AngleAxisd(-0.6, Eigen::Vector3d::UnitX());
+  Eigen::Affine3d tilted_transform = transform * Eigen::AngleAxisd(0.02, Eigen::Vector3d::UnitY());
+
+  DepthMatrix plane = PlaneToDepthImage::convert(transform, parameters);
+  DepthMatrix tilted_plane = PlaneToDepthImage::convert(tilted_transform, parameters);
+  DepthMatrix depth = plane + 0.02 * DepthMatrix::Random(plane.rows(), plane.cols());
+  DepthMatrix min_plane = (plane.array() - 0.1f).matrix();
+  DepthMatrix max_plane = (plane.array() + 0.1f).matrix();
+
+  PlaneToDepthImage::XYMultipliers xy_multipliers = PlaneToDepthImage::depthCalculationXYMultiplier(parameters);
+  Eigen::RowVectorXf x_multiplier = xy_multipliers.first;
+  Eigen::VectorXf y_multiplier = xy_multipliers.second;
+  Eigen::Vector4f plane_coeffs = PlaneToDepthImage::planeCoefficients(transform);
+
+  DepthMatrix out;
+
+  std::cout << parameters.width_ << "x" << parameters.height_ << std::setw(43) << "dynamic" << std::setw(13)
+      << "fixed" << std::endl;
+
+  printBenchmark("planeDepth", benchmarkMilliseconds([&]()
+  { FixedSizeKernels::planeDepth(dynamic, plane_coeffs, x_multiplier, y_multiplier, out);}),
+                 benchmarkMilliseconds([&]()
+                 { FixedSizeKernels::planeDepth(fixed, plane_coeffs, x_multiplier, y_multiplier, out);}));
+
+  printBenchmark("squaredDistance", benchmarkMilliseconds([&]()
+  { sink = FixedSizeKernels::squaredDistance(dynamic, tilted_plane, depth);}),
+                 benchmarkMilliseconds([&]()
+                 { sink = FixedSizeKernels::squaredDistance(fixed, tilted_plane, depth);}));
+
+  printBenchmark("filter", benchmarkMilliseconds([&]()
+  { FixedSizeKernels::filter(dynamic, depth, min_plane, max_plane, out);}),
+                 benchmarkMilliseconds([&]()
+                 { FixedSizeKernels::filter(fixed, depth, min_plane, max_plane, out);}));
+
+  printBenchmark("difference", benchmarkMilliseconds([&]()
+  { sink = FixedSizeKernels::difference(dynamic, plane, depth, out);}),
+                 benchmarkMilliseconds([&]()
+                 { sink = FixedSizeKernels::difference(fixed, plane, depth, out);}));
+
+  std::cout << std::endl;
+}
+
+int main()
+{
+  benchmarkResolution(CameraModel::Parameters(321.3, 212, 570.3422, 570.3422, 640, 480));
+  benchmarkResolution(CameraModel::Parameters(160.15, 105.75, 285.1711, 285.1711, 320, 240));
+  return 0;
+}
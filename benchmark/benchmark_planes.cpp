@@ -0,0 +1,47 @@
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <Eigen/Dense>
+
+#include "benchmark.hpp"
+#include "plane_calibration/planes.hpp"
+#include "plane_calibration/plane_to_depth_image.hpp"
+
+using namespace plane_calibration;
+
+void benchmarkBuildThreads(const CameraModel::Parameters& camera_parameters, const int& max_threads)
+{
+  PlaneToDepthImage plane_to_depth(camera_parameters);
+
+  CalibrationParameters::Parameters parameters(0.1, Eigen::Vector3d(0.0, -0.16, 0.96),
+                                               Eigen::AngleAxisd(-0.6, Eigen::Vector3d::UnitX()), true, 40);
+
+  std::string title = std::to_string(camera_parameters.width_) + "x" + std::to_string(camera_parameters.height_) + ", "
+      + std::to_string(parameters.precomputed_plane_pairs_count_) + " pairs";
+  std::cout << title << std::setw(50 - title.size()) << "1 thread" << std::setw(13) << "n threads" << std::endl;
+
+  parameters.plane_build_threads_ = 1;
+  double single_thread_ms = benchmarkMilliseconds([&]()
+  { Planes planes(parameters, plane_to_depth);}, 3);
+
+  for (int threads = 2; threads <= max_threads; threads *= 2)
+  {
+    parameters.plane_build_threads_ = threads;
+    double threads_ms = benchmarkMilliseconds([&]()
+    { Planes planes(parameters, plane_to_depth);}, 3);
+
+    printBenchmark("Planes, " + std::to_string(threads) + " threads", single_thread_ms, threads_ms);
+  }
+
+  std::cout << std::endl;
+}
+
+int main()
+{
+  int max_threads = std::max(static_cast<int>(std::thread::hardware_concurrency()), 2);
+
+  benchmarkBuildThreads(CameraModel::Parameters(321.3, 212, 570.3422, 570.3422, 640, 480), max_threads);
+  benchmarkBuildThreads(CameraModel::Parameters(160.15, 105.75, 285.1711, 285.1711, 320, 240), max_threads);
+  return 0;
+}
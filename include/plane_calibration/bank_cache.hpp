@@ -0,0 +1,164 @@
+#ifndef plane_calibration_SRC_BANK_CACHE_HPP_
+#define plane_calibration_SRC_BANK_CACHE_HPP_
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "calibration_parameters.hpp"
+#include "camera_model.hpp"
+
+namespace plane_calibration
+{
+
+/**
+ * Cache keys of everything made for one ground transform. The transform is quantized (0.1 mm, 1e-5 of the rotation
+ * matrix ~ 0.0006 degree), a sensor returning to a pose with some tf noise gets the same key.
+ */
+class BankKey
+{
+public:
+  typedef std::vector<std::int64_t> Key;
+  // offset, rotation matrix, max deviation and millimeter_depth_; fixed size, so comparing doesn't allocate
+  typedef std::array<std::int64_t, 14> TransformKey;
+
+  // ground transform, max deviation and millimeter_depth_
+  static Key transform(const CalibrationParameters::Parameters& parameters);
+  static TransformKey transformKey(const CalibrationParameters::Parameters& parameters);
+  static void append(const CameraModel::Parameters& camera_parameters, Key& key);
+  static void append(const double& value, const double& resolution, Key& key);
+
+protected:
+  static std::int64_t quantize(const double& value, const double& resolution);
+};
+
+class BankCacheStatistics
+{
+public:
+  BankCacheStatistics() :
+      hits(0), misses(0), banks(0), bytes(0)
+  {
+  }
+
+  std::size_t hits;
+  std::size_t misses;
+  std::size_t banks;
+  std::size_t bytes;
+};
+
+/**
+ * Least recently used banks (Planes, DeviationPlanes) within a memory budget, thread safe.
+ * Users keep their shared pointer of a dropped bank as long as they need it.
+ */
+template<typename Bank>
+class BankCache
+{
+public:
+  typedef std::shared_ptr<Bank> BankPtr;
+
+  BankCache() :
+      budget_bytes_(0)
+  {
+  }
+
+  // nullptr on a miss, a hit becomes the most recently used bank
+  BankPtr find(const BankKey::Key& key)
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    typename std::map<BankKey::Key, typename Entries::iterator>::iterator found = index_.find(key);
+    if (found == index_.end())
+    {
+      ++statistics_.misses;
+      return BankPtr();
+    }
+
+    ++statistics_.hits;
+    entries_.splice(entries_.begin(), entries_, found->second);
+    return found->second->bank;
+  }
+
+  // replaces a bank with the same key, a bank larger than the budget is not kept
+  void insert(const BankKey::Key& key, const BankPtr& bank, const std::size_t& bytes)
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    erase(key);
+
+    if (bytes > budget_bytes_)
+    {
+      return;
+    }
+
+    Entry entry;
+    entry.key = key;
+    entry.bank = bank;
+    entry.bytes = bytes;
+    entries_.push_front(entry);
+    index_[key] = entries_.begin();
+    statistics_.bytes += bytes;
+
+    shrink();
+  }
+
+  // <= 0: nothing is kept
+  void setBudget(const int& megabytes)
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    budget_bytes_ = static_cast<std::size_t>(std::max(megabytes, 0)) * 1024 * 1024;
+    shrink();
+  }
+
+  BankCacheStatistics getStatistics() const
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    BankCacheStatistics statistics = statistics_;
+    statistics.banks = entries_.size();
+    return statistics;
+  }
+
+protected:
+  class Entry
+  {
+  public:
+    BankKey::Key key;
+    BankPtr bank;
+    std::size_t bytes;
+  };
+  typedef std::list<Entry> Entries;
+
+  void erase(const BankKey::Key& key)
+  {
+    typename std::map<BankKey::Key, typename Entries::iterator>::iterator found = index_.find(key);
+    if (found != index_.end())
+    {
+      statistics_.bytes -= found->second->bytes;
+      entries_.erase(found->second);
+      index_.erase(found);
+    }
+  }
+
+  void shrink()
+  {
+    while (statistics_.bytes > budget_bytes_)
+    {
+      erase(entries_.back().key);
+    }
+  }
+
+  mutable std::mutex mutex_;
+  std::size_t budget_bytes_;
+  BankCacheStatistics statistics_;
+
+  // most recently used first
+  Entries entries_;
+  std::map<BankKey::Key, typename Entries::iterator> index_;
+};
+
+} /* end namespace */
+
+#endif
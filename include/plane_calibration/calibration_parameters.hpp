@@ -3,6 +3,7 @@
 
 #include <mutex>
 #include <memory>
+#include <string>
 #include <Eigen/Dense>
 
 namespace plane_calibration
@@ -22,6 +23,18 @@ public:
       deviation_ = 0.0;
       precompute_planes_ = true;
       precomputed_plane_pairs_count_ = 0;
+      millimeter_depth_ = false;
+      pyramid_factor_ = 1;
+      moment_estimation_ = false;
+      interpolate_planes_ = false;
+      half_precision_planes_ = false;
+      plane_build_threads_ = 0;
+      kernel_threads_ = 1;
+      planes_cache_directory_ = "";
+      shared_planes_directory_ = "";
+      bank_cache_megabytes_ = 0;
+      lazy_planes_ = false;
+      prefetch_planes_ = 0;
     }
 
     Parameters(const double& max_deviation, const Eigen::Vector3d& ground_plane_offset,
@@ -33,6 +46,18 @@ public:
       deviation_ = max_deviation_;
       precompute_planes_ = precompute_planes;
       precomputed_plane_pairs_count_ = precomputed_plane_pairs_count;
+      millimeter_depth_ = false;
+      pyramid_factor_ = 1;
+      moment_estimation_ = false;
+      interpolate_planes_ = false;
+      half_precision_planes_ = false;
+      plane_build_threads_ = 0;
+      kernel_threads_ = 1;
+      planes_cache_directory_ = "";
+      shared_planes_directory_ = "";
+      bank_cache_megabytes_ = 0;
+      lazy_planes_ = false;
+      prefetch_planes_ = 0;
     }
 
     Eigen::Affine3d getTransform() const
@@ -48,8 +73,35 @@ public:
 
     bool precompute_planes_;
     int precomputed_plane_pairs_count_;
+    // blend the bank planes to the exact angles, allows way less precomputed planes
+    bool interpolate_planes_;
+    // store the float bank planes as fp16, half the memory and read bandwidth
+    bool half_precision_planes_;
+    // threads to make the precomputed planes with, <= 0: one per core
+    int plane_build_threads_;
+    // threads the per pixel kernels split the image rows over (see RowPool), <= 0: one per core
+    int kernel_threads_;
+    // make the precomputed planes when they are used the first time, prefetch_planes_ neighbours in the background
+    bool lazy_planes_;
+    int prefetch_planes_;
+    // banks are stored here and loaded instead of built again, empty: no cache
+    std::string planes_cache_directory_;
+    // banks are shared here (a tmpfs like /dev/shm) with all instances and processes, empty: not shared
+    std::string shared_planes_directory_;
+    // memory for the banks (and separately the deviation planes) of earlier ground transforms, 0: only the current
+    int bank_cache_megabytes_;
+
+    // integer pipeline with depth in [mm] for 16UC1 input
+    bool millimeter_depth_;
+
+    // > 1: all but the last iteration run on a binned (factor x factor) image
+    int pyramid_factor_;
+
+    // estimate from the inverse depth moments of one pass over the data instead of plane images
+    bool moment_estimation_;
   };
 
+  CalibrationParameters();
   CalibrationParameters(bool precompute_planes, int precomputed_plane_pairs_count);
   CalibrationParameters(const double& max_deviation, const Eigen::Vector3d& ground_plane_offset,
                         const Eigen::AngleAxisd& rotation, bool precompute_planes, int precomputed_plane_pairs_count);
@@ -59,6 +111,7 @@ public:
   Parameters getParameters();
   bool parametersUpdated();
   Eigen::Affine3d getTransform() const;
+  int getKernelThreads() const;
 
   void update(const Eigen::Vector3d& ground_plane_offset, const double& max_deviation,
               const Eigen::AngleAxisd& rotation);
@@ -70,6 +123,17 @@ public:
   void update(const double& deviation);
   void updateDeviations(const double& value);
   void updatePrecomputation(const bool& enable, const int& plane_pair_count);
+  void updatePlaneInterpolation(const bool& enable);
+  void updateHalfPrecisionPlanes(const bool& enable);
+  void updatePlaneBuildThreads(const int& threads);
+  void updateKernelThreads(const int& threads);
+  void updateLazyPlanes(const bool& enable, const int& prefetch_count);
+  void updatePlanesCacheDirectory(const std::string& directory);
+  void updateSharedPlanesDirectory(const std::string& directory);
+  void updateBankCacheBudget(const int& megabytes);
+  void updateMillimeterDepth(const bool& enable);
+  void updatePyramidFactor(const int& factor);
+  void updateMomentEstimation(const bool& enable);
 
   void updateDeviation(const double& deviation);
 
@@ -7,6 +7,10 @@
 
 #include "camera_model.hpp"
 #include "calibration_parameters.hpp"
+#include "depth_kernels.hpp"
+#include "depth_matrix.hpp"
+#include "row_pool.hpp"
+#include "valid_pixels.hpp"
 #include "visualizer_interface.hpp"
 
 namespace plane_calibration
@@ -36,14 +40,32 @@ public:
   void updateConfig(const Config& new_config);
 
   bool angleOffsetValid(const std::pair<double, double>& angles);
-  bool groundPlaneFitsData(const Eigen::MatrixXf& ground_plane, const Eigen::MatrixXf& data, const bool& debug = false);
-  bool groundPlaneHasDataBelow(const Eigen::MatrixXf& ground_plane, const Eigen::MatrixXf& data, const bool& debug =
-                                   false);
+  bool groundPlaneFitsData(const DepthConstRef& ground_plane, const DepthConstRef& data, const bool& debug = false);
+  bool groundPlaneHasDataBelow(const DepthConstRef& ground_plane, const DepthConstRef& data, const bool& debug = false);
+
+  // data given as its valid pixels
+  bool groundPlaneFitsData(const DepthConstRef& ground_plane, const ValidPixels& data, const bool& debug = false);
+  bool groundPlaneHasDataBelow(const DepthConstRef& ground_plane, const ValidPixels& data, const bool& debug = false);
 
 protected:
-  void getDifferenceAndNotNanCount(const Eigen::MatrixXf& ground_plane, const Eigen::MatrixXf& data,
-                                   Eigen::MatrixXf& difference, int& not_nan_count);
-  bool checkTooLow(const Eigen::MatrixXf& difference, const int& not_nan_count, double& too_low_ratio);
+  // the ratio of differences beyond this is checked against max_too_low_ratio
+  static const double max_outside_distance;
+
+  // of plane - data, nan differences are left out
+  DepthKernels::DifferenceStatistics getDifferenceStatistics(const DepthConstRef& ground_plane,
+                                                             const DepthConstRef& data);
+  DepthKernels::DifferenceStatistics getDifferenceStatistics(const DepthConstRef& ground_plane,
+                                                             const ValidPixels& data);
+  // too_low_buffer and max_outside_distance as float thresholds for the kernels
+  void getThresholds(float& below, float& outside);
+
+  bool groundPlaneFitsData_(const DepthKernels::DifferenceStatistics& statistics, const bool& debug);
+  bool groundPlaneHasDataBelow_(const DepthKernels::DifferenceStatistics& statistics, const bool& debug);
+  bool checkTooLow(const DepthKernels::DifferenceStatistics& statistics, double& too_low_ratio);
+
+  // adds up block_sum(start, length) of fixed size blocks of [0, size) in order, split over the kernel threads
+  template<typename T, typename BlockSum>
+  T sumBlocks(const int& size, const T& zero, const BlockSum& block_sum);
 
   mutable std::mutex mutex_;
   CameraModel camera_model_;
@@ -51,7 +73,7 @@ protected:
   Config config_;
   VisualizerInterfacePtr depth_visualizer_;
 
-  Eigen::MatrixXf last_ground_plane_;
+  DepthMatrix last_ground_plane_;
 };
 typedef std::shared_ptr<CalibrationValidation> CalibrationValidationPtr;
 
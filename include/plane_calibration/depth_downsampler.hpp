@@ -0,0 +1,38 @@
+#ifndef plane_calibration_SRC_DEPTH_DOWNSAMPLER_HPP_
+#define plane_calibration_SRC_DEPTH_DOWNSAMPLER_HPP_
+
+#include "camera_model.hpp"
+#include "depth_matrix.hpp"
+#include "image_msg_eigen_converter.hpp"
+#include "valid_pixels.hpp"
+
+namespace plane_calibration
+{
+
+/**
+ * Bins factor x factor pixel blocks into one pixel by averaging the valid depths (nan / 0 are ignored).
+ * The camera model parameters are scaled to match, so every stage can work on the smaller images.
+ */
+class DepthDownsampler
+{
+public:
+  // valid pixels per output pixel
+  typedef Eigen::Matrix<int, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> CountMatrix;
+
+  static CameraModel::Parameters downsample(const CameraModel::Parameters& camera_model_paramaters,
+                                            const int& factor);
+
+  static void downsample(const DepthConstRef& depth, const int& factor, DepthMatrix& out_depth);
+  static void downsample(const MillimeterDepthConstRef& depth, const int& factor,
+                         MillimeterDepthMatrix& out_depth);
+  // same result as binning the image the pixels were compacted from
+  static void downsample(const ValidPixels& valid_pixels, const int& factor, DepthMatrix& out_depth);
+  // same, counts is kept by the caller so no frame allocates
+  static void downsample(const ValidPixels& valid_pixels, const int& factor, DepthMatrix& out_depth,
+                         CountMatrix& counts);
+  static void downsample(const DepthImageView& depth_image, const int& factor, DepthImageView& out_depth_image);
+};
+
+} /* end namespace */
+
+#endif
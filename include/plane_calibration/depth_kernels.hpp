@@ -0,0 +1,124 @@
+#ifndef plane_calibration_SRC_DEPTH_KERNELS_HPP_
+#define plane_calibration_SRC_DEPTH_KERNELS_HPP_
+
+#include <cstdint>
+#include <limits>
+
+namespace plane_calibration
+{
+
+/**
+ * Hand vectorized per pixel kernels. The SIMD versions give the exact same results as the scalar ones,
+ * the best one the cpu supports is picked once at runtime.
+ */
+class DepthKernels
+{
+public:
+  // of the not nan differences a - b
+  class DifferenceStatistics
+  {
+  public:
+    DifferenceStatistics();
+    DifferenceStatistics& operator+=(const DifferenceStatistics& other);
+
+    double sum;
+    double abs_sum;
+    float abs_min; // inf without valid differences
+    float abs_max; // 0 without valid differences
+    int valid_count;
+    // differences < below, absolute differences > outside
+    int below_count;
+    int outside_count;
+  };
+
+  // 16UC1 [mm] to 32FC1 [m], zeros and depths beyond max_range are marked as nan
+  static void millimetersToMeters(const unsigned short* input, float* output, const int& count,
+                                  const float& max_range = std::numeric_limits<float>::infinity());
+
+  static void millimetersToMetersScalar(const unsigned short* input, float* output, const int& count,
+                                        const float& max_range);
+  static void millimetersToMetersSSE41(const unsigned short* input, float* output, const int& count,
+                                       const float& max_range);
+  static void millimetersToMetersAVX2(const unsigned short* input, float* output, const int& count,
+                                      const float& max_range);
+
+  // IEEE fp16 (raw bits) <-> float, rounded to nearest even
+  static void halfToFloat(const unsigned short* input, float* output, const int& count);
+  static void floatToHalf(const float* input, unsigned short* output, const int& count);
+
+  // sum of (half - data)^2, pixels with nan data are skipped, the half values are decoded on the fly.
+  // Summed in 8 lanes in every version, so all give the same result
+  static float halfSquaredDistance(const unsigned short* half, const float* data, const int& count);
+
+  static void halfToFloatScalar(const unsigned short* input, float* output, const int& count);
+  static void halfToFloatF16C(const unsigned short* input, float* output, const int& count);
+  static void floatToHalfScalar(const float* input, unsigned short* output, const int& count);
+  static void floatToHalfF16C(const float* input, unsigned short* output, const int& count);
+  static float halfSquaredDistanceScalar(const unsigned short* half, const float* data, const int& count);
+  static float halfSquaredDistanceF16C(const unsigned short* half, const float* data, const int& count);
+
+  // nan aware reductions over a - b, a nan difference (nan in a or b) is skipped. Everything stays in registers,
+  // the sums are added up in 16 lanes in every version, so all give the same result
+  static float squaredDistance(const float* a, const float* b, const int& count);
+  static DifferenceStatistics differenceStatistics(const float* a, const float* b, const int& count,
+                                                   const float& below = -std::numeric_limits<float>::infinity(),
+                                                   const float& outside = std::numeric_limits<float>::infinity());
+  static void countNansAndZeros(const float* data, const int& count, int& nan_count, int& zero_count);
+
+  static float squaredDistanceScalar(const float* a, const float* b, const int& count);
+  static float squaredDistanceSSE2(const float* a, const float* b, const int& count);
+  static float squaredDistanceAVX2(const float* a, const float* b, const int& count);
+  static float squaredDistanceAVX512(const float* a, const float* b, const int& count);
+  static DifferenceStatistics differenceStatisticsScalar(const float* a, const float* b, const int& count,
+                                                         const float& below, const float& outside);
+  static DifferenceStatistics differenceStatisticsSSE2(const float* a, const float* b, const int& count,
+                                                       const float& below, const float& outside);
+  static DifferenceStatistics differenceStatisticsAVX2(const float* a, const float* b, const int& count,
+                                                       const float& below, const float& outside);
+  static DifferenceStatistics differenceStatisticsAVX512(const float* a, const float* b, const int& count,
+                                                         const float& below, const float& outside);
+  static void countNansAndZerosScalar(const float* data, const int& count, int& nan_count, int& zero_count);
+  static void countNansAndZerosSSE2(const float* data, const int& count, int& nan_count, int& zero_count);
+  static void countNansAndZerosAVX2(const float* data, const int& count, int& nan_count, int& zero_count);
+  static void countNansAndZerosAVX512(const float* data, const int& count, int& nan_count, int& zero_count);
+
+  // sum of (a - b)^2 in [mm^2], pixels with a 0 (invalid) in a or b are skipped. Integer sums, so every version
+  // gives the same result
+  static std::int64_t millimeterSquaredDistance(const unsigned short* a, const unsigned short* b, const int& count);
+
+  static std::int64_t millimeterSquaredDistanceScalar(const unsigned short* a, const unsigned short* b,
+                                                      const int& count);
+  static std::int64_t millimeterSquaredDistanceSSE2(const unsigned short* a, const unsigned short* b,
+                                                    const int& count);
+  static std::int64_t millimeterSquaredDistanceAVX2(const unsigned short* a, const unsigned short* b,
+                                                    const int& count);
+  static std::int64_t millimeterSquaredDistanceAVX512(const unsigned short* a, const unsigned short* b,
+                                                      const int& count);
+
+  static bool hasSSE2();
+  static bool hasSSE41();
+  static bool hasAVX2();
+  static bool hasAVX512();
+  static bool hasF16C();
+
+  static constexpr float millimeter_to_meter = 0.001f;
+
+protected:
+  static const int lanes = 8;
+  static const int reduction_lanes = 16;
+
+  // continues the lane sums from index start on and adds the lanes up in a fixed order
+  static float halfSquaredDistanceTail(const unsigned short* half, const float* data, const int& start,
+                                       const int& count, float* lane_sums);
+  static float squaredDistanceTail(const float* a, const float* b, const int& start, const int& count,
+                                   float* lane_sums);
+  // continues statistics (its counts, min and max) and the lane sums from index start on
+  static void differenceStatisticsTail(const float* a, const float* b, const int& start, const int& count,
+                                       const float& below, const float& outside, float* lane_sums,
+                                       float* lane_abs_sums, DifferenceStatistics& statistics);
+  static float addLanes(const float* lane_sums);
+};
+
+} /* end namespace */
+
+#endif
@@ -0,0 +1,30 @@
+#ifndef plane_calibration_SRC_DEPTH_MATRIX_HPP_
+#define plane_calibration_SRC_DEPTH_MATRIX_HPP_
+
+#include <Eigen/Dense>
+
+namespace plane_calibration
+{
+
+// Depth images are stored row major, same as the sensor_msgs::Image buffers,
+// so they can be mapped without copying and walked row by row
+typedef Eigen::Matrix<float, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> DepthMatrix;
+
+// Read only view of a depth image with arbitrary row step (e.g. padded image msg rows)
+typedef Eigen::Map<const DepthMatrix, Eigen::Unaligned, Eigen::OuterStride<> > DepthMap;
+
+// Accepts DepthMatrix and DepthMap without copying
+typedef Eigen::Ref<const DepthMatrix, Eigen::Unaligned, Eigen::OuterStride<> > DepthConstRef;
+
+// Depth in millimeters as published by most 16UC1 sensors, 0 marks invalid depth
+typedef Eigen::Matrix<unsigned short, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> MillimeterDepthMatrix;
+typedef Eigen::Map<const MillimeterDepthMatrix, Eigen::Unaligned, Eigen::OuterStride<> > MillimeterDepthMap;
+typedef Eigen::Ref<const MillimeterDepthMatrix, Eigen::Unaligned, Eigen::OuterStride<> > MillimeterDepthConstRef;
+
+// IEEE fp16 depth in [m], used for the precomputed planes
+typedef Eigen::Matrix<Eigen::half, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> HalfDepthMatrix;
+typedef Eigen::Ref<const HalfDepthMatrix, Eigen::Unaligned, Eigen::OuterStride<> > HalfDepthConstRef;
+
+} /* end namespace */
+
+#endif
@@ -8,6 +8,7 @@
 #include <Eigen/Dense>
 #include <ros/node_handle.h>
 #include <ros/publisher.h>
+#include <sensor_msgs/CameraInfo.h>
 #include <sensor_msgs/Image.h>
 #include <sensor_msgs/PointCloud2.h>
 #include <image_geometry/pinhole_camera_model.h>
@@ -24,6 +25,8 @@ public:
   DepthVisualizer(ros::NodeHandle node_handle, std::string frame_id = std::string("camera_depth_optical_frame"));
 
   virtual void setCameraModel(const image_geometry::PinholeCameraModel& camera_model);
+  // pinhole model without distortion, e.g. of the downsampled processing images
+  virtual void setCameraModel(const CameraModel::Parameters& camera_model_paramaters);
 
   virtual void publishImage(const std::string& topic, const Eigen::MatrixXf& image_matrix, std::string frame_id =
                                 std::string(""));
@@ -42,13 +45,14 @@ public:
 
 protected:
   template<typename MsgType>
-  void addPublisherIfNotExist(const std::string& topic);
+  ros::Publisher addPublisherIfNotExist(const std::string& topic);
   sensor_msgs::PointCloud2Ptr imageMsgToPointCloud(const sensor_msgs::Image& image_msg);
 
   ros::NodeHandle node_handle_;
   std::string frame_id_;
   std::mutex camera_model_mutex_;
   image_geometry::PinholeCameraModel camera_model_;
+  std::mutex publishers_mutex_;
   std::map<std::string, ros::Publisher> publishers_;
 };
 
@@ -6,7 +6,9 @@
 #include <Eigen/Dense>
 
 #include "calibration_parameters.hpp"
+#include "depth_matrix.hpp"
 #include "plane_to_depth_image.hpp"
+#include "valid_pixels.hpp"
 #include "visualizer_interface.hpp"
 
 namespace plane_calibration
@@ -20,18 +22,45 @@ public:
   void init(const CalibrationParameters::Parameters& parameters);
   void update(const CalibrationParameters::Parameters& parameters, const bool& use_max_deviation = false);
 
-  std::pair<double, double> estimateAngles(const Eigen::MatrixXf& plane, const bool& debug = false);
-  std::pair<double, double> getDistanceDiffs(const Eigen::MatrixXf& plane, const bool& debug = false);
-  static double getDistance(const Eigen::MatrixXf& from, const Eigen::MatrixXf& to, const bool& remove_nans);
+  std::pair<double, double> estimateAngles(const DepthConstRef& plane, const bool& debug = false);
+  std::pair<double, double> getDistanceDiffs(const DepthConstRef& plane, const bool& debug = false);
+  // the rows (or blocks of valid pixels) are split over threads row pool threads, same result for any thread count
+  static double getDistance(const DepthConstRef& from, const DepthConstRef& to, const bool& remove_nans,
+                            const int& threads = 1);
+
+  // integer versions for depth in [mm], invalid pixels (0) are skipped, distances are returned in [m^2]
+  std::pair<double, double> estimateAngles(const MillimeterDepthConstRef& plane, const bool& debug = false);
+  std::pair<double, double> getDistanceDiffs(const MillimeterDepthConstRef& plane, const bool& debug = false);
+  static double getDistance(const MillimeterDepthConstRef& from, const MillimeterDepthConstRef& to,
+                            const int& threads = 1);
+
+  // over the valid pixels only, the plane depths are calculated per pixel
+  std::pair<double, double> estimateAngles(const ValidPixels& pixels, const bool& debug = false);
+  std::pair<double, double> getDistanceDiffs(const ValidPixels& pixels, const bool& debug = false);
+  static double getPlaneDistance(const Eigen::Vector4f& plane_coeffs, const ValidPixels& to, const int& threads = 1);
+  // one pass over the list for the planes of the columns, same results as getPlaneDistance per plane
+  static Eigen::Vector4d getPlaneDistances(const Eigen::Matrix4f& plane_coeffs, const ValidPixels& to,
+                                           const int& threads = 1);
+  static double getDistance(const DepthConstRef& from, const ValidPixels& to, const int& threads = 1);
+
+  // fp16 planes (see Planes), decoded on the fly
+  static double getDistance(const HalfDepthConstRef& from, const DepthConstRef& to, const int& threads = 1);
+  static double getDistance(const HalfDepthConstRef& from, const HalfDepthConstRef& to, const int& threads = 1);
+  // same, single threaded with to_row as the buffer for one decoded row of to
+  static double getDistance(const HalfDepthConstRef& from, const HalfDepthConstRef& to,
+                            Eigen::Ref<Eigen::RowVectorXf> to_row);
+  static double getDistance(const HalfDepthConstRef& from, const ValidPixels& to, const int& threads = 1);
 
   double getDeviation();
+  // memory of the plane images
+  std::size_t bytes() const;
   std::pair<double, double> getMultipliers();
 
-  Eigen::MatrixXf xPositive();
-  Eigen::MatrixXf xNegative();
+  const DepthMatrix& xPositive();
+  const DepthMatrix& xNegative();
 
-  Eigen::MatrixXf yPositive();
-  Eigen::MatrixXf yNegative();
+  const DepthMatrix& yPositive();
+  const DepthMatrix& yNegative();
 
   Eigen::Affine3d xPositiveTransform();
   Eigen::Affine3d xNegativeTransform();
@@ -40,7 +69,11 @@ public:
   Eigen::Affine3d yNegativeTransform();
 
 protected:
-  static std::vector<double> getDistances(const std::vector<Eigen::MatrixXf>& from, const Eigen::MatrixXf& to);
+  // of the four planes
+  static Eigen::Vector4d getDistances(const std::vector<MillimeterDepthMatrix>& from,
+                                      const MillimeterDepthConstRef& to, const int& threads);
+  std::pair<double, double> estimateAnglesFromDistanceDiffs(const std::pair<double, double>& distance_diffs,
+                                                           const bool& debug);
 
   int indexXPositive();
   int indexXNegative();
@@ -50,9 +83,12 @@ protected:
   VisualizerInterfacePtr depth_visualizer_;
   PlaneToDepthImage plane_to_depth_;
   double deviation_;
+  int kernel_threads_;
 
-  std::vector<Eigen::MatrixXf> planes_;
+  std::vector<DepthMatrix> planes_;
+  std::vector<MillimeterDepthMatrix> millimeter_planes_;
   std::vector<Eigen::Affine3d> transform_;
+  Eigen::Matrix4f plane_coefficients_; // (a, b, c, d) per plane index
 
   std::pair<double, double> magic_multipliers_;
 };
@@ -0,0 +1,87 @@
+#ifndef plane_calibration_SRC_FIXED_SIZE_KERNELS_HPP_
+#define plane_calibration_SRC_FIXED_SIZE_KERNELS_HPP_
+
+#include <Eigen/Dense>
+
+#include "camera_model.hpp"
+#include "depth_matrix.hpp"
+
+namespace plane_calibration
+{
+
+/**
+ * Per pixel kernels of the calibration stages, compiled for the common sensor resolutions (640x480, 320x240)
+ * and for dynamic sizes. Whole images are too big for fixed size Eigen types (stack), so the images are
+ * walked row by row with rows of compile time length, written rows are aligned.
+ * The resolution is picked from the camera model, images of any other size use the dynamic version.
+ * The rows are split over threads row pool threads (see RowPool), the results don't depend on the thread count.
+ */
+class FixedSizeKernels
+{
+public:
+  enum Resolution
+  {
+    DYNAMIC_RESOLUTION,
+    VGA_RESOLUTION, // 640x480
+    QVGA_RESOLUTION // 320x240
+  };
+
+  static Resolution select(const CameraModel::Parameters& camera_model_paramaters);
+  static Resolution select(const int& rows, const int& cols);
+
+  // depth = -d / (a * x_multiplier + b * y_multiplier + c), x_multiplier per column, y_multiplier per row
+  static void planeDepth(const Resolution& resolution, const Eigen::Vector4f& plane_coeffs,
+                         const Eigen::RowVectorXf& x_multiplier, const Eigen::VectorXf& y_multiplier,
+                         DepthMatrix& out_depth);
+
+  // sum of the squared differences, nans are skipped
+  static double squaredDistance(const Resolution& resolution, const DepthConstRef& from, const DepthConstRef& to,
+                                const int& threads = 1);
+
+  // squared distances (nans skipped) of depth to four planes, one plane (a, b, c, d) per column of plane_coeffs.
+  // The plane depths are calculated on the fly, so every depth pixel is read only once for all planes
+  static Eigen::Vector4d planeSquaredDistances(const Resolution& resolution, const Eigen::Matrix4f& plane_coeffs,
+                                               const Eigen::RowVectorXf& x_multiplier,
+                                               const Eigen::VectorXf& y_multiplier, const DepthConstRef& depth,
+                                               const int& threads = 1);
+
+  // input within [min_plane, max_plane] and not 0, otherwise nan, works in place
+  static void filter(const Resolution& resolution, const DepthConstRef& input, const DepthConstRef& min_plane,
+                     const DepthConstRef& max_plane, DepthMatrix& out_filtered, const int& threads = 1);
+
+  // plane - data with nans set to 0, returns the count of not nan differences
+  static int difference(const Resolution& resolution, const DepthConstRef& plane, const DepthConstRef& data,
+                        DepthMatrix& out_difference, const int& threads = 1);
+
+protected:
+  // columns per block of the dynamic planeSquaredDistances
+  static const int dynamic_block_cols = 256;
+
+  static Resolution check(const Resolution& resolution, const int& rows, const int& cols);
+
+  template<int Rows, int Cols>
+  static void planeDepth_(const Eigen::Vector4f& plane_coeffs, const Eigen::RowVectorXf& x_multiplier,
+                          const Eigen::VectorXf& y_multiplier, DepthMatrix& out_depth);
+  template<int Rows, int Cols>
+  static double squaredDistance_(const DepthConstRef& from, const DepthConstRef& to, const int& threads);
+  template<int Rows, int Cols>
+  static Eigen::Vector4d planeSquaredDistances_(const Eigen::Matrix4f& plane_coeffs,
+                                                const Eigen::RowVectorXf& x_multiplier,
+                                                const Eigen::VectorXf& y_multiplier, const DepthConstRef& depth,
+                                                const int& threads);
+  // rows in blocks of at most dynamic_block_cols, the block buffer is on the stack so no call allocates
+  static Eigen::Vector4d dynamicPlaneSquaredDistances_(const Eigen::Matrix4f& plane_coeffs,
+                                                       const Eigen::RowVectorXf& x_multiplier,
+                                                       const Eigen::VectorXf& y_multiplier,
+                                                       const DepthConstRef& depth, const int& threads);
+  template<int Rows, int Cols>
+  static void filter_(const DepthConstRef& input, const DepthConstRef& min_plane, const DepthConstRef& max_plane,
+                      DepthMatrix& out_filtered, const int& threads);
+  template<int Rows, int Cols>
+  static int difference_(const DepthConstRef& plane, const DepthConstRef& data, DepthMatrix& out_difference,
+                         const int& threads);
+};
+
+} /* end namespace */
+
+#endif
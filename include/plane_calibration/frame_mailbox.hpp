@@ -0,0 +1,99 @@
+#ifndef plane_calibration_SRC_FRAME_MAILBOX_HPP_
+#define plane_calibration_SRC_FRAME_MAILBOX_HPP_
+
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+
+namespace plane_calibration
+{
+
+/**
+ * Single slot between a producer and one worker, the latest frame wins: a frame which was not taken yet is replaced
+ * (and counted as dropped) instead of queued, so the worker always gets the newest one. Thread safe.
+ */
+template<typename Frame>
+class FrameMailbox
+{
+public:
+  FrameMailbox() :
+      full_(false), closed_(false), dropped_(0)
+  {
+  }
+
+  FrameMailbox(const FrameMailbox&) = delete;
+  FrameMailbox& operator=(const FrameMailbox&) = delete;
+
+  // never blocks, true if a not yet taken frame was replaced. Ignored once closed
+  bool post(const Frame& frame)
+  {
+    bool replaced;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (closed_)
+      {
+        return false;
+      }
+
+      replaced = full_;
+      if (replaced)
+      {
+        ++dropped_;
+      }
+      frame_ = frame;
+      full_ = true;
+    }
+    condition_.notify_one();
+    return replaced;
+  }
+
+  // blocks until there is a frame, false once closed (a posted frame is not taken anymore then)
+  bool take(Frame& frame)
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    condition_.wait(lock, [this]()
+    { return full_ || closed_;});
+
+    if (closed_)
+    {
+      return false;
+    }
+
+    frame = frame_;
+    // don't keep the frame alive (image msgs are large)
+    frame_ = Frame();
+    full_ = false;
+    return true;
+  }
+
+  // wakes the worker, take returns false from now on
+  void close()
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      closed_ = true;
+      frame_ = Frame();
+      full_ = false;
+    }
+    condition_.notify_all();
+  }
+
+  // frames replaced before the worker took them
+  std::size_t dropped() const
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return dropped_;
+  }
+
+protected:
+  mutable std::mutex mutex_;
+  std::condition_variable condition_;
+  Frame frame_;
+  bool full_;
+  bool closed_;
+  std::size_t dropped_;
+};
+
+} /* end namespace */
+
+#endif
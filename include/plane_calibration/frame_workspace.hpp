@@ -0,0 +1,50 @@
+#ifndef plane_calibration_SRC_FRAME_WORKSPACE_HPP_
+#define plane_calibration_SRC_FRAME_WORKSPACE_HPP_
+
+#include <vector>
+#include <Eigen/Dense>
+
+#include "camera_model.hpp"
+#include "depth_matrix.hpp"
+#include "valid_pixels.hpp"
+
+namespace plane_calibration
+{
+
+/**
+ * The buffers one depth image needs on its way through the stages, sized once from the (processing) camera model.
+ * The stages only write into these and the lists use a head of their full size buffers, so a frame of the same
+ * size doesn't allocate anymore.
+ */
+class FrameWorkspace
+{
+public:
+  FrameWorkspace();
+  explicit FrameWorkspace(const CameraModel::Parameters& camera_parameters);
+
+  // no-op for the same image size
+  void resize(const CameraModel::Parameters& camera_parameters);
+
+  int rows() const;
+  int cols() const;
+
+  DepthMatrix filtered_depth;
+  MillimeterDepthMatrix filtered_millimeter_depth;
+  ValidPixels valid_pixels;
+  ValidPixels range_valid_pixels;
+  // of the range valid pixels, only the head of their size is used
+  Eigen::ArrayXf point_heights;
+
+  // raw points in the ground frame for the planarity check, 0 for invalid pixels
+  std::vector<Eigen::Vector3f> planarity_points;
+  // ground plane of the calibration result
+  DepthMatrix ground_plane;
+
+protected:
+  int rows_;
+  int cols_;
+};
+
+} /* end namespace */
+
+#endif
@@ -0,0 +1,64 @@
+#ifndef plane_calibration_SRC_GROUND_CHECKS_HPP_
+#define plane_calibration_SRC_GROUND_CHECKS_HPP_
+
+#include <vector>
+#include <Eigen/Dense>
+
+#include "camera_model.hpp"
+#include "depth_matrix.hpp"
+#include "valid_pixels.hpp"
+
+namespace plane_calibration
+{
+
+/**
+ * Per pixel part of the planarity pre-check and of the obstacle height check of the nodelet. The decisions on the
+ * sums stay in the nodelet, so the tests run the same per frame code without ros.
+ */
+class GroundChecks
+{
+public:
+  // sums of the planarity check, per row and over the rows
+  class PlanarityStatistics
+  {
+  public:
+    PlanarityStatistics();
+    PlanarityStatistics& operator+=(const PlanarityStatistics& other);
+
+    int valid_points;
+    int invalid_points_x;
+    int invalid_points_y;
+    float normalized_z_by_x;
+    float normalized_z_by_y;
+    float invalid_normalized_z_by_x;
+    float invalid_normalized_z_by_y;
+  };
+
+  class HeightStatistics
+  {
+  public:
+    HeightStatistics();
+
+    // points higher than the threshold and the sum of their heights
+    int invalid_points;
+    float invalid_height_sum;
+  };
+
+  // slopes between the raw points (up to max_range) in the ground frame, xyzs is the buffer for the points and
+  // resized to raw_depth.size()
+  static PlanarityStatistics planarity(const DepthConstRef& raw_depth,
+                                       const CameraModel::Parameters& camera_parameters,
+                                       const Eigen::AngleAxisd& ground_rotation, const float& max_range,
+                                       const float& max_z_by_xy, std::vector<Eigen::Vector3f>& xyzs,
+                                       const int& threads = 1);
+
+  // heights above the ground of the pixels (same rays as the planes) into the head of point_heights, which needs
+  // room for all of them
+  static HeightStatistics pointHeights(const ValidPixels& pixels, const Eigen::AngleAxisd& rotation,
+                                       const double& sensor_height, const float& invalid_height_threshold,
+                                       Eigen::ArrayXf& point_heights);
+};
+
+} /* end namespace */
+
+#endif
@@ -1,22 +1,71 @@
 #ifndef plane_calibration_SRC_IMAGE_MSG_EIGEN_CONVERTER_HPP_
 #define plane_calibration_SRC_IMAGE_MSG_EIGEN_CONVERTER_HPP_
 
+#include <limits>
 #include <sensor_msgs/Image.h>
 #include <Eigen/Dense>
 
+#include "depth_matrix.hpp"
+
 namespace plane_calibration
 {
 
+/**
+ * Row major view on depth data. 32FC1 messages are mapped directly (keeping the message alive),
+ * other encodings are converted into the internal buffer which is reused for the next frame.
+ * For 16UC1 messages the raw [mm] data stays accessible as well.
+ */
+class DepthImageView
+{
+public:
+  DepthImageView();
+
+  void wrap(const sensor_msgs::ImageConstPtr& image_msg, const int& outer_stride);
+  DepthMatrix& buffer(const int& rows, const int& cols);
+  void wrapMillimeters(const sensor_msgs::ImageConstPtr& image_msg, const int& outer_stride);
+  MillimeterDepthMatrix& millimeterBuffer(const int& rows, const int& cols); // same size as buffer()
+
+  DepthMap map() const;
+  bool empty() const;
+  bool isMapped() const;
+
+  MillimeterDepthMap millimeterMap() const;
+  bool hasMillimeters() const;
+
+  int rows() const;
+  int cols() const;
+
+protected:
+  sensor_msgs::ImageConstPtr image_msg_;
+  DepthMatrix buffer_;
+  MillimeterDepthMatrix millimeter_buffer_;
+
+  const float* data_;
+  int rows_;
+  int cols_;
+  int outer_stride_;
+
+  const unsigned short* millimeter_data_;
+  int millimeter_outer_stride_;
+};
+
 class ImageMsgEigenConverter
 {
 public:
-  //TODO make fixed size (640x480, 320x240) for faster stuff
+  // 16UC1 gets scaled to meters with zero depth set to nan, copies the data
   static bool convert(const sensor_msgs::ImageConstPtr& image_msg, Eigen::MatrixXf& out_matrix);
+  // 16UC1 gets scaled to meters with invalid (zero or out of range) depth set to nan, 32FC1 is mapped as is
+  static bool convert(const sensor_msgs::ImageConstPtr& image_msg, DepthImageView& out_view,
+                      const float& max_range = std::numeric_limits<float>::infinity());
   static bool convert(const Eigen::MatrixXf& matrix, sensor_msgs::Image& out_image_msg);
 
 protected:
+  static bool checkImage(const sensor_msgs::ImageConstPtr& image_msg);
+  static size_t getStep(const sensor_msgs::Image& image_msg, const size_t& element_size);
+
   template<typename DataType>
-  inline static Eigen::MatrixXf dataToMatrix(const unsigned char* data_pointer, const int& height, const int& width);
+  inline static Eigen::Map<const Eigen::Matrix<DataType, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>, 0,
+      Eigen::OuterStride<> > dataToMap(const sensor_msgs::Image& image_msg);
 };
 
 } /* end namespace */
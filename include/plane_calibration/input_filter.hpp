@@ -7,6 +7,10 @@
 
 #include "camera_model.hpp"
 #include "calibration_parameters.hpp"
+#include "depth_matrix.hpp"
+#include "fixed_size_kernels.hpp"
+#include "plane_to_depth_image.hpp"
+#include "valid_pixels.hpp"
 #include "visualizer_interface.hpp"
 
 namespace plane_calibration
@@ -42,19 +46,36 @@ public:
 
   void updateConfig(const Config& config);
   void updateBorders();
-  void filter(Eigen::MatrixXf& matrix, bool debug = false);
-  bool dataIsUsable(const Eigen::MatrixXf& data, bool debug = false);
+  void filter(DepthMatrix& matrix, bool debug = false);
+  void filter(const DepthConstRef& input, DepthMatrix& filtered, bool debug = false);
+  bool dataIsUsable(const DepthConstRef& data, bool debug = false);
+
+  // additionally collects the valid pixels for the later stages
+  void filter(const DepthConstRef& input, DepthMatrix& filtered, ValidPixels& valid_pixels, bool debug = false);
+  bool dataIsUsable(const ValidPixels& data, bool debug = false);
+
+  // integer versions for depth in [mm], filtered out points are set to 0
+  void filter(const MillimeterDepthConstRef& input, MillimeterDepthMatrix& filtered, bool debug = false);
+  bool dataIsUsable(const MillimeterDepthConstRef& data, bool debug = false);
 
 protected:
   void updateBorders_();
+  bool dataIsUsable_(const int& size, const int& nan_count, const int& zero_count, bool debug);
 
   mutable std::mutex mutex_;
   CameraModel camera_model_;
+  PlaneToDepthImage plane_to_depth_;
   CalibrationParametersPtr parameters_;
   Config config_;
+  FixedSizeKernels::Resolution resolution_;
+
+  DepthMatrix min_plane_;
+  DepthMatrix max_plane_;
 
-  Eigen::MatrixXf min_plane_;
-  Eigen::MatrixXf max_plane_;
+  MillimeterDepthMatrix min_millimeter_plane_;
+  MillimeterDepthMatrix max_millimeter_plane_;
+  // kept for the next frame of the same size
+  DepthMatrix debug_valid_;
 
   VisualizerInterfacePtr depth_visualizer_;
 };
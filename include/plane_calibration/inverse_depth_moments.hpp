@@ -0,0 +1,63 @@
+#ifndef plane_calibration_SRC_INVERSE_DEPTH_MOMENTS_HPP_
+#define plane_calibration_SRC_INVERSE_DEPTH_MOMENTS_HPP_
+
+#include <memory>
+#include <utility>
+#include <Eigen/Dense>
+
+#include "camera_model.hpp"
+#include "calibration_parameters.hpp"
+#include "depth_matrix.hpp"
+#include "plane_to_depth_image.hpp"
+#include "valid_pixels.hpp"
+
+namespace plane_calibration
+{
+
+/**
+ * Second moments of phi = (x_multiplier, y_multiplier, 1, 1 / depth) over the valid pixels of one frame.
+ * The inverse depth of a plane is affine in the multipliers: 1 / depth = -(a * x_multiplier + b * y_multiplier + c) / d,
+ * so the squared inverse depth residual of the data to any plane is q^T * M * q with q = (a, b, c, d) / d.
+ * After one pass over the data every candidate plane costs O(1), no plane images are needed.
+ */
+class InverseDepthMoments
+{
+public:
+  InverseDepthMoments(const CameraModel::Parameters& camera_model_paramaters);
+
+  // replace the moments with the ones of the given data, nan / 0 are skipped
+  void accumulate(const DepthConstRef& depth);
+  void accumulate(const MillimeterDepthConstRef& depth);
+  void accumulate(const ValidPixels& valid_pixels);
+
+  // sum of (1 / depth - plane inverse depth)^2 over the accumulated pixels
+  double squaredResidual(const Eigen::Vector4d& plane_coeffs) const;
+  // sum of the squared inverse depth differences of two planes over the accumulated pixels
+  double squaredDistance(const Eigen::Vector4d& plane_coeffs_a, const Eigen::Vector4d& plane_coeffs_b) const;
+
+  // same estimation as DeviationPlanes, the four planes tilted by +-deviation around the parameters rotation
+  std::pair<double, double> estimateAngles(const CalibrationParameters::Parameters& parameters,
+                                           const double& deviation) const;
+
+  static Eigen::Vector4d planeCoefficients(const Eigen::Affine3d& plane_transformation);
+
+  int count() const;
+  const Eigen::Matrix4d& getMoments() const;
+
+protected:
+  // adds one image row, mask is 1 for valid pixels, inverse_depth 0 for invalid ones
+  void addRow(const float& y_multiplier, const Eigen::ArrayXf& mask, const Eigen::ArrayXf& inverse_depth);
+  void finish();
+
+  PlaneToDepthImage::XYMultipliers xy_multipliers_;
+  Eigen::Matrix4d moments_;
+
+  // row buffers, keep their memory between frames
+  Eigen::ArrayXf mask_;
+  Eigen::ArrayXf inverse_depth_;
+};
+typedef std::shared_ptr<InverseDepthMoments> InverseDepthMomentsPtr;
+
+} /* end namespace */
+
+#endif
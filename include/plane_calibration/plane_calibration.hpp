@@ -2,15 +2,21 @@
 #define plane_calibration_SRC_PLANE_CALIBRATION_HPP_
 
 #include <mutex>
+#include <string>
 #include <vector>
 #include <utility>
 #include <memory>
 #include <Eigen/Dense>
 
 #include "camera_model.hpp"
+#include "bank_cache.hpp"
 #include "calibration_parameters.hpp"
+#include "depth_downsampler.hpp"
 #include "deviation_planes.hpp"
+#include "inverse_depth_moments.hpp"
 #include "planes.hpp"
+#include "planes_builder.hpp"
+#include "valid_pixels.hpp"
 #include "visualizer_interface.hpp"
 
 namespace plane_calibration
@@ -26,28 +32,88 @@ public:
   {
   }
 
-  std::pair<double, double> calibrate(const Eigen::MatrixXf& filtered_depth_matrix, const int& iterations = 3);
+  std::pair<double, double> calibrate(const DepthConstRef& filtered_depth_matrix, const int& iterations = 3);
+
+  // integer version, needs millimeter_depth_ set in the parameters
+  std::pair<double, double> calibrate(const MillimeterDepthConstRef& filtered_depth_matrix, const int& iterations = 3);
+
+  // on the valid pixels of the filtered image only
+  std::pair<double, double> calibrate(const ValidPixels& valid_pixels, const int& iterations = 3);
+
+  // the precomputed planes are built in the background, until they are done calibrate calculates the planes
+  // on the fly. Blocks until the requested planes (also of the coarse level) are ready
+  void waitForPlanes();
+
+  // hits and misses of the banks and the deviation planes of earlier ground transforms
+  BankCacheStatistics getPlanesCacheStatistics() const;
+  BankCacheStatistics getDeviationPlanesCacheStatistics() const;
 
 protected:
-  std::pair<double, double> estimateAngles(const Eigen::MatrixXf& filtered_depth_matrix,
+  template<typename DepthRef>
+  std::pair<double, double> calibrate_(const DepthRef& filtered_depth_matrix, const int& iterations);
+
+  void requestPlanes(const CalibrationParameters::Parameters& parameters);
+  // from the cache or made for the parameters
+  void updateDeviationPlanes(const CalibrationParameters::Parameters& parameters);
+  void updatePyramid(const CalibrationParameters::Parameters& parameters);
+  std::pair<double, double> calibrateCoarse(const DepthConstRef& filtered_depth_matrix, const int& iterations);
+  std::pair<double, double> calibrateCoarse(const MillimeterDepthConstRef& filtered_depth_matrix,
+                                            const int& iterations);
+  std::pair<double, double> calibrateCoarse(const ValidPixels& valid_pixels, const int& iterations);
+  void publishTiming(const std::string& level, const double& seconds);
+  void publishCacheStatistics();
+
+  // refinement in moment estimation mode, the moments are accumulated once per frame
+  std::pair<double, double> estimateAnglesFromMoments(const double& deviation);
+
+  std::pair<double, double> estimateAngles(const DepthConstRef& filtered_depth_matrix,
                                            const std::pair<double, double>& last_estimation, const double& deviation);
-  std::pair<double, double> estimateAngles(const Eigen::MatrixXf& filtered_depth_matrix, const double& x_angle_offset,
+  std::pair<double, double> estimateAngles(const DepthConstRef& filtered_depth_matrix, const double& x_angle_offset,
                                            const double& y_angle_offset, const double& deviation);
 
+  std::pair<double, double> estimateAngles(const MillimeterDepthConstRef& filtered_depth_matrix,
+                                           const std::pair<double, double>& last_estimation, const double& deviation);
+  std::pair<double, double> estimateAngles(const MillimeterDepthConstRef& filtered_depth_matrix,
+                                           const double& x_angle_offset, const double& y_angle_offset,
+                                           const double& deviation);
+
+  std::pair<double, double> estimateAngles(const ValidPixels& valid_pixels,
+                                           const std::pair<double, double>& last_estimation, const double& deviation);
+  std::pair<double, double> estimateAngles(const ValidPixels& valid_pixels, const double& x_angle_offset,
+                                           const double& y_angle_offset, const double& deviation);
+
+  // precomputed planes version for a fp16 bank, for the float image and the valid pixels
+  template<typename DepthRef>
+  std::pair<double, double> estimateAnglesFromHalfPlanes(const DepthRef& filtered_depth, const double& x_angle_offset,
+                                                         const double& y_angle_offset, const double& deviation);
+
   mutable std::mutex mutex_;
   CameraModel camera_model_;
   CalibrationParametersPtr parameters_;
 
   PlaneToDepthImage plane_to_depth_;
   DeviationPlanesPtr max_deviation_planes_;
+  BankCache<DeviationPlanes> deviation_planes_cache_;
 
+  // the bank used by the current calibration, nullptr while the builder has none for the parameters
   PlanesPtr precomputed_planes_;
+  PlanesBuilderPtr planes_builder_;
+  InverseDepthMoments moments_;
 
   std::vector<DeviationPlanesPtr> deviation_planes_;
 
   CalibrationParameters::Parameters temp_parameters_;
   DeviationPlanesPtr temp_deviation_planes_;
-  Eigen::MatrixXf temp_estimated_plane_;
+  DepthMatrix temp_estimated_plane_;
+  std::pair<double, double> last_estimation_;
+
+  // coarse pyramid level with its own camera model and planes, only used by this one
+  std::shared_ptr<PlaneCalibration> coarse_level_;
+  CalibrationParametersPtr coarse_parameters_;
+  int pyramid_factor_;
+  DepthMatrix coarse_depth_;
+  MillimeterDepthMatrix coarse_millimeter_depth_;
+  DepthDownsampler::CountMatrix coarse_counts_;
 
   VisualizerInterfacePtr depth_visualizer_;
 };
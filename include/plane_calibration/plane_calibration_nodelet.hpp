@@ -2,8 +2,12 @@
 #define plane_calibration_SRC_PLANE_CALIBRATION_NODELET_HPP_
 
 #include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
 #include <mutex>
 #include <memory>
+#include <thread>
 #include <Eigen/Dense>
 
 #include <nodelet/nodelet.h>
@@ -23,6 +27,14 @@
 #include "calibration_validation.hpp"
 #include "plane_to_depth_image.hpp"
 #include "depth_visualizer.hpp"
+#include "depth_matrix.hpp"
+#include "image_msg_eigen_converter.hpp"
+#include "depth_downsampler.hpp"
+#include "frame_mailbox.hpp"
+#include "frame_workspace.hpp"
+#include "ground_checks.hpp"
+#include "stage_queue.hpp"
+#include "valid_pixels.hpp"
 
 namespace plane_calibration
 {
@@ -31,25 +43,110 @@ class PlaneCalibrationNodelet : public nodelet::Nodelet
 {
 public:
   PlaneCalibrationNodelet();
+  virtual ~PlaneCalibrationNodelet();
 
   virtual void onInit();
 
 protected:
   virtual void reconfigureCB(PlaneCalibrationConfig &config, uint32_t level);
   virtual void cameraInfoCB(const sensor_msgs::CameraInfoConstPtr& camera_info_msg);
+  // only hands the image to the calibration worker and publishes the current transform
   virtual void depthImageCB(const sensor_msgs::ImageConstPtr& depth_image_msg);
 
+  // one depth image on its way through the stages, the buffers of the workspace are reused for later images
+  class DepthFrame : public FrameWorkspace
+  {
+  public:
+    DepthFrame() :
+        downsampled(false), millimeter_depth(false), sensor_height(0.0), calibrated(false)
+    {
+    }
+
+    const DepthImageView& image() const
+    {
+      return downsampled ? downsampled_depth_image : depth_image;
+    }
+
+    DepthImageView depth_image;
+    DepthImageView downsampled_depth_image;
+    bool downsampled;
+    bool millimeter_depth;
+    double sensor_height;
+    // the results of frames of an older ground transform are dropped
+    std::shared_ptr<std::pair<Eigen::Vector3d, Eigen::AngleAxisd>> ground_transform;
+
+    // set by the calibration stage, the validation skips the frame otherwise
+    bool calibrated;
+    CalibrationParameters::Parameters parameters;
+    std::pair<double, double> calibration_result;
+  };
+  typedef std::unique_ptr<DepthFrame> DepthFramePtr;
+
+  enum Stage
+  {
+    ingest_stage = 0, calibration_stage, validation_stage, stage_count
+  };
+
+  // the ingest stage: takes the images from the mailbox, with pipelined_calibration_ the other stages run in their
+  // own threads, otherwise here as well
+  virtual void runCalibrationWorker();
+  virtual void runCalibrationStage();
+  virtual void runValidationStage();
+
+  // conversion, planarity pre-check and filtering. false: nothing to calibrate
+  virtual bool ingestDepthImage(const sensor_msgs::ImageConstPtr& depth_image_msg, DepthFrame& frame);
+  // false: the last calibration still fits or the result is not usable
+  virtual bool calibrate(DepthFrame& frame);
+  // obstacle height check and validation of the new ground plane, takes it if valid
+  virtual void validate(DepthFrame& frame);
+
+  // xyzs: buffer for the raw points in the ground frame, resized to raw_depth.size()
+  virtual bool groundLooksPlanar(const DepthMap& raw_depth, std::vector<Eigen::Vector3f>& xyzs);
+  // blocks until the calibration and validation stage are idle, before the processing objects are replaced
+  virtual void waitForPipeline();
+  virtual void addStageTime(const Stage& stage, const std::chrono::steady_clock::time_point& start);
+  virtual void reportPipelineStatistics();
+
+  virtual void updateDownsampling();
+  virtual void setupProcessing();
   virtual void getTransform();
   virtual std::pair<Eigen::Vector3d, Eigen::AngleAxisd> getTransformManual();
   virtual std::pair<Eigen::Vector3d, Eigen::AngleAxisd> getTransformTF();
 
-  virtual void runCalibration(Eigen::MatrixXf depth_matrix);
   virtual void publishTransform();
 
   std::atomic<bool> enable_;
   ros::Time last_call_time_;
   double calibration_rate_;
 
+  // latest depth image for the calibration worker, older ones are dropped instead of queued
+  FrameMailbox<sensor_msgs::ImageConstPtr> depth_image_mailbox_;
+  std::thread calibration_worker_;
+  // the ingest stage processes one image at a time, the camera info only sets up if it is idle
+  std::mutex processing_mutex_;
+  // transform_ and the last valid calibration results, used by the stages and the callback
+  std::mutex result_mutex_;
+
+  // not reconfigurable, the stage threads are started in onInit
+  bool pipelined_calibration_;
+  std::thread calibration_stage_thread_;
+  std::thread validation_stage_thread_;
+  // frames circulate: free -> ingest -> ingested -> calibration -> calibrated -> validation -> free
+  StageQueue<DepthFramePtr> free_frames_;
+  StageQueue<DepthFramePtr> ingested_frames_;
+  StageQueue<DepthFramePtr> calibrated_frames_;
+  std::mutex pipeline_mutex_;
+  std::condition_variable pipeline_condition_;
+  int frames_in_flight_;
+  bool stop_pipeline_;
+  // frame of the serial mode
+  DepthFrame frame_;
+
+  std::atomic<std::int64_t> stage_nanoseconds_[stage_count];
+  std::chrono::steady_clock::time_point last_statistics_time_;
+  std::int64_t last_stage_nanoseconds_[stage_count];
+  std::size_t last_dropped_images_;
+
   bool precompute_planes_;
   int precomputed_plane_pairs_count_;
   CameraModelPtr camera_model_;
@@ -64,6 +161,12 @@ protected:
   CalibrationValidationPtr calibration_validation_;
   PlaneToDepthImagePtr plane_to_depth_converter_;
 
+  std::atomic<int> downsample_factor_;
+  int processing_downsample_factor_;
+  CameraModel::Parameters processing_camera_parameters_;
+  // the same for the other stages and the debug clouds of the callbacks
+  CameraModel processing_camera_model_;
+
   std::atomic<double> max_deviation_;
   Eigen::Vector3d ground_plane_offset_;
   Eigen::AngleAxisd ground_plane_rotation_;
@@ -71,7 +174,7 @@ protected:
 
   std::pair<double, double> last_valid_calibration_result_;
   std::pair<double, double> last_calibration_result_;
-  Eigen::MatrixXf last_valid_calibration_result_plane_;
+  DepthMatrix last_valid_calibration_result_plane_;
   Eigen::Affine3d last_valid_calibration_transformation_;
 
   InputFilter::Config input_filter_config_;
@@ -104,6 +207,7 @@ protected:
   float threshold_normalized_z_by_xy;
   float threshold_normalized_invalid_z_by_xy;
   float max_angle_change;
+  float min_valid_point_ratio;
 };
 
 } /* end namespace */
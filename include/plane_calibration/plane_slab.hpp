@@ -0,0 +1,160 @@
+#ifndef plane_calibration_SRC_PLANE_SLAB_HPP_
+#define plane_calibration_SRC_PLANE_SLAB_HPP_
+
+#include <cstddef>
+#include <new>
+#include <Eigen/Dense>
+
+namespace plane_calibration
+{
+
+/**
+ * Cache line aligned memory, big blocks are aligned to huge pages and marked for transparent huge pages.
+ */
+class AlignedMemory
+{
+public:
+  static const std::size_t alignment = 64;
+  static const std::size_t huge_page_size = 2 * 1024 * 1024;
+
+  // nullptr if out of memory
+  static void* allocate(const std::size_t& bytes);
+  static void free(void* memory);
+};
+
+/**
+ * Equally sized planes in one contiguous allocation, every plane starts at a 64 byte boundary.
+ * Planes are addressed by index, the slab is not copyable (the maps point into it).
+ * A slab can also be a read only view of memory owned by someone else (e.g. a mapped file) with the same layout.
+ */
+template<typename Scalar>
+class PlaneSlab
+{
+public:
+  typedef Eigen::Matrix<Scalar, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> Plane;
+  typedef Eigen::Map<Plane, Eigen::Aligned16> PlaneMap;
+  typedef Eigen::Map<const Plane, Eigen::Aligned16> PlaneConstMap;
+
+  PlaneSlab()
+  {
+    data_ = nullptr;
+    count_ = 0;
+    rows_ = 0;
+    cols_ = 0;
+    plane_stride_ = 0;
+    owned_ = true;
+  }
+
+  ~PlaneSlab()
+  {
+    release();
+  }
+
+  PlaneSlab(const PlaneSlab&) = delete;
+  PlaneSlab& operator=(const PlaneSlab&) = delete;
+
+  // previous content is lost, no reallocation if the size did not change
+  void resize(const int& count, const int& rows, const int& cols)
+  {
+    std::size_t plane_stride = planeStride(rows, cols);
+
+    if (data_ && owned_ && count == count_ && plane_stride == plane_stride_ && rows == rows_ && cols == cols_)
+    {
+      return;
+    }
+
+    release();
+
+    std::size_t bytes = count * plane_stride * sizeof(Scalar);
+    if (bytes > 0)
+    {
+      data_ = static_cast<Scalar*>(AlignedMemory::allocate(bytes));
+      if (!data_)
+      {
+        throw std::bad_alloc();
+      }
+    }
+
+    count_ = count;
+    rows_ = rows;
+    cols_ = cols;
+    plane_stride_ = plane_stride;
+  }
+
+  // the memory has to stay valid as long as the slab is used, it has to have the layout of bytes(count, rows, cols)
+  void view(const void* data, const int& count, const int& rows, const int& cols)
+  {
+    release();
+
+    data_ = static_cast<Scalar*>(const_cast<void*>(data));
+    owned_ = false;
+    count_ = count;
+    rows_ = rows;
+    cols_ = cols;
+    plane_stride_ = planeStride(rows, cols);
+  }
+
+  int count() const
+  {
+    return count_;
+  }
+
+  const void* data() const
+  {
+    return data_;
+  }
+
+  // only owned slabs can be written
+  PlaneMap plane(const int& index)
+  {
+    eigen_assert(index >= 0 && index < count_ && owned_);
+    return PlaneMap(data_ + index * plane_stride_, rows_, cols_);
+  }
+
+  PlaneConstMap plane(const int& index) const
+  {
+    eigen_assert(index >= 0 && index < count_);
+    return PlaneConstMap(data_ + index * plane_stride_, rows_, cols_);
+  }
+
+  std::size_t bytes() const
+  {
+    return count_ * plane_stride_ * sizeof(Scalar);
+  }
+
+  static std::size_t bytes(const int& count, const int& rows, const int& cols)
+  {
+    return count * planeStride(rows, cols) * sizeof(Scalar);
+  }
+
+protected:
+  static std::size_t planeStride(const int& rows, const int& cols)
+  {
+    std::size_t scalars_per_alignment = AlignedMemory::alignment / sizeof(Scalar);
+    return (static_cast<std::size_t>(rows) * cols + scalars_per_alignment - 1) / scalars_per_alignment
+        * scalars_per_alignment;
+  }
+
+  void release()
+  {
+    if (owned_)
+    {
+      AlignedMemory::free(data_);
+    }
+
+    data_ = nullptr;
+    owned_ = true;
+    count_ = 0;
+  }
+
+  Scalar* data_;
+  bool owned_;
+  int count_;
+  int rows_;
+  int cols_;
+  std::size_t plane_stride_;
+};
+
+} /* end namespace */
+
+#endif
@@ -7,6 +7,7 @@
 #include <memory>
 
 #include "camera_model.hpp"
+#include "depth_matrix.hpp"
 
 namespace plane_calibration
 {
@@ -29,24 +30,37 @@ public:
     double max;
   };
 
+  // ray multipliers, x only changes with the column (row vector), y only with the row (column vector)
+  typedef std::pair<Eigen::RowVectorXf, Eigen::VectorXf> XYMultipliers;
+
   PlaneToDepthImage(const CameraModel::Parameters& camera_model_paramaters);
-  Eigen::MatrixXf convert(const Eigen::Affine3d& plane_transformation);
+  DepthMatrix convert(const Eigen::Affine3d& plane_transformation);
+  // into a caller provided buffer, no allocation if it has the right size already
+  void convert(const Eigen::Affine3d& plane_transformation, DepthMatrix& out_depth) const;
+
+  static DepthMatrix convert(const Eigen::Affine3d& plane_transformation,
+                             const CameraModel::Parameters& camera_model_paramaters);
+  static void convert(const Eigen::Affine3d& plane_transformation,
+                      const CameraModel::Parameters& camera_model_paramaters, const XYMultipliers& xy_multipliers,
+                      DepthMatrix& out_depth);
+
+  // a*x + b*y + c*z + d = 0 of the xy plane of the given transformation
+  static Eigen::Vector4f planeCoefficients(const Eigen::Affine3d& plane_transformation);
 
-  static Eigen::MatrixXf convert(const Eigen::Affine3d& plane_transformation,
-                                 const CameraModel::Parameters& camera_model_paramaters);
-  static Eigen::MatrixXf convert(const Eigen::Affine3d& plane_transformation,
-                                 const CameraModel::Parameters& camera_model_paramaters,
-                                 const std::pair<Eigen::MatrixXd, Eigen::MatrixXd>& xy_multipliers);
+  // [m] to [mm], rounded and saturated; nan and depth behind the camera become 0 (= invalid)
+  static void quantize(const DepthConstRef& depth, MillimeterDepthMatrix& out_millimeter_depth);
+  MillimeterDepthMatrix convertMillimeters(const Eigen::Affine3d& plane_transformation);
 
-  static std::pair<Eigen::MatrixXd, Eigen::MatrixXd> depthCalculationXYMultiplier(
-      const CameraModel::Parameters& camera_model_paramaters);
+  static XYMultipliers depthCalculationXYMultiplier(const CameraModel::Parameters& camera_model_paramaters);
+  const XYMultipliers& getXYMultipliers() const;
+  const CameraModel::Parameters& getCameraParameters() const;
 
   static Errors getErrors(const Eigen::Affine3d& plane_transformation,
-                          const CameraModel::Parameters& camera_model_paramaters, Eigen::MatrixXf image_matrix);
+                          const CameraModel::Parameters& camera_model_paramaters, const DepthConstRef& image_matrix);
 
 protected:
   CameraModel::Parameters camera_model_paramaters_;
-  std::pair<Eigen::MatrixXd, Eigen::MatrixXd> xy_multipliers_;
+  XYMultipliers xy_multipliers_;
 };
 typedef std::shared_ptr<PlaneToDepthImage> PlaneToDepthImagePtr;
 
@@ -1,46 +1,249 @@
 #ifndef plane_calibration_SRC_PLANES_HPP_
 #define plane_calibration_SRC_PLANES_HPP_
 
+#include <atomic>
+#include <condition_variable>
+#include <functional>
 #include <memory>
-#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
 #include <utility>
+#include <vector>
 #include <Eigen/Dense>
 
+#include "bank_cache.hpp"
 #include "calibration_parameters.hpp"
+#include "plane_slab.hpp"
 #include "plane_to_depth_image.hpp"
+#include "planes_file.hpp"
 
 namespace plane_calibration
 {
-typedef std::shared_ptr<Eigen::MatrixXf> MatrixPlanePtr;
+typedef PlaneSlab<float>::PlaneConstMap MatrixPlane;
+typedef PlaneSlab<unsigned short>::PlaneConstMap MillimeterPlane;
+typedef PlaneSlab<Eigen::half>::PlaneConstMap HalfPlane;
 
+/**
+ * Bank of planes tilted around x and y in equal angle steps, one slab per axis.
+ * Plane k (k in [-pair_count, pair_count]) has the tilt angle k * angle step and sits at index k + pair_count,
+ * so a lookup is an index calculation.
+ * With interpolate_planes_ the planes at exactly angle +- deviation are blended from the two neighbouring
+ * bank planes into a small buffer, which keeps the accuracy with a fraction of the bank size.
+ * With half_precision_planes_ the float planes are stored as fp16 and decoded while calculating the distances.
+ * A bank can be stored to a file and loaded again, the loaded planes are read from the read only mapping.
+ * Loaded shared banks (see PlanesFile) remove their file when the last user in any process is gone.
+ * With lazy_planes_ a plane is made the first time it is asked for (the slab pages are only touched then), optionally
+ * a background thread makes the neighbours of the last asked planes in advance.
+ * The squared distances between the bank planes of every (upper, lower) pair are calculated with the bank, so only
+ * the distances to the data are left for the calibration.
+ */
 class Planes
 {
 public:
+  enum Axis
+  {
+    x_axis = 0, y_axis = 1
+  };
+
+  template<typename Scalar>
+  using PlanePair = std::pair<typename PlaneSlab<Scalar>::PlaneConstMap, typename PlaneSlab<Scalar>::PlaneConstMap>;
+
   Planes(const CalibrationParameters::Parameters& parameters, const PlaneToDepthImage& plane_to_depth);
+  ~Planes();
+
+  Planes(const Planes&) = delete;
+  Planes& operator=(const Planes&) = delete;
+
+  // the bank stored for the parameters and camera in directory, nullptr if there is none or it is damaged
+  static std::shared_ptr<Planes> load(const std::string& directory,
+                                      const CalibrationParameters::Parameters& parameters,
+                                      const PlaneToDepthImage& plane_to_depth, const bool& shared = false);
+  // false if the file could not be written
+  bool store(const std::string& directory) const;
+  // of the bank for the parameters and camera in directory
+  static std::string filePath(const std::string& directory, const CalibrationParameters::Parameters& parameters,
+                              const PlaneToDepthImage& plane_to_depth);
+  // read from a file mapping
+  bool mapped() const;
+
+  // the maps point into the bank (or the interpolation buffer, valid until the next call for the same axis).
+  // Lazy banks make missing planes, other threads can use the bank meanwhile (without interpolation)
+  std::pair<MatrixPlane, MatrixPlane> getFittingXTiltPlanes(const double& angle, const double& deviation);
+  std::pair<MatrixPlane, MatrixPlane> getFittingYTiltPlanes(const double& angle, const double& deviation);
+
+  // only available if the planes were made with millimeter_depth_ set
+  std::pair<MillimeterPlane, MillimeterPlane> getFittingXTiltMillimeterPlanes(const double& angle,
+                                                                              const double& deviation);
+  std::pair<MillimeterPlane, MillimeterPlane> getFittingYTiltMillimeterPlanes(const double& angle,
+                                                                              const double& deviation);
 
-  std::pair<MatrixPlanePtr, MatrixPlanePtr> getFittingXTiltPlanes(const double& angle, const double& deviation);
-  std::pair<MatrixPlanePtr, MatrixPlanePtr> getFittingYTiltPlanes(const double& angle, const double& deviation);
+  // only available if the planes were made with half_precision_planes_ set (and millimeter_depth_ not)
+  std::pair<HalfPlane, HalfPlane> getFittingXTiltHalfPlanes(const double& angle, const double& deviation);
+  std::pair<HalfPlane, HalfPlane> getFittingYTiltHalfPlanes(const double& angle, const double& deviation);
+  bool halfPrecision() const;
+
+  // squared distance between the planes returned by getFitting*TiltPlanes for the same axis, angle and deviation.
+  // From the table for bank planes (lazy banks fill it on first use), interpolated planes are calculated
+  double getFittingTiltDistance(const Axis& axis, const double& angle, const double& deviation,
+                                const std::pair<MatrixPlane, MatrixPlane>& planes);
+  double getFittingTiltDistance(const Axis& axis, const double& angle, const double& deviation,
+                                const std::pair<MillimeterPlane, MillimeterPlane>& planes);
+  double getFittingTiltDistance(const Axis& axis, const double& angle, const double& deviation,
+                                const std::pair<HalfPlane, HalfPlane>& planes);
+
+  // wall time of the construction (or the loading)
+  double buildSeconds() const;
+  // all of the bank if it is not lazy
+  int madePlanes() const;
+  bool lazy() const;
+
+  // made for the (quantized, see BankKey) base transform and max deviation of the parameters,
+  // the other options only change size / precision
+  bool fits(const CalibrationParameters::Parameters& parameters) const;
+  // both parameters result in the same bank
+  static bool sameBank(const CalibrationParameters::Parameters& parameters_a,
+                       const CalibrationParameters::Parameters& parameters_b);
+  // of the bank for the parameters and camera
+  static BankKey::Key cacheKey(const CalibrationParameters::Parameters& parameters,
+                               const PlaneToDepthImage& plane_to_depth);
+
+  // resident memory of the bank
+  std::size_t bytes() const;
 
 protected:
+  // maps the stored bank, file_ stays empty if it can not be used
+  Planes(const CalibrationParameters::Parameters& parameters, const PlaneToDepthImage& plane_to_depth,
+         const std::string& directory, const bool& shared);
+
+  // everything but the bank planes
+  void setup();
+  bool floatPlanes() const;
+  // of the bank slabs and the pair distances in the file order
+  std::vector<std::size_t> bankBytes() const;
+  static std::string fileKey(const CalibrationParameters::Parameters& parameters,
+                             const PlaneToDepthImage& plane_to_depth);
+
+  enum SlotState
+  {
+    empty_slot = 0, making_slot, ready_slot
+  };
+
   void makePlanes();
-  Eigen::MatrixXf makePlane(const Eigen::Vector2d& angles);
+  // x and y plane of one index, the buffers are only used for the calculation
+  void makePlanePair(const int& index, DepthMatrix& plane, MillimeterDepthMatrix& millimeter_plane);
+  void makeTiltPlane(const Axis& axis, const int& index, DepthMatrix& plane, MillimeterDepthMatrix& millimeter_plane);
+
+  // lazy banks: makes the plane if nobody did, waits if another thread is making it. Indices outside are ignored
+  void ensurePlane(const Axis& axis, const int& index);
+  // lazy banks with prefetch: the background thread makes [first - prefetch, last + prefetch], replaces older ones
+  void prefetch(const Axis& axis, const int& first_index, const int& last_index);
+  void runPrefetch();
+
+  // the upper >= lower part of the table, the planes have to be ready
+  template<typename Scalar>
+  void makePairDistances(const PlaneSlab<Scalar>& x_planes, const PlaneSlab<Scalar>& y_planes);
+  std::atomic<double>& pairDistance(const Axis& axis, const int& upper_index, const int& lower_index);
+  template<typename Plane>
+  double fittingTiltDistance(const Axis& axis, const double& angle, const double& deviation,
+                             const std::pair<Plane, Plane>& planes);
+  // of the interpolated planes, fp16 planes are decoded into half_rows_
+  template<typename Plane>
+  double interpolatedDistance(const Plane& upper, const Plane& lower);
+  double interpolatedDistance(const HalfPlane& upper, const HalfPlane& lower);
+  // calls work from thread_count threads (this one included), work takes its jobs itself
+  void runWorkers(const std::function<void()>& work, const int& jobs) const;
 
-  void addPlanePairs(const double& angle);
-  void addPlanes(const double& angle);
+  // same calculation as the on the fly version of PlaneCalibration
+  static double squaredDistance(const MatrixPlane& upper, const MatrixPlane& lower);
+  static double squaredDistance(const MillimeterPlane& upper, const MillimeterPlane& lower);
+  static double squaredDistance(const HalfPlane& upper, const HalfPlane& lower);
+  void makePlane(const Eigen::Vector2d& angles, DepthMatrix& out_plane) const;
+  // threads <= 0: one per core
+  static int workerCount(const int& threads);
+  static void encodeHalf(const DepthMatrix& plane, PlaneSlab<Eigen::half>::PlaneMap out_plane);
 
-  std::pair<MatrixPlanePtr, MatrixPlanePtr> getFittingTiltPlanes(const std::map<double, MatrixPlanePtr>& planes,
-                                                                 const double& angle, const double& deviation);
-  std::pair<double, double> getDeviationPlaneKeys(const double& angle, const double& deviation);
+  // first plane at or above angle + deviation, last plane below angle - deviation, clamped to the bank
+  std::pair<int, int> getDeviationPlaneIndices(const double& angle, const double& deviation) const;
+  int clampIndex(const double& step) const;
 
+  static bool sameBaseTransform(const CalibrationParameters::Parameters& parameters_a,
+                                const CalibrationParameters::Parameters& parameters_b);
+
+  template<typename Scalar>
+  PlanePair<Scalar> getFittingTiltPlanes(const Axis& axis, const PlaneSlab<Scalar>& planes,
+                                         PlaneSlab<Scalar>& interpolated_planes, const double& angle,
+                                         const double& deviation);
+  // lower of the two bank planes blended for angle
+  int interpolationIndex(const double& angle) const;
+  // linear blend of the two bank planes around angle
+  template<typename Scalar>
+  void interpolate(const PlaneSlab<Scalar>& planes, const double& angle,
+                   typename PlaneSlab<Scalar>::PlaneMap out_plane);
+  static void blend(const MatrixPlane& lower, const MatrixPlane& upper, const float& weight,
+                    PlaneSlab<float>::PlaneMap out_plane);
+  static void blend(const MillimeterPlane& lower, const MillimeterPlane& upper, const float& weight,
+                    PlaneSlab<unsigned short>::PlaneMap out_plane);
+  // blended in float row by row in half_rows_
+  void blend(const HalfPlane& lower, const HalfPlane& upper, const float& weight,
+             PlaneSlab<Eigen::half>::PlaneMap out_plane);
+
+  CalibrationParameters::Parameters parameters_;
   int pair_count_;
+  bool millimeter_depth_;
+  bool interpolate_planes_;
+  bool half_precision_;
   double max_deviation_;
+  double angle_step_size_;
+  int build_threads_;
+  double build_seconds_;
+  bool lazy_;
+  int prefetch_count_;
+  std::atomic<int> made_planes_;
   PlaneToDepthImage plane_to_depth_;
+  int rows_;
+  int cols_;
 
   Eigen::Translation3d translation_;
   Eigen::AngleAxisd base_rotation_;
 
-  std::map<double, MatrixPlanePtr> x_planes_;
-  std::map<double, MatrixPlanePtr> y_planes_;
+  // owner of the memory of the bank slabs of a loaded bank
+  PlanesFilePtr file_;
+
+  PlaneSlab<float> x_planes_;
+  PlaneSlab<float> y_planes_;
+
+  PlaneSlab<unsigned short> x_millimeter_planes_;
+  PlaneSlab<unsigned short> y_millimeter_planes_;
+
+  PlaneSlab<Eigen::half> x_half_planes_;
+  PlaneSlab<Eigen::half> y_half_planes_;
+
+  // the upper and lower plane per axis
+  PlaneSlab<float> x_interpolated_planes_;
+  PlaneSlab<float> y_interpolated_planes_;
+  PlaneSlab<unsigned short> x_interpolated_millimeter_planes_;
+  PlaneSlab<unsigned short> y_interpolated_millimeter_planes_;
+  PlaneSlab<Eigen::half> x_interpolated_half_planes_;
+  PlaneSlab<Eigen::half> y_interpolated_half_planes_;
+  // two float rows for blending and comparing the interpolated fp16 planes, sized with them
+  Eigen::Matrix<float, 2, Eigen::Dynamic, Eigen::RowMajor> half_rows_;
+
+  // per axis, upper and lower index. nan: not calculated yet
+  std::unique_ptr<std::atomic<double>[]> pair_distances_;
+
+  // lazy banks: SlotState per axis and index, the waiting for planes made by another thread uses the mutex
+  std::unique_ptr<std::atomic<int>[]> slot_states_;
+  std::mutex slot_mutex_;
+  std::condition_variable slot_condition_;
+
+  std::mutex prefetch_mutex_;
+  std::condition_variable prefetch_condition_;
+  bool stop_prefetch_;
+  bool prefetch_pending_[2];
+  std::pair<int, int> prefetch_ranges_[2];
+  // last member, started after everything above is initialized
+  std::thread prefetch_thread_;
 };
 typedef std::shared_ptr<Planes> PlanesPtr;
 
@@ -0,0 +1,69 @@
+#ifndef plane_calibration_SRC_PLANES_BUILDER_HPP_
+#define plane_calibration_SRC_PLANES_BUILDER_HPP_
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "bank_cache.hpp"
+#include "calibration_parameters.hpp"
+#include "plane_to_depth_image.hpp"
+#include "planes.hpp"
+#include "planes_file.hpp"
+
+namespace plane_calibration
+{
+
+/**
+ * Builds the precomputed planes in a background thread. The finished bank replaces the previous one,
+ * users keep their shared pointer to the old bank as long as they need it.
+ * With a planes cache directory a stored bank is loaded instead, a new one is stored after building.
+ * Banks of earlier transforms are kept within bank_cache_megabytes_, going back to such a transform is a lookup.
+ * With a shared planes directory the builders of all instances (also in other processes) map one copy of a bank,
+ * the first one builds it while the others wait.
+ */
+class PlanesBuilder
+{
+public:
+  PlanesBuilder(const PlaneToDepthImage& plane_to_depth);
+  ~PlanesBuilder();
+
+  PlanesBuilder(const PlanesBuilder&) = delete;
+  PlanesBuilder& operator=(const PlanesBuilder&) = delete;
+
+  // returns immediately, replaces a not yet started request, the same bank is not built twice.
+  // A cached bank is available right away
+  void build(const CalibrationParameters::Parameters& parameters);
+
+  // latest finished bank, nullptr until the first one is done
+  PlanesPtr getPlanes();
+
+  // blocks until all requested banks are built
+  void wait();
+
+  BankCacheStatistics getCacheStatistics() const;
+
+protected:
+  void run();
+
+  PlaneToDepthImage plane_to_depth_;
+
+  mutable std::mutex mutex_;
+  std::condition_variable condition_;
+  bool stop_;
+  bool requested_;
+  bool pending_;
+  bool building_;
+  CalibrationParameters::Parameters last_request_;
+  PlanesPtr planes_;
+  BankCache<Planes> cache_;
+
+  // last member, started after everything above is initialized
+  std::thread thread_;
+};
+typedef std::shared_ptr<PlanesBuilder> PlanesBuilderPtr;
+
+} /* end namespace */
+
+#endif
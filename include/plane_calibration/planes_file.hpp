@@ -0,0 +1,102 @@
+#ifndef plane_calibration_SRC_PLANES_FILE_HPP_
+#define plane_calibration_SRC_PLANES_FILE_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace plane_calibration
+{
+
+class PlanesFile;
+typedef std::shared_ptr<PlanesFile> PlanesFilePtr;
+
+/**
+ * Versioned binary file of a plane bank, mapped read only so processes on one machine share its pages.
+ * Layout: header, key, blob sizes, padding to a page, blobs (each a multiple of 8 bytes, the slabs a multiple of
+ * 64 bytes, so they keep the 64 byte alignment of the page). The key describes everything the bank depends on, its
+ * hash is the file name and it is compared byte by byte when opening. Header and data have checksums.
+ * Shared files (in a tmpfs like /dev/shm) are reference counted with a shared flock per user, the last user removes
+ * the file. An exclusive Lock on path.lock serializes making a file and removing it.
+ */
+class PlanesFile
+{
+public:
+  static const std::uint32_t version = 2;
+
+  ~PlanesFile();
+
+  PlanesFile(const PlanesFile&) = delete;
+  PlanesFile& operator=(const PlanesFile&) = delete;
+
+  // exclusive flock on path.lock (created if missing, never removed), released with the object
+  class Lock
+  {
+  public:
+    // wait false: does not block, check locked()
+    explicit Lock(const std::string& path, const bool& wait = true);
+    ~Lock();
+
+    Lock(const Lock&) = delete;
+    Lock& operator=(const Lock&) = delete;
+
+    bool locked() const;
+
+  protected:
+    int descriptor_;
+    bool locked_;
+  };
+
+  // nullptr if the file is missing, made for another key or damaged.
+  // shared: the file is removed when the last shared user is destroyed (and nobody holds its Lock)
+  static PlanesFilePtr open(const std::string& path, const std::string& key, const std::vector<std::size_t>& blob_bytes,
+                            const bool& shared = false);
+
+  // writes a temporary file next to path and renames it, readers never see a partial file. false on failure
+  static bool write(const std::string& path, const std::string& key,
+                    const std::vector<std::pair<const void*, std::size_t> >& blobs);
+
+  // planes_<key hash>.bin
+  static std::string fileName(const std::string& key);
+
+  const void* blob(const int& index) const;
+
+  // FNV-1a on 64 bit words, the tail byte wise
+  static std::uint64_t checksum(const void* data, const std::size_t& bytes,
+                                std::uint64_t hash = 14695981039346656037ULL);
+
+protected:
+  struct Header
+  {
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t byte_order;
+    std::uint64_t key_bytes;
+    std::uint64_t blob_count;
+    std::uint64_t data_offset;
+    std::uint64_t data_bytes;
+    std::uint64_t data_checksum;
+    // over the header above, the key and the blob sizes
+    std::uint64_t header_checksum;
+  };
+
+  PlanesFile();
+
+  static std::uint64_t headerChecksum(const Header& header, const std::string& key,
+                                      const std::vector<std::uint64_t>& blob_bytes);
+  static bool makeDirectories(const std::string& directory);
+
+  void* memory_;
+  std::size_t size_;
+  std::string path_;
+  // shared files: open with a shared flock as long as the file is used, -1 otherwise
+  int shared_descriptor_;
+  std::vector<std::size_t> blob_offsets_;
+};
+
+} /* end namespace */
+
+#endif
@@ -0,0 +1,160 @@
+#ifndef plane_calibration_SRC_ROW_POOL_HPP_
+#define plane_calibration_SRC_ROW_POOL_HPP_
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <Eigen/Core>
+
+namespace plane_calibration
+{
+
+/**
+ * Process wide worker threads for the per pixel kernels. Images are split into bands of band_rows rows, the calling
+ * thread and up to threads - 1 workers take the bands one after the other from the job, so a thread which is done
+ * early steals the remaining bands of the slower ones. The calling thread always works on its own job as well, so
+ * calls from several stages (or from inside a band) never wait for a free worker.
+ *
+ * The band size doesn't depend on the thread count and sums are added up per row in row order, so the results are
+ * bit identical for any thread count. threads <= 1 runs everything in the calling thread.
+ */
+class RowPool
+{
+public:
+  // work(begin_row, end_row) by reference, unlike std::function it never allocates
+  class BandWork
+  {
+  public:
+    template<typename Work>
+    BandWork(const Work& work) :
+        work_(&work), call_(&call<Work>)
+    {
+    }
+
+    void operator()(const int& begin_row, const int& end_row) const
+    {
+      call_(work_, begin_row, end_row);
+    }
+
+  protected:
+    template<typename Work>
+    static void call(const void* work, const int& begin_row, const int& end_row)
+    {
+      (*static_cast<const Work*>(work))(begin_row, end_row);
+    }
+
+    const void* work_;
+    void (*call_)(const void* work, const int& begin_row, const int& end_row);
+  };
+
+  static const int band_rows = 16;
+
+  // work(begin_row, end_row) for all bands of [0, rows), blocks until all are done. threads <= 0: one per core
+  template<typename Work>
+  static void forRows(const int& rows, const int& threads, const Work& work)
+  {
+    int thread_count = std::min(threadCount(threads), (rows + band_rows - 1) / band_rows);
+    if (thread_count <= 1)
+    {
+      for (int begin_row = 0; begin_row < rows; begin_row += band_rows)
+      {
+        work(begin_row, std::min(begin_row + band_rows, rows));
+      }
+      return;
+    }
+
+    instance().run(BandWork(work), rows, thread_count);
+  }
+
+  // band_sum(begin_row, end_row, row_sums) sets row_sums[i] to the sum of row begin_row + i,
+  // the row sums are added to zero in row order
+  template<typename T, typename BandSum>
+  static T sumRows(const int& rows, const int& threads, const T& zero, const BandSum& band_sum)
+  {
+    T sum = zero;
+    if (threadCount(threads) <= 1 || rows <= band_rows)
+    {
+      T row_sums[band_rows];
+      for (int begin_row = 0; begin_row < rows; begin_row += band_rows)
+      {
+        int end_row = std::min(begin_row + band_rows, rows);
+        band_sum(begin_row, end_row, row_sums);
+        for (int i = 0; i < end_row - begin_row; ++i)
+        {
+          sum += row_sums[i];
+        }
+      }
+      return sum;
+    }
+
+    // the buffer of this thread keeps its memory for the next call, a nested call (from inside a band) needs its own
+    static thread_local std::vector<T, Eigen::aligned_allocator<T> > thread_row_sums;
+    static thread_local bool thread_row_sums_used = false;
+    std::vector<T, Eigen::aligned_allocator<T> > nested_row_sums;
+    const bool nested = thread_row_sums_used;
+    std::vector<T, Eigen::aligned_allocator<T> >& row_sums = nested ? nested_row_sums : thread_row_sums;
+    thread_row_sums_used = true;
+
+    row_sums.assign(rows, zero);
+    forRows(rows, threads, [&](const int& begin_row, const int& end_row)
+    {
+      band_sum(begin_row, end_row, row_sums.data() + begin_row);
+    });
+
+    for (int row = 0; row < rows; ++row)
+    {
+      sum += row_sums[row];
+    }
+
+    thread_row_sums_used = nested;
+    return sum;
+  }
+
+  // threads <= 0: one per core
+  static int threadCount(const int& threads);
+
+  ~RowPool();
+
+protected:
+  class Job
+  {
+  public:
+    Job(const BandWork& work, const int& rows);
+
+    // false once all bands are taken
+    bool runBand();
+
+    const BandWork& work_;
+    const int rows_;
+    const int bands_;
+    std::atomic<int> next_band_;
+    std::atomic<int> done_bands_;
+    // workers which took the job from the requests and are not done with it yet
+    int helpers_;
+
+    std::mutex mutex_;
+    std::condition_variable done_;
+  };
+
+  RowPool();
+  static RowPool& instance();
+
+  void run(const BandWork& work, const int& rows, const int& threads);
+  void workerLoop();
+
+  std::mutex mutex_;
+  std::condition_variable condition_;
+  // one entry per helping worker a job asks for, the jobs live on the stack of their caller. It removes the entries
+  // no worker took once its bands are taken and waits for the helpers, so no worker sees a finished job.
+  // Only grows to the most requests ever waiting, no allocation after that
+  std::vector<Job*> requests_;
+  std::vector<std::thread> workers_;
+  bool stop_;
+};
+
+} /* end namespace */
+
+#endif
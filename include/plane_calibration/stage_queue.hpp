@@ -0,0 +1,166 @@
+#ifndef plane_calibration_SRC_STAGE_QUEUE_HPP_
+#define plane_calibration_SRC_STAGE_QUEUE_HPP_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace plane_calibration
+{
+
+/**
+ * Bounded queue between two pipeline stages, one producer and one consumer thread.
+ * Pushing and popping is lock free (a ring with atomic head and tail), the mutex is only taken to sleep while the
+ * queue is full / empty and to wake such a sleeper.
+ */
+template<typename T>
+class StageQueue
+{
+public:
+  explicit StageQueue(const std::size_t& capacity) :
+      slots_(capacity + 1), head_(0), tail_(0), waiting_(0), closed_(false), max_size_(0)
+  {
+  }
+
+  StageQueue(const StageQueue&) = delete;
+  StageQueue& operator=(const StageQueue&) = delete;
+
+  // producer: moves value in, false if full
+  bool tryPush(T& value)
+  {
+    std::size_t tail = tail_.load(std::memory_order_relaxed);
+    std::size_t next = (tail + 1) % slots_.size();
+    if (next == head_.load(std::memory_order_acquire))
+    {
+      return false;
+    }
+
+    slots_[tail] = std::move(value);
+    tail_.store(next, std::memory_order_release);
+
+    std::size_t size = this->size();
+    std::size_t max_size = max_size_.load(std::memory_order_relaxed);
+    while (size > max_size && !max_size_.compare_exchange_weak(max_size, size, std::memory_order_relaxed))
+    {
+    }
+
+    wake();
+    return true;
+  }
+
+  // consumer: false if empty
+  bool tryPop(T& value)
+  {
+    std::size_t head = head_.load(std::memory_order_relaxed);
+    if (head == tail_.load(std::memory_order_acquire))
+    {
+      return false;
+    }
+
+    value = std::move(slots_[head]);
+    slots_[head] = T();
+    head_.store((head + 1) % slots_.size(), std::memory_order_release);
+
+    wake();
+    return true;
+  }
+
+  // blocks while full, false once closed
+  bool push(T& value)
+  {
+    return wait([this, &value]()
+    { return tryPush(value);}, [this]()
+    { return size() < capacity();});
+  }
+
+  // blocks while empty, false once closed
+  bool pop(T& value)
+  {
+    return wait([this, &value]()
+    { return tryPop(value);}, [this]()
+    { return size() > 0;});
+  }
+
+  // wakes both sides, push and pop fail from now on if they would block
+  void close()
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      closed_ = true;
+    }
+    condition_.notify_all();
+  }
+
+  // exact for the producer and the consumer, a snapshot for others
+  std::size_t size() const
+  {
+    std::size_t head = head_.load(std::memory_order_acquire);
+    std::size_t tail = tail_.load(std::memory_order_acquire);
+    return (tail + slots_.size() - head) % slots_.size();
+  }
+
+  std::size_t capacity() const
+  {
+    return slots_.size() - 1;
+  }
+
+  // largest size since the last call
+  std::size_t takeMaxSize()
+  {
+    return max_size_.exchange(size(), std::memory_order_relaxed);
+  }
+
+protected:
+  template<typename Operation, typename Ready>
+  bool wait(const Operation& operation, const Ready& ready)
+  {
+    while (!operation())
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      waiting_.fetch_add(1);
+      // pairs with the fence in wake: either the other side sees waiting_ or ready sees its change
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+
+      if (!ready() && !closed_)
+      {
+        condition_.wait(lock);
+      }
+      waiting_.fetch_sub(1);
+
+      if (closed_)
+      {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  void wake()
+  {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (waiting_.load(std::memory_order_relaxed) > 0)
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      condition_.notify_all();
+    }
+  }
+
+  // one slot stays empty to tell full from empty
+  std::vector<T> slots_;
+  std::atomic<std::size_t> head_;
+  std::atomic<std::size_t> tail_;
+
+  std::mutex mutex_;
+  std::condition_variable condition_;
+  std::atomic<int> waiting_;
+  bool closed_;
+
+  std::atomic<std::size_t> max_size_;
+};
+
+} /* end namespace */
+
+#endif
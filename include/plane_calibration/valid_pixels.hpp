@@ -0,0 +1,92 @@
+#ifndef plane_calibration_SRC_VALID_PIXELS_HPP_
+#define plane_calibration_SRC_VALID_PIXELS_HPP_
+
+#include <algorithm>
+#include <limits>
+#include <Eigen/Dense>
+
+#include "depth_matrix.hpp"
+#include "plane_to_depth_image.hpp"
+#include "row_pool.hpp"
+
+namespace plane_calibration
+{
+
+/**
+ * Compact list (structure of arrays) of the valid pixels of a depth image together with their ray multipliers.
+ * After filtering most of the image is nan, so the later stages only look at the usable pixels.
+ * The buffers keep their memory between frames of the same size.
+ */
+class ValidPixels
+{
+public:
+  typedef Eigen::VectorXi::ConstSegmentReturnType Indices;
+  typedef Eigen::VectorXf::ConstSegmentReturnType Values;
+
+  ValidPixels();
+
+  // collects the not nan pixels up to max_depth, the multipliers have to match the image size
+  void compact(const DepthConstRef& depth, const PlaneToDepthImage::XYMultipliers& xy_multipliers,
+               const float& max_depth = std::numeric_limits<float>::infinity());
+  // buffers for images of image_size pixels, done by compact as well
+  void reserve(const int& image_size);
+
+  int size() const;
+  bool empty() const;
+
+  // of the image the pixels are from
+  int rows() const;
+  int cols() const;
+  int imageSize() const;
+
+  Indices u() const;
+  Indices v() const;
+  Values depth() const;
+  Values xMultiplier() const;
+  Values yMultiplier() const;
+
+  // part of the list, e.g. for block wise sums
+  Values depth(const int& start, const int& length) const;
+  Values xMultiplier(const int& start, const int& length) const;
+  Values yMultiplier(const int& start, const int& length) const;
+
+  // sums over blocks (float for the vectorized ones), double over the blocks in block order; block_sum(start, length).
+  // The blocks are split over the row pool threads, same result for any thread count
+  template<typename BlockSum>
+  double sum(const BlockSum& block_sum, const int& threads = 1) const
+  {
+    return sums(0.0, block_sum, threads);
+  }
+
+  // the same for several sums at once (e.g. Eigen::Vector4d), added to zero
+  template<typename T, typename BlockSum>
+  T sums(const T& zero, const BlockSum& block_sum, const int& threads = 1) const
+  {
+    const int blocks = (size_ + block_size - 1) / block_size;
+    return RowPool::sumRows(blocks, threads, zero, [&](const int& begin_block, const int& end_block, T* sums)
+    {
+      for (int block = begin_block; block < end_block; ++block)
+      {
+        int start = block * block_size;
+        sums[block - begin_block] = block_sum(start, std::min(block_size, size_ - start));
+      }
+    });
+  }
+
+  static const int block_size = 1024;
+
+protected:
+  int size_;
+  int rows_;
+  int cols_;
+
+  Eigen::VectorXi u_;
+  Eigen::VectorXi v_;
+  Eigen::VectorXf depth_;
+  Eigen::VectorXf x_multiplier_;
+  Eigen::VectorXf y_multiplier_;
+};
+
+} /* end namespace */
+
+#endif
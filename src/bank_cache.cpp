@@ -0,0 +1,53 @@
+#include "plane_calibration/bank_cache.hpp"
+
+#include <cmath>
+
+namespace plane_calibration
+{
+
+BankKey::Key BankKey::transform(const CalibrationParameters::Parameters& parameters)
+{
+  TransformKey transform_key = transformKey(parameters);
+  return Key(transform_key.begin(), transform_key.end());
+}
+
+BankKey::TransformKey BankKey::transformKey(const CalibrationParameters::Parameters& parameters)
+{
+  TransformKey key;
+  for (int i = 0; i < 3; ++i)
+  {
+    key[i] = quantize(parameters.ground_plane_offset_[i], 1e-4);
+  }
+
+  Eigen::Matrix3d rotation = parameters.rotation_.toRotationMatrix();
+  for (int i = 0; i < rotation.size(); ++i)
+  {
+    key[3 + i] = quantize(rotation.data()[i], 1e-5);
+  }
+
+  key[12] = quantize(parameters.max_deviation_, 1e-6);
+  key[13] = parameters.millimeter_depth_;
+  return key;
+}
+
+void BankKey::append(const CameraModel::Parameters& camera_parameters, Key& key)
+{
+  append(camera_parameters.center_x_, 1e-3, key);
+  append(camera_parameters.center_y_, 1e-3, key);
+  append(camera_parameters.f_x_, 1e-3, key);
+  append(camera_parameters.f_y_, 1e-3, key);
+  key.push_back(camera_parameters.width_);
+  key.push_back(camera_parameters.height_);
+}
+
+void BankKey::append(const double& value, const double& resolution, Key& key)
+{
+  key.push_back(quantize(value, resolution));
+}
+
+std::int64_t BankKey::quantize(const double& value, const double& resolution)
+{
+  return static_cast<std::int64_t>(std::llround(value / resolution));
+}
+
+} /* end namespace */
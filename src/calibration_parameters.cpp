@@ -2,6 +2,11 @@
 
 namespace plane_calibration
 {
+CalibrationParameters::CalibrationParameters() :
+    CalibrationParameters(true, 40)
+{
+}
+
 CalibrationParameters::CalibrationParameters(bool precompute_planes, int precomputed_plane_pairs_count)
 {
   parameters_.precompute_planes_ = precompute_planes;
@@ -57,6 +62,12 @@ Eigen::Affine3d CalibrationParameters::getTransform() const
   return parameters_.getTransform();
 }
 
+int CalibrationParameters::getKernelThreads() const
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  return parameters_.kernel_threads_;
+}
+
 void CalibrationParameters::update(const Eigen::Vector3d& ground_plane_offset, const double& max_deviation,
                                    const Eigen::AngleAxisd& rotation)
 {
@@ -120,6 +131,84 @@ void CalibrationParameters::updatePrecomputation(const bool& enable, const int&
   updated_ = true;
 }
 
+void CalibrationParameters::updatePlaneInterpolation(const bool& enable)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  parameters_.interpolate_planes_ = enable;
+  updated_ = true;
+}
+
+void CalibrationParameters::updateHalfPrecisionPlanes(const bool& enable)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  parameters_.half_precision_planes_ = enable;
+  updated_ = true;
+}
+
+void CalibrationParameters::updatePlaneBuildThreads(const int& threads)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  parameters_.plane_build_threads_ = threads;
+  updated_ = true;
+}
+
+void CalibrationParameters::updateKernelThreads(const int& threads)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  parameters_.kernel_threads_ = threads;
+  updated_ = true;
+}
+
+void CalibrationParameters::updateLazyPlanes(const bool& enable, const int& prefetch_count)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  parameters_.lazy_planes_ = enable;
+  parameters_.prefetch_planes_ = prefetch_count;
+  updated_ = true;
+}
+
+void CalibrationParameters::updateBankCacheBudget(const int& megabytes)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  parameters_.bank_cache_megabytes_ = megabytes;
+  updated_ = true;
+}
+
+void CalibrationParameters::updatePlanesCacheDirectory(const std::string& directory)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  parameters_.planes_cache_directory_ = directory;
+  updated_ = true;
+}
+
+void CalibrationParameters::updateSharedPlanesDirectory(const std::string& directory)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  parameters_.shared_planes_directory_ = directory;
+  updated_ = true;
+}
+
+void CalibrationParameters::updateMillimeterDepth(const bool& enable)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  parameters_.millimeter_depth_ = enable;
+  updated_ = true;
+}
+
+void CalibrationParameters::updatePyramidFactor(const int& factor)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  parameters_.pyramid_factor_ = factor;
+  updated_ = true;
+}
+
+void CalibrationParameters::updateMomentEstimation(const bool& enable)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  parameters_.moment_estimation_ = enable;
+  updated_ = true;
+}
+
 void CalibrationParameters::updateDeviation(const double& deviation)
 {
   std::lock_guard<std::mutex> lock(mutex_);
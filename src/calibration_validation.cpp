@@ -1,10 +1,14 @@
 #include "plane_calibration/calibration_validation.hpp"
 
+#include <cmath>
+#include <limits>
 #include <ros/console.h>
 
 namespace plane_calibration
 {
 
+const double CalibrationValidation::max_outside_distance = 0.04;
+
 CalibrationValidation::CalibrationValidation(const CameraModel& camera_model,
                                              const CalibrationParametersPtr& parameters, const Config& config,
                                              const VisualizerInterfacePtr& depth_visualizer) :
@@ -41,19 +45,41 @@ bool CalibrationValidation::angleOffsetValid(const std::pair<double, double>& an
   return true;
 }
 
-bool CalibrationValidation::groundPlaneFitsData(const Eigen::MatrixXf& ground_plane, const Eigen::MatrixXf& data,
+bool CalibrationValidation::groundPlaneFitsData(const DepthConstRef& ground_plane, const DepthConstRef& data,
+                                                const bool& debug)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  return groundPlaneFitsData_(getDifferenceStatistics(ground_plane, data), debug);
+}
+
+bool CalibrationValidation::groundPlaneFitsData(const DepthConstRef& ground_plane, const ValidPixels& data,
                                                 const bool& debug)
 {
   std::lock_guard<std::mutex> lock(mutex_);
+  return groundPlaneFitsData_(getDifferenceStatistics(ground_plane, data), debug);
+}
+
+bool CalibrationValidation::groundPlaneHasDataBelow(const DepthConstRef& ground_plane, const DepthConstRef& data,
+                                                    const bool& debug)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  return groundPlaneHasDataBelow_(getDifferenceStatistics(ground_plane, data), debug);
+}
 
-  Eigen::MatrixXf difference;
-  int not_nan_count;
-  getDifferenceAndNotNanCount(ground_plane, data, difference, not_nan_count);
+bool CalibrationValidation::groundPlaneHasDataBelow(const DepthConstRef& ground_plane, const ValidPixels& data,
+                                                    const bool& debug)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  return groundPlaneHasDataBelow_(getDifferenceStatistics(ground_plane, data), debug);
+}
 
+bool CalibrationValidation::groundPlaneFitsData_(const DepthKernels::DifferenceStatistics& statistics,
+                                                 const bool& debug)
+{
   double too_low_ratio;
-  bool too_low = checkTooLow(difference, not_nan_count, too_low_ratio);
+  bool too_low = checkTooLow(statistics, too_low_ratio);
 
-  double mean = difference.sum() / not_nan_count;
+  double mean = statistics.sum / statistics.valid_count;
 
   if (debug)
   {
@@ -84,17 +110,11 @@ bool CalibrationValidation::groundPlaneFitsData(const Eigen::MatrixXf& ground_pl
   return true;
 }
 
-bool CalibrationValidation::groundPlaneHasDataBelow(const Eigen::MatrixXf& ground_plane, const Eigen::MatrixXf& data,
-                                                    const bool& debug)
+bool CalibrationValidation::groundPlaneHasDataBelow_(const DepthKernels::DifferenceStatistics& statistics,
+                                                     const bool& debug)
 {
-  std::lock_guard<std::mutex> lock(mutex_);
-
-  Eigen::MatrixXf difference;
-  int not_nan_count;
-  getDifferenceAndNotNanCount(ground_plane, data, difference, not_nan_count);
-
   double too_low_ratio;
-  bool too_low = checkTooLow(difference, not_nan_count, too_low_ratio);
+  bool too_low = checkTooLow(statistics, too_low_ratio);
 
   if (debug)
   {
@@ -114,29 +134,70 @@ bool CalibrationValidation::groundPlaneHasDataBelow(const Eigen::MatrixXf& groun
   return false;
 }
 
-void CalibrationValidation::getDifferenceAndNotNanCount(const Eigen::MatrixXf& ground_plane,
-                                                        const Eigen::MatrixXf& data, Eigen::MatrixXf& difference,
-                                                        int& not_nan_count)
+void CalibrationValidation::getThresholds(float& below, float& outside)
+{
+  // the float thresholds give the same results as comparing the float differences against the double values
+  double too_low_distance = 0.0 - config_.too_low_buffer;
+  below = static_cast<float>(too_low_distance);
+  if (below < too_low_distance)
+  {
+    below = std::nextafter(below, std::numeric_limits<float>::infinity());
+  }
+
+  outside = static_cast<float>(max_outside_distance);
+  if (outside > max_outside_distance)
+  {
+    outside = std::nextafter(outside, -std::numeric_limits<float>::infinity());
+  }
+}
+
+DepthKernels::DifferenceStatistics CalibrationValidation::getDifferenceStatistics(const DepthConstRef& ground_plane,
+                                                                                  const DepthConstRef& data)
+{
+  float below;
+  float outside;
+  getThresholds(below, outside);
+
+  // nan differences are counted out
+  return RowPool::sumRows(data.rows(), parameters_->getKernelThreads(), DepthKernels::DifferenceStatistics(),
+                          [&](const int& begin_row, const int& end_row, DepthKernels::DifferenceStatistics* row_statistics)
+  {
+    for (int row = begin_row; row < end_row; ++row)
+    {
+      row_statistics[row - begin_row] = DepthKernels::differenceStatistics(ground_plane.row(row).data(),
+                                                                           data.row(row).data(), data.cols(), below,
+                                                                           outside);
+    }
+  });
+}
+
+DepthKernels::DifferenceStatistics CalibrationValidation::getDifferenceStatistics(const DepthConstRef& ground_plane,
+                                                                                  const ValidPixels& data)
 {
-  difference = (ground_plane - data);
+  float below;
+  float outside;
+  getThresholds(below, outside);
 
-  // (nan == nan) gives false
-  not_nan_count = (difference.array() == difference.array()).count();
+  ValidPixels::Indices u = data.u();
+  ValidPixels::Indices v = data.v();
+  ValidPixels::Values depth = data.depth();
 
-  //remove nans
-  difference = difference.unaryExpr([](float v)
-  { return std::isnan(v) ? 0.0f : v;});
+  // the data has no nans, the plane still can have some
+  return sumBlocks(data.size(), DepthKernels::DifferenceStatistics(), [&](const int& start, const int& length)
+  {
+    float plane[ValidPixels::block_size];
+    for (int i = 0; i < length; ++i)
+    {
+      plane[i] = ground_plane(v[start + i], u[start + i]);
+    }
+    return DepthKernels::differenceStatistics(plane, depth.data() + start, length, below, outside);
+  });
 }
 
-bool CalibrationValidation::checkTooLow(const Eigen::MatrixXf& difference, const int& not_nan_count,
-                                        double& too_low_ratio)
+bool CalibrationValidation::checkTooLow(const DepthKernels::DifferenceStatistics& statistics, double& too_low_ratio)
 {
-  double too_low_distance = 0.0 - config_.too_low_buffer;
-  int is_too_low = (difference.array() < too_low_distance).count();
-  too_low_ratio = is_too_low / (double)not_nan_count;
-   
-  is_too_low = ( difference.array().abs() > 0.04 ).count();
-  too_low_ratio = is_too_low / (double)not_nan_count;  
+  too_low_ratio = statistics.below_count / (double)statistics.valid_count;
+  too_low_ratio = statistics.outside_count / (double)statistics.valid_count;
 
   if (too_low_ratio > config_.max_too_low_ratio)
   {
@@ -146,5 +207,23 @@ bool CalibrationValidation::checkTooLow(const Eigen::MatrixXf& difference, const
   return false;
 }
 
+template<typename T, typename BlockSum>
+T CalibrationValidation::sumBlocks(const int& size, const T& zero, const BlockSum& block_sum)
+{
+  const int block_size = ValidPixels::block_size;
+  const int blocks = (size + block_size - 1) / block_size;
+
+  // the blocks are added up in order, same result for any thread count
+  return RowPool::sumRows(blocks, parameters_->getKernelThreads(), zero,
+                          [&](const int& begin_block, const int& end_block, T* sums)
+  {
+    for (int block = begin_block; block < end_block; ++block)
+    {
+      int start = block * block_size;
+      sums[block - begin_block] = block_sum(start, std::min(block_size, size - start));
+    }
+  });
+}
+
 }
 /* end namespace */
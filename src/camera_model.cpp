@@ -23,6 +23,7 @@ CameraModel::CameraModel(const CameraModel &object)
 
 bool CameraModel::initialized() const
 {
+  std::lock_guard<std::mutex> lock(mutex_);
   return initialized_;
 }
 
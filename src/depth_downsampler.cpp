@@ -0,0 +1,146 @@
+#include "plane_calibration/depth_downsampler.hpp"
+
+#include <limits>
+
+namespace plane_calibration
+{
+
+CameraModel::Parameters DepthDownsampler::downsample(const CameraModel::Parameters& camera_model_paramaters,
+                                                     const int& factor)
+{
+  CameraModel::Parameters parameters = camera_model_paramaters;
+
+  // pixel u of the binned image sees the center of the block [u * factor, (u + 1) * factor - 1]
+  double block_center_offset = (factor - 1) / 2.0;
+  parameters.center_x_ = (camera_model_paramaters.center_x_ - block_center_offset) / factor;
+  parameters.center_y_ = (camera_model_paramaters.center_y_ - block_center_offset) / factor;
+  parameters.f_x_ = camera_model_paramaters.f_x_ / factor;
+  parameters.f_y_ = camera_model_paramaters.f_y_ / factor;
+  parameters.width_ = camera_model_paramaters.width_ / factor;
+  parameters.height_ = camera_model_paramaters.height_ / factor;
+
+  return parameters;
+}
+
+void DepthDownsampler::downsample(const DepthConstRef& depth, const int& factor, DepthMatrix& out_depth)
+{
+  int rows = depth.rows() / factor;
+  int cols = depth.cols() / factor;
+  out_depth.resize(rows, cols);
+
+  // one block after the other, the factor input rows of a block row stay in the cache
+  for (int row = 0; row < rows; ++row)
+  {
+    for (int col = 0; col < cols; ++col)
+    {
+      float sum = 0.0f;
+      int count = 0;
+
+      for (int block_row = 0; block_row < factor; ++block_row)
+      {
+        const float* input = depth.row(row * factor + block_row).data() + col * factor;
+
+        for (int block_col = 0; block_col < factor; ++block_col)
+        {
+          float value = input[block_col];
+          if (value == value)
+          {
+            sum += value;
+            ++count;
+          }
+        }
+      }
+
+      out_depth(row, col) = count > 0 ? sum / count : std::numeric_limits<float>::quiet_NaN();
+    }
+  }
+}
+
+void DepthDownsampler::downsample(const MillimeterDepthConstRef& depth, const int& factor,
+                                  MillimeterDepthMatrix& out_depth)
+{
+  int rows = depth.rows() / factor;
+  int cols = depth.cols() / factor;
+  out_depth.resize(rows, cols);
+
+  for (int row = 0; row < rows; ++row)
+  {
+    for (int col = 0; col < cols; ++col)
+    {
+      int sum = 0;
+      int count = 0;
+
+      for (int block_row = 0; block_row < factor; ++block_row)
+      {
+        const unsigned short* input = depth.row(row * factor + block_row).data() + col * factor;
+
+        for (int block_col = 0; block_col < factor; ++block_col)
+        {
+          unsigned short value = input[block_col];
+          sum += value;
+          count += value != 0;
+        }
+      }
+
+      // rounded integer mean, 0 stays invalid
+      out_depth(row, col) = count > 0 ? (sum + count / 2) / count : 0;
+    }
+  }
+}
+
+void DepthDownsampler::downsample(const ValidPixels& valid_pixels, const int& factor, DepthMatrix& out_depth)
+{
+  CountMatrix counts;
+  downsample(valid_pixels, factor, out_depth, counts);
+}
+
+void DepthDownsampler::downsample(const ValidPixels& valid_pixels, const int& factor, DepthMatrix& out_depth,
+                                  CountMatrix& counts)
+{
+  int rows = valid_pixels.rows() / factor;
+  int cols = valid_pixels.cols() / factor;
+
+  // sums in the output buffer, counts in the given buffer, the list is in row major order like the image
+  DepthMatrix& sums = out_depth;
+  sums.setZero(rows, cols);
+  counts.setZero(rows, cols);
+
+  ValidPixels::Indices u = valid_pixels.u();
+  ValidPixels::Indices v = valid_pixels.v();
+  ValidPixels::Values depth = valid_pixels.depth();
+
+  for (int i = 0; i < valid_pixels.size(); ++i)
+  {
+    int row = v[i] / factor;
+    int col = u[i] / factor;
+
+    // the remainder rows / cols are cut off like in the dense version
+    if (row >= rows || col >= cols)
+    {
+      continue;
+    }
+
+    sums(row, col) += depth[i];
+    ++counts(row, col);
+  }
+
+  // in place, every element only reads its own sum
+  out_depth.array() = (counts.array() > 0).select(sums.array() / counts.cast<float>().array(),
+                                                 std::numeric_limits<float>::quiet_NaN());
+}
+
+void DepthDownsampler::downsample(const DepthImageView& depth_image, const int& factor,
+                                  DepthImageView& out_depth_image)
+{
+  DepthMatrix& depth_buffer = out_depth_image.buffer(depth_image.rows() / factor, depth_image.cols() / factor);
+  downsample(depth_image.map(), factor, depth_buffer);
+
+  if (depth_image.hasMillimeters())
+  {
+    MillimeterDepthMatrix& millimeter_buffer = out_depth_image.millimeterBuffer(depth_image.rows() / factor,
+                                                                                depth_image.cols() / factor);
+    downsample(depth_image.millimeterMap(), factor, millimeter_buffer);
+  }
+}
+
+} /* end namespace */
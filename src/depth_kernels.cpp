@@ -0,0 +1,1066 @@
+#include "plane_calibration/depth_kernels.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <Eigen/Core>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define PLANE_CALIBRATION_X86_KERNELS
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+namespace plane_calibration
+{
+
+constexpr float DepthKernels::millimeter_to_meter;
+const int DepthKernels::lanes;
+const int DepthKernels::reduction_lanes;
+
+typedef void (*MillimetersToMetersFunction)(const unsigned short*, float*, const int&, const float&);
+
+static MillimetersToMetersFunction selectMillimetersToMeters()
+{
+  if (DepthKernels::hasAVX2())
+  {
+    return &DepthKernels::millimetersToMetersAVX2;
+  }
+
+  if (DepthKernels::hasSSE41())
+  {
+    return &DepthKernels::millimetersToMetersSSE41;
+  }
+
+  return &DepthKernels::millimetersToMetersScalar;
+}
+
+void DepthKernels::millimetersToMeters(const unsigned short* input, float* output, const int& count,
+                                       const float& max_range)
+{
+  // cpu check only once
+  static const MillimetersToMetersFunction function = selectMillimetersToMeters();
+  function(input, output, count, max_range);
+}
+
+void DepthKernels::millimetersToMetersScalar(const unsigned short* input, float* output, const int& count,
+                                             const float& max_range)
+{
+  const float nan = std::numeric_limits<float>::quiet_NaN();
+
+  for (int i = 0; i < count; ++i)
+  {
+    float depth = static_cast<float>(input[i]) * millimeter_to_meter;
+    output[i] = (input[i] == 0 || depth > max_range) ? nan : depth;
+  }
+}
+
+void DepthKernels::halfToFloat(const unsigned short* input, float* output, const int& count)
+{
+  static const bool f16c = hasF16C();
+  f16c ? halfToFloatF16C(input, output, count) : halfToFloatScalar(input, output, count);
+}
+
+void DepthKernels::floatToHalf(const float* input, unsigned short* output, const int& count)
+{
+  static const bool f16c = hasF16C();
+  f16c ? floatToHalfF16C(input, output, count) : floatToHalfScalar(input, output, count);
+}
+
+float DepthKernels::halfSquaredDistance(const unsigned short* half, const float* data, const int& count)
+{
+  static const bool f16c = hasF16C();
+  return f16c ? halfSquaredDistanceF16C(half, data, count) : halfSquaredDistanceScalar(half, data, count);
+}
+
+void DepthKernels::halfToFloatScalar(const unsigned short* input, float* output, const int& count)
+{
+  for (int i = 0; i < count; ++i)
+  {
+    output[i] = Eigen::half_impl::half_to_float(Eigen::half_impl::raw_uint16_to_half(input[i]));
+  }
+}
+
+void DepthKernels::floatToHalfScalar(const float* input, unsigned short* output, const int& count)
+{
+  for (int i = 0; i < count; ++i)
+  {
+    output[i] = Eigen::half(input[i]).x;
+  }
+}
+
+float DepthKernels::halfSquaredDistanceScalar(const unsigned short* half, const float* data, const int& count)
+{
+  float lane_sums[lanes] = {};
+  return halfSquaredDistanceTail(half, data, 0, count, lane_sums);
+}
+
+float DepthKernels::halfSquaredDistanceTail(const unsigned short* half, const float* data, const int& start,
+                                            const int& count, float* lane_sums)
+{
+  for (int i = start; i < count; ++i)
+  {
+    float difference = Eigen::half_impl::half_to_float(Eigen::half_impl::raw_uint16_to_half(half[i])) - data[i];
+    if (data[i] == data[i])
+    {
+      lane_sums[i % lanes] += difference * difference;
+    }
+  }
+
+  return ((lane_sums[0] + lane_sums[1]) + (lane_sums[2] + lane_sums[3]))
+      + ((lane_sums[4] + lane_sums[5]) + (lane_sums[6] + lane_sums[7]));
+}
+
+DepthKernels::DifferenceStatistics::DifferenceStatistics() :
+    sum(0.0), abs_sum(0.0), abs_min(std::numeric_limits<float>::infinity()), abs_max(0.0f), valid_count(0),
+    below_count(0), outside_count(0)
+{
+}
+
+DepthKernels::DifferenceStatistics& DepthKernels::DifferenceStatistics::operator+=(const DifferenceStatistics& other)
+{
+  sum += other.sum;
+  abs_sum += other.abs_sum;
+  abs_min = std::min(abs_min, other.abs_min);
+  abs_max = std::max(abs_max, other.abs_max);
+  valid_count += other.valid_count;
+  below_count += other.below_count;
+  outside_count += other.outside_count;
+  return *this;
+}
+
+// the best version the cpu supports
+template<typename Function>
+static Function selectReduction(const Function& scalar, const Function& sse2, const Function& avx2,
+                                const Function& avx512)
+{
+  if (DepthKernels::hasAVX512())
+  {
+    return avx512;
+  }
+
+  if (DepthKernels::hasAVX2())
+  {
+    return avx2;
+  }
+
+  return DepthKernels::hasSSE2() ? sse2 : scalar;
+}
+
+float DepthKernels::squaredDistance(const float* a, const float* b, const int& count)
+{
+  static const decltype(&squaredDistanceScalar) function = selectReduction(&squaredDistanceScalar,
+                                                                           &squaredDistanceSSE2,
+                                                                           &squaredDistanceAVX2,
+                                                                           &squaredDistanceAVX512);
+  return function(a, b, count);
+}
+
+DepthKernels::DifferenceStatistics DepthKernels::differenceStatistics(const float* a, const float* b,
+                                                                      const int& count, const float& below,
+                                                                      const float& outside)
+{
+  static const decltype(&differenceStatisticsScalar) function = selectReduction(&differenceStatisticsScalar,
+                                                                                &differenceStatisticsSSE2,
+                                                                                &differenceStatisticsAVX2,
+                                                                                &differenceStatisticsAVX512);
+  return function(a, b, count, below, outside);
+}
+
+void DepthKernels::countNansAndZeros(const float* data, const int& count, int& nan_count, int& zero_count)
+{
+  static const decltype(&countNansAndZerosScalar) function = selectReduction(&countNansAndZerosScalar,
+                                                                             &countNansAndZerosSSE2,
+                                                                             &countNansAndZerosAVX2,
+                                                                             &countNansAndZerosAVX512);
+  function(data, count, nan_count, zero_count);
+}
+
+std::int64_t DepthKernels::millimeterSquaredDistance(const unsigned short* a, const unsigned short* b,
+                                                     const int& count)
+{
+  static const decltype(&millimeterSquaredDistanceScalar) function = selectReduction(
+      &millimeterSquaredDistanceScalar, &millimeterSquaredDistanceSSE2, &millimeterSquaredDistanceAVX2,
+      &millimeterSquaredDistanceAVX512);
+  return function(a, b, count);
+}
+
+float DepthKernels::addLanes(const float* lane_sums)
+{
+  return (((lane_sums[0] + lane_sums[1]) + (lane_sums[2] + lane_sums[3]))
+      + ((lane_sums[4] + lane_sums[5]) + (lane_sums[6] + lane_sums[7])))
+      + (((lane_sums[8] + lane_sums[9]) + (lane_sums[10] + lane_sums[11]))
+          + ((lane_sums[12] + lane_sums[13]) + (lane_sums[14] + lane_sums[15])));
+}
+
+float DepthKernels::squaredDistanceScalar(const float* a, const float* b, const int& count)
+{
+  float lane_sums[reduction_lanes] = {};
+  return squaredDistanceTail(a, b, 0, count, lane_sums);
+}
+
+float DepthKernels::squaredDistanceTail(const float* a, const float* b, const int& start, const int& count,
+                                        float* lane_sums)
+{
+  for (int i = start; i < count; ++i)
+  {
+    float difference = a[i] - b[i];
+    lane_sums[i % reduction_lanes] += difference == difference ? difference * difference : 0.0f;
+  }
+
+  return addLanes(lane_sums);
+}
+
+DepthKernels::DifferenceStatistics DepthKernels::differenceStatisticsScalar(const float* a, const float* b,
+                                                                            const int& count, const float& below,
+                                                                            const float& outside)
+{
+  float lane_sums[reduction_lanes] = {};
+  float lane_abs_sums[reduction_lanes] = {};
+  DifferenceStatistics statistics;
+  differenceStatisticsTail(a, b, 0, count, below, outside, lane_sums, lane_abs_sums, statistics);
+  return statistics;
+}
+
+void DepthKernels::differenceStatisticsTail(const float* a, const float* b, const int& start, const int& count,
+                                            const float& below, const float& outside, float* lane_sums,
+                                            float* lane_abs_sums, DifferenceStatistics& statistics)
+{
+  for (int i = start; i < count; ++i)
+  {
+    float difference = a[i] - b[i];
+    float abs_difference = std::abs(difference);
+    bool valid = difference == difference;
+
+    lane_sums[i % reduction_lanes] += valid ? difference : 0.0f;
+    lane_abs_sums[i % reduction_lanes] += valid ? abs_difference : 0.0f;
+    if (valid)
+    {
+      statistics.valid_count++;
+      statistics.abs_min = std::min(statistics.abs_min, abs_difference);
+      statistics.abs_max = std::max(statistics.abs_max, abs_difference);
+    }
+
+    // nans fail the comparisons
+    statistics.below_count += difference < below;
+    statistics.outside_count += abs_difference > outside;
+  }
+
+  statistics.sum = addLanes(lane_sums);
+  statistics.abs_sum = addLanes(lane_abs_sums);
+}
+
+void DepthKernels::countNansAndZerosScalar(const float* data, const int& count, int& nan_count, int& zero_count)
+{
+  nan_count = 0;
+  zero_count = 0;
+  for (int i = 0; i < count; ++i)
+  {
+    nan_count += data[i] != data[i];
+    zero_count += data[i] == 0.0f;
+  }
+}
+
+std::int64_t DepthKernels::millimeterSquaredDistanceScalar(const unsigned short* a, const unsigned short* b,
+                                                           const int& count)
+{
+  std::int64_t distance = 0;
+  for (int i = 0; i < count; ++i)
+  {
+    std::int32_t difference = (std::int32_t)a[i] - (std::int32_t)b[i];
+    bool valid = a[i] != 0 && b[i] != 0;
+
+    distance += valid ? (std::int64_t)difference * difference : 0;
+  }
+  return distance;
+}
+
+bool DepthKernels::hasSSE2()
+{
+#ifdef PLANE_CALIBRATION_X86_KERNELS
+  return __builtin_cpu_supports("sse2");
+#else
+  return false;
+#endif
+}
+
+bool DepthKernels::hasSSE41()
+{
+#ifdef PLANE_CALIBRATION_X86_KERNELS
+  return __builtin_cpu_supports("sse4.1");
+#else
+  return false;
+#endif
+}
+
+bool DepthKernels::hasAVX2()
+{
+#ifdef PLANE_CALIBRATION_X86_KERNELS
+  return __builtin_cpu_supports("avx2");
+#else
+  return false;
+#endif
+}
+
+bool DepthKernels::hasAVX512()
+{
+#ifdef PLANE_CALIBRATION_X86_KERNELS
+  return __builtin_cpu_supports("avx512f");
+#else
+  return false;
+#endif
+}
+
+bool DepthKernels::hasF16C()
+{
+#ifdef PLANE_CALIBRATION_X86_KERNELS
+  // the builtin checks the os support of the avx registers, f16c is only in cpuid
+  unsigned int eax, ebx, ecx, edx;
+  if (!__builtin_cpu_supports("avx") || !__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+  {
+    return false;
+  }
+  return (ecx & bit_F16C) != 0;
+#else
+  return false;
+#endif
+}
+
+#ifdef PLANE_CALIBRATION_X86_KERNELS
+
+__attribute__((target("sse4.1")))
+void DepthKernels::millimetersToMetersSSE41(const unsigned short* input, float* output, const int& count,
+                                            const float& max_range)
+{
+  const __m128 scale = _mm_set1_ps(millimeter_to_meter);
+  const __m128 range = _mm_set1_ps(max_range);
+  const __m128 nan = _mm_set1_ps(std::numeric_limits<float>::quiet_NaN());
+  const __m128i zero = _mm_setzero_si128();
+
+  int i = 0;
+  for (; i + 4 <= count; i += 4)
+  {
+    __m128i raw = _mm_cvtepu16_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(input + i)));
+    __m128 depth = _mm_mul_ps(_mm_cvtepi32_ps(raw), scale);
+
+    __m128 invalid = _mm_or_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(raw, zero)), _mm_cmpgt_ps(depth, range));
+    _mm_storeu_ps(output + i, _mm_blendv_ps(depth, nan, invalid));
+  }
+
+  millimetersToMetersScalar(input + i, output + i, count - i, max_range);
+}
+
+__attribute__((target("avx2")))
+void DepthKernels::millimetersToMetersAVX2(const unsigned short* input, float* output, const int& count,
+                                           const float& max_range)
+{
+  const __m256 scale = _mm256_set1_ps(millimeter_to_meter);
+  const __m256 range = _mm256_set1_ps(max_range);
+  const __m256 nan = _mm256_set1_ps(std::numeric_limits<float>::quiet_NaN());
+  const __m256i zero = _mm256_setzero_si256();
+
+  int i = 0;
+  for (; i + 8 <= count; i += 8)
+  {
+    __m256i raw = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(input + i)));
+    __m256 depth = _mm256_mul_ps(_mm256_cvtepi32_ps(raw), scale);
+
+    __m256 invalid = _mm256_or_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(raw, zero)),
+                                  _mm256_cmp_ps(depth, range, _CMP_GT_OQ));
+    _mm256_storeu_ps(output + i, _mm256_blendv_ps(depth, nan, invalid));
+  }
+
+  millimetersToMetersScalar(input + i, output + i, count - i, max_range);
+}
+
+__attribute__((target("avx,f16c")))
+void DepthKernels::halfToFloatF16C(const unsigned short* input, float* output, const int& count)
+{
+  int i = 0;
+  for (; i + 8 <= count; i += 8)
+  {
+    __m128i half = _mm_loadu_si128(reinterpret_cast<const __m128i*>(input + i));
+    _mm256_storeu_ps(output + i, _mm256_cvtph_ps(half));
+  }
+
+  halfToFloatScalar(input + i, output + i, count - i);
+}
+
+__attribute__((target("avx,f16c")))
+void DepthKernels::floatToHalfF16C(const float* input, unsigned short* output, const int& count)
+{
+  int i = 0;
+  for (; i + 8 <= count; i += 8)
+  {
+    __m128i half = _mm256_cvtps_ph(_mm256_loadu_ps(input + i), _MM_FROUND_TO_NEAREST_INT);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(output + i), half);
+  }
+
+  floatToHalfScalar(input + i, output + i, count - i);
+}
+
+__attribute__((target("avx,f16c")))
+float DepthKernels::halfSquaredDistanceF16C(const unsigned short* half, const float* data, const int& count)
+{
+  __m256 sums = _mm256_setzero_ps();
+
+  int i = 0;
+  for (; i + lanes <= count; i += lanes)
+  {
+    __m256 plane = _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(half + i)));
+    __m256 depth = _mm256_loadu_ps(data + i);
+    __m256 difference = _mm256_sub_ps(plane, depth);
+
+    // nan data fails the comparison with itself
+    __m256 valid = _mm256_cmp_ps(depth, depth, _CMP_EQ_OQ);
+    sums = _mm256_add_ps(sums, _mm256_and_ps(_mm256_mul_ps(difference, difference), valid));
+  }
+
+  float lane_sums[lanes];
+  _mm256_storeu_ps(lane_sums, sums);
+  return halfSquaredDistanceTail(half, data, i, count, lane_sums);
+}
+
+// the counts, min and max don't depend on the order, only the sums are kept per lane
+__attribute__((target("sse2")))
+static inline void sumSquaredDifferenceSSE2(const float* a, const float* b, __m128& sums)
+{
+  __m128 difference = _mm_sub_ps(_mm_loadu_ps(a), _mm_loadu_ps(b));
+  __m128 valid = _mm_cmpeq_ps(difference, difference);
+  sums = _mm_add_ps(sums, _mm_and_ps(_mm_mul_ps(difference, difference), valid));
+}
+
+__attribute__((target("sse2")))
+float DepthKernels::squaredDistanceSSE2(const float* a, const float* b, const int& count)
+{
+  __m128 sums_0 = _mm_setzero_ps();
+  __m128 sums_1 = _mm_setzero_ps();
+  __m128 sums_2 = _mm_setzero_ps();
+  __m128 sums_3 = _mm_setzero_ps();
+
+  int i = 0;
+  for (; i + reduction_lanes <= count; i += reduction_lanes)
+  {
+    sumSquaredDifferenceSSE2(a + i, b + i, sums_0);
+    sumSquaredDifferenceSSE2(a + i + 4, b + i + 4, sums_1);
+    sumSquaredDifferenceSSE2(a + i + 8, b + i + 8, sums_2);
+    sumSquaredDifferenceSSE2(a + i + 12, b + i + 12, sums_3);
+  }
+
+  float lane_sums[reduction_lanes];
+  _mm_storeu_ps(lane_sums, sums_0);
+  _mm_storeu_ps(lane_sums + 4, sums_1);
+  _mm_storeu_ps(lane_sums + 8, sums_2);
+  _mm_storeu_ps(lane_sums + 12, sums_3);
+  return squaredDistanceTail(a, b, i, count, lane_sums);
+}
+
+__attribute__((target("avx2")))
+static inline void sumSquaredDifferenceAVX2(const float* a, const float* b, __m256& sums)
+{
+  __m256 difference = _mm256_sub_ps(_mm256_loadu_ps(a), _mm256_loadu_ps(b));
+  __m256 valid = _mm256_cmp_ps(difference, difference, _CMP_EQ_OQ);
+  sums = _mm256_add_ps(sums, _mm256_and_ps(_mm256_mul_ps(difference, difference), valid));
+}
+
+__attribute__((target("avx2")))
+float DepthKernels::squaredDistanceAVX2(const float* a, const float* b, const int& count)
+{
+  __m256 sums_0 = _mm256_setzero_ps();
+  __m256 sums_1 = _mm256_setzero_ps();
+
+  int i = 0;
+  for (; i + reduction_lanes <= count; i += reduction_lanes)
+  {
+    sumSquaredDifferenceAVX2(a + i, b + i, sums_0);
+    sumSquaredDifferenceAVX2(a + i + 8, b + i + 8, sums_1);
+  }
+
+  float lane_sums[reduction_lanes];
+  _mm256_storeu_ps(lane_sums, sums_0);
+  _mm256_storeu_ps(lane_sums + 8, sums_1);
+  return squaredDistanceTail(a, b, i, count, lane_sums);
+}
+
+__attribute__((target("avx512f")))
+float DepthKernels::squaredDistanceAVX512(const float* a, const float* b, const int& count)
+{
+  __m512 sums = _mm512_setzero_ps();
+
+  int i = 0;
+  for (; i + reduction_lanes <= count; i += reduction_lanes)
+  {
+    __m512 difference = _mm512_sub_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i));
+    __mmask16 valid = _mm512_cmp_ps_mask(difference, difference, _CMP_EQ_OQ);
+    // + 0 for nans like the other versions
+    sums = _mm512_add_ps(sums, _mm512_maskz_mul_ps(valid, difference, difference));
+  }
+
+  float lane_sums[reduction_lanes];
+  _mm512_storeu_ps(lane_sums, sums);
+  return squaredDistanceTail(a, b, i, count, lane_sums);
+}
+
+// every lane holds the min / max / counts of its elements
+static void addLaneStatistics(const float* min, const float* max, const int* valid_count, const int* below_count,
+                              const int* outside_count, const int& size,
+                              DepthKernels::DifferenceStatistics& statistics)
+{
+  for (int lane = 0; lane < size; ++lane)
+  {
+    statistics.abs_min = std::min(statistics.abs_min, min[lane]);
+    statistics.abs_max = std::max(statistics.abs_max, max[lane]);
+    statistics.valid_count += valid_count[lane];
+    statistics.below_count += below_count[lane];
+    statistics.outside_count += outside_count[lane];
+  }
+}
+
+class StatisticsSSE2
+{
+public:
+  __attribute__((target("sse2")))
+  StatisticsSSE2(const float& below, const float& outside) :
+      below_(_mm_set1_ps(below)), outside_(_mm_set1_ps(outside)),
+      sign_(_mm_castsi128_ps(_mm_set1_epi32(0x7fffffff))), infinity_(_mm_set1_ps(std::numeric_limits<float>::infinity()))
+  {
+    min_ = infinity_;
+    max_ = _mm_setzero_ps();
+    valid_count_ = _mm_setzero_si128();
+    below_count_ = _mm_setzero_si128();
+    outside_count_ = _mm_setzero_si128();
+  }
+
+  __attribute__((target("sse2")))
+  inline void store(DepthKernels::DifferenceStatistics& statistics) const
+  {
+    float min[4];
+    float max[4];
+    int valid_count[4];
+    int below_count[4];
+    int outside_count[4];
+    _mm_storeu_ps(min, min_);
+    _mm_storeu_ps(max, max_);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(valid_count), valid_count_);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(below_count), below_count_);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(outside_count), outside_count_);
+    addLaneStatistics(min, max, valid_count, below_count, outside_count, 4, statistics);
+  }
+
+  __attribute__((target("sse2")))
+  inline void add(const float* a, const float* b, __m128& sums, __m128& abs_sums)
+  {
+    __m128 difference = _mm_sub_ps(_mm_loadu_ps(a), _mm_loadu_ps(b));
+    __m128 abs_difference = _mm_and_ps(difference, sign_);
+    __m128 valid = _mm_cmpeq_ps(difference, difference);
+
+    sums = _mm_add_ps(sums, _mm_and_ps(difference, valid));
+    abs_sums = _mm_add_ps(abs_sums, _mm_and_ps(abs_difference, valid));
+    min_ = _mm_min_ps(min_, _mm_or_ps(_mm_and_ps(valid, abs_difference), _mm_andnot_ps(valid, infinity_)));
+    max_ = _mm_max_ps(max_, _mm_and_ps(valid, abs_difference));
+
+    // true is -1
+    valid_count_ = _mm_sub_epi32(valid_count_, _mm_castps_si128(valid));
+    below_count_ = _mm_sub_epi32(below_count_, _mm_castps_si128(_mm_cmplt_ps(difference, below_)));
+    outside_count_ = _mm_sub_epi32(outside_count_, _mm_castps_si128(_mm_cmpgt_ps(abs_difference, outside_)));
+  }
+
+  const __m128 below_;
+  const __m128 outside_;
+  const __m128 sign_;
+  const __m128 infinity_;
+  __m128 min_;
+  __m128 max_;
+  __m128i valid_count_;
+  __m128i below_count_;
+  __m128i outside_count_;
+};
+
+__attribute__((target("sse2")))
+DepthKernels::DifferenceStatistics DepthKernels::differenceStatisticsSSE2(const float* a, const float* b,
+                                                                          const int& count, const float& below,
+                                                                          const float& outside)
+{
+  StatisticsSSE2 registers(below, outside);
+  __m128 sums_0 = _mm_setzero_ps();
+  __m128 sums_1 = _mm_setzero_ps();
+  __m128 sums_2 = _mm_setzero_ps();
+  __m128 sums_3 = _mm_setzero_ps();
+  __m128 abs_sums_0 = _mm_setzero_ps();
+  __m128 abs_sums_1 = _mm_setzero_ps();
+  __m128 abs_sums_2 = _mm_setzero_ps();
+  __m128 abs_sums_3 = _mm_setzero_ps();
+
+  int i = 0;
+  for (; i + reduction_lanes <= count; i += reduction_lanes)
+  {
+    registers.add(a + i, b + i, sums_0, abs_sums_0);
+    registers.add(a + i + 4, b + i + 4, sums_1, abs_sums_1);
+    registers.add(a + i + 8, b + i + 8, sums_2, abs_sums_2);
+    registers.add(a + i + 12, b + i + 12, sums_3, abs_sums_3);
+  }
+
+  float lane_sums[reduction_lanes];
+  float lane_abs_sums[reduction_lanes];
+  _mm_storeu_ps(lane_sums, sums_0);
+  _mm_storeu_ps(lane_sums + 4, sums_1);
+  _mm_storeu_ps(lane_sums + 8, sums_2);
+  _mm_storeu_ps(lane_sums + 12, sums_3);
+  _mm_storeu_ps(lane_abs_sums, abs_sums_0);
+  _mm_storeu_ps(lane_abs_sums + 4, abs_sums_1);
+  _mm_storeu_ps(lane_abs_sums + 8, abs_sums_2);
+  _mm_storeu_ps(lane_abs_sums + 12, abs_sums_3);
+
+  DifferenceStatistics statistics;
+  registers.store(statistics);
+  differenceStatisticsTail(a, b, i, count, below, outside, lane_sums, lane_abs_sums, statistics);
+  return statistics;
+}
+
+class StatisticsAVX2
+{
+public:
+  __attribute__((target("avx2")))
+  StatisticsAVX2(const float& below, const float& outside) :
+      below_(_mm256_set1_ps(below)), outside_(_mm256_set1_ps(outside)),
+      sign_(_mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff))),
+      infinity_(_mm256_set1_ps(std::numeric_limits<float>::infinity()))
+  {
+    min_ = infinity_;
+    max_ = _mm256_setzero_ps();
+    valid_count_ = _mm256_setzero_si256();
+    below_count_ = _mm256_setzero_si256();
+    outside_count_ = _mm256_setzero_si256();
+  }
+
+  __attribute__((target("avx2")))
+  inline void store(DepthKernels::DifferenceStatistics& statistics) const
+  {
+    float min[8];
+    float max[8];
+    int valid_count[8];
+    int below_count[8];
+    int outside_count[8];
+    _mm256_storeu_ps(min, min_);
+    _mm256_storeu_ps(max, max_);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(valid_count), valid_count_);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(below_count), below_count_);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(outside_count), outside_count_);
+    addLaneStatistics(min, max, valid_count, below_count, outside_count, 8, statistics);
+  }
+
+  __attribute__((target("avx2")))
+  inline void add(const float* a, const float* b, __m256& sums, __m256& abs_sums)
+  {
+    __m256 difference = _mm256_sub_ps(_mm256_loadu_ps(a), _mm256_loadu_ps(b));
+    __m256 abs_difference = _mm256_and_ps(difference, sign_);
+    __m256 valid = _mm256_cmp_ps(difference, difference, _CMP_EQ_OQ);
+
+    sums = _mm256_add_ps(sums, _mm256_and_ps(difference, valid));
+    abs_sums = _mm256_add_ps(abs_sums, _mm256_and_ps(abs_difference, valid));
+    min_ = _mm256_min_ps(min_, _mm256_blendv_ps(infinity_, abs_difference, valid));
+    max_ = _mm256_max_ps(max_, _mm256_and_ps(valid, abs_difference));
+
+    valid_count_ = _mm256_sub_epi32(valid_count_, _mm256_castps_si256(valid));
+    below_count_ = _mm256_sub_epi32(below_count_,
+                                    _mm256_castps_si256(_mm256_cmp_ps(difference, below_, _CMP_LT_OQ)));
+    outside_count_ = _mm256_sub_epi32(outside_count_,
+                                      _mm256_castps_si256(_mm256_cmp_ps(abs_difference, outside_, _CMP_GT_OQ)));
+  }
+
+  const __m256 below_;
+  const __m256 outside_;
+  const __m256 sign_;
+  const __m256 infinity_;
+  __m256 min_;
+  __m256 max_;
+  __m256i valid_count_;
+  __m256i below_count_;
+  __m256i outside_count_;
+};
+
+__attribute__((target("avx2")))
+DepthKernels::DifferenceStatistics DepthKernels::differenceStatisticsAVX2(const float* a, const float* b,
+                                                                          const int& count, const float& below,
+                                                                          const float& outside)
+{
+  StatisticsAVX2 registers(below, outside);
+  __m256 sums_0 = _mm256_setzero_ps();
+  __m256 sums_1 = _mm256_setzero_ps();
+  __m256 abs_sums_0 = _mm256_setzero_ps();
+  __m256 abs_sums_1 = _mm256_setzero_ps();
+
+  int i = 0;
+  for (; i + reduction_lanes <= count; i += reduction_lanes)
+  {
+    registers.add(a + i, b + i, sums_0, abs_sums_0);
+    registers.add(a + i + 8, b + i + 8, sums_1, abs_sums_1);
+  }
+
+  float lane_sums[reduction_lanes];
+  float lane_abs_sums[reduction_lanes];
+  _mm256_storeu_ps(lane_sums, sums_0);
+  _mm256_storeu_ps(lane_sums + 8, sums_1);
+  _mm256_storeu_ps(lane_abs_sums, abs_sums_0);
+  _mm256_storeu_ps(lane_abs_sums + 8, abs_sums_1);
+
+  DifferenceStatistics statistics;
+  registers.store(statistics);
+  differenceStatisticsTail(a, b, i, count, below, outside, lane_sums, lane_abs_sums, statistics);
+  return statistics;
+}
+
+__attribute__((target("avx512f")))
+DepthKernels::DifferenceStatistics DepthKernels::differenceStatisticsAVX512(const float* a, const float* b,
+                                                                            const int& count, const float& below,
+                                                                            const float& outside)
+{
+  const __m512 below_value = _mm512_set1_ps(below);
+  const __m512 outside_value = _mm512_set1_ps(outside);
+  const __m512i one = _mm512_set1_epi32(1);
+
+  __m512 sums = _mm512_setzero_ps();
+  __m512 abs_sums = _mm512_setzero_ps();
+  __m512 min = _mm512_set1_ps(std::numeric_limits<float>::infinity());
+  __m512 max = _mm512_setzero_ps();
+  __m512i valid_count = _mm512_setzero_si512();
+  __m512i below_count = _mm512_setzero_si512();
+  __m512i outside_count = _mm512_setzero_si512();
+
+  int i = 0;
+  for (; i + reduction_lanes <= count; i += reduction_lanes)
+  {
+    __m512 difference = _mm512_sub_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i));
+    __m512 abs_difference = _mm512_abs_ps(difference);
+    __mmask16 valid = _mm512_cmp_ps_mask(difference, difference, _CMP_EQ_OQ);
+
+    sums = _mm512_add_ps(sums, _mm512_maskz_mov_ps(valid, difference));
+    abs_sums = _mm512_add_ps(abs_sums, _mm512_maskz_mov_ps(valid, abs_difference));
+    min = _mm512_mask_min_ps(min, valid, min, abs_difference);
+    max = _mm512_mask_max_ps(max, valid, max, abs_difference);
+
+    valid_count = _mm512_mask_add_epi32(valid_count, valid, valid_count, one);
+    below_count = _mm512_mask_add_epi32(below_count, _mm512_cmp_ps_mask(difference, below_value, _CMP_LT_OQ),
+                                        below_count, one);
+    outside_count = _mm512_mask_add_epi32(outside_count,
+                                          _mm512_cmp_ps_mask(abs_difference, outside_value, _CMP_GT_OQ),
+                                          outside_count, one);
+  }
+
+  float lane_sums[reduction_lanes];
+  float lane_abs_sums[reduction_lanes];
+  _mm512_storeu_ps(lane_sums, sums);
+  _mm512_storeu_ps(lane_abs_sums, abs_sums);
+
+  float lane_min[reduction_lanes];
+  float lane_max[reduction_lanes];
+  int lane_valid_count[reduction_lanes];
+  int lane_below_count[reduction_lanes];
+  int lane_outside_count[reduction_lanes];
+  _mm512_storeu_ps(lane_min, min);
+  _mm512_storeu_ps(lane_max, max);
+  _mm512_storeu_si512(lane_valid_count, valid_count);
+  _mm512_storeu_si512(lane_below_count, below_count);
+  _mm512_storeu_si512(lane_outside_count, outside_count);
+
+  DifferenceStatistics statistics;
+  addLaneStatistics(lane_min, lane_max, lane_valid_count, lane_below_count, lane_outside_count, reduction_lanes,
+                    statistics);
+  differenceStatisticsTail(a, b, i, count, below, outside, lane_sums, lane_abs_sums, statistics);
+  return statistics;
+}
+
+__attribute__((target("sse2")))
+void DepthKernels::countNansAndZerosSSE2(const float* data, const int& count, int& nan_count, int& zero_count)
+{
+  const __m128 zero = _mm_setzero_ps();
+  __m128i nans = _mm_setzero_si128();
+  __m128i zeros = _mm_setzero_si128();
+
+  int i = 0;
+  for (; i + 4 <= count; i += 4)
+  {
+    __m128 depth = _mm_loadu_ps(data + i);
+    nans = _mm_sub_epi32(nans, _mm_castps_si128(_mm_cmpunord_ps(depth, depth)));
+    zeros = _mm_sub_epi32(zeros, _mm_castps_si128(_mm_cmpeq_ps(depth, zero)));
+  }
+
+  int tail_nans;
+  int tail_zeros;
+  countNansAndZerosScalar(data + i, count - i, tail_nans, tail_zeros);
+
+  int lane_nans[4];
+  int lane_zeros[4];
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(lane_nans), nans);
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(lane_zeros), zeros);
+  nan_count = tail_nans + lane_nans[0] + lane_nans[1] + lane_nans[2] + lane_nans[3];
+  zero_count = tail_zeros + lane_zeros[0] + lane_zeros[1] + lane_zeros[2] + lane_zeros[3];
+}
+
+__attribute__((target("avx2")))
+void DepthKernels::countNansAndZerosAVX2(const float* data, const int& count, int& nan_count, int& zero_count)
+{
+  const __m256 zero = _mm256_setzero_ps();
+  __m256i nans = _mm256_setzero_si256();
+  __m256i zeros = _mm256_setzero_si256();
+
+  int i = 0;
+  for (; i + 8 <= count; i += 8)
+  {
+    __m256 depth = _mm256_loadu_ps(data + i);
+    nans = _mm256_sub_epi32(nans, _mm256_castps_si256(_mm256_cmp_ps(depth, depth, _CMP_UNORD_Q)));
+    zeros = _mm256_sub_epi32(zeros, _mm256_castps_si256(_mm256_cmp_ps(depth, zero, _CMP_EQ_OQ)));
+  }
+
+  countNansAndZerosScalar(data + i, count - i, nan_count, zero_count);
+
+  int lane_nans[8];
+  int lane_zeros[8];
+  _mm256_storeu_si256(reinterpret_cast<__m256i*>(lane_nans), nans);
+  _mm256_storeu_si256(reinterpret_cast<__m256i*>(lane_zeros), zeros);
+  for (int lane = 0; lane < 8; ++lane)
+  {
+    nan_count += lane_nans[lane];
+    zero_count += lane_zeros[lane];
+  }
+}
+
+// |a - b| of 8 pixels as 16 bit, 0 for invalid pixels
+__attribute__((target("sse2")))
+static inline __m128i millimeterDifferenceSSE2(const unsigned short* a, const unsigned short* b)
+{
+  const __m128i zero = _mm_setzero_si128();
+  __m128i a_values = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a));
+  __m128i b_values = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b));
+
+  __m128i difference = _mm_or_si128(_mm_subs_epu16(a_values, b_values), _mm_subs_epu16(b_values, a_values));
+  __m128i invalid = _mm_or_si128(_mm_cmpeq_epi16(a_values, zero), _mm_cmpeq_epi16(b_values, zero));
+  return _mm_andnot_si128(invalid, difference);
+}
+
+// the squares of 4 differences (32 bit lanes) don't fit in 32 bit, so they are made and added up as 64 bit
+__attribute__((target("sse2")))
+static inline void sumMillimeterSquaresSSE2(const __m128i& difference, __m128i& sums)
+{
+  sums = _mm_add_epi64(sums, _mm_mul_epu32(difference, difference));
+  __m128i odd = _mm_srli_epi64(difference, 32);
+  sums = _mm_add_epi64(sums, _mm_mul_epu32(odd, odd));
+}
+
+__attribute__((target("sse2")))
+std::int64_t DepthKernels::millimeterSquaredDistanceSSE2(const unsigned short* a, const unsigned short* b,
+                                                         const int& count)
+{
+  const __m128i zero = _mm_setzero_si128();
+  __m128i sums = _mm_setzero_si128();
+
+  int i = 0;
+  for (; i + 8 <= count; i += 8)
+  {
+    __m128i difference = millimeterDifferenceSSE2(a + i, b + i);
+    sumMillimeterSquaresSSE2(_mm_unpacklo_epi16(difference, zero), sums);
+    sumMillimeterSquaresSSE2(_mm_unpackhi_epi16(difference, zero), sums);
+  }
+
+  std::int64_t lane_sums[2];
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(lane_sums), sums);
+  return lane_sums[0] + lane_sums[1] + millimeterSquaredDistanceScalar(a + i, b + i, count - i);
+}
+
+__attribute__((target("avx2")))
+static inline void sumMillimeterSquaresAVX2(const __m256i& difference, __m256i& sums)
+{
+  sums = _mm256_add_epi64(sums, _mm256_mul_epu32(difference, difference));
+  __m256i odd = _mm256_srli_epi64(difference, 32);
+  sums = _mm256_add_epi64(sums, _mm256_mul_epu32(odd, odd));
+}
+
+__attribute__((target("avx2")))
+std::int64_t DepthKernels::millimeterSquaredDistanceAVX2(const unsigned short* a, const unsigned short* b,
+                                                         const int& count)
+{
+  const __m256i zero = _mm256_setzero_si256();
+  __m256i sums = _mm256_setzero_si256();
+
+  int i = 0;
+  for (; i + 16 <= count; i += 16)
+  {
+    __m256i a_values = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+    __m256i b_values = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i));
+
+    __m256i difference = _mm256_or_si256(_mm256_subs_epu16(a_values, b_values),
+                                         _mm256_subs_epu16(b_values, a_values));
+    __m256i invalid = _mm256_or_si256(_mm256_cmpeq_epi16(a_values, zero), _mm256_cmpeq_epi16(b_values, zero));
+    difference = _mm256_andnot_si256(invalid, difference);
+
+    // the unpacks stay within the 128 bit halves, the order doesn't matter for the integer sum
+    sumMillimeterSquaresAVX2(_mm256_unpacklo_epi16(difference, zero), sums);
+    sumMillimeterSquaresAVX2(_mm256_unpackhi_epi16(difference, zero), sums);
+  }
+
+  std::int64_t lane_sums[4];
+  _mm256_storeu_si256(reinterpret_cast<__m256i*>(lane_sums), sums);
+  return (lane_sums[0] + lane_sums[1]) + (lane_sums[2] + lane_sums[3])
+      + millimeterSquaredDistanceScalar(a + i, b + i, count - i);
+}
+
+// avx512f only has 32 bit integer compares, so the pixels are widened first
+__attribute__((target("avx512f")))
+std::int64_t DepthKernels::millimeterSquaredDistanceAVX512(const unsigned short* a, const unsigned short* b,
+                                                           const int& count)
+{
+  __m512i sums = _mm512_setzero_si512();
+
+  int i = 0;
+  for (; i + 16 <= count; i += 16)
+  {
+    __m512i a_values = _mm512_cvtepu16_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i)));
+    __m512i b_values = _mm512_cvtepu16_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i)));
+
+    __mmask16 valid = _mm512_test_epi32_mask(a_values, a_values) & _mm512_test_epi32_mask(b_values, b_values);
+    __m512i difference = _mm512_maskz_abs_epi32(valid, _mm512_sub_epi32(a_values, b_values));
+
+    sums = _mm512_add_epi64(sums, _mm512_mul_epu32(difference, difference));
+    __m512i odd = _mm512_srli_epi64(difference, 32);
+    sums = _mm512_add_epi64(sums, _mm512_mul_epu32(odd, odd));
+  }
+
+  std::int64_t lane_sums[8];
+  _mm512_storeu_si512(lane_sums, sums);
+  std::int64_t distance = 0;
+  for (int lane = 0; lane < 8; ++lane)
+  {
+    distance += lane_sums[lane];
+  }
+  return distance + millimeterSquaredDistanceScalar(a + i, b + i, count - i);
+}
+
+__attribute__((target("avx512f")))
+void DepthKernels::countNansAndZerosAVX512(const float* data, const int& count, int& nan_count, int& zero_count)
+{
+  const __m512 zero = _mm512_setzero_ps();
+  const __m512i one = _mm512_set1_epi32(1);
+  __m512i nans = _mm512_setzero_si512();
+  __m512i zeros = _mm512_setzero_si512();
+
+  int i = 0;
+  for (; i + 16 <= count; i += 16)
+  {
+    __m512 depth = _mm512_loadu_ps(data + i);
+    nans = _mm512_mask_add_epi32(nans, _mm512_cmp_ps_mask(depth, depth, _CMP_UNORD_Q), nans, one);
+    zeros = _mm512_mask_add_epi32(zeros, _mm512_cmp_ps_mask(depth, zero, _CMP_EQ_OQ), zeros, one);
+  }
+
+  countNansAndZerosScalar(data + i, count - i, nan_count, zero_count);
+
+  int lane_nans[16];
+  int lane_zeros[16];
+  _mm512_storeu_si512(lane_nans, nans);
+  _mm512_storeu_si512(lane_zeros, zeros);
+  for (int lane = 0; lane < 16; ++lane)
+  {
+    nan_count += lane_nans[lane];
+    zero_count += lane_zeros[lane];
+  }
+}
+
+#else
+
+void DepthKernels::halfToFloatF16C(const unsigned short* input, float* output, const int& count)
+{
+  halfToFloatScalar(input, output, count);
+}
+
+void DepthKernels::floatToHalfF16C(const float* input, unsigned short* output, const int& count)
+{
+  floatToHalfScalar(input, output, count);
+}
+
+float DepthKernels::halfSquaredDistanceF16C(const unsigned short* half, const float* data, const int& count)
+{
+  return halfSquaredDistanceScalar(half, data, count);
+}
+
+void DepthKernels::millimetersToMetersSSE41(const unsigned short* input, float* output, const int& count,
+                                            const float& max_range)
+{
+  millimetersToMetersScalar(input, output, count, max_range);
+}
+
+void DepthKernels::millimetersToMetersAVX2(const unsigned short* input, float* output, const int& count,
+                                           const float& max_range)
+{
+  millimetersToMetersScalar(input, output, count, max_range);
+}
+
+float DepthKernels::squaredDistanceSSE2(const float* a, const float* b, const int& count)
+{
+  return squaredDistanceScalar(a, b, count);
+}
+
+float DepthKernels::squaredDistanceAVX2(const float* a, const float* b, const int& count)
+{
+  return squaredDistanceScalar(a, b, count);
+}
+
+float DepthKernels::squaredDistanceAVX512(const float* a, const float* b, const int& count)
+{
+  return squaredDistanceScalar(a, b, count);
+}
+
+DepthKernels::DifferenceStatistics DepthKernels::differenceStatisticsSSE2(const float* a, const float* b,
+                                                                          const int& count, const float& below,
+                                                                          const float& outside)
+{
+  return differenceStatisticsScalar(a, b, count, below, outside);
+}
+
+DepthKernels::DifferenceStatistics DepthKernels::differenceStatisticsAVX2(const float* a, const float* b,
+                                                                          const int& count, const float& below,
+                                                                          const float& outside)
+{
+  return differenceStatisticsScalar(a, b, count, below, outside);
+}
+
+DepthKernels::DifferenceStatistics DepthKernels::differenceStatisticsAVX512(const float* a, const float* b,
+                                                                            const int& count, const float& below,
+                                                                            const float& outside)
+{
+  return differenceStatisticsScalar(a, b, count, below, outside);
+}
+
+void DepthKernels::countNansAndZerosSSE2(const float* data, const int& count, int& nan_count, int& zero_count)
+{
+  countNansAndZerosScalar(data, count, nan_count, zero_count);
+}
+
+void DepthKernels::countNansAndZerosAVX2(const float* data, const int& count, int& nan_count, int& zero_count)
+{
+  countNansAndZerosScalar(data, count, nan_count, zero_count);
+}
+
+void DepthKernels::countNansAndZerosAVX512(const float* data, const int& count, int& nan_count, int& zero_count)
+{
+  countNansAndZerosScalar(data, count, nan_count, zero_count);
+}
+
+std::int64_t DepthKernels::millimeterSquaredDistanceSSE2(const unsigned short* a, const unsigned short* b,
+                                                         const int& count)
+{
+  return millimeterSquaredDistanceScalar(a, b, count);
+}
+
+std::int64_t DepthKernels::millimeterSquaredDistanceAVX2(const unsigned short* a, const unsigned short* b,
+                                                         const int& count)
+{
+  return millimeterSquaredDistanceScalar(a, b, count);
+}
+
+std::int64_t DepthKernels::millimeterSquaredDistanceAVX512(const unsigned short* a, const unsigned short* b,
+                                                           const int& count)
+{
+  return millimeterSquaredDistanceScalar(a, b, count);
+}
+
+#endif
+
+} /* end namespace */
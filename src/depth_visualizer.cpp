@@ -22,11 +22,32 @@ void DepthVisualizer::setCameraModel(const image_geometry::PinholeCameraModel& c
   camera_model_ = camera_model;
 }
 
+void DepthVisualizer::setCameraModel(const CameraModel::Parameters& camera_model_paramaters)
+{
+  sensor_msgs::CameraInfo camera_info;
+  camera_info.width = camera_model_paramaters.width_;
+  camera_info.height = camera_model_paramaters.height_;
+  camera_info.distortion_model = "plumb_bob";
+  camera_info.D.assign(5, 0.0);
+
+  camera_info.K = {camera_model_paramaters.f_x_, 0.0, camera_model_paramaters.center_x_,
+                   0.0, camera_model_paramaters.f_y_, camera_model_paramaters.center_y_,
+                   0.0, 0.0, 1.0};
+  camera_info.R = {1.0, 0.0, 0.0, 0.0, 1.0, 0.0, 0.0, 0.0, 1.0};
+  camera_info.P = {camera_model_paramaters.f_x_, 0.0, camera_model_paramaters.center_x_, 0.0,
+                   0.0, camera_model_paramaters.f_y_, camera_model_paramaters.center_y_, 0.0,
+                   0.0, 0.0, 1.0, 0.0};
+
+  image_geometry::PinholeCameraModel camera_model;
+  camera_model.fromCameraInfo(camera_info);
+  setCameraModel(camera_model);
+}
+
 void DepthVisualizer::publishImage(const std::string& topic, const Eigen::MatrixXf& image_matrix, std::string frame_id)
 {
-  addPublisherIfNotExist<sensor_msgs::Image>(topic);
+  ros::Publisher publisher = addPublisherIfNotExist<sensor_msgs::Image>(topic);
 
-  if (publishers_[topic].getNumSubscribers() == 0)
+  if (publisher.getNumSubscribers() == 0)
   {
     return;
   }
@@ -39,20 +60,20 @@ void DepthVisualizer::publishImage(const std::string& topic, const Eigen::Matrix
 
 void DepthVisualizer::publishImage(const std::string& topic, const sensor_msgs::Image& image_msg)
 {
-  addPublisherIfNotExist<sensor_msgs::Image>(topic);
+  ros::Publisher publisher = addPublisherIfNotExist<sensor_msgs::Image>(topic);
 
-  if (publishers_[topic].getNumSubscribers() > 0)
+  if (publisher.getNumSubscribers() > 0)
   {
-    publishers_[topic].publish(image_msg);
+    publisher.publish(image_msg);
   }
 }
 
 void DepthVisualizer::publishCloud(const std::string& topic, const Eigen::Affine3d& plane_transformation,
                                    const CameraModel::Parameters& camera_model_paramaters, std::string frame_id)
 {
-  addPublisherIfNotExist<sensor_msgs::PointCloud2>(topic);
+  ros::Publisher publisher = addPublisherIfNotExist<sensor_msgs::PointCloud2>(topic);
 
-  if (publishers_[topic].getNumSubscribers() == 0)
+  if (publisher.getNumSubscribers() == 0)
   {
     return;
   }
@@ -67,9 +88,9 @@ void DepthVisualizer::publishCloud(const std::string& topic, const Eigen::Affine
 
 void DepthVisualizer::publishCloud(const std::string& topic, const Eigen::MatrixXf& image_matrix, std::string frame_id)
 {
-  addPublisherIfNotExist<sensor_msgs::PointCloud2>(topic);
+  ros::Publisher publisher = addPublisherIfNotExist<sensor_msgs::PointCloud2>(topic);
 
-  if (publishers_[topic].getNumSubscribers() == 0)
+  if (publisher.getNumSubscribers() == 0)
   {
     return;
   }
@@ -82,38 +103,41 @@ void DepthVisualizer::publishCloud(const std::string& topic, const Eigen::Matrix
 
 void DepthVisualizer::publishCloud(const std::string& topic, const sensor_msgs::Image& image_msg)
 {
-  addPublisherIfNotExist<sensor_msgs::PointCloud2>(topic);
+  ros::Publisher publisher = addPublisherIfNotExist<sensor_msgs::PointCloud2>(topic);
 
-  if (publishers_[topic].getNumSubscribers() > 0)
+  if (publisher.getNumSubscribers() > 0)
   {
     sensor_msgs::PointCloud2Ptr point_cloud_msg_ptr = imageMsgToPointCloud(image_msg);
-    publishers_[topic].publish(point_cloud_msg_ptr);
+    publisher.publish(point_cloud_msg_ptr);
   }
 }
 
 void DepthVisualizer::publishDouble(const std::string& topic, const double& value)
 {
-  addPublisherIfNotExist<std_msgs::Float32>(topic);
+  ros::Publisher publisher = addPublisherIfNotExist<std_msgs::Float32>(topic);
 
-  if (publishers_[topic].getNumSubscribers() > 0)
+  if (publisher.getNumSubscribers() > 0)
   {
     std_msgs::Float32 msg;
     msg.data = value;
-    publishers_[topic].publish(msg);
+    publisher.publish(msg);
   }
 }
 
 template<typename MsgType>
-void DepthVisualizer::addPublisherIfNotExist(const std::string& topic)
+ros::Publisher DepthVisualizer::addPublisherIfNotExist(const std::string& topic)
 {
+  // the calibration stages publish from their own threads
+  std::lock_guard<std::mutex> lock(publishers_mutex_);
   auto publisher_match = publishers_.find(topic);
   bool publisher_exists_already = publisher_match != publishers_.end();
 
   if (!publisher_exists_already)
   {
-    publishers_.emplace(topic, node_handle_.advertise<MsgType>(topic, 1));
-    return;
+    publisher_match = publishers_.emplace(topic, node_handle_.advertise<MsgType>(topic, 1)).first;
   }
+
+  return publisher_match->second;
 }
 
 sensor_msgs::PointCloud2Ptr DepthVisualizer::imageMsgToPointCloud(const sensor_msgs::Image& image_msg)
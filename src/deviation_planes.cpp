@@ -1,8 +1,13 @@
 #include "plane_calibration/deviation_planes.hpp"
 
+#include <cstdint>
 #include <iostream>
 #include <ecl/geometry/angle.hpp>
 
+#include "plane_calibration/depth_kernels.hpp"
+#include "plane_calibration/fixed_size_kernels.hpp"
+#include "plane_calibration/row_pool.hpp"
+
 namespace plane_calibration
 {
 DeviationPlanes::DeviationPlanes(const PlaneToDepthImage& plane_to_depth, const VisualizerInterfacePtr& depth_visualizer) :
@@ -10,7 +15,9 @@ DeviationPlanes::DeviationPlanes(const PlaneToDepthImage& plane_to_depth, const
 {
   planes_.resize(4);
   transform_.resize(4);
+  plane_coefficients_.setZero();
   deviation_ = 0.0;
+  kernel_threads_ = 1;
   depth_visualizer_ = depth_visualizer;
 }
 
@@ -23,6 +30,7 @@ void DeviationPlanes::init(const CalibrationParameters::Parameters& parameters)
 void DeviationPlanes::update(const CalibrationParameters::Parameters& parameters, const bool& use_max_deviation)
 {
   deviation_ = use_max_deviation ? parameters.max_deviation_ : parameters.deviation_;
+  kernel_threads_ = parameters.kernel_threads_;
 
   Eigen::Translation3d translation = Eigen::Translation3d(parameters.ground_plane_offset_);
 
@@ -39,12 +47,19 @@ void DeviationPlanes::update(const CalibrationParameters::Parameters& parameters
 
   for (int i = 0; i < transform_.size(); ++i)
   {
-    planes_[i] = plane_to_depth_.convert(transform_[i]);
+    plane_to_depth_.convert(transform_[i], planes_[i]);
+    plane_coefficients_.col(i) = PlaneToDepthImage::planeCoefficients(transform_[i]);
+  }
+
+  millimeter_planes_.resize(parameters.millimeter_depth_ ? planes_.size() : 0);
+  for (std::size_t i = 0; i < millimeter_planes_.size(); ++i)
+  {
+    PlaneToDepthImage::quantize(planes_[i], millimeter_planes_[i]);
   }
 
   bool matrix_has_nans = false;
-  double x_distance = getDistance(xPositive(), xNegative(), matrix_has_nans);
-  double y_distance = getDistance(yPositive(), yNegative(), matrix_has_nans);
+  double x_distance = getDistance(xPositive(), xNegative(), matrix_has_nans, kernel_threads_);
+  double y_distance = getDistance(yPositive(), yNegative(), matrix_has_nans, kernel_threads_);
 
   double x_magic_multiplier = deviation_ / x_distance;
   double y_magic_multiplier = deviation_ / y_distance;
@@ -52,10 +67,40 @@ void DeviationPlanes::update(const CalibrationParameters::Parameters& parameters
   magic_multipliers_ = std::make_pair(x_magic_multiplier, y_magic_multiplier);
 }
 
-std::pair<double, double> DeviationPlanes::estimateAngles(const Eigen::MatrixXf& plane, const bool& debug)
+std::size_t DeviationPlanes::bytes() const
+{
+  std::size_t bytes = 0;
+  for (const DepthMatrix& plane : planes_)
+  {
+    bytes += plane.size() * sizeof(float);
+  }
+
+  for (const MillimeterDepthMatrix& plane : millimeter_planes_)
+  {
+    bytes += plane.size() * sizeof(unsigned short);
+  }
+
+  return bytes;
+}
+
+std::pair<double, double> DeviationPlanes::estimateAngles(const DepthConstRef& plane, const bool& debug)
+{
+  return estimateAnglesFromDistanceDiffs(getDistanceDiffs(plane, debug), debug);
+}
+
+std::pair<double, double> DeviationPlanes::estimateAngles(const MillimeterDepthConstRef& plane, const bool& debug)
 {
-  std::pair<double, double> distance_diffs = getDistanceDiffs(plane, debug);
+  return estimateAnglesFromDistanceDiffs(getDistanceDiffs(plane, debug), debug);
+}
 
+std::pair<double, double> DeviationPlanes::estimateAngles(const ValidPixels& pixels, const bool& debug)
+{
+  return estimateAnglesFromDistanceDiffs(getDistanceDiffs(pixels, debug), debug);
+}
+
+std::pair<double, double> DeviationPlanes::estimateAnglesFromDistanceDiffs(
+    const std::pair<double, double>& distance_diffs, const bool& debug)
+{
   double px_estimation = magic_multipliers_.first * distance_diffs.first;
   double py_estimation = magic_multipliers_.second * distance_diffs.second;
 
@@ -77,9 +122,13 @@ std::pair<double, double> DeviationPlanes::estimateAngles(const Eigen::MatrixXf&
   return std::make_pair(px_estimation, py_estimation);
 }
 
-std::pair<double, double> DeviationPlanes::getDistanceDiffs(const Eigen::MatrixXf& plane, const bool& debug)
+std::pair<double, double> DeviationPlanes::getDistanceDiffs(const DepthConstRef& plane, const bool& debug)
 {
-  std::vector<double> distances = getDistances(planes_, plane);
+  // one pass over the data for all four planes, the plane depths are calculated on the fly
+  const PlaneToDepthImage::XYMultipliers& xy_multipliers = plane_to_depth_.getXYMultipliers();
+  Eigen::Vector4d distances = FixedSizeKernels::planeSquaredDistances(
+      FixedSizeKernels::select(plane.rows(), plane.cols()), plane_coefficients_, xy_multipliers.first,
+      xy_multipliers.second, plane, kernel_threads_);
 
   if (debug)
   {
@@ -100,32 +149,215 @@ std::pair<double, double> DeviationPlanes::getDistanceDiffs(const Eigen::MatrixX
   return std::make_pair(x_diff, y_diff);
 }
 
-std::vector<double> DeviationPlanes::getDistances(const std::vector<Eigen::MatrixXf>& from, const Eigen::MatrixXf& to)
+std::pair<double, double> DeviationPlanes::getDistanceDiffs(const MillimeterDepthConstRef& plane, const bool& debug)
 {
-  std::vector<double> distances;
-  for (int i = 0; i < from.size(); ++i)
+  Eigen::Vector4d distances = getDistances(millimeter_planes_, plane, kernel_threads_);
+
+  if (debug)
   {
-    bool matrix_has_nans = true;
-    distances.push_back(getDistance(from[i], to, matrix_has_nans));
+    for (int i = 0; i < distances.size(); ++i)
+    {
+      std::cout << "DeviationPlanes/getDistanceDiffs: plane distances: " << i << ": " << distances[i] << std::endl;
+    }
   }
-  return distances;
+
+  double x_diff = distances[indexXNegative()] - distances[indexXPositive()];
+  double y_diff = distances[indexYNegative()] - distances[indexYPositive()];
+
+  return std::make_pair(x_diff, y_diff);
 }
 
-double DeviationPlanes::getDistance(const Eigen::MatrixXf& from, const Eigen::MatrixXf& to, const bool& remove_nans)
+std::pair<double, double> DeviationPlanes::getDistanceDiffs(const ValidPixels& pixels, const bool& debug)
 {
-  Eigen::MatrixXf difference = (to - from).cwiseAbs2();
+  Eigen::Vector4d distances = getPlaneDistances(plane_coefficients_, pixels, kernel_threads_);
+
+  if (debug)
+  {
+    for (int i = 0; i < distances.size(); ++i)
+    {
+      std::cout << "DeviationPlanes/getDistanceDiffs: plane distances: " << i << ": " << distances[i] << std::endl;
+    }
+  }
 
+  double x_diff = distances[indexXNegative()] - distances[indexXPositive()];
+  double y_diff = distances[indexYNegative()] - distances[indexYPositive()];
+
+  return std::make_pair(x_diff, y_diff);
+}
+
+Eigen::Vector4d DeviationPlanes::getDistances(const std::vector<MillimeterDepthMatrix>& from,
+                                              const MillimeterDepthConstRef& to, const int& threads)
+{
+  eigen_assert(from.size() == 4);
+
+  Eigen::Vector4d distances;
+  for (int i = 0; i < distances.size(); ++i)
+  {
+    distances[i] = getDistance(from[i], to, threads);
+  }
+  return distances;
+}
+
+double DeviationPlanes::getDistance(const DepthConstRef& from, const DepthConstRef& to, const bool& remove_nans,
+                                    const int& threads)
+{
   if (remove_nans)
   {
-    //TODO optimize this, so we only have to do it once for angle estimation
-    difference = difference.unaryExpr([](float v)
-    { return std::isnan(v) ? 0.0f : v;});
+    // float per row, double over the rows
+    return RowPool::sumRows(to.rows(), threads, 0.0,
+                            [&](const int& begin_row, const int& end_row, double* row_distances)
+    {
+      for (int row = begin_row; row < end_row; ++row)
+      {
+        row_distances[row - begin_row] = DepthKernels::squaredDistance(to.row(row).data(), from.row(row).data(),
+                                                                       to.cols());
+      }
+    });
   }
 
-  double distance = difference.sum();
+  // summed on the expression, no temporary image
+  double distance = (to - from).cwiseAbs2().sum();
+  return distance;
+}
+
+double DeviationPlanes::getDistance(const MillimeterDepthConstRef& from, const MillimeterDepthConstRef& to,
+                                    const int& threads)
+{
+  int64_t distance = RowPool::sumRows(to.rows(), threads, (int64_t)0,
+                                      [&](const int& begin_row, const int& end_row, int64_t* row_distances)
+  {
+    for (int row = begin_row; row < end_row; ++row)
+    {
+      row_distances[row - begin_row] = DepthKernels::millimeterSquaredDistance(to.row(row).data(),
+                                                                               from.row(row).data(), to.cols());
+    }
+  });
+
+  // [mm^2] -> [m^2], so the multipliers from the float planes stay usable
+  return distance * 1e-6;
+}
+
+double DeviationPlanes::getPlaneDistance(const Eigen::Vector4f& plane_coeffs, const ValidPixels& to,
+                                         const int& threads)
+{
+  const float minus_d = -plane_coeffs(3);
+
+  // all pixels are valid, so no nan checks and the whole expression vectorizes
+  return to.sum([&](const int& start, const int& length)
+  {
+    ValidPixels::Values depth = to.depth(start, length);
+    ValidPixels::Values x = to.xMultiplier(start, length);
+    ValidPixels::Values y = to.yMultiplier(start, length);
+
+    // same arithmetic as PlaneToDepthImage::convert
+    return (depth.array() - minus_d / (plane_coeffs(0) * x.array() + (plane_coeffs(1) * y.array() + plane_coeffs(2))))
+        .square().sum();
+  }, threads);
+}
+
+Eigen::Vector4d DeviationPlanes::getPlaneDistances(const Eigen::Matrix4f& plane_coeffs, const ValidPixels& to,
+                                                   const int& threads)
+{
+  const Eigen::Array4f minus_d = -plane_coeffs.row(3).transpose().array();
+
+  return to.sums(Eigen::Vector4d::Zero().eval(), [&](const int& start, const int& length)
+  {
+    ValidPixels::Values depth = to.depth(start, length);
+    ValidPixels::Values x = to.xMultiplier(start, length);
+    ValidPixels::Values y = to.yMultiplier(start, length);
+
+    // a block is read from memory once and stays in the cache for all four planes
+    Eigen::Vector4d distances;
+    for (int plane = 0; plane < 4; ++plane)
+    {
+      distances(plane) = (depth.array() - minus_d(plane) / (plane_coeffs(0, plane) * x.array()
+          + (plane_coeffs(1, plane) * y.array() + plane_coeffs(2, plane)))).square().sum();
+    }
+    return distances;
+  }, threads);
+}
+
+double DeviationPlanes::getDistance(const DepthConstRef& from, const ValidPixels& to, const int& threads)
+{
+  ValidPixels::Indices u = to.u();
+  ValidPixels::Indices v = to.v();
+  ValidPixels::Values depth = to.depth();
+
+  return to.sum([&](const int& start, const int& length)
+  {
+    double distance = 0.0;
+    for (int i = start; i < start + length; ++i)
+    {
+      float difference = depth[i] - from(v[i], u[i]);
+      distance += difference == difference ? difference * difference : 0.0f;
+    }
+    return distance;
+  }, threads);
+}
+
+double DeviationPlanes::getDistance(const HalfDepthConstRef& from, const DepthConstRef& to, const int& threads)
+{
+  // float per row, double over the rows
+  return RowPool::sumRows(to.rows(), threads, 0.0,
+                          [&](const int& begin_row, const int& end_row, double* row_distances)
+  {
+    for (int row = begin_row; row < end_row; ++row)
+    {
+      row_distances[row - begin_row] = DepthKernels::halfSquaredDistance(
+          reinterpret_cast<const unsigned short*>(from.row(row).data()), to.row(row).data(), to.cols());
+    }
+  });
+}
+
+double DeviationPlanes::getDistance(const HalfDepthConstRef& from, const HalfDepthConstRef& to, const int& threads)
+{
+  return RowPool::sumRows(to.rows(), threads, 0.0,
+                          [&](const int& begin_row, const int& end_row, double* row_distances)
+  {
+    Eigen::RowVectorXf to_row(to.cols());
+    for (int row = begin_row; row < end_row; ++row)
+    {
+      DepthKernels::halfToFloat(reinterpret_cast<const unsigned short*>(to.row(row).data()), to_row.data(), to.cols());
+      row_distances[row - begin_row] = DepthKernels::halfSquaredDistance(
+          reinterpret_cast<const unsigned short*>(from.row(row).data()), to_row.data(), to.cols());
+    }
+  });
+}
+
+double DeviationPlanes::getDistance(const HalfDepthConstRef& from, const HalfDepthConstRef& to,
+                                    Eigen::Ref<Eigen::RowVectorXf> to_row)
+{
+  eigen_assert(to_row.size() == to.cols());
+
+  // float per row, double over the rows like the threaded version
+  double distance = 0.0;
+  for (int row = 0; row < to.rows(); ++row)
+  {
+    DepthKernels::halfToFloat(reinterpret_cast<const unsigned short*>(to.row(row).data()), to_row.data(), to.cols());
+    distance += DepthKernels::halfSquaredDistance(reinterpret_cast<const unsigned short*>(from.row(row).data()),
+                                                  to_row.data(), to.cols());
+  }
   return distance;
 }
 
+double DeviationPlanes::getDistance(const HalfDepthConstRef& from, const ValidPixels& to, const int& threads)
+{
+  ValidPixels::Indices u = to.u();
+  ValidPixels::Indices v = to.v();
+  ValidPixels::Values depth = to.depth();
+
+  return to.sum([&](const int& start, const int& length)
+  {
+    double distance = 0.0;
+    for (int i = start; i < start + length; ++i)
+    {
+      float difference = depth[i] - static_cast<float>(from(v[i], u[i]));
+      distance += difference == difference ? difference * difference : 0.0f;
+    }
+    return distance;
+  }, threads);
+}
+
 double DeviationPlanes::getDeviation()
 {
   return deviation_;
@@ -136,22 +368,22 @@ std::pair<double, double> DeviationPlanes::getMultipliers()
   return magic_multipliers_;
 }
 
-Eigen::MatrixXf DeviationPlanes::xPositive()
+const DepthMatrix& DeviationPlanes::xPositive()
 {
   return planes_[indexXPositive()];
 }
 
-Eigen::MatrixXf DeviationPlanes::xNegative()
+const DepthMatrix& DeviationPlanes::xNegative()
 {
   return planes_[indexXNegative()];
 }
 
-Eigen::MatrixXf DeviationPlanes::yPositive()
+const DepthMatrix& DeviationPlanes::yPositive()
 {
   return planes_[indexYPositive()];
 }
 
-Eigen::MatrixXf DeviationPlanes::yNegative()
+const DepthMatrix& DeviationPlanes::yNegative()
 {
   return planes_[indexYNegative()];
 }
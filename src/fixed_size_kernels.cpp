@@ -0,0 +1,300 @@
+#include "plane_calibration/fixed_size_kernels.hpp"
+
+#include <algorithm>
+#include <limits>
+
+#include "plane_calibration/row_pool.hpp"
+
+namespace plane_calibration
+{
+
+// read rows can come from msg buffers (unaligned), written rows are from our own (aligned) matrices
+template<typename Scalar, int Cols>
+struct RowMaps
+{
+  typedef Eigen::Map<const Eigen::Array<Scalar, 1, Cols> > Input;
+  typedef Eigen::Map<Eigen::Array<Scalar, 1, Cols>, Cols == Eigen::Dynamic ? Eigen::Unaligned : Eigen::Aligned16>
+      Output;
+};
+
+const int FixedSizeKernels::dynamic_block_cols;
+
+FixedSizeKernels::Resolution FixedSizeKernels::select(const CameraModel::Parameters& camera_model_paramaters)
+{
+  return select(camera_model_paramaters.height_, camera_model_paramaters.width_);
+}
+
+FixedSizeKernels::Resolution FixedSizeKernels::select(const int& rows, const int& cols)
+{
+  if (rows == 480 && cols == 640)
+  {
+    return VGA_RESOLUTION;
+  }
+
+  if (rows == 240 && cols == 320)
+  {
+    return QVGA_RESOLUTION;
+  }
+
+  return DYNAMIC_RESOLUTION;
+}
+
+FixedSizeKernels::Resolution FixedSizeKernels::check(const Resolution& resolution, const int& rows, const int& cols)
+{
+  // a wrong resolution would read out of bounds, so better safe than sorry
+  return select(rows, cols) == resolution ? resolution : DYNAMIC_RESOLUTION;
+}
+
+void FixedSizeKernels::planeDepth(const Resolution& resolution, const Eigen::Vector4f& plane_coeffs,
+                                  const Eigen::RowVectorXf& x_multiplier, const Eigen::VectorXf& y_multiplier,
+                                  DepthMatrix& out_depth)
+{
+  switch (check(resolution, y_multiplier.size(), x_multiplier.size()))
+  {
+    case VGA_RESOLUTION:
+      planeDepth_<480, 640>(plane_coeffs, x_multiplier, y_multiplier, out_depth);
+      break;
+    case QVGA_RESOLUTION:
+      planeDepth_<240, 320>(plane_coeffs, x_multiplier, y_multiplier, out_depth);
+      break;
+    default:
+      planeDepth_<Eigen::Dynamic, Eigen::Dynamic>(plane_coeffs, x_multiplier, y_multiplier, out_depth);
+  }
+}
+
+double FixedSizeKernels::squaredDistance(const Resolution& resolution, const DepthConstRef& from,
+                                         const DepthConstRef& to, const int& threads)
+{
+  switch (check(resolution, to.rows(), to.cols()))
+  {
+    case VGA_RESOLUTION:
+      return squaredDistance_<480, 640>(from, to, threads);
+    case QVGA_RESOLUTION:
+      return squaredDistance_<240, 320>(from, to, threads);
+    default:
+      return squaredDistance_<Eigen::Dynamic, Eigen::Dynamic>(from, to, threads);
+  }
+}
+
+Eigen::Vector4d FixedSizeKernels::planeSquaredDistances(const Resolution& resolution,
+                                                        const Eigen::Matrix4f& plane_coeffs,
+                                                        const Eigen::RowVectorXf& x_multiplier,
+                                                        const Eigen::VectorXf& y_multiplier,
+                                                        const DepthConstRef& depth, const int& threads)
+{
+  eigen_assert(x_multiplier.size() == depth.cols() && y_multiplier.size() == depth.rows());
+
+  switch (check(resolution, depth.rows(), depth.cols()))
+  {
+    case VGA_RESOLUTION:
+      return planeSquaredDistances_<480, 640>(plane_coeffs, x_multiplier, y_multiplier, depth, threads);
+    case QVGA_RESOLUTION:
+      return planeSquaredDistances_<240, 320>(plane_coeffs, x_multiplier, y_multiplier, depth, threads);
+    default:
+      return dynamicPlaneSquaredDistances_(plane_coeffs, x_multiplier, y_multiplier, depth, threads);
+  }
+}
+
+Eigen::Vector4d FixedSizeKernels::dynamicPlaneSquaredDistances_(const Eigen::Matrix4f& plane_coeffs,
+                                                                const Eigen::RowVectorXf& x_multiplier,
+                                                                const Eigen::VectorXf& y_multiplier,
+                                                                const DepthConstRef& depth, const int& threads)
+{
+  const int cols = depth.cols();
+  const Eigen::Array4f minus_d = -plane_coeffs.row(3).transpose().array();
+
+  return RowPool::sumRows(depth.rows(), threads, Eigen::Vector4d::Zero().eval(),
+                          [&](const int& begin_row, const int& end_row, Eigen::Vector4d* row_distances)
+  {
+    // fixed maximum size, lives on the stack
+    Eigen::Array<float, 1, Eigen::Dynamic, Eigen::RowMajor, 1, dynamic_block_cols> plane_block;
+
+    for (int row = begin_row; row < end_row; ++row)
+    {
+      // float per row like the fixed size version, rows up to dynamic_block_cols are one block
+      Eigen::Array4f row_distance = Eigen::Array4f::Zero();
+
+      for (int start = 0; start < cols; start += dynamic_block_cols)
+      {
+        const int length = std::min(dynamic_block_cols, cols - start);
+        RowMaps<float, Eigen::Dynamic>::Input depth_block(depth.row(row).data() + start, length);
+        RowMaps<float, Eigen::Dynamic>::Input x_block(x_multiplier.data() + start, length);
+
+        for (int plane = 0; plane < 4; ++plane)
+        {
+          float y = plane_coeffs(1, plane) * y_multiplier(row) + plane_coeffs(2, plane);
+          plane_block = minus_d(plane) / (plane_coeffs(0, plane) * x_block + y);
+
+          auto difference = (depth_block - plane_block).square();
+          row_distance(plane) += (difference == difference).select(difference, 0.0f).sum();
+        }
+      }
+
+      row_distances[row - begin_row] = row_distance.cast<double>().matrix();
+    }
+  });
+}
+
+void FixedSizeKernels::filter(const Resolution& resolution, const DepthConstRef& input,
+                              const DepthConstRef& min_plane, const DepthConstRef& max_plane,
+                              DepthMatrix& out_filtered, const int& threads)
+{
+  // the rows are walked with raw maps of the input width
+  eigen_assert(min_plane.rows() == input.rows() && min_plane.cols() == input.cols());
+  eigen_assert(max_plane.rows() == input.rows() && max_plane.cols() == input.cols());
+
+  switch (check(resolution, input.rows(), input.cols()))
+  {
+    case VGA_RESOLUTION:
+      filter_<480, 640>(input, min_plane, max_plane, out_filtered, threads);
+      break;
+    case QVGA_RESOLUTION:
+      filter_<240, 320>(input, min_plane, max_plane, out_filtered, threads);
+      break;
+    default:
+      filter_<Eigen::Dynamic, Eigen::Dynamic>(input, min_plane, max_plane, out_filtered, threads);
+  }
+}
+
+int FixedSizeKernels::difference(const Resolution& resolution, const DepthConstRef& plane, const DepthConstRef& data,
+                                 DepthMatrix& out_difference, const int& threads)
+{
+  eigen_assert(plane.rows() == data.rows() && plane.cols() == data.cols());
+
+  switch (check(resolution, data.rows(), data.cols()))
+  {
+    case VGA_RESOLUTION:
+      return difference_<480, 640>(plane, data, out_difference, threads);
+    case QVGA_RESOLUTION:
+      return difference_<240, 320>(plane, data, out_difference, threads);
+    default:
+      return difference_<Eigen::Dynamic, Eigen::Dynamic>(plane, data, out_difference, threads);
+  }
+}
+
+template<int Rows, int Cols>
+void FixedSizeKernels::planeDepth_(const Eigen::Vector4f& plane_coeffs, const Eigen::RowVectorXf& x_multiplier,
+                                   const Eigen::VectorXf& y_multiplier, DepthMatrix& out_depth)
+{
+  const int rows = Rows == Eigen::Dynamic ? y_multiplier.size() : Rows;
+  const int cols = Cols == Eigen::Dynamic ? x_multiplier.size() : Cols;
+  out_depth.resize(rows, cols);
+
+  // a * x is the same for every row, b * y + c the same for the whole row
+  Eigen::Array<float, 1, Cols> x = plane_coeffs(0) * x_multiplier.array();
+  const float minus_d = -plane_coeffs(3);
+
+  for (int row = 0; row < rows; ++row)
+  {
+    float y = plane_coeffs(1) * y_multiplier(row) + plane_coeffs(2);
+    typename RowMaps<float, Cols>::Output out_row(out_depth.row(row).data(), cols);
+    out_row = minus_d / (x + y);
+  }
+}
+
+template<int Rows, int Cols>
+double FixedSizeKernels::squaredDistance_(const DepthConstRef& from, const DepthConstRef& to, const int& threads)
+{
+  const int rows = Rows == Eigen::Dynamic ? to.rows() : Rows;
+  const int cols = Cols == Eigen::Dynamic ? to.cols() : Cols;
+
+  // float per row, double over the rows
+  return RowPool::sumRows(rows, threads, 0.0, [&](const int& begin_row, const int& end_row, double* row_distances)
+  {
+    for (int row = begin_row; row < end_row; ++row)
+    {
+      typename RowMaps<float, Cols>::Input from_row(from.row(row).data(), cols);
+      typename RowMaps<float, Cols>::Input to_row(to.row(row).data(), cols);
+
+      // nan == nan gives false, stays an expression so the dynamic version doesn't allocate per row
+      auto difference = (to_row - from_row).square();
+      row_distances[row - begin_row] = (difference == difference).select(difference, 0.0f).sum();
+    }
+  });
+}
+
+template<int Rows, int Cols>
+Eigen::Vector4d FixedSizeKernels::planeSquaredDistances_(const Eigen::Matrix4f& plane_coeffs,
+                                                         const Eigen::RowVectorXf& x_multiplier,
+                                                         const Eigen::VectorXf& y_multiplier,
+                                                         const DepthConstRef& depth, const int& threads)
+{
+  const int rows = Rows == Eigen::Dynamic ? depth.rows() : Rows;
+  const int cols = Cols == Eigen::Dynamic ? depth.cols() : Cols;
+
+  // a * x per plane, same plane depths as planeDepth_
+  Eigen::Array<float, 4, Cols, Eigen::RowMajor> x = (plane_coeffs.row(0).transpose() * x_multiplier).array();
+  const Eigen::Array4f minus_d = -plane_coeffs.row(3).transpose().array();
+
+  return RowPool::sumRows(rows, threads, Eigen::Vector4d::Zero().eval(),
+                          [&](const int& begin_row, const int& end_row, Eigen::Vector4d* row_distances)
+  {
+    // one row of plane depth, the division is too expensive to be evaluated twice in the nan check below
+    Eigen::Array<float, 1, Cols> plane_row(cols);
+
+    for (int row = begin_row; row < end_row; ++row)
+    {
+      // the depth row stays in the cache for all four planes
+      typename RowMaps<float, Cols>::Input depth_row(depth.row(row).data(), cols);
+
+      for (int plane = 0; plane < 4; ++plane)
+      {
+        float y = plane_coeffs(1, plane) * y_multiplier(row) + plane_coeffs(2, plane);
+        plane_row = minus_d(plane) / (x.row(plane) + y);
+
+        auto difference = (depth_row - plane_row).square();
+        row_distances[row - begin_row](plane) = (difference == difference).select(difference, 0.0f).sum();
+      }
+    }
+  });
+}
+
+template<int Rows, int Cols>
+void FixedSizeKernels::filter_(const DepthConstRef& input, const DepthConstRef& min_plane,
+                               const DepthConstRef& max_plane, DepthMatrix& out_filtered, const int& threads)
+{
+  const int rows = Rows == Eigen::Dynamic ? input.rows() : Rows;
+  const int cols = Cols == Eigen::Dynamic ? input.cols() : Cols;
+  out_filtered.resize(rows, cols);
+
+  const float nan = std::numeric_limits<float>::quiet_NaN();
+
+  RowPool::forRows(rows, threads, [&](const int& begin_row, const int& end_row)
+  {
+    for (int row = begin_row; row < end_row; ++row)
+    {
+      typename RowMaps<float, Cols>::Input input_row(input.row(row).data(), cols);
+      typename RowMaps<float, Cols>::Input min_row(min_plane.row(row).data(), cols);
+      typename RowMaps<float, Cols>::Input max_row(max_plane.row(row).data(), cols);
+      typename RowMaps<float, Cols>::Output out_row(out_filtered.row(row).data(), cols);
+
+      // nans fail the comparisons, zeros are no valid depth
+      out_row = (input_row >= min_row && input_row <= max_row && input_row != 0.0f).select(input_row, nan);
+    }
+  });
+}
+
+template<int Rows, int Cols>
+int FixedSizeKernels::difference_(const DepthConstRef& plane, const DepthConstRef& data,
+                                  DepthMatrix& out_difference, const int& threads)
+{
+  const int rows = Rows == Eigen::Dynamic ? data.rows() : Rows;
+  const int cols = Cols == Eigen::Dynamic ? data.cols() : Cols;
+  out_difference.resize(rows, cols);
+
+  return RowPool::sumRows(rows, threads, 0, [&](const int& begin_row, const int& end_row, int* row_counts)
+  {
+    for (int row = begin_row; row < end_row; ++row)
+    {
+      typename RowMaps<float, Cols>::Input plane_row(plane.row(row).data(), cols);
+      typename RowMaps<float, Cols>::Input data_row(data.row(row).data(), cols);
+      typename RowMaps<float, Cols>::Output out_row(out_difference.row(row).data(), cols);
+
+      out_row = plane_row - data_row;
+      row_counts[row - begin_row] = (out_row == out_row).count();
+      out_row = (out_row == out_row).select(out_row, 0.0f);
+    }
+  });
+}
+
+} /* end namespace */
@@ -0,0 +1,47 @@
+#include "plane_calibration/frame_workspace.hpp"
+
+namespace plane_calibration
+{
+
+FrameWorkspace::FrameWorkspace() :
+    rows_(0), cols_(0)
+{
+}
+
+FrameWorkspace::FrameWorkspace(const CameraModel::Parameters& camera_parameters) :
+    rows_(0), cols_(0)
+{
+  resize(camera_parameters);
+}
+
+void FrameWorkspace::resize(const CameraModel::Parameters& camera_parameters)
+{
+  if (camera_parameters.height_ == rows_ && camera_parameters.width_ == cols_)
+  {
+    return;
+  }
+
+  rows_ = camera_parameters.height_;
+  cols_ = camera_parameters.width_;
+  const int size = rows_ * cols_;
+
+  filtered_depth.resize(rows_, cols_);
+  filtered_millimeter_depth.resize(rows_, cols_);
+  valid_pixels.reserve(size);
+  range_valid_pixels.reserve(size);
+  point_heights.resize(size);
+  planarity_points.resize(size);
+  ground_plane.resize(rows_, cols_);
+}
+
+int FrameWorkspace::rows() const
+{
+  return rows_;
+}
+
+int FrameWorkspace::cols() const
+{
+  return cols_;
+}
+
+} /* end namespace */
@@ -0,0 +1,141 @@
+#include "plane_calibration/ground_checks.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#include "plane_calibration/row_pool.hpp"
+
+namespace plane_calibration
+{
+
+GroundChecks::PlanarityStatistics::PlanarityStatistics() :
+    valid_points(0), invalid_points_x(0), invalid_points_y(0), normalized_z_by_x(0.0f), normalized_z_by_y(0.0f),
+    invalid_normalized_z_by_x(0.0f), invalid_normalized_z_by_y(0.0f)
+{
+}
+
+GroundChecks::PlanarityStatistics& GroundChecks::PlanarityStatistics::operator+=(const PlanarityStatistics& other)
+{
+  valid_points += other.valid_points;
+  invalid_points_x += other.invalid_points_x;
+  invalid_points_y += other.invalid_points_y;
+  normalized_z_by_x += other.normalized_z_by_x;
+  normalized_z_by_y += other.normalized_z_by_y;
+  invalid_normalized_z_by_x += other.invalid_normalized_z_by_x;
+  invalid_normalized_z_by_y += other.invalid_normalized_z_by_y;
+  return *this;
+}
+
+GroundChecks::HeightStatistics::HeightStatistics() :
+    invalid_points(0), invalid_height_sum(0.0f)
+{
+}
+
+GroundChecks::PlanarityStatistics GroundChecks::planarity(const DepthConstRef& raw_depth,
+                                                          const CameraModel::Parameters& camera_parameters,
+                                                          const Eigen::AngleAxisd& ground_rotation,
+                                                          const float& max_range, const float& max_z_by_xy,
+                                                          std::vector<Eigen::Vector3f>& xyzs, const int& threads)
+{
+  const CameraModel::Parameters& cmp = camera_parameters;
+  Eigen::Matrix3d rot = ground_rotation.matrix().transpose();
+  const int cols = raw_depth.cols();
+
+  // the buffer of the last frame, every point is written
+  xyzs.resize(raw_depth.size());
+
+  RowPool::forRows(raw_depth.rows(), threads, [&](const int& begin_row, const int& end_row)
+  {
+    for (int i = begin_row; i < end_row; i++)
+    {
+      int idx = i * cols;
+      for (int j = 0; j < cols; j++, idx++)
+      {
+        double depth = raw_depth(i, j);
+        if (std::isnan(depth) || depth > max_range)
+        {
+          xyzs[idx].setZero();
+          continue;
+        }
+
+        Eigen::Vector3d nv(j, i, 1);
+        nv.x() -= cmp.center_x_;
+        nv.y() -= cmp.center_y_;
+        nv.x() /= cmp.f_x_;
+        nv.y() /= cmp.f_y_;
+        nv *= depth;
+
+        xyzs[idx] = (rot * nv).cast<float>();
+      }
+    }
+  });
+
+  const int sw = 2;
+  const int erows = raw_depth.rows() - sw;
+  const int ecols = cols - sw;
+
+  // sums per row, added up in row order
+  return RowPool::sumRows(std::max(erows - sw, 0), threads, PlanarityStatistics(),
+                          [&](const int& begin_row, const int& end_row, PlanarityStatistics* row_statistics)
+  {
+    for (int i = begin_row + sw; i < end_row + sw; i++)
+    {
+      PlanarityStatistics& row = row_statistics[i - sw - begin_row];
+      row = PlanarityStatistics();
+
+      int idx = i * cols + sw;
+      for (int j = sw; j < ecols; j++, idx++)
+      {
+        if (xyzs[idx - sw].x() == 0.0f || xyzs[idx + sw].x() == 0.0f || xyzs[idx + cols * sw].x() == 0.0f
+            || xyzs[idx - cols * sw].x() == 0.0f)
+        {
+          continue;
+        }
+
+        Eigen::Vector3f dx = xyzs[idx + sw] - xyzs[idx - sw];
+        Eigen::Vector3f dy = xyzs[idx + cols * sw] - xyzs[idx - cols * sw];
+
+        row.valid_points++;
+
+        float normalized_z_by_x = std::abs(dx.z() / dx.head<2>().norm());
+        float normalized_z_by_y = std::abs(dy.z() / dy.head<2>().norm());
+
+        row.normalized_z_by_x += normalized_z_by_x;
+        row.normalized_z_by_y += normalized_z_by_y;
+
+        if (normalized_z_by_x > max_z_by_xy)
+        {
+          row.invalid_points_x++;
+          row.invalid_normalized_z_by_x += normalized_z_by_x;
+        }
+
+        if (normalized_z_by_y > max_z_by_xy)
+        {
+          row.invalid_points_y++;
+          row.invalid_normalized_z_by_y += normalized_z_by_y;
+        }
+      }
+    }
+  });
+}
+
+GroundChecks::HeightStatistics GroundChecks::pointHeights(const ValidPixels& pixels,
+                                                          const Eigen::AngleAxisd& rotation,
+                                                          const double& sensor_height,
+                                                          const float& invalid_height_threshold,
+                                                          Eigen::ArrayXf& point_heights)
+{
+  Eigen::ArrayXf::SegmentReturnType heights = point_heights.head(pixels.size());
+
+  // height of a point = z in the ground frame = depth * (r0 * x_multiplier + r1 * y_multiplier + r2)
+  Eigen::Vector3f up = rotation.matrix().col(2).cast<float>();
+  heights = (pixels.depth().array() * (up(0) * pixels.xMultiplier().array() + up(1) * pixels.yMultiplier().array()
+      + up(2)) + static_cast<float>(sensor_height)).abs();
+
+  HeightStatistics statistics;
+  statistics.invalid_points = (heights > invalid_height_threshold).count();
+  statistics.invalid_height_sum = (heights > invalid_height_threshold).select(heights, 0.0f).sum();
+  return statistics;
+}
+
+} /* end namespace */
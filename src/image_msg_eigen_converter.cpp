@@ -3,10 +3,106 @@
 #include <sensor_msgs/image_encodings.h>
 #include <ros/console.h>
 
+#include "plane_calibration/depth_kernels.hpp"
+
 namespace plane_calibration
 {
 
-bool ImageMsgEigenConverter::convert(const sensor_msgs::ImageConstPtr& image_msg, Eigen::MatrixXf& out_matrix)
+DepthImageView::DepthImageView()
+{
+  data_ = nullptr;
+  rows_ = 0;
+  cols_ = 0;
+  outer_stride_ = 0;
+
+  millimeter_data_ = nullptr;
+  millimeter_outer_stride_ = 0;
+}
+
+void DepthImageView::wrap(const sensor_msgs::ImageConstPtr& image_msg, const int& outer_stride)
+{
+  // holding the pointer keeps the message buffer alive as long as we look at it
+  image_msg_ = image_msg;
+
+  data_ = reinterpret_cast<const float*>(&(image_msg->data.front()));
+  rows_ = image_msg->height;
+  cols_ = image_msg->width;
+  outer_stride_ = outer_stride;
+
+  millimeter_data_ = nullptr;
+}
+
+DepthMatrix& DepthImageView::buffer(const int& rows, const int& cols)
+{
+  image_msg_.reset();
+
+  // no reallocation if the size stays the same
+  buffer_.resize(rows, cols);
+
+  data_ = buffer_.data();
+  rows_ = rows;
+  cols_ = cols;
+  outer_stride_ = cols;
+
+  millimeter_data_ = nullptr;
+
+  return buffer_;
+}
+
+void DepthImageView::wrapMillimeters(const sensor_msgs::ImageConstPtr& image_msg, const int& outer_stride)
+{
+  image_msg_ = image_msg;
+
+  millimeter_data_ = reinterpret_cast<const unsigned short*>(&(image_msg->data.front()));
+  millimeter_outer_stride_ = outer_stride;
+}
+
+MillimeterDepthMatrix& DepthImageView::millimeterBuffer(const int& rows, const int& cols)
+{
+  millimeter_buffer_.resize(rows, cols);
+
+  millimeter_data_ = millimeter_buffer_.data();
+  millimeter_outer_stride_ = cols;
+
+  return millimeter_buffer_;
+}
+
+DepthMap DepthImageView::map() const
+{
+  return DepthMap(data_, rows_, cols_, Eigen::OuterStride<>(outer_stride_));
+}
+
+bool DepthImageView::empty() const
+{
+  return data_ == nullptr || rows_ == 0 || cols_ == 0;
+}
+
+bool DepthImageView::isMapped() const
+{
+  return data_ != nullptr && data_ != buffer_.data();
+}
+
+MillimeterDepthMap DepthImageView::millimeterMap() const
+{
+  return MillimeterDepthMap(millimeter_data_, rows_, cols_, Eigen::OuterStride<>(millimeter_outer_stride_));
+}
+
+bool DepthImageView::hasMillimeters() const
+{
+  return millimeter_data_ != nullptr;
+}
+
+int DepthImageView::rows() const
+{
+  return rows_;
+}
+
+int DepthImageView::cols() const
+{
+  return cols_;
+}
+
+bool ImageMsgEigenConverter::checkImage(const sensor_msgs::ImageConstPtr& image_msg)
 {
   if (image_msg->is_bigendian != 0)
   {
@@ -17,36 +113,115 @@ bool ImageMsgEigenConverter::convert(const sensor_msgs::ImageConstPtr& image_msg
   //only 32FC1 and 16UC1 observed in the wild
   std::string encoding = image_msg->encoding;
 
-  if (encoding != sensor_msgs::image_encodings::TYPE_16UC1 && encoding != sensor_msgs::image_encodings::TYPE_32FC1)
+  int element_size = 0;
+  if (encoding == sensor_msgs::image_encodings::TYPE_16UC1)
+  {
+    element_size = sizeof(unsigned short);
+  }
+  else if (encoding == sensor_msgs::image_encodings::TYPE_32FC1)
+  {
+    element_size = sizeof(float);
+  }
+  else
   {
     ROS_ERROR_STREAM("[ImageMsgEigenConverter]: Unsupported encoding: " << encoding);
+    return false;
   }
 
-  const unsigned char* data_pointer = &(image_msg->data.front());
+  size_t step = getStep(*image_msg, element_size);
+  if (step % element_size != 0 || step < image_msg->width * element_size)
+  {
+    ROS_ERROR_STREAM("[ImageMsgEigenConverter]: Unsupported row step: " << step);
+    return false;
+  }
 
-  if (encoding == sensor_msgs::image_encodings::TYPE_16UC1)
+  if (image_msg->data.size() < step * image_msg->height || image_msg->data.empty())
   {
-    out_matrix = dataToMatrix<unsigned short>(data_pointer, image_msg->height, image_msg->width);
+    ROS_ERROR_STREAM("[ImageMsgEigenConverter]: Image data smaller than step * height");
+    return false;
   }
-  else if (encoding == sensor_msgs::image_encodings::TYPE_32FC1)
+
+  return true;
+}
+
+bool ImageMsgEigenConverter::convert(const sensor_msgs::ImageConstPtr& image_msg, Eigen::MatrixXf& out_matrix)
+{
+  if (!checkImage(image_msg))
   {
-    out_matrix = dataToMatrix<float>(data_pointer, image_msg->height, image_msg->width);
+    return false;
+  }
+
+  if (image_msg->encoding == sensor_msgs::image_encodings::TYPE_16UC1)
+  {
+    // same meters and nans as the DepthImageView version, converted row major like the msg data
+    // C++ template trickery: https://stackoverflow.com/q/29754251
+    Eigen::Map<const Eigen::Matrix<unsigned short, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>, 0,
+        Eigen::OuterStride<> > map = dataToMap<unsigned short>(*image_msg);
+    DepthMatrix meters(map.rows(), map.cols());
+    for (int row = 0; row < map.rows(); ++row)
+    {
+      DepthKernels::millimetersToMeters(map.row(row).data(), meters.row(row).data(), map.cols());
+    }
+    out_matrix = meters;
+  }
+  else
+  {
+    out_matrix = dataToMap<float>(*image_msg);
   }
 
   return true;
 }
 
-template<typename DataType>
-Eigen::MatrixXf ImageMsgEigenConverter::dataToMatrix(const unsigned char* data_pointer, const int& height,
-                                                     const int& width)
+bool ImageMsgEigenConverter::convert(const sensor_msgs::ImageConstPtr& image_msg, DepthImageView& out_view,
+                                     const float& max_range)
 {
-  const DataType* short_data_pointer = reinterpret_cast<const DataType*>(data_pointer);
+  if (!checkImage(image_msg))
+  {
+    return false;
+  }
+
+  if (image_msg->encoding == sensor_msgs::image_encodings::TYPE_32FC1)
+  {
+    out_view.wrap(image_msg, getStep(*image_msg, sizeof(float)) / sizeof(float));
+    return true;
+  }
+
+  // row major to row major, so this is a linear walk through the msg data
+  // scaling and invalid marking in the same pass, so the filter doesn't need to care about units or zeros
+  DepthMatrix& buffer = out_view.buffer(image_msg->height, image_msg->width);
+  Eigen::Map<const Eigen::Matrix<unsigned short, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>, 0,
+      Eigen::OuterStride<> > map = dataToMap<unsigned short>(*image_msg);
+
+  for (int row = 0; row < map.rows(); ++row)
+  {
+    DepthKernels::millimetersToMeters(map.row(row).data(), buffer.row(row).data(), map.cols(), max_range);
+  }
 
-  Eigen::Map<const Eigen::Matrix<DataType, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>> map(short_data_pointer,
-                                                                                                 height, width);
+  // keep the raw data around for the integer pipeline
+  out_view.wrapMillimeters(image_msg, map.outerStride());
+
+  return true;
+}
+
+size_t ImageMsgEigenConverter::getStep(const sensor_msgs::Image& image_msg, const size_t& element_size)
+{
+  // no step given, assume tightly packed rows
+  if (image_msg.step == 0)
+  {
+    return image_msg.width * element_size;
+  }
+  return image_msg.step;
+}
+
+template<typename DataType>
+Eigen::Map<const Eigen::Matrix<DataType, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>, 0, Eigen::OuterStride<> > ImageMsgEigenConverter::dataToMap(
+    const sensor_msgs::Image& image_msg)
+{
+  const DataType* data_pointer = reinterpret_cast<const DataType*>(&(image_msg.data.front()));
+  int outer_stride = getStep(image_msg, sizeof(DataType)) / sizeof(DataType);
 
-  // C++ template trickery: https://stackoverflow.com/q/29754251
-  return map.template cast<float>();
+  return Eigen::Map<const Eigen::Matrix<DataType, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>, 0,
+      Eigen::OuterStride<> >(data_pointer, image_msg.height, image_msg.width, Eigen::OuterStride<>(outer_stride));
 }
 
 bool ImageMsgEigenConverter::convert(const Eigen::MatrixXf& _matrix, sensor_msgs::Image& out_image_msg)
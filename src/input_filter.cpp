@@ -1,18 +1,20 @@
 #include "plane_calibration/input_filter.hpp"
 
-#include "plane_calibration/plane_to_depth_image.hpp"
 #include <ros/console.h>
 
+#include "plane_calibration/depth_kernels.hpp"
+
 namespace plane_calibration
 {
 
 InputFilter::InputFilter(const CameraModel& camera_model, const CalibrationParametersPtr& parameters,
                          const VisualizerInterfacePtr& depth_visualizer, const Config& config) :
-    camera_model_(camera_model)
+    camera_model_(camera_model), plane_to_depth_(camera_model.getParameters())
 {
   parameters_ = parameters;
   config_ = config;
   depth_visualizer_ = depth_visualizer;
+  resolution_ = FixedSizeKernels::select(camera_model_.getParameters());
 
   updateBorders_();
 }
@@ -42,49 +44,113 @@ void InputFilter::updateBorders_()
   Eigen::Affine3d top_transform = ground_transform * top_offset;
   Eigen::Affine3d bottom_transform = ground_transform * bottom_offset;
 
-  min_plane_ = PlaneToDepthImage::convert(top_transform, camera_model_.getParameters());
-  max_plane_ = PlaneToDepthImage::convert(bottom_transform, camera_model_.getParameters());
+  plane_to_depth_.convert(top_transform, min_plane_);
+  plane_to_depth_.convert(bottom_transform, max_plane_);
 
+  PlaneToDepthImage::quantize(min_plane_, min_millimeter_plane_);
+  PlaneToDepthImage::quantize(max_plane_, max_millimeter_plane_);
 }
 
-void InputFilter::filter(Eigen::MatrixXf& matrix, bool debug)
+void InputFilter::filter(DepthMatrix& matrix, bool debug)
 {
-  std::lock_guard<std::mutex> lock(mutex_);
+  filter(matrix, matrix, debug);
+}
 
-  Eigen::MatrixXf valid = (matrix.array() >= min_plane_.array() && matrix.array() <= max_plane_.array()).cast<float>();
-  matrix = matrix.cwiseProduct(valid);
+void InputFilter::filter(const DepthConstRef& input, DepthMatrix& filtered, bool debug)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
 
-  matrix = matrix.unaryExpr([](float v)
-  { return v == 0.0f ? std::nanf("") : v;});
+  // single pass and element wise, so in place filtering works as well
+  // nans fail the comparisons, zeros are no valid depth
+  FixedSizeKernels::filter(resolution_, input, min_plane_, max_plane_, filtered, parameters_->getKernelThreads());
 
   if (debug)
   {
+    debug_valid_ = (filtered.array() == filtered.array()).cast<float>();
+
     depth_visualizer_->publishCloud("debug/filter/far_border", max_plane_);
     depth_visualizer_->publishCloud("debug/filter/near_border", min_plane_);
     depth_visualizer_->publishImage("debug/filter/min_plane", max_plane_);
     depth_visualizer_->publishImage("debug/filter/max_plane", max_plane_);
 
-    depth_visualizer_->publishImage("debug/filter/valid_input", valid.cast<float>());
+    depth_visualizer_->publishImage("debug/filter/valid_input", debug_valid_);
+
+    depth_visualizer_->publishImage("debug/filter/diff_min", min_plane_ - filtered);
+    depth_visualizer_->publishImage("debug/filter/diff_max", max_plane_ - filtered);
+    depth_visualizer_->publishCloud("debug/filter/filtered", filtered);
+  }
+}
+
+void InputFilter::filter(const DepthConstRef& input, DepthMatrix& filtered, ValidPixels& valid_pixels, bool debug)
+{
+  filter(input, filtered, debug);
+  valid_pixels.compact(filtered, plane_to_depth_.getXYMultipliers());
+}
+
+void InputFilter::filter(const MillimeterDepthConstRef& input, MillimeterDepthMatrix& filtered, bool debug)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  // a quantized border of 0 is a plane behind the camera, so same behavior as the float version
+  filtered.resize(input.rows(), input.cols());
+  filtered.array() = (input.array() >= min_millimeter_plane_.array() && input.array() <= max_millimeter_plane_.array()
+      && input.array() != 0).select(input.array(), 0);
+
+  if (debug)
+  {
+    depth_visualizer_->publishCloud("debug/filter/filtered", filtered.cast<float>() / 1000.0f);
+  }
+}
+
+bool InputFilter::dataIsUsable(const DepthConstRef& data, bool debug)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
 
-    depth_visualizer_->publishImage("debug/filter/diff_min", min_plane_ - matrix);
-    depth_visualizer_->publishImage("debug/filter/diff_max", max_plane_ - matrix);
-    depth_visualizer_->publishCloud("debug/filter/filtered", matrix);
+  int nan_count = 0;
+  int zero_count = 0;
+  for (int row = 0; row < data.rows(); ++row)
+  {
+    int row_nan_count;
+    int row_zero_count;
+    DepthKernels::countNansAndZeros(data.row(row).data(), data.cols(), row_nan_count, row_zero_count);
+    nan_count += row_nan_count;
+    zero_count += row_zero_count;
   }
+
+  return dataIsUsable_(data.size(), nan_count, zero_count, debug);
+}
+
+bool InputFilter::dataIsUsable(const MillimeterDepthConstRef& data, bool debug)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  // 0 is the invalid marker, same as nan for the float data
+  int nan_count = (data.array() == 0).count();
+  int zero_count = 0;
+
+  return dataIsUsable_(data.size(), nan_count, zero_count, debug);
 }
 
-bool InputFilter::dataIsUsable(const Eigen::MatrixXf& data, bool debug)
+bool InputFilter::dataIsUsable(const ValidPixels& data, bool debug)
 {
   std::lock_guard<std::mutex> lock(mutex_);
-  double data_size = data.size();
 
-  int nan_count = (data.array() != data.array()).count();
+  // the filter marks zeros as nan, so everything not in the list counts as nan
+  int nan_count = data.imageSize() - data.size();
+  int zero_count = 0;
+
+  return dataIsUsable_(data.imageSize(), nan_count, zero_count, debug);
+}
+
+bool InputFilter::dataIsUsable_(const int& size, const int& nan_count, const int& zero_count, bool debug)
+{
+  double data_size = size;
   double nan_ratio = nan_count / data_size;
 
   data_size = data_size - nan_count;
-  int zero_count = (data.array() == 0.0).count();
   double zero_ratio = zero_count / data_size;
 
-  double data_ratio = data_size / data.size();
+  double data_ratio = data_size / size;
 
   if (debug)
   {
@@ -0,0 +1,191 @@
+#include "plane_calibration/inverse_depth_moments.hpp"
+
+#include <algorithm>
+
+namespace plane_calibration
+{
+
+InverseDepthMoments::InverseDepthMoments(const CameraModel::Parameters& camera_model_paramaters)
+{
+  xy_multipliers_ = PlaneToDepthImage::depthCalculationXYMultiplier(camera_model_paramaters);
+  moments_.setZero();
+}
+
+void InverseDepthMoments::accumulate(const DepthConstRef& depth)
+{
+  eigen_assert(depth.rows() == xy_multipliers_.second.size() && depth.cols() == xy_multipliers_.first.size());
+
+  moments_.setZero();
+  mask_.resize(depth.cols());
+  inverse_depth_.resize(depth.cols());
+
+  for (int row = 0; row < depth.rows(); ++row)
+  {
+    Eigen::Map<const Eigen::ArrayXf> depth_row(depth.row(row).data(), depth.cols());
+
+    // nans fail the comparison
+    mask_ = (depth_row > 0.0f).cast<float>();
+    inverse_depth_ = (depth_row > 0.0f).select(depth_row.inverse(), 0.0f);
+    addRow(xy_multipliers_.second(row), mask_, inverse_depth_);
+  }
+
+  finish();
+}
+
+void InverseDepthMoments::accumulate(const MillimeterDepthConstRef& depth)
+{
+  eigen_assert(depth.rows() == xy_multipliers_.second.size() && depth.cols() == xy_multipliers_.first.size());
+
+  moments_.setZero();
+  mask_.resize(depth.cols());
+  inverse_depth_.resize(depth.cols());
+
+  const unsigned short invalid = 0;
+  for (int row = 0; row < depth.rows(); ++row)
+  {
+    Eigen::Map<const Eigen::Array<unsigned short, Eigen::Dynamic, 1> > depth_row(depth.row(row).data(), depth.cols());
+
+    // [mm] -> [1/m], 0 is invalid
+    mask_ = (depth_row != invalid).cast<float>();
+    inverse_depth_ = (depth_row != invalid).select(1000.0f / depth_row.cast<float>(), 0.0f);
+    addRow(xy_multipliers_.second(row), mask_, inverse_depth_);
+  }
+
+  finish();
+}
+
+void InverseDepthMoments::accumulate(const ValidPixels& valid_pixels)
+{
+  moments_.setZero();
+
+  // upper triangle of phi * phi^T, all pixels of the list are valid
+  Eigen::Matrix<double, 10, 1> sums = Eigen::Matrix<double, 10, 1>::Zero();
+  const int block_size = 1024;
+  if (inverse_depth_.size() < block_size)
+  {
+    inverse_depth_.resize(block_size);
+  }
+
+  for (int start = 0; start < valid_pixels.size(); start += block_size)
+  {
+    int length = std::min(block_size, valid_pixels.size() - start);
+    ValidPixels::Values x = valid_pixels.xMultiplier(start, length);
+    ValidPixels::Values y = valid_pixels.yMultiplier(start, length);
+
+    // the last block is shorter, only its head of the buffer is used
+    Eigen::ArrayXf::SegmentReturnType inverse_depth = inverse_depth_.head(length);
+    inverse_depth = valid_pixels.depth(start, length).array().inverse();
+
+    // float per block, double over the blocks
+    sums[0] += x.array().square().sum();
+    sums[1] += (x.array() * y.array()).sum();
+    sums[2] += x.sum();
+    sums[3] += (x.array() * inverse_depth).sum();
+    sums[4] += y.array().square().sum();
+    sums[5] += y.sum();
+    sums[6] += (y.array() * inverse_depth).sum();
+    sums[7] += length;
+    sums[8] += inverse_depth.sum();
+    sums[9] += inverse_depth.square().sum();
+  }
+
+  moments_(0, 0) = sums[0];
+  moments_(0, 1) = sums[1];
+  moments_(0, 2) = sums[2];
+  moments_(0, 3) = sums[3];
+  moments_(1, 1) = sums[4];
+  moments_(1, 2) = sums[5];
+  moments_(1, 3) = sums[6];
+  moments_(2, 2) = sums[7];
+  moments_(2, 3) = sums[8];
+  moments_(3, 3) = sums[9];
+
+  finish();
+}
+
+void InverseDepthMoments::addRow(const float& y_multiplier, const Eigen::ArrayXf& mask,
+                                 const Eigen::ArrayXf& inverse_depth)
+{
+  Eigen::Map<const Eigen::ArrayXf> x(xy_multipliers_.first.data(), xy_multipliers_.first.size());
+
+  // y is constant along the row, so the row only needs sums over x and the inverse depth
+  double count = mask.sum();
+  double x_sum = (mask * x).sum();
+  double inverse_depth_sum = inverse_depth.sum();
+  double y = y_multiplier;
+
+  moments_(0, 0) += (mask * x.square()).sum();
+  moments_(0, 1) += y * x_sum;
+  moments_(0, 2) += x_sum;
+  moments_(0, 3) += (inverse_depth * x).sum();
+  moments_(1, 1) += y * y * count;
+  moments_(1, 2) += y * count;
+  moments_(1, 3) += y * inverse_depth_sum;
+  moments_(2, 2) += count;
+  moments_(2, 3) += inverse_depth_sum;
+  moments_(3, 3) += inverse_depth.square().sum();
+}
+
+void InverseDepthMoments::finish()
+{
+  moments_.triangularView<Eigen::StrictlyLower>() = moments_.transpose();
+}
+
+double InverseDepthMoments::squaredResidual(const Eigen::Vector4d& plane_coeffs) const
+{
+  // residual = 1 / depth + (a * x + b * y + c) / d = q^T * phi
+  Eigen::Vector4d q = plane_coeffs / plane_coeffs(3);
+  q(3) = 1.0;
+
+  return q.dot(moments_ * q);
+}
+
+double InverseDepthMoments::squaredDistance(const Eigen::Vector4d& plane_coeffs_a,
+                                            const Eigen::Vector4d& plane_coeffs_b) const
+{
+  // the 1 / depth parts cancel out
+  Eigen::Vector4d q = plane_coeffs_a / plane_coeffs_a(3) - plane_coeffs_b / plane_coeffs_b(3);
+  q(3) = 0.0;
+
+  return q.dot(moments_ * q);
+}
+
+std::pair<double, double> InverseDepthMoments::estimateAngles(const CalibrationParameters::Parameters& parameters,
+                                                              const double& deviation) const
+{
+  Eigen::Affine3d transform = parameters.getTransform();
+
+  Eigen::Vector4d x_positive = planeCoefficients(transform * Eigen::AngleAxisd(deviation, Eigen::Vector3d::UnitX()));
+  Eigen::Vector4d x_negative = planeCoefficients(transform * Eigen::AngleAxisd(-deviation, Eigen::Vector3d::UnitX()));
+  Eigen::Vector4d y_positive = planeCoefficients(transform * Eigen::AngleAxisd(deviation, Eigen::Vector3d::UnitY()));
+  Eigen::Vector4d y_negative = planeCoefficients(transform * Eigen::AngleAxisd(-deviation, Eigen::Vector3d::UnitY()));
+
+  double x_magic_multiplier = deviation / squaredDistance(x_positive, x_negative);
+  double y_magic_multiplier = deviation / squaredDistance(y_positive, y_negative);
+
+  double x_distance_diff = squaredResidual(x_negative) - squaredResidual(x_positive);
+  double y_distance_diff = squaredResidual(y_negative) - squaredResidual(y_positive);
+
+  return std::make_pair(x_magic_multiplier * x_distance_diff, y_magic_multiplier * y_distance_diff);
+}
+
+Eigen::Vector4d InverseDepthMoments::planeCoefficients(const Eigen::Affine3d& plane_transformation)
+{
+  // same as PlaneToDepthImage::planeCoefficients, kept in double for the moments
+  Eigen::Vector3d plane_normal = plane_transformation.linear().col(2);
+  Eigen::Hyperplane<double, 3> plane(plane_normal, plane_transformation.translation());
+
+  return plane.coeffs();
+}
+
+int InverseDepthMoments::count() const
+{
+  return static_cast<int>(moments_(2, 2));
+}
+
+const Eigen::Matrix4d& InverseDepthMoments::getMoments() const
+{
+  return moments_;
+}
+
+} /* end namespace */
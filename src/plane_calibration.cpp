@@ -13,7 +13,7 @@ namespace plane_calibration
 
 PlaneCalibration::PlaneCalibration(const CameraModel& camera_model, const CalibrationParametersPtr& parameters,
                                    const VisualizerInterfacePtr& depth_visualizer) :
-    plane_to_depth_(camera_model.getParameters())
+    plane_to_depth_(camera_model.getParameters()), moments_(camera_model.getParameters())
 {
   camera_model_.update(camera_model.getParameters());
   parameters_ = parameters;
@@ -22,25 +22,85 @@ PlaneCalibration::PlaneCalibration(const CameraModel& camera_model, const Calibr
   temp_deviation_planes_ = std::make_shared<DeviationPlanes>(plane_to_depth_, depth_visualizer);
 
   depth_visualizer_ = depth_visualizer;
+  last_estimation_ = std::make_pair(0.0, 0.0);
+  pyramid_factor_ = 1;
 
-  if (parameters->getParameters().precompute_planes_)
+  // start with the planes right away, the first calibration should not have to make them
+  planes_builder_ = std::make_shared<PlanesBuilder>(plane_to_depth_);
+  requestPlanes(parameters_->getParameters());
+  updatePyramid(parameters_->getParameters());
+}
+
+void PlaneCalibration::waitForPlanes()
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  planes_builder_->wait();
+
+  if (coarse_level_)
   {
-    precomputed_planes_ = std::make_shared<Planes>(parameters_->getParameters(), plane_to_depth_);
+    coarse_level_->waitForPlanes();
   }
 }
 
-std::pair<double, double> PlaneCalibration::calibrate(const Eigen::MatrixXf& filtered_depth_matrix,
+BankCacheStatistics PlaneCalibration::getPlanesCacheStatistics() const
+{
+  return planes_builder_->getCacheStatistics();
+}
+
+BankCacheStatistics PlaneCalibration::getDeviationPlanesCacheStatistics() const
+{
+  return deviation_planes_cache_.getStatistics();
+}
+
+std::pair<double, double> PlaneCalibration::calibrate(const DepthConstRef& filtered_depth_matrix,
                                                       const int& iterations)
 {
   std::lock_guard<std::mutex> lock(mutex_);
+  return calibrate_(filtered_depth_matrix, iterations);
+}
+
+std::pair<double, double> PlaneCalibration::calibrate(const MillimeterDepthConstRef& filtered_depth_matrix,
+                                                      const int& iterations)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  return calibrate_(filtered_depth_matrix, iterations);
+}
+
+std::pair<double, double> PlaneCalibration::calibrate(const ValidPixels& valid_pixels, const int& iterations)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  return calibrate_(valid_pixels, iterations);
+}
+
+template<typename DepthRef>
+std::pair<double, double> PlaneCalibration::calibrate_(const DepthRef& filtered_depth_matrix, const int& iterations)
+{
+  ros::WallTime start_time = ros::WallTime::now();
 
   CalibrationParameters::Parameters updated_parameters;
   bool parameters_updated = parameters_->getUpdatedParameters(updated_parameters);
 
   if (parameters_updated)
   {
-    max_deviation_planes_->update(updated_parameters);
-    precomputed_planes_ = std::make_shared<Planes>(parameters_->getParameters(), plane_to_depth_);
+    updateDeviationPlanes(updated_parameters);
+    requestPlanes(updated_parameters);
+    updatePyramid(updated_parameters);
+    publishCacheStatistics();
+  }
+
+  // the latest bank of the builder, as long as it was made for the current transform
+  PlanesPtr planes = planes_builder_->getPlanes();
+  if (planes && planes->fits(updated_parameters))
+  {
+    if (planes != precomputed_planes_)
+    {
+      publishTiming("planes_build", planes->buildSeconds());
+    }
+    precomputed_planes_ = planes;
+  }
+  else
+  {
+    precomputed_planes_.reset();
   }
 
   double x_angle_offset = 0.0;
@@ -48,19 +108,52 @@ std::pair<double, double> PlaneCalibration::calibrate(const Eigen::MatrixXf& fil
 
   temp_parameters_ = updated_parameters;
 
-  std::pair<double, double> angle_offset_estimation = max_deviation_planes_->estimateAngles(filtered_depth_matrix);
-  x_angle_offset += angle_offset_estimation.first;
-  y_angle_offset += angle_offset_estimation.second;
+  std::pair<double, double> angle_offset_estimation;
+  int full_resolution_iterations = iterations;
+
+  if (coarse_level_ && iterations > 0)
+  {
+    // first guess and all but the last refinement on the coarse level, the last one on the full image
+    std::pair<double, double> coarse_offset = calibrateCoarse(filtered_depth_matrix, iterations - 1);
+    x_angle_offset = coarse_offset.first;
+    y_angle_offset = coarse_offset.second;
+    angle_offset_estimation = coarse_level_->last_estimation_;
+
+    // same start parameters, so the coarse rotation is the one we would have ended up with
+    temp_parameters_.rotation_ = coarse_level_->temp_parameters_.rotation_;
+    full_resolution_iterations = 1;
+  }
+  else
+  {
+    if (temp_parameters_.moment_estimation_)
+    {
+      // the only pass over the data, all planes below are evaluated on the moments
+      moments_.accumulate(filtered_depth_matrix);
+      angle_offset_estimation = moments_.estimateAngles(temp_parameters_, temp_parameters_.max_deviation_);
+    }
+    else
+    {
+      angle_offset_estimation = max_deviation_planes_->estimateAngles(filtered_depth_matrix);
+    }
+    x_angle_offset += angle_offset_estimation.first;
+    y_angle_offset += angle_offset_estimation.second;
+
+    temp_parameters_.rotation_ = temp_parameters_.rotation_
+        * Eigen::AngleAxisd(angle_offset_estimation.first, Eigen::Vector3d::UnitX())
+        * Eigen::AngleAxisd(angle_offset_estimation.second, Eigen::Vector3d::UnitY());
+  }
 
-  temp_parameters_.rotation_ = temp_parameters_.rotation_
-      * Eigen::AngleAxisd(angle_offset_estimation.first, Eigen::Vector3d::UnitX())
-      * Eigen::AngleAxisd(angle_offset_estimation.second, Eigen::Vector3d::UnitY());
+  ros::WallTime full_resolution_start_time = ros::WallTime::now();
 
-  for (int i = 0; i < iterations; ++i)
+  for (int i = 0; i < full_resolution_iterations; ++i)
   {
     double max_angle_deviation = std::max(std::abs(angle_offset_estimation.first),
                                           std::abs(angle_offset_estimation.second));
-    if (!temp_parameters_.precompute_planes_)
+    if (temp_parameters_.moment_estimation_)
+    {
+      angle_offset_estimation = estimateAnglesFromMoments(max_angle_deviation);
+    }
+    else if (!temp_parameters_.precompute_planes_ || !precomputed_planes_)
     {
       angle_offset_estimation = estimateAngles(filtered_depth_matrix, angle_offset_estimation, max_angle_deviation);
     }
@@ -79,10 +172,135 @@ std::pair<double, double> PlaneCalibration::calibrate(const Eigen::MatrixXf& fil
 
   }
 
+  last_estimation_ = angle_offset_estimation;
+
+  ros::WallTime end_time = ros::WallTime::now();
+  if (coarse_level_ && iterations > 0)
+  {
+    publishTiming("level_1", (full_resolution_start_time - start_time).toSec());
+    publishTiming("level_0", (end_time - full_resolution_start_time).toSec());
+  }
+  publishTiming("total", (end_time - start_time).toSec());
+
   return std::make_pair(x_angle_offset, y_angle_offset);
 }
 
-std::pair<double, double> PlaneCalibration::estimateAngles(const Eigen::MatrixXf& filtered_depth_matrix,
+void PlaneCalibration::updateDeviationPlanes(const CalibrationParameters::Parameters& parameters)
+{
+  deviation_planes_cache_.setBudget(parameters.bank_cache_megabytes_);
+
+  BankKey::Key key = BankKey::transform(parameters);
+  BankKey::append(camera_model_.getParameters(), key);
+  BankKey::append(parameters.deviation_, 1e-6, key);
+
+  DeviationPlanesPtr deviation_planes = deviation_planes_cache_.find(key);
+  if (!deviation_planes)
+  {
+    deviation_planes = std::make_shared<DeviationPlanes>(plane_to_depth_, depth_visualizer_);
+    deviation_planes->update(parameters);
+    deviation_planes_cache_.insert(key, deviation_planes, deviation_planes->bytes());
+  }
+
+  max_deviation_planes_ = deviation_planes;
+}
+
+void PlaneCalibration::requestPlanes(const CalibrationParameters::Parameters& parameters)
+{
+  // the moments don't use any plane images
+  if (parameters.precompute_planes_ && !parameters.moment_estimation_)
+  {
+    planes_builder_->build(parameters);
+  }
+}
+
+void PlaneCalibration::updatePyramid(const CalibrationParameters::Parameters& parameters)
+{
+  // the moments make the iterations free already, no need for a coarse level
+  if (parameters.pyramid_factor_ <= 1 || parameters.moment_estimation_)
+  {
+    coarse_level_.reset();
+    coarse_parameters_.reset();
+    pyramid_factor_ = 1;
+    return;
+  }
+
+  CalibrationParameters::Parameters coarse_parameters = parameters;
+  coarse_parameters.pyramid_factor_ = 1;
+
+  // the coarse planes get rebuilt by the coarse level itself on its next run
+  if (coarse_level_ && pyramid_factor_ == parameters.pyramid_factor_)
+  {
+    coarse_parameters_->update(coarse_parameters);
+    return;
+  }
+
+  pyramid_factor_ = parameters.pyramid_factor_;
+
+  CameraModel coarse_camera_model;
+  coarse_camera_model.update(DepthDownsampler::downsample(camera_model_.getParameters(), pyramid_factor_));
+
+  coarse_parameters_ = std::make_shared<CalibrationParameters>();
+  coarse_parameters_->update(coarse_parameters);
+  // no visualizer, debug output and timing only come from the full resolution level
+  coarse_level_ = std::make_shared<PlaneCalibration>(coarse_camera_model, coarse_parameters_,
+                                                     VisualizerInterfacePtr());
+}
+
+std::pair<double, double> PlaneCalibration::calibrateCoarse(const DepthConstRef& filtered_depth_matrix,
+                                                            const int& iterations)
+{
+  DepthDownsampler::downsample(filtered_depth_matrix, pyramid_factor_, coarse_depth_);
+  return coarse_level_->calibrate_<DepthConstRef>(coarse_depth_, iterations);
+}
+
+std::pair<double, double> PlaneCalibration::calibrateCoarse(const MillimeterDepthConstRef& filtered_depth_matrix,
+                                                            const int& iterations)
+{
+  DepthDownsampler::downsample(filtered_depth_matrix, pyramid_factor_, coarse_millimeter_depth_);
+  return coarse_level_->calibrate_<MillimeterDepthConstRef>(coarse_millimeter_depth_, iterations);
+}
+
+std::pair<double, double> PlaneCalibration::calibrateCoarse(const ValidPixels& valid_pixels, const int& iterations)
+{
+  // the binned image is small and mostly valid, so the coarse level stays dense
+  DepthDownsampler::downsample(valid_pixels, pyramid_factor_, coarse_depth_, coarse_counts_);
+  return coarse_level_->calibrate_<DepthConstRef>(coarse_depth_, iterations);
+}
+
+std::pair<double, double> PlaneCalibration::estimateAnglesFromMoments(const double& deviation)
+{
+  double deviation_buffer = ecl::degrees_to_radians(0.5);
+  temp_parameters_.deviation_ = deviation + deviation_buffer;
+
+  return moments_.estimateAngles(temp_parameters_, temp_parameters_.deviation_);
+}
+
+void PlaneCalibration::publishTiming(const std::string& level, const double& seconds)
+{
+  if (!depth_visualizer_)
+  {
+    return;
+  }
+
+  depth_visualizer_->publishDouble("debug/calibration_time_" + level, seconds * 1000.0);
+}
+
+void PlaneCalibration::publishCacheStatistics()
+{
+  if (!depth_visualizer_)
+  {
+    return;
+  }
+
+  BankCacheStatistics planes = getPlanesCacheStatistics();
+  BankCacheStatistics deviation_planes = getDeviationPlanesCacheStatistics();
+  depth_visualizer_->publishDouble("debug/planes_cache_hits", planes.hits);
+  depth_visualizer_->publishDouble("debug/planes_cache_misses", planes.misses);
+  depth_visualizer_->publishDouble("debug/deviation_planes_cache_hits", deviation_planes.hits);
+  depth_visualizer_->publishDouble("debug/deviation_planes_cache_misses", deviation_planes.misses);
+}
+
+std::pair<double, double> PlaneCalibration::estimateAngles(const DepthConstRef& filtered_depth_matrix,
                                                            const std::pair<double, double>& last_estimation,
                                                            const double& deviation)
 {
@@ -93,27 +311,148 @@ std::pair<double, double> PlaneCalibration::estimateAngles(const Eigen::MatrixXf
   return temp_deviation_planes_->estimateAngles(filtered_depth_matrix);
 }
 
-std::pair<double, double> PlaneCalibration::estimateAngles(const Eigen::MatrixXf& filtered_depth_matrix,
+template<typename DepthRef>
+std::pair<double, double> PlaneCalibration::estimateAnglesFromHalfPlanes(const DepthRef& filtered_depth,
+                                                                         const double& x_angle_offset,
+                                                                         const double& y_angle_offset,
+                                                                         const double& deviation)
+{
+  std::pair<HalfPlane, HalfPlane> x_planes = precomputed_planes_->getFittingXTiltHalfPlanes(x_angle_offset, deviation);
+  std::pair<HalfPlane, HalfPlane> y_planes = precomputed_planes_->getFittingYTiltHalfPlanes(y_angle_offset, deviation);
+
+  double x_magic_multiplier = deviation
+      / precomputed_planes_->getFittingTiltDistance(Planes::x_axis, x_angle_offset, deviation, x_planes);
+  double y_magic_multiplier = deviation
+      / precomputed_planes_->getFittingTiltDistance(Planes::y_axis, y_angle_offset, deviation, y_planes);
+
+  const int& threads = temp_parameters_.kernel_threads_;
+  double x_distance_diff = DeviationPlanes::getDistance(x_planes.second, filtered_depth, threads)
+      - DeviationPlanes::getDistance(x_planes.first, filtered_depth, threads);
+  double y_distance_diff = DeviationPlanes::getDistance(y_planes.second, filtered_depth, threads)
+      - DeviationPlanes::getDistance(y_planes.first, filtered_depth, threads);
+
+  return std::make_pair(x_magic_multiplier * x_distance_diff, y_magic_multiplier * y_distance_diff);
+}
+
+std::pair<double, double> PlaneCalibration::estimateAngles(const DepthConstRef& filtered_depth_matrix,
+                                                           const double& x_angle_offset, const double& y_angle_offset,
+                                                           const double& deviation)
+{
+  if (precomputed_planes_->halfPrecision())
+  {
+    return estimateAnglesFromHalfPlanes(filtered_depth_matrix, x_angle_offset, y_angle_offset, deviation);
+  }
+
+  std::pair<MatrixPlane, MatrixPlane> x_planes_ = precomputed_planes_->getFittingXTiltPlanes(x_angle_offset,
+                                                                                                   deviation);
+  std::pair<MatrixPlane, MatrixPlane> y_planes_ = precomputed_planes_->getFittingYTiltPlanes(y_angle_offset,
+                                                                                                   deviation);
+
+  // the plane to plane distances come with the bank
+  double x_distance = precomputed_planes_->getFittingTiltDistance(Planes::x_axis, x_angle_offset, deviation, x_planes_);
+  double y_distance = precomputed_planes_->getFittingTiltDistance(Planes::y_axis, y_angle_offset, deviation, y_planes_);
+
+  double x_magic_multiplier = deviation / x_distance;
+  double y_magic_multiplier = deviation / y_distance;
+
+  bool matrix_has_nans = true;
+  const int& threads = temp_parameters_.kernel_threads_;
+  double x_distance_positive = DeviationPlanes::getDistance(x_planes_.first, filtered_depth_matrix, matrix_has_nans,
+                                                            threads);
+  double x_distance_negative = DeviationPlanes::getDistance(x_planes_.second, filtered_depth_matrix, matrix_has_nans,
+                                                            threads);
+  double y_distance_positive = DeviationPlanes::getDistance(y_planes_.first, filtered_depth_matrix, matrix_has_nans,
+                                                            threads);
+  double y_distance_negative = DeviationPlanes::getDistance(y_planes_.second, filtered_depth_matrix, matrix_has_nans,
+                                                            threads);
+
+  double x_distance_diff = x_distance_negative - x_distance_positive;
+  double y_distance_diff = y_distance_negative - y_distance_positive;
+
+  double px_estimation = x_magic_multiplier * x_distance_diff;
+  double py_estimation = y_magic_multiplier * y_distance_diff;
+
+  return std::make_pair(px_estimation, py_estimation);
+}
+
+std::pair<double, double> PlaneCalibration::estimateAngles(const MillimeterDepthConstRef& filtered_depth_matrix,
+                                                           const std::pair<double, double>& /*last_estimation*/,
+                                                           const double& deviation)
+{
+  double deviation_buffer = ecl::degrees_to_radians(0.5);
+  temp_parameters_.deviation_ = deviation + deviation_buffer;
+
+  temp_deviation_planes_->update(temp_parameters_);
+  return temp_deviation_planes_->estimateAngles(filtered_depth_matrix);
+}
+
+std::pair<double, double> PlaneCalibration::estimateAngles(const MillimeterDepthConstRef& filtered_depth_matrix,
                                                            const double& x_angle_offset, const double& y_angle_offset,
                                                            const double& deviation)
 {
-  std::pair<MatrixPlanePtr, MatrixPlanePtr> x_planes_ = precomputed_planes_->getFittingXTiltPlanes(x_angle_offset,
+  std::pair<MillimeterPlane, MillimeterPlane> x_planes_ = precomputed_planes_->getFittingXTiltMillimeterPlanes(
+      x_angle_offset, deviation);
+  std::pair<MillimeterPlane, MillimeterPlane> y_planes_ = precomputed_planes_->getFittingYTiltMillimeterPlanes(
+      y_angle_offset, deviation);
+
+  double x_distance = precomputed_planes_->getFittingTiltDistance(Planes::x_axis, x_angle_offset, deviation, x_planes_);
+  double y_distance = precomputed_planes_->getFittingTiltDistance(Planes::y_axis, y_angle_offset, deviation, y_planes_);
+
+  double x_magic_multiplier = deviation / x_distance;
+  double y_magic_multiplier = deviation / y_distance;
+
+  const int& threads = temp_parameters_.kernel_threads_;
+  double x_distance_positive = DeviationPlanes::getDistance(x_planes_.first, filtered_depth_matrix, threads);
+  double x_distance_negative = DeviationPlanes::getDistance(x_planes_.second, filtered_depth_matrix, threads);
+  double y_distance_positive = DeviationPlanes::getDistance(y_planes_.first, filtered_depth_matrix, threads);
+  double y_distance_negative = DeviationPlanes::getDistance(y_planes_.second, filtered_depth_matrix, threads);
+
+  double x_distance_diff = x_distance_negative - x_distance_positive;
+  double y_distance_diff = y_distance_negative - y_distance_positive;
+
+  double px_estimation = x_magic_multiplier * x_distance_diff;
+  double py_estimation = y_magic_multiplier * y_distance_diff;
+
+  return std::make_pair(px_estimation, py_estimation);
+}
+
+std::pair<double, double> PlaneCalibration::estimateAngles(const ValidPixels& valid_pixels,
+                                                           const std::pair<double, double>& /*last_estimation*/,
+                                                           const double& deviation)
+{
+  double deviation_buffer = ecl::degrees_to_radians(0.5);
+  temp_parameters_.deviation_ = deviation + deviation_buffer;
+
+  temp_deviation_planes_->update(temp_parameters_);
+  return temp_deviation_planes_->estimateAngles(valid_pixels);
+}
+
+std::pair<double, double> PlaneCalibration::estimateAngles(const ValidPixels& valid_pixels,
+                                                           const double& x_angle_offset, const double& y_angle_offset,
+                                                           const double& deviation)
+{
+  if (precomputed_planes_->halfPrecision())
+  {
+    return estimateAnglesFromHalfPlanes(valid_pixels, x_angle_offset, y_angle_offset, deviation);
+  }
+
+  std::pair<MatrixPlane, MatrixPlane> x_planes_ = precomputed_planes_->getFittingXTiltPlanes(x_angle_offset,
                                                                                                    deviation);
-  std::pair<MatrixPlanePtr, MatrixPlanePtr> y_planes_ = precomputed_planes_->getFittingYTiltPlanes(y_angle_offset,
+  std::pair<MatrixPlane, MatrixPlane> y_planes_ = precomputed_planes_->getFittingYTiltPlanes(y_angle_offset,
                                                                                                    deviation);
 
-  bool matrix_has_nans = false;
-  double x_distance = DeviationPlanes::getDistance(*x_planes_.first, *x_planes_.second, matrix_has_nans);
-  double y_distance = DeviationPlanes::getDistance(*y_planes_.first, *y_planes_.second, matrix_has_nans);
+  // the plane to plane distances come with the bank, only the distances to the data use the list
+  double x_distance = precomputed_planes_->getFittingTiltDistance(Planes::x_axis, x_angle_offset, deviation, x_planes_);
+  double y_distance = precomputed_planes_->getFittingTiltDistance(Planes::y_axis, y_angle_offset, deviation, y_planes_);
 
   double x_magic_multiplier = deviation / x_distance;
   double y_magic_multiplier = deviation / y_distance;
 
-  matrix_has_nans = true;
-  double x_distance_positive = DeviationPlanes::getDistance(*x_planes_.first, filtered_depth_matrix, matrix_has_nans);
-  double x_distance_negative = DeviationPlanes::getDistance(*x_planes_.second, filtered_depth_matrix, matrix_has_nans);
-  double y_distance_positive = DeviationPlanes::getDistance(*y_planes_.first, filtered_depth_matrix, matrix_has_nans);
-  double y_distance_negative = DeviationPlanes::getDistance(*y_planes_.second, filtered_depth_matrix, matrix_has_nans);
+  const int& threads = temp_parameters_.kernel_threads_;
+  double x_distance_positive = DeviationPlanes::getDistance(x_planes_.first, valid_pixels, threads);
+  double x_distance_negative = DeviationPlanes::getDistance(x_planes_.second, valid_pixels, threads);
+  double y_distance_positive = DeviationPlanes::getDistance(y_planes_.first, valid_pixels, threads);
+  double y_distance_negative = DeviationPlanes::getDistance(y_planes_.second, valid_pixels, threads);
 
   double x_distance_diff = x_distance_negative - x_distance_positive;
   double y_distance_diff = y_distance_negative - y_distance_positive;
@@ -1,6 +1,7 @@
 #include "plane_calibration/plane_calibration_nodelet.hpp"
 
 #include <sstream>
+#include <string>
 #include <Eigen/Dense>
 #include <ecl/geometry/angle.hpp>
 
@@ -13,12 +14,19 @@
 #include <geometry_msgs/Pose2D.h>
 
 #include "plane_calibration/image_msg_eigen_converter.hpp"
+#include "plane_calibration/depth_kernels.hpp"
 
 namespace plane_calibration
 {
 
+// one frame in each stage and in each queue between them
+const int pipeline_frames = 5;
+
+double restored_sensor_height(0.0f);
+
 PlaneCalibrationNodelet::PlaneCalibrationNodelet() :
-    transform_listener_buffer_(), transform_listener_(transform_listener_buffer_)
+    free_frames_(pipeline_frames), ingested_frames_(1), calibrated_frames_(1), transform_listener_buffer_(),
+    transform_listener_(transform_listener_buffer_)
 {
   enable_ = true;
   calibration_rate_ = 1.0;
@@ -30,6 +38,9 @@ PlaneCalibrationNodelet::PlaneCalibrationNodelet() :
   precompute_planes_ = true;
   precomputed_plane_pairs_count_ = 20;
 
+  downsample_factor_ = 1;
+  processing_downsample_factor_ = 1;
+
   last_valid_calibration_result_ = std::make_pair(0.0, 0.0);
 
   Eigen::AngleAxisd rotation;
@@ -40,6 +51,40 @@ PlaneCalibrationNodelet::PlaneCalibrationNodelet() :
   
   last_calibration_result_.first = 0;
   last_calibration_result_.second = 0;
+
+  pipelined_calibration_ = false;
+  frames_in_flight_ = 0;
+  stop_pipeline_ = false;
+  for (int stage = 0; stage < stage_count; ++stage)
+  {
+    stage_nanoseconds_[stage] = 0;
+    last_stage_nanoseconds_[stage] = 0;
+  }
+  last_statistics_time_ = std::chrono::steady_clock::now();
+  last_dropped_images_ = 0;
+}
+
+PlaneCalibrationNodelet::~PlaneCalibrationNodelet()
+{
+  // running stages finish their frame first
+  {
+    std::lock_guard<std::mutex> lock(pipeline_mutex_);
+    stop_pipeline_ = true;
+  }
+  pipeline_condition_.notify_all();
+  depth_image_mailbox_.close();
+  free_frames_.close();
+  ingested_frames_.close();
+  calibrated_frames_.close();
+
+  std::thread* threads[] = {&calibration_worker_, &calibration_stage_thread_, &validation_stage_thread_};
+  for (std::thread* thread : threads)
+  {
+    if (thread->joinable())
+    {
+      thread->join();
+    }
+  }
 }
 
 void PlaneCalibrationNodelet::onInit()
@@ -58,18 +103,43 @@ void PlaneCalibrationNodelet::onInit()
   node_handle.param("precompute_planes", precompute_planes_, true);
   node_handle.param("precomputed_plane_pairs_count", precomputed_plane_pairs_count_, 20);
 
+  // not reconfigurable, the parameters were made by the reconfigure callback above
+  std::string planes_cache_directory;
+  node_handle.param("planes_cache_directory", planes_cache_directory, std::string(""));
+  calibration_parameters_->updatePlanesCacheDirectory(planes_cache_directory);
+  std::string shared_planes_directory;
+  node_handle.param("shared_planes_directory", shared_planes_directory, std::string(""));
+  calibration_parameters_->updateSharedPlanesDirectory(shared_planes_directory);
+
   node_handle.param("camera_depth_frame", camera_depth_frame_, std::string("camera_depth_optical_frame"));
   node_handle.param("result_camera_depth_frame", result_frame_, std::string("ground_plane_frame"));
     
-  node_handle.getParam("maximum_range_of_depth_camera", maximum_range_of_depth_camera);
+  node_handle.param("maximum_range_of_depth_camera", maximum_range_of_depth_camera, 3.5f);
   node_handle.getParam("threshold_normalized_z_by_xy", threshold_normalized_z_by_xy);
   node_handle.getParam("threshold_normalized_invalid_z_by_xy", threshold_normalized_invalid_z_by_xy);
   node_handle.getParam("max_angle_change", max_angle_change);
+  // 40000 of 640x480 points
+  node_handle.param("min_valid_point_ratio", min_valid_point_ratio, 0.13f);
   
   depth_visualizer_ = std::make_shared<DepthVisualizer>(node_handle, camera_depth_frame_);
+  // created before the worker starts, filled by the camera info callback
+  camera_model_ = std::make_shared<CameraModel>();
 
   pub_update_ = node_handle.advertise<geometry_msgs::Pose2D>("plane_angle_update_degrees", 1);
 
+  node_handle.param("pipelined_calibration", pipelined_calibration_, false);
+  if (pipelined_calibration_)
+  {
+    for (int i = 0; i < pipeline_frames; ++i)
+    {
+      DepthFramePtr frame(new DepthFrame());
+      free_frames_.tryPush(frame);
+    }
+    calibration_stage_thread_ = std::thread(&PlaneCalibrationNodelet::runCalibrationStage, this);
+    validation_stage_thread_ = std::thread(&PlaneCalibrationNodelet::runValidationStage, this);
+  }
+  calibration_worker_ = std::thread(&PlaneCalibrationNodelet::runCalibrationWorker, this);
+
   sub_camera_info_ = node_handle.subscribe<sensor_msgs::CameraInfo>("camera_info", 1,
                                                                     &PlaneCalibrationNodelet::cameraInfoCB, this);
   sub_depth_image_ = node_handle.subscribe<sensor_msgs::Image>("input_depth_image", 1,
@@ -99,6 +169,7 @@ void PlaneCalibrationNodelet::reconfigureCB(PlaneCalibrationConfig &config, uint
 
   max_deviation_ = ecl::degrees_to_radians(config.max_deviation_degrees);
   iterations_ = config.iterations;
+  downsample_factor_ = config.downsample_factor;
 
   input_filter_config_.max_nan_ratio = config.input_max_nan_ratio;
   input_filter_config_.max_zero_ratio = config.input_max_zero_ratio;
@@ -119,6 +190,15 @@ void PlaneCalibrationNodelet::reconfigureCB(PlaneCalibrationConfig &config, uint
 
   calibration_parameters_->updateDeviations(ecl::degrees_to_radians(config.max_deviation_degrees));
   calibration_parameters_->updatePrecomputation(config.precompute_planes, config.precomputed_plane_pairs_count);
+  calibration_parameters_->updatePlaneInterpolation(config.interpolate_planes);
+  calibration_parameters_->updateHalfPrecisionPlanes(config.half_precision_planes);
+  calibration_parameters_->updatePlaneBuildThreads(config.plane_build_threads);
+  calibration_parameters_->updateKernelThreads(config.kernel_threads);
+  calibration_parameters_->updateBankCacheBudget(config.bank_cache_megabytes);
+  calibration_parameters_->updateLazyPlanes(config.lazy_planes, config.prefetch_planes);
+  calibration_parameters_->updateMillimeterDepth(config.millimeter_depth);
+  calibration_parameters_->updatePyramidFactor(config.pyramid_factor);
+  calibration_parameters_->updateMomentEstimation(config.moment_estimation);
 
   use_manual_ground_transform_ = config.use_manual_ground_transform;
   always_update_ = config.always_update;
@@ -138,27 +218,193 @@ void PlaneCalibrationNodelet::cameraInfoCB(const sensor_msgs::CameraInfoConstPtr
   image_geometry::PinholeCameraModel pinhole_camera_model;
   pinhole_camera_model.fromCameraInfo(camera_info_msg);
 
-  depth_visualizer_->setCameraModel(pinhole_camera_model);
+  // the model exists from onInit on, the worker waits until this first update
+  camera_model_->update(pinhole_camera_model.cx(), pinhole_camera_model.cy(), pinhole_camera_model.fx(),
+                        pinhole_camera_model.fy(), camera_info_msg->width, camera_info_msg->height);
 
-  if (!camera_model_)
+  // set up everything with the first camera info, so the planes are built before the first depth image.
+  // Planes for the default transform would be thrown away again, so wait for the ground transform.
+  // A busy worker is already set up
+  std::unique_lock<std::mutex> processing_lock(processing_mutex_, std::try_to_lock);
+  if (!processing_lock.owns_lock() || plane_calibration_ || !calibration_parameters_)
   {
-    camera_model_ = std::make_shared<CameraModel>();
+    return;
   }
 
-  camera_model_->update(pinhole_camera_model.cx(), pinhole_camera_model.cy(), pinhole_camera_model.fx(),
-                        pinhole_camera_model.fy(), camera_info_msg->width, camera_info_msg->height);
+  bool transform_available = use_manual_ground_transform_
+      || transform_listener_buffer_.canTransform(ground_frame_, camera_depth_frame_, ros::Time(0));
+  if (!transform_available)
+  {
+    return;
+  }
+
+  getTransform();
+  updateDownsampling();
+  setupProcessing();
 }
 
 void PlaneCalibrationNodelet::depthImageCB(const sensor_msgs::ImageConstPtr& depth_image_msg)
 {
-  ros::Time call_time = ros::Time::now();
-  if (ros::Time::now() < last_call_time_ + ros::Duration(1.0 / calibration_rate_))
+  // the transform of the latest result is published at the input rate, also while the worker calibrates
+  if (ros::Time::now() >= last_call_time_ + ros::Duration(1.0 / calibration_rate_))
+  {
+    last_call_time_ = ros::Time::now();
+    depth_image_mailbox_.post(depth_image_msg);
+  }
+
+  publishTransform();
+}
+
+void PlaneCalibrationNodelet::runCalibrationWorker()
+{
+  DepthFramePtr frame;
+  sensor_msgs::ImageConstPtr depth_image_msg;
+  while (true)
+  {
+    // a free frame first, so the image taken afterwards is the latest one
+    if (pipelined_calibration_ && !frame && !free_frames_.pop(frame))
+    {
+      return;
+    }
+
+    if (!depth_image_mailbox_.take(depth_image_msg))
+    {
+      return;
+    }
+
+    bool ingested;
+    {
+      std::lock_guard<std::mutex> lock(processing_mutex_);
+      DepthFrame& current_frame = pipelined_calibration_ ? *frame : frame_;
+
+      std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+      ingested = ingestDepthImage(depth_image_msg, current_frame);
+      addStageTime(ingest_stage, start);
+
+      if (ingested && !pipelined_calibration_)
+      {
+        start = std::chrono::steady_clock::now();
+        bool calibrated = calibrate(frame_);
+        addStageTime(calibration_stage, start);
+
+        if (calibrated)
+        {
+          start = std::chrono::steady_clock::now();
+          validate(frame_);
+          addStageTime(validation_stage, start);
+        }
+        publishTransform();
+      }
+    }
+    // the frame keeps the msg as long as it maps it
+    depth_image_msg.reset();
+
+    if (ingested && pipelined_calibration_)
+    {
+      {
+        std::lock_guard<std::mutex> lock(pipeline_mutex_);
+        ++frames_in_flight_;
+      }
+
+      if (!ingested_frames_.push(frame))
+      {
+        return;
+      }
+    }
+
+    reportPipelineStatistics();
+  }
+}
+
+void PlaneCalibrationNodelet::runCalibrationStage()
+{
+  DepthFramePtr frame;
+  while (ingested_frames_.pop(frame))
+  {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    frame->calibrated = calibrate(*frame);
+    addStageTime(calibration_stage, start);
+
+    if (!calibrated_frames_.push(frame))
+    {
+      return;
+    }
+  }
+}
+
+void PlaneCalibrationNodelet::runValidationStage()
+{
+  DepthFramePtr frame;
+  while (calibrated_frames_.pop(frame))
+  {
+    if (frame->calibrated)
+    {
+      std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+      validate(*frame);
+      addStageTime(validation_stage, start);
+      publishTransform();
+    }
+
+    // never blocks, there is room for all frames
+    free_frames_.push(frame);
+    {
+      std::lock_guard<std::mutex> lock(pipeline_mutex_);
+      --frames_in_flight_;
+    }
+    pipeline_condition_.notify_all();
+  }
+}
+
+void PlaneCalibrationNodelet::waitForPipeline()
+{
+  std::unique_lock<std::mutex> lock(pipeline_mutex_);
+  pipeline_condition_.wait(lock, [this]()
+  { return frames_in_flight_ == 0 || stop_pipeline_;});
+}
+
+void PlaneCalibrationNodelet::addStageTime(const Stage& stage, const std::chrono::steady_clock::time_point& start)
+{
+  stage_nanoseconds_[stage] += std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now() - start).count();
+}
+
+void PlaneCalibrationNodelet::reportPipelineStatistics()
+{
+  std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+  double seconds = std::chrono::duration<double>(now - last_statistics_time_).count();
+  if (!debug_ || seconds < 5.0)
   {
-    publishTransform();
     return;
   }
-  last_call_time_ = ros::Time::now();
+  last_statistics_time_ = now;
+
+  // the input of the ingest stage is the mailbox, its drops instead of a depth
+  std::size_t dropped_images = depth_image_mailbox_.dropped();
+  std::size_t queue_depths[] = {dropped_images - last_dropped_images_, ingested_frames_.takeMaxSize(),
+                                calibrated_frames_.takeMaxSize()};
+  last_dropped_images_ = dropped_images;
+
+  const std::string names[] = {"ingest", "calibration", "validation"};
+  std::stringstream report;
+  for (int stage = 0; stage < stage_count; ++stage)
+  {
+    std::int64_t nanoseconds = stage_nanoseconds_[stage];
+    double occupancy = (nanoseconds - last_stage_nanoseconds_[stage]) * 1e-9 / seconds;
+    last_stage_nanoseconds_[stage] = nanoseconds;
+
+    depth_visualizer_->publishDouble("debug/pipeline_" + names[stage] + "_occupancy", occupancy);
+    std::string depth_name = stage == ingest_stage ? "_dropped_images" : "_max_queue_depth";
+    depth_visualizer_->publishDouble("debug/pipeline_" + names[stage] + depth_name, queue_depths[stage]);
+    report << " " << names[stage] << " " << static_cast<int>(100.0 * occupancy + 0.5) << "%" << (
+        stage == ingest_stage ? " dropped " : " queue ") << queue_depths[stage] << ",";
+  }
+
+  ROS_INFO_STREAM("[PlaneCalibrationNodelet]: Stage occupancy and queue depth of the last " << seconds << " s:"
+                  << report.str());
+}
 
+bool PlaneCalibrationNodelet::ingestDepthImage(const sensor_msgs::ImageConstPtr& depth_image_msg, DepthFrame& frame)
+{
   if (!enable_)
   {
     if(debug_)
@@ -166,56 +412,194 @@ void PlaneCalibrationNodelet::depthImageCB(const sensor_msgs::ImageConstPtr& dep
       ROS_INFO_STREAM_THROTTLE(5.0, "[PlaneCalibrationNodelet]: Calibration disabled, not calibrating");
     }
 
-    return;
+    return false;
   }
 
-  bool wait_for_initialization = !camera_model_ || !calibration_parameters_;
+  bool wait_for_initialization = !camera_model_->initialized() || !calibration_parameters_;
   if (wait_for_initialization)
   {
-    return;
+    return false;
   }
 
+  updateDownsampling();
+  setupProcessing();
+
+  // 32FC1 data is used directly from the msg buffer, no copy
+  bool converted_successfully = ImageMsgEigenConverter::convert(depth_image_msg, frame.depth_image,
+                                                                maximum_range_of_depth_camera);
+  if (!converted_successfully)
+  {
+    ROS_ERROR_STREAM("[PlaneCalibrationNodelet]: Conversion from image msg to Eigen matrix failed");
+    return false;
+  }
+
+  // the planes and buffers of all stages are sized from the camera info, other images would be read out of bounds
+  const CameraModel::Parameters camera_parameters = camera_model_->getParameters();
+  if (frame.depth_image.rows() != camera_parameters.height_ || frame.depth_image.cols() != camera_parameters.width_)
+  {
+    ROS_ERROR_STREAM_THROTTLE(5.0, "[PlaneCalibrationNodelet]: Depth image size " << frame.depth_image.cols() << "x"
+                              << frame.depth_image.rows() << " differs from the camera info "
+                              << camera_parameters.width_ << "x" << camera_parameters.height_);
+    return false;
+  }
+
+  getTransform();
+
+  if (!transform_)
+  {
+    return false;
+  }
+  frame.ground_transform = transform_;
+  frame.sensor_height = restored_sensor_height;
+
+  frame.downsampled = processing_downsample_factor_ > 1;
+  if (frame.downsampled)
+  {
+    DepthDownsampler::downsample(frame.depth_image, processing_downsample_factor_, frame.downsampled_depth_image);
+  }
+
+  DepthMap raw_depth = frame.image().map();
+  // sized once, a frame of the same size doesn't allocate anymore
+  frame.resize(processing_camera_parameters_);
+
+  if (debug_)
+  {
+    static tf2_ros::TransformBroadcaster transform_broadcaster;
+    geometry_msgs::TransformStamped transformStamped;
+
+    transformStamped.header.stamp = ros::Time::now();
+    transformStamped.header.frame_id = camera_depth_frame_;
+
+    CalibrationParameters::Parameters parameters = calibration_parameters_->getParameters();
+
+    transformStamped.child_frame_id = "uncalibrated_ground";
+    tf::transformEigenToMsg(parameters.getTransform(), transformStamped.transform);
+    transform_broadcaster.sendTransform(transformStamped);
+
+    depth_visualizer_->publishCloud("debug/uncalibrated_ground", parameters.getTransform(),
+                                    processing_camera_parameters_);
+  }
+
+  if (!groundLooksPlanar(raw_depth, frame.planarity_points))
+  {
+    return false;
+  }
+
+  frame.millimeter_depth = calibration_parameters_->getParameters().millimeter_depth_
+      && frame.image().hasMillimeters();
+
+  // filtered data ends up in the frame buffers which keep their memory between frames
+  bool input_data_not_usable;
+  if (frame.millimeter_depth)
+  {
+    input_filter_->filter(frame.image().millimeterMap(), frame.filtered_millimeter_depth, debug_);
+    input_data_not_usable = !input_filter_->dataIsUsable(frame.filtered_millimeter_depth, debug_);
+
+    // the validation works in [m]
+    frame.filtered_depth.resize(frame.filtered_millimeter_depth.rows(), frame.filtered_millimeter_depth.cols());
+    DepthKernels::millimetersToMeters(frame.filtered_millimeter_depth.data(), frame.filtered_depth.data(),
+                                      frame.filtered_millimeter_depth.size());
+    frame.valid_pixels.compact(frame.filtered_depth, plane_to_depth_converter_->getXYMultipliers());
+  }
+  else
+  {
+    // most of the filtered image is nan, the later stages only run over the valid pixels
+    input_filter_->filter(raw_depth, frame.filtered_depth, frame.valid_pixels, debug_);
+    input_data_not_usable = !input_filter_->dataIsUsable(frame.valid_pixels, debug_);
+  }
+
+  if (input_data_not_usable)
+  {
+    if (debug_)
+    {
+      ROS_WARN_STREAM("[PlaneCalibrationNodelet]: Input data not usable, not going to calibrate");
+    }
+    return false;
+  }
+
+  return true;
+}
+
+void PlaneCalibrationNodelet::setupProcessing()
+{
+  CameraModel processing_camera_model;
+  processing_camera_model.update(processing_camera_parameters_);
+
   if (!plane_calibration_)
   {
-    plane_calibration_ = std::make_shared<PlaneCalibration>(*camera_model_, calibration_parameters_, depth_visualizer_);
+    // starts building the precomputed planes in the background
+    plane_calibration_ = std::make_shared<PlaneCalibration>(processing_camera_model, calibration_parameters_,
+                                                            depth_visualizer_);
   }
 
   if (!input_filter_)
   {
-    input_filter_ = std::make_shared<InputFilter>(*camera_model_, calibration_parameters_, depth_visualizer_,
+    input_filter_ = std::make_shared<InputFilter>(processing_camera_model, calibration_parameters_, depth_visualizer_,
                                                   input_filter_config_);
   }
 
   if (!calibration_validation_)
   {
-    calibration_validation_ = std::make_shared<CalibrationValidation>(*camera_model_, calibration_parameters_,
+    calibration_validation_ = std::make_shared<CalibrationValidation>(processing_camera_model, calibration_parameters_,
                                                                       calibration_validation_config_,
                                                                       depth_visualizer_);
   }
 
   if (!plane_to_depth_converter_)
   {
-    plane_to_depth_converter_ = std::make_shared<PlaneToDepthImage>(camera_model_->getParameters());
+    plane_to_depth_converter_ = std::make_shared<PlaneToDepthImage>(processing_camera_parameters_);
+
+    std::lock_guard<std::mutex> lock(result_mutex_);
+    if (last_valid_calibration_result_plane_.size() != 0)
+    {
+      last_valid_calibration_result_plane_ = plane_to_depth_converter_->convert(last_valid_calibration_transformation_);
+    }
   }
+}
+
+void PlaneCalibrationNodelet::updateDownsampling()
+{
+  int downsample_factor = downsample_factor_;
+  CameraModel::Parameters camera_parameters = DepthDownsampler::downsample(camera_model_->getParameters(),
+                                                                           downsample_factor);
 
-  Eigen::MatrixXf depth_matrix;
+  bool processing_size_changed = downsample_factor != processing_downsample_factor_
+      || camera_parameters.width_ != processing_camera_parameters_.width_
+      || camera_parameters.height_ != processing_camera_parameters_.height_;
 
-  bool converted_successfully = ImageMsgEigenConverter::convert(depth_image_msg, depth_matrix);
-  if (!converted_successfully)
+  bool processing_model_changed = processing_size_changed
+      || camera_parameters.center_x_ != processing_camera_parameters_.center_x_
+      || camera_parameters.center_y_ != processing_camera_parameters_.center_y_
+      || camera_parameters.f_x_ != processing_camera_parameters_.f_x_
+      || camera_parameters.f_y_ != processing_camera_parameters_.f_y_;
+
+  processing_downsample_factor_ = downsample_factor;
+  processing_camera_parameters_ = camera_parameters;
+
+  if (processing_model_changed)
   {
-    ROS_ERROR_STREAM("[PlaneCalibrationNodelet]: Conversion from image msg to Eigen matrix failed");
-    return;
+    // the debug clouds are made from images of the processing size
+    processing_camera_model_.update(camera_parameters);
+    depth_visualizer_->setCameraModel(camera_parameters);
   }
 
-  getTransform();
-
-  if (!transform_)
+  if (!processing_size_changed)
   {
     return;
   }
 
-  runCalibration(depth_matrix);
-  publishTransform();
+  ROS_INFO_STREAM("[PlaneCalibrationNodelet]: Processing resolution: " << camera_parameters.width_ << "x"
+                  << camera_parameters.height_);
+
+  // everything which holds images needs to be made again for the new size, the other stages must not use it anymore
+  waitForPipeline();
+  plane_calibration_.reset();
+  input_filter_.reset();
+  calibration_validation_.reset();
+  plane_to_depth_converter_.reset();
+
+  // the new plane calibration has to set up its planes on the first run
+  calibration_parameters_->update(calibration_parameters_->getParameters());
 }
 
 void PlaneCalibrationNodelet::getTransform()
@@ -250,13 +634,20 @@ void PlaneCalibrationNodelet::getTransform()
   {
     ROS_INFO_STREAM("[PlaneCalibrationNodelet]: Sensor transform changed, resetting calibration");
 
-    last_valid_calibration_result_plane_ = Eigen::MatrixXf();
-    last_valid_calibration_result_ = std::make_pair(0.0, 0.0);
-    last_valid_calibration_transformation_ = Eigen::Translation3d(transform.first) * transform.second;
-
-    transform_ = std::make_shared<std::pair<Eigen::Vector3d, Eigen::AngleAxisd>>(transform);
+    {
+      std::lock_guard<std::mutex> lock(result_mutex_);
+      last_valid_calibration_result_plane_ = DepthMatrix();
+      last_valid_calibration_result_ = std::make_pair(0.0, 0.0);
+      last_valid_calibration_transformation_ = Eigen::Translation3d(transform.first) * transform.second;
+      transform_ = std::make_shared<std::pair<Eigen::Vector3d, Eigen::AngleAxisd>>(transform);
+    }
     calibration_parameters_->update(transform_->first, transform_->second);
-    input_filter_->updateBorders();
+
+    // not set up yet if called from the camera info
+    if (input_filter_)
+    {
+      input_filter_->updateBorders();
+    }
   }
 }
 
@@ -271,7 +662,6 @@ std::pair<Eigen::Vector3d, Eigen::AngleAxisd> PlaneCalibrationNodelet::getTransf
   return std::make_pair(offset, rotation);
 }
 
-double restored_sensor_height(0.0f);
 std::pair<Eigen::Vector3d, Eigen::AngleAxisd> PlaneCalibrationNodelet::getTransformTF()
 {
   geometry_msgs::TransformStamped transformStamped;
@@ -295,121 +685,30 @@ std::pair<Eigen::Vector3d, Eigen::AngleAxisd> PlaneCalibrationNodelet::getTransf
   return std::make_pair(scale_to_ground * sensor_z_axis, rotation);
 }
 
-void PlaneCalibrationNodelet::runCalibration(Eigen::MatrixXf depth_matrix)
+bool PlaneCalibrationNodelet::groundLooksPlanar(const DepthMap& raw_depth, std::vector<Eigen::Vector3f>& xyzs)
 {
-  if (debug_)
-  {
-    static tf2_ros::TransformBroadcaster transform_broadcaster;
-    geometry_msgs::TransformStamped transformStamped;
-
-    transformStamped.header.stamp = ros::Time::now();
-    transformStamped.header.frame_id = camera_depth_frame_;
-
-    CalibrationParameters::Parameters parameters = calibration_parameters_->getParameters();
-
-    transformStamped.child_frame_id = "uncalibrated_ground";
-    tf::transformEigenToMsg(parameters.getTransform(), transformStamped.transform);
-    transform_broadcaster.sendTransform(transformStamped);
-
-    depth_visualizer_->publishCloud("debug/uncalibrated_ground", parameters.getTransform(),
-                                    camera_model_->getParameters());
-  }
-
-  Eigen::MatrixXf raw_depth = depth_matrix;
-    
-  // some candidate parameters
-  const float invalid_height_threshold = 0.04;
-  
   // maximum change of z should be constrained by maximum calibration range
   const float max_z_by_xy( std::tan( max_deviation_ ) );  
   
   // check plane here
   {
-    CameraModel::Parameters cmp = camera_model_->getParameters();
-    Eigen::Matrix3d rot = calibration_parameters_->getParameters().rotation_.matrix().transpose();
-    
-    
-    std::vector< Eigen::Vector3f > xyzs( raw_depth.rows() * raw_depth.cols(), Eigen::Vector3f(0,0,0) );
-    
-    int idx(0);
-    for( int i(0); i<raw_depth.rows(); i++ )
-    {
-      for( int j(0); j<raw_depth.cols(); j++, idx ++ )
-      {
-        double depth = raw_depth(i,j);
-        if( std::isnan(depth) || depth > maximum_range_of_depth_camera )
-        {
-          continue;
-        }
-        
-        Eigen::Vector3d nv(j,i,1);
-        nv.x() -= cmp.center_x_;
-        nv.y() -= cmp.center_y_;
-        nv.x() /= cmp.f_x_;
-        nv.y() /= cmp.f_y_;
-        nv *= depth;
-        
-        xyzs[idx] = (rot * nv).cast<float>();
-      }
-    }
-    
-    const int sw = 2;
-    const int erows = raw_depth.rows() - sw;
-    const int ecols = raw_depth.cols() - sw;
-    
+    GroundChecks::PlanarityStatistics statistics = GroundChecks::planarity(
+        raw_depth, processing_camera_parameters_, calibration_parameters_->getParameters().rotation_,
+        maximum_range_of_depth_camera, max_z_by_xy, xyzs, calibration_parameters_->getKernelThreads());
     
-    int valid_points(0);
-    float avg_normalized_z_by_x(0);
-    float avg_normalized_z_by_y(0);
+    int valid_points(statistics.valid_points);
+    float avg_normalized_z_by_x(statistics.normalized_z_by_x);
+    float avg_normalized_z_by_y(statistics.normalized_z_by_y);
     
-    int invalid_points_x(0);
-    int invalid_points_y(0);
-    float avg_invalid_normalized_z_by_x(0);
-    float avg_invalid_normalized_z_by_y(0);
-     
-    
-    for( int i(sw); i<erows; i++ )
-    {
-      idx = i * raw_depth.cols() + sw;
-      for( int j(sw); j<ecols; j++, idx++ )
-      {
-        if( xyzs[idx-sw].x() == 0.0f 
-        || xyzs[idx+sw].x() == 0.0f
-        || xyzs[idx+raw_depth.cols()*sw].x() == 0.0f
-        || xyzs[idx-raw_depth.cols()*sw].x() == 0.0f )
-        {
-          continue;
-        }
-        
-        Eigen::Vector3f dx = xyzs[idx+sw] - xyzs[idx-sw];
-        Eigen::Vector3f dy = xyzs[idx+raw_depth.cols()*sw] - xyzs[idx-raw_depth.cols()*sw];
-        
-        valid_points++;
-        
-        float normalized_z_by_x = std::abs( dx.z() / dx.head<2>().norm() );
-        float normalized_z_by_y = std::abs( dy.z() / dy.head<2>().norm() );   
-        
-        avg_normalized_z_by_x += normalized_z_by_x;
-        avg_normalized_z_by_y += normalized_z_by_y;
-        
-        if( normalized_z_by_x > max_z_by_xy )
-        {
-          invalid_points_x++;
-          avg_invalid_normalized_z_by_x += normalized_z_by_x;
-        }
-        
-        if( normalized_z_by_y > max_z_by_xy )
-        {
-          invalid_points_y++;
-          avg_invalid_normalized_z_by_y += normalized_z_by_y;          
-        }
-      }
-    }
+    int invalid_points_x(statistics.invalid_points_x);
+    int invalid_points_y(statistics.invalid_points_y);
+    float avg_invalid_normalized_z_by_x(statistics.invalid_normalized_z_by_x);
+    float avg_invalid_normalized_z_by_y(statistics.invalid_normalized_z_by_y);
     
-    if( valid_points < 40000 )
+    if( valid_points < min_valid_point_ratio * raw_depth.size() )
     {
       ROS_INFO("[PlaneCalibrationNodelet]: You do not have enough points for plane calibration ");
-      return;      
+      return false;
     }
     
     avg_normalized_z_by_x /= static_cast<float>( valid_points );
@@ -421,7 +720,7 @@ void PlaneCalibrationNodelet::runCalibration(Eigen::MatrixXf depth_matrix)
       {
         ROS_INFO_STREAM("[PlaneCalibrationNodelet]: valid_points = " << valid_points  << " normalized_z_by_x = " << avg_normalized_z_by_x <<" normalized_z_by_y = " << avg_normalized_z_by_y);
       }
-      return;
+      return false;
     }
     
     if( invalid_points_x > 10 ) 
@@ -433,7 +732,7 @@ void PlaneCalibrationNodelet::runCalibration(Eigen::MatrixXf depth_matrix)
         {
          ROS_INFO_STREAM("[PlaneCalibrationNodelet]: invalid_points_x = " << invalid_points_x << ", avg_invalid_normalized_z_by_x = " << avg_invalid_normalized_z_by_x);
         }
-        return;
+        return false;
       }
     }
     else 
@@ -453,7 +752,7 @@ void PlaneCalibrationNodelet::runCalibration(Eigen::MatrixXf depth_matrix)
         {
           ROS_INFO_STREAM("[PlaneCalibrationNodelet]: invalid_points_y = " << invalid_points_y << ", avg_invalid_normalized_z_by_y = " << avg_invalid_normalized_z_by_y);
         }
-        return;
+        return false;
       }
     }
     else 
@@ -464,39 +763,46 @@ void PlaneCalibrationNodelet::runCalibration(Eigen::MatrixXf depth_matrix)
       }
     }
     
-  }  
-  
-  input_filter_->filter(depth_matrix, debug_);
-
-  bool input_data_not_usable = !input_filter_->dataIsUsable(depth_matrix, debug_);
-  if (input_data_not_usable)
-  {
-    if (debug_)
-    {
-      ROS_WARN_STREAM("[PlaneCalibrationNodelet]: Input data not usable, not going to calibrate");
-    }
-    return;
   }
 
-  if (!always_update_ && last_valid_calibration_result_plane_.size() != 0)
+  return true;
+}
+
+bool PlaneCalibrationNodelet::calibrate(DepthFrame& frame)
+{
+  if (!always_update_)
   {
-    // is there any update from calibration module ?
-    bool parameters_updated = calibration_parameters_->parametersUpdated();
-    
-    // can we use past calibration results for incoming data ?
-    bool last_calibration_gone_bad = calibration_validation_->groundPlaneHasDataBelow( last_valid_calibration_result_plane_, depth_matrix, debug_);
-    if (!parameters_updated && !last_calibration_gone_bad)
+    std::lock_guard<std::mutex> lock(result_mutex_);
+    if (last_valid_calibration_result_plane_.size() != 0)
     {
-      if (debug_)
+      // is there any update from calibration module ?
+      bool parameters_updated = calibration_parameters_->parametersUpdated();
+
+      // can we use past calibration results for incoming data ?
+      bool last_calibration_gone_bad = calibration_validation_->groundPlaneHasDataBelow(
+          last_valid_calibration_result_plane_, frame.valid_pixels, debug_);
+      if (!parameters_updated && !last_calibration_gone_bad)
       {
-        ROS_INFO_STREAM("[PlaneCalibrationNodelet]: Last calibration data still works, not going to calibrate");
+        if (debug_)
+        {
+          ROS_INFO_STREAM("[PlaneCalibrationNodelet]: Last calibration data still works, not going to calibrate");
+        }
+        return false;
       }
-      return;
     }
   }
 
-  CalibrationParameters::Parameters parameters = calibration_parameters_->getParameters();
-  std::pair<double, double> calibration_result = plane_calibration_->calibrate(depth_matrix, iterations_);
+  frame.parameters = calibration_parameters_->getParameters();
+  const CalibrationParameters::Parameters& parameters = frame.parameters;
+  std::pair<double, double> calibration_result;
+  if (frame.millimeter_depth)
+  {
+    calibration_result = plane_calibration_->calibrate(frame.filtered_millimeter_depth, iterations_);
+  }
+  else
+  {
+    calibration_result = plane_calibration_->calibrate(frame.valid_pixels, iterations_);
+  }
 
   if (debug_)
   {
@@ -509,7 +815,7 @@ void PlaneCalibrationNodelet::runCalibration(Eigen::MatrixXf depth_matrix)
 
     Eigen::Affine3d transform = Eigen::Translation3d(parameters.ground_plane_offset_) * rotation;
 
-    depth_visualizer_->publishCloud("debug/calibration_result", transform, camera_model_->getParameters());
+    depth_visualizer_->publishCloud("debug/calibration_result", transform, processing_camera_model_.getParameters());
   }
 
   bool valid_calibration_angles = calibration_validation_->angleOffsetValid(calibration_result);
@@ -523,7 +829,7 @@ void PlaneCalibrationNodelet::runCalibration(Eigen::MatrixXf depth_matrix)
           "[PlaneCalibrationNodelet]: x,y angles [degree]: " << ecl::radians_to_degrees(calibration_result.first) << ", " << ecl::radians_to_degrees(calibration_result.second));
     }
     //keep old / last one
-    return;
+    return false;
   }
   
   // check discontinuity
@@ -538,54 +844,37 @@ void PlaneCalibrationNodelet::runCalibration(Eigen::MatrixXf depth_matrix)
       ROS_WARN_STREAM( "[PlaneCalibrationNodelet]: Too big change of angles. xangle_diff[degree]: " << xangle_diff << ", yangle_diff[degree] " << yangle_diff );
     }
   }
-  
-  
+
+  frame.calibration_result = calibration_result;
+  return true;
+}
+
+void PlaneCalibrationNodelet::validate(DepthFrame& frame)
+{
+  // some candidate parameters
+  const float invalid_height_threshold = 0.04;
+
+  const CalibrationParameters::Parameters& parameters = frame.parameters;
+  const std::pair<double, double>& calibration_result = frame.calibration_result;
+  DepthMap raw_depth = frame.image().map();
 
   Eigen::AngleAxisd rotation;
   rotation = parameters.rotation_ * Eigen::AngleAxisd(calibration_result.first, Eigen::Vector3d::UnitX())
       * Eigen::AngleAxisd(calibration_result.second, Eigen::Vector3d::UnitY());
 
   Eigen::Affine3d transform = Eigen::Translation3d(parameters.ground_plane_offset_) * rotation;
-  Eigen::MatrixXf new_ground_plane = plane_to_depth_converter_->convert(transform);
+  plane_to_depth_converter_->convert(transform, frame.ground_plane);
   
   {
-    CameraModel::Parameters cmp = camera_model_->getParameters();
-    Eigen::Matrix3d rot = rotation.matrix();
-    
-    float avg_height(0);
-    float avg_invalid_point_height(0);
-    int valid_points(0);
-    int invalid_points(0);
-    
-    for( int i(0); i<raw_depth.rows(); i++ )
-    {
-      for( int j(0); j<raw_depth.cols(); j++ )
-      {
-        double depth = raw_depth(i,j);
-        if( std::isnan(depth) || depth > maximum_range_of_depth_camera )
-        {
-          continue;
-        }
-        
-        Eigen::Vector3d nv(j,i,1);
-        nv.x() -= cmp.center_x_;
-        nv.y() -= cmp.center_y_;
-        nv.x() /= cmp.f_x_;
-        nv.y() /= cmp.f_y_;
-        nv *= depth;
-        
-        Eigen::Vector3d prj = rot.transpose() * nv;
-        double height_from_ground = prj.z() + restored_sensor_height;
-        
-        avg_height += std::abs(height_from_ground);
-        valid_points ++;
-        if( std::abs(height_from_ground) > invalid_height_threshold )
-        {
-          avg_invalid_point_height += std::abs(height_from_ground);
-          invalid_points ++;
-        }
-      }
-    }
+    // raw data up to the camera range, the same rays as the planes
+    frame.range_valid_pixels.compact(raw_depth, plane_to_depth_converter_->getXYMultipliers(),
+                                     maximum_range_of_depth_camera);
+
+    GroundChecks::HeightStatistics heights = GroundChecks::pointHeights(frame.range_valid_pixels, rotation,
+                                                                        frame.sensor_height,
+                                                                        invalid_height_threshold, frame.point_heights);
+    int invalid_points = heights.invalid_points;
+    float avg_invalid_point_height = heights.invalid_height_sum;
 
     if( invalid_points > 10 )
     { 
@@ -605,7 +894,7 @@ void PlaneCalibrationNodelet::runCalibration(Eigen::MatrixXf depth_matrix)
     }
   }
 
-  bool good_calibration = calibration_validation_->groundPlaneFitsData(new_ground_plane, depth_matrix, debug_);
+  bool good_calibration = calibration_validation_->groundPlaneFitsData(frame.ground_plane, frame.valid_pixels, debug_);
   if (!good_calibration)
   {
     if (debug_)
@@ -616,6 +905,13 @@ void PlaneCalibrationNodelet::runCalibration(Eigen::MatrixXf depth_matrix)
     return;
   }
 
+  std::lock_guard<std::mutex> lock(result_mutex_);
+  // the ground transform changed while this frame was calibrated
+  if (frame.ground_transform != transform_)
+  {
+    return;
+  }
+
   std::stringstream angle_change_string;
   angle_change_string << "px [degree]: " << ecl::radians_to_degrees(last_valid_calibration_result_.first) << " -> "
       << ecl::radians_to_degrees(calibration_result.first);
@@ -632,7 +928,8 @@ void PlaneCalibrationNodelet::runCalibration(Eigen::MatrixXf depth_matrix)
   ROS_INFO_STREAM("[PlaneCalibrationNodelet]: Updated the calibration angles: " << angle_change_string.str());
 
   last_valid_calibration_result_ = calibration_result;
-  last_valid_calibration_result_plane_ = new_ground_plane;
+  // the frame gets the old plane's memory for its next result
+  last_valid_calibration_result_plane_.swap(frame.ground_plane);
   last_valid_calibration_transformation_ = transform;
 }
 
@@ -645,11 +942,21 @@ void PlaneCalibrationNodelet::publishTransform()
   transformStamped.header.frame_id = camera_depth_frame_;
   transformStamped.child_frame_id = result_frame_;
 
-  if (transform_)
+  // called by the depth image callback and the calibration worker
+  std::shared_ptr<std::pair<Eigen::Vector3d, Eigen::AngleAxisd>> ground_transform;
+  Eigen::Affine3d calibration_transformation;
+  {
+    std::lock_guard<std::mutex> lock(result_mutex_);
+    ground_transform = transform_;
+    calibration_transformation = last_valid_calibration_transformation_;
+  }
+
+  if (ground_transform)
   {
-    Eigen::Affine3d inverse_transform = (Eigen::Translation3d(transform_->first) * transform_->second).inverse();
+    Eigen::Affine3d inverse_transform = (Eigen::Translation3d(ground_transform->first)
+        * ground_transform->second).inverse();
 
-    Eigen::Affine3d camera_from_detected_ground = last_valid_calibration_transformation_ * inverse_transform;
+    Eigen::Affine3d camera_from_detected_ground = calibration_transformation * inverse_transform;
     tf::transformEigenToMsg(camera_from_detected_ground.inverse(), transformStamped.transform);
   }
   else
@@ -664,11 +971,11 @@ void PlaneCalibrationNodelet::publishTransform()
   if (debug_)
   {
     transformStamped.child_frame_id = "detected_ground";
-    tf::transformEigenToMsg(last_valid_calibration_transformation_, transformStamped.transform);
+    tf::transformEigenToMsg(calibration_transformation, transformStamped.transform);
     transform_broadcaster.sendTransform(transformStamped);
 
-    depth_visualizer_->publishCloud("debug/calibrated_plane", last_valid_calibration_transformation_,
-                                    camera_model_->getParameters());
+    depth_visualizer_->publishCloud("debug/calibrated_plane", calibration_transformation,
+                                    processing_camera_model_.getParameters());
   }
 }
 
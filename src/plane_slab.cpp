@@ -0,0 +1,38 @@
+#include "plane_calibration/plane_slab.hpp"
+
+#include <cstdlib>
+#include <sys/mman.h>
+
+namespace plane_calibration
+{
+
+const std::size_t AlignedMemory::alignment;
+const std::size_t AlignedMemory::huge_page_size;
+
+void* AlignedMemory::allocate(const std::size_t& bytes)
+{
+  bool use_huge_pages = bytes >= huge_page_size;
+
+  void* memory = nullptr;
+  if (posix_memalign(&memory, use_huge_pages ? huge_page_size : alignment, bytes) != 0)
+  {
+    return nullptr;
+  }
+
+#ifdef MADV_HUGEPAGE
+  if (use_huge_pages)
+  {
+    // only a hint, fails quietly if transparent huge pages are disabled
+    madvise(memory, bytes, MADV_HUGEPAGE);
+  }
+#endif
+
+  return memory;
+}
+
+void AlignedMemory::free(void* memory)
+{
+  std::free(memory);
+}
+
+} /* end namespace */
@@ -1,6 +1,10 @@
 #include "plane_calibration/plane_to_depth_image.hpp"
 
 #include <iostream>
+#include <limits>
+
+#include "plane_calibration/depth_kernels.hpp"
+#include "plane_calibration/fixed_size_kernels.hpp"
 
 namespace plane_calibration
 {
@@ -13,96 +17,115 @@ PlaneToDepthImage::PlaneToDepthImage(const CameraModel::Parameters& camera_model
   xy_multipliers_ = depthCalculationXYMultiplier(camera_model_paramaters_);
 }
 
-Eigen::MatrixXf PlaneToDepthImage::convert(const Eigen::Affine3d& plane_transformation)
+DepthMatrix PlaneToDepthImage::convert(const Eigen::Affine3d& plane_transformation)
+{
+  DepthMatrix result;
+  convert(plane_transformation, camera_model_paramaters_, xy_multipliers_, result);
+  return result;
+}
+
+void PlaneToDepthImage::convert(const Eigen::Affine3d& plane_transformation, DepthMatrix& out_depth) const
 {
-  return convert(plane_transformation, camera_model_paramaters_, xy_multipliers_);
+  convert(plane_transformation, camera_model_paramaters_, xy_multipliers_, out_depth);
 }
 
-MatrixXf PlaneToDepthImage::convert(const Affine3d& plane_transformation,
-                                    const CameraModel::Parameters& camera_model_paramaters)
+DepthMatrix PlaneToDepthImage::convert(const Affine3d& plane_transformation,
+                                       const CameraModel::Parameters& camera_model_paramaters)
 {
   // inverting the depth to point cloud calculations, see package depth_image_proc -> depth_conversions.h
   // (u - c) * depth * (1 / f) -> depth * ( (u - c) / f) -> depth * multiplier
-  std::pair<MatrixXd, MatrixXd> xy_multipliers = depthCalculationXYMultiplier(camera_model_paramaters);
+  XYMultipliers xy_multipliers = depthCalculationXYMultiplier(camera_model_paramaters);
 
-  return convert(plane_transformation, camera_model_paramaters, xy_multipliers);
+  DepthMatrix result;
+  convert(plane_transformation, camera_model_paramaters, xy_multipliers, result);
+  return result;
 }
 
-MatrixXf PlaneToDepthImage::convert(const Affine3d& plane_transformation,
-                                    const CameraModel::Parameters& camera_model_paramaters,
-                                    const std::pair<Eigen::MatrixXd, Eigen::MatrixXd>& xy_multipliers)
+void PlaneToDepthImage::convert(const Affine3d& plane_transformation,
+                                const CameraModel::Parameters& camera_model_paramaters,
+                                const XYMultipliers& xy_multipliers, DepthMatrix& out_depth)
 {
-  MatrixXd result_image_matrix;
+  // a*x + b*y + c*z + d = 0
+  // a * (depth * x_multiplier) + b * (depth * y_multiplier) + c * depth + d = 0
+  // depth * ( a * x_multiplier + b * y_multiplier + c) + d = 0
+  // depth * ( a * x_multiplier + b * y_multiplier + c) = -d
+  // depth = -d / ( a * x_multiplier + b * y_multiplier + c)
+  FixedSizeKernels::planeDepth(FixedSizeKernels::select(camera_model_paramaters),
+                               planeCoefficients(plane_transformation), xy_multipliers.first, xy_multipliers.second,
+                               out_depth);
+}
 
+Vector4f PlaneToDepthImage::planeCoefficients(const Eigen::Affine3d& plane_transformation)
+{
   Vector3d translation = plane_transformation.translation();
-  double distance = translation.norm();
-  int height = camera_model_paramaters.height_;
 
   Vector4d z_axis(0.0, 0.0, 1.0, 0.0);
   Vector4d plane_normal = plane_transformation * z_axis;
   Hyperplane<double, 3> plane(plane_normal.topRows(3), translation);
 
-  // a*x + b*y + c*z + d = 0
-  // a * (depth * x_multiplier) + b * (depth * y_multiplier) + c * depth + d = 0
-  // depth * ( a * x_multiplier + b * y_multiplier + c) + d = 0
-  // depth * ( a * x_multiplier + b * y_multiplier + c) = -d
-  // depth = -d / ( a * x_multiplier + b * y_multiplier + c)
+  return plane.coeffs().cast<float>();
+}
 
-  MatrixXd x = plane.coeffs().coeff(0) * xy_multipliers.first;
-  MatrixXd y = plane.coeffs().coeff(1) * xy_multipliers.second;
-  double z = plane.coeffs().coeff(2); //same for all rays
+MillimeterDepthMatrix PlaneToDepthImage::convertMillimeters(const Eigen::Affine3d& plane_transformation)
+{
+  MillimeterDepthMatrix result;
+  quantize(convert(plane_transformation), result);
+  return result;
+}
 
-  result_image_matrix = -plane.coeffs().coeff(3) / ((x + y).array() + z);
+void PlaneToDepthImage::quantize(const DepthConstRef& depth, MillimeterDepthMatrix& out_millimeter_depth)
+{
+  const float max_millimeters = std::numeric_limits<unsigned short>::max();
 
-  return result_image_matrix.cast<float>();
+  // (nan > 0) is false, so nans end up as 0 as well, + 0.5 for rounding
+  out_millimeter_depth = (depth.array() > 0.0f).select((depth.array() * 1000.0f + 0.5f).min(max_millimeters), 0.0f).cast<
+      unsigned short>().matrix();
 }
 
-std::pair<MatrixXd, MatrixXd> PlaneToDepthImage::depthCalculationXYMultiplier(
+PlaneToDepthImage::XYMultipliers PlaneToDepthImage::depthCalculationXYMultiplier(
     const CameraModel::Parameters& camera_model_paramaters)
 {
-  MatrixXd xy_factor_matrix(2 * camera_model_paramaters.height_, camera_model_paramaters.width_);
-
-  VectorXd x_indices_lin = VectorXd::LinSpaced(camera_model_paramaters.width_, 0.0, camera_model_paramaters.width_ - 1);
-  VectorXd y_indices_lin = VectorXd::LinSpaced(camera_model_paramaters.height_, 0.0,
-                                               camera_model_paramaters.height_ - 1);
-
-  MatrixXd x_indices_matrix = (x_indices_lin * VectorXd::Ones(camera_model_paramaters.height_).transpose()).transpose();
-  MatrixXd y_indices_matrix = y_indices_lin * VectorXd::Ones(camera_model_paramaters.width_).transpose();
+  VectorXd x_indices = VectorXd::LinSpaced(camera_model_paramaters.width_, 0.0, camera_model_paramaters.width_ - 1);
+  VectorXd y_indices = VectorXd::LinSpaced(camera_model_paramaters.height_, 0.0, camera_model_paramaters.height_ - 1);
 
   // (u - c) * d * (1 / f) -> d * ( (u - c) / f) -> d * multiplier
-  MatrixXd x_multiplier = (x_indices_matrix.array() - camera_model_paramaters.center_x_) / camera_model_paramaters.f_x_;
-  MatrixXd y_multiplier = (y_indices_matrix.array() - camera_model_paramaters.center_y_) / camera_model_paramaters.f_y_;
+  XYMultipliers xy_multipliers;
+  xy_multipliers.first = ((x_indices.array() - camera_model_paramaters.center_x_) / camera_model_paramaters.f_x_)
+      .cast<float>().matrix().transpose();
+  xy_multipliers.second = ((y_indices.array() - camera_model_paramaters.center_y_) / camera_model_paramaters.f_y_)
+      .cast<float>().matrix();
 
-  std::pair<MatrixXd, MatrixXd> multiplier_pair(x_multiplier, y_multiplier);
-  return multiplier_pair;
+  return xy_multipliers;
 }
 
-struct real_value {
-  typedef float result_value;
-  float operator()(float value) const {
-    return std::isnan(value) ? 0. : value;
-  }
-};
+const CameraModel::Parameters& PlaneToDepthImage::getCameraParameters() const
+{
+  return camera_model_paramaters_;
+}
+
+const PlaneToDepthImage::XYMultipliers& PlaneToDepthImage::getXYMultipliers() const
+{
+  return xy_multipliers_;
+}
 
 PlaneToDepthImage::Errors PlaneToDepthImage::getErrors(const Eigen::Affine3d& plane_transformation,
                                                        const CameraModel::Parameters& camera_model_paramaters,
-                                                       Eigen::MatrixXf image_matrix)
+                                                       const DepthConstRef& image_matrix)
 {
-  Eigen::MatrixXf plane = convert(plane_transformation, camera_model_paramaters);
+  DepthMatrix plane = convert(plane_transformation, camera_model_paramaters);
 
-  Eigen::MatrixXf difference = (plane - image_matrix).cwiseAbs();
-
-  // nan == nan gives false
-  int not_nan_count = (difference.array() == difference.array()).count();
-
-  difference = difference.unaryExpr(real_value());
-
-  double mean = difference.sum() / not_nan_count;
+  DepthKernels::DifferenceStatistics statistics;
+  for (int row = 0; row < plane.rows(); ++row)
+  {
+    statistics += DepthKernels::differenceStatistics(plane.row(row).data(), image_matrix.row(row).data(),
+                                                     plane.cols());
+  }
 
   Errors errors;
-  errors.mean = mean;
-  errors.min = difference.minCoeff();
-  errors.max = difference.maxCoeff();
+  errors.mean = statistics.abs_sum / statistics.valid_count;
+  // nan differences count as 0
+  errors.min = statistics.valid_count < plane.size() ? 0.0f : statistics.abs_min;
+  errors.max = statistics.abs_max;
 
   return errors;
 }
@@ -1,107 +1,762 @@
 #include "plane_calibration/planes.hpp"
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <cmath>
 #include <iostream>
+#include <thread>
+#include <vector>
+
+#include "plane_calibration/depth_kernels.hpp"
+#include "plane_calibration/deviation_planes.hpp"
+#include "plane_calibration/planes_file.hpp"
 
 namespace plane_calibration
 {
 
 Planes::Planes(const CalibrationParameters::Parameters& parameters, const PlaneToDepthImage& plane_to_depth) :
-    plane_to_depth_(plane_to_depth)
+    parameters_(parameters), plane_to_depth_(plane_to_depth)
 {
-  pair_count_ = parameters.precomputed_plane_pairs_count_;
-  max_deviation_ = parameters.max_deviation_;
-
-  translation_ = Eigen::Translation3d(parameters.ground_plane_offset_);
-  base_rotation_ = parameters.rotation_;
+  setup();
 
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
   makePlanes();
+  build_seconds_ = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
 }
 
-void Planes::makePlanes()
+Planes::Planes(const CalibrationParameters::Parameters& parameters, const PlaneToDepthImage& plane_to_depth,
+               const std::string& directory, const bool& shared) :
+    parameters_(parameters), plane_to_depth_(plane_to_depth)
+{
+  setup();
+
+  // all planes are in the file
+  lazy_ = false;
+
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  std::string key = fileKey(parameters_, plane_to_depth_);
+  file_ = PlanesFile::open(directory + "/" + PlanesFile::fileName(key), key, bankBytes(), shared);
+  if (file_)
+  {
+    // same order as bankBytes
+    int plane_count = 2 * pair_count_ + 1;
+    x_planes_.view(file_->blob(0), floatPlanes() ? plane_count : 0, rows_, cols_);
+    y_planes_.view(file_->blob(1), floatPlanes() ? plane_count : 0, rows_, cols_);
+    x_millimeter_planes_.view(file_->blob(2), millimeter_depth_ ? plane_count : 0, rows_, cols_);
+    y_millimeter_planes_.view(file_->blob(3), millimeter_depth_ ? plane_count : 0, rows_, cols_);
+    x_half_planes_.view(file_->blob(4), half_precision_ ? plane_count : 0, rows_, cols_);
+    y_half_planes_.view(file_->blob(5), half_precision_ ? plane_count : 0, rows_, cols_);
+
+    const double* pair_distances = static_cast<const double*>(file_->blob(6));
+    for (std::size_t i = 0; i < bankBytes()[6] / sizeof(double); ++i)
+    {
+      pair_distances_[i].store(pair_distances[i], std::memory_order_relaxed);
+    }
+  }
+  build_seconds_ = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+Planes::~Planes()
+{
+  if (prefetch_thread_.joinable())
+  {
+    {
+      std::lock_guard<std::mutex> lock(prefetch_mutex_);
+      stop_prefetch_ = true;
+    }
+    prefetch_condition_.notify_all();
+    prefetch_thread_.join();
+  }
+}
+
+PlanesPtr Planes::load(const std::string& directory, const CalibrationParameters::Parameters& parameters,
+                       const PlaneToDepthImage& plane_to_depth, const bool& shared)
 {
+  PlanesPtr planes(new Planes(parameters, plane_to_depth, directory, shared));
+  if (!planes->file_)
+  {
+    return PlanesPtr();
+  }
+
+  return planes;
+}
+
+bool Planes::store(const std::string& directory) const
+{
+  std::vector<std::pair<const void*, std::size_t> > blobs;
+  blobs.push_back(std::make_pair(x_planes_.data(), x_planes_.bytes()));
+  blobs.push_back(std::make_pair(y_planes_.data(), y_planes_.bytes()));
+  blobs.push_back(std::make_pair(x_millimeter_planes_.data(), x_millimeter_planes_.bytes()));
+  blobs.push_back(std::make_pair(y_millimeter_planes_.data(), y_millimeter_planes_.bytes()));
+  blobs.push_back(std::make_pair(x_half_planes_.data(), x_half_planes_.bytes()));
+  blobs.push_back(std::make_pair(y_half_planes_.data(), y_half_planes_.bytes()));
+
+  std::vector<double> pair_distances(bankBytes()[6] / sizeof(double));
+  for (std::size_t i = 0; i < pair_distances.size(); ++i)
+  {
+    pair_distances[i] = pair_distances_[i].load(std::memory_order_relaxed);
+  }
+  blobs.push_back(std::make_pair(pair_distances.data(), pair_distances.size() * sizeof(double)));
+
+  std::string key = fileKey(parameters_, plane_to_depth_);
+  return PlanesFile::write(directory + "/" + PlanesFile::fileName(key), key, blobs);
+}
+
+std::string Planes::filePath(const std::string& directory, const CalibrationParameters::Parameters& parameters,
+                             const PlaneToDepthImage& plane_to_depth)
+{
+  return directory + "/" + PlanesFile::fileName(fileKey(parameters, plane_to_depth));
+}
+
+bool Planes::mapped() const
+{
+  return static_cast<bool>(file_);
+}
+
+void Planes::setup()
+{
+  pair_count_ = parameters_.precomputed_plane_pairs_count_;
+  millimeter_depth_ = parameters_.millimeter_depth_;
+  interpolate_planes_ = parameters_.interpolate_planes_;
+  half_precision_ = parameters_.half_precision_planes_ && !millimeter_depth_;
+  max_deviation_ = parameters_.max_deviation_;
+
+  translation_ = Eigen::Translation3d(parameters_.ground_plane_offset_);
+  base_rotation_ = parameters_.rotation_;
+  build_threads_ = parameters_.plane_build_threads_;
+  lazy_ = parameters_.lazy_planes_;
+  prefetch_count_ = parameters_.prefetch_planes_;
+  made_planes_ = 0;
+  stop_prefetch_ = false;
+  prefetch_pending_[x_axis] = false;
+  prefetch_pending_[y_axis] = false;
+
   // When fitting a plane close to the max deviation we have to have
   // some planes outside the max deviation borders
   double buffer_multiplier = 2.2;
-  double angle_step_size = max_deviation_ * buffer_multiplier / pair_count_;
-  double angle = max_deviation_ * buffer_multiplier;
+  angle_step_size_ = pair_count_ > 0 ? max_deviation_ * buffer_multiplier / pair_count_ : 0.0;
+
+  rows_ = plane_to_depth_.getXYMultipliers().second.size();
+  cols_ = plane_to_depth_.getXYMultipliers().first.size();
+
+  int plane_count = 2 * pair_count_ + 1;
+  int pair_distance_count = interpolate_planes_ ? 0 : 2 * plane_count * plane_count;
+  pair_distances_.reset(new std::atomic<double>[pair_distance_count]);
+  for (int i = 0; i < pair_distance_count; ++i)
+  {
+    pair_distances_[i].store(NAN, std::memory_order_relaxed);
+  }
+
+  int interpolated_count = interpolate_planes_ ? 2 : 0;
+  x_interpolated_planes_.resize(floatPlanes() ? interpolated_count : 0, rows_, cols_);
+  y_interpolated_planes_.resize(floatPlanes() ? interpolated_count : 0, rows_, cols_);
+  x_interpolated_millimeter_planes_.resize(millimeter_depth_ ? interpolated_count : 0, rows_, cols_);
+  y_interpolated_millimeter_planes_.resize(millimeter_depth_ ? interpolated_count : 0, rows_, cols_);
+  x_interpolated_half_planes_.resize(half_precision_ ? interpolated_count : 0, rows_, cols_);
+  y_interpolated_half_planes_.resize(half_precision_ ? interpolated_count : 0, rows_, cols_);
+  half_rows_.resize(2, half_precision_ && interpolate_planes_ ? cols_ : 0);
+}
+
+bool Planes::floatPlanes() const
+{
+  // only keep the quantized / half planes, the float ones are not needed for their fitting
+  return !millimeter_depth_ && !half_precision_;
+}
+
+std::vector<std::size_t> Planes::bankBytes() const
+{
+  int plane_count = 2 * pair_count_ + 1;
+
+  std::vector<std::size_t> bytes;
+  bytes.push_back(PlaneSlab<float>::bytes(floatPlanes() ? plane_count : 0, rows_, cols_));
+  bytes.push_back(PlaneSlab<float>::bytes(floatPlanes() ? plane_count : 0, rows_, cols_));
+  bytes.push_back(PlaneSlab<unsigned short>::bytes(millimeter_depth_ ? plane_count : 0, rows_, cols_));
+  bytes.push_back(PlaneSlab<unsigned short>::bytes(millimeter_depth_ ? plane_count : 0, rows_, cols_));
+  bytes.push_back(PlaneSlab<Eigen::half>::bytes(half_precision_ ? plane_count : 0, rows_, cols_));
+  bytes.push_back(PlaneSlab<Eigen::half>::bytes(half_precision_ ? plane_count : 0, rows_, cols_));
+  bytes.push_back((interpolate_planes_ ? 0 : 2 * plane_count * plane_count) * sizeof(double));
+  return bytes;
+}
+
+std::string Planes::fileKey(const CalibrationParameters::Parameters& parameters,
+                            const PlaneToDepthImage& plane_to_depth)
+{
+  // everything the bank planes depend on (see setup). The camera is in the ray multipliers, interpolation and the
+  // build threads don't change the bank
+  std::string key;
+  auto append = [&key](const void* data, const std::size_t& bytes)
+  { key.append(static_cast<const char*>(data), bytes);};
+
+  const PlaneToDepthImage::XYMultipliers& xy_multipliers = plane_to_depth.getXYMultipliers();
+  int flags[] = {static_cast<int>(xy_multipliers.second.size()), static_cast<int>(xy_multipliers.first.size()),
+                 parameters.precomputed_plane_pairs_count_, parameters.millimeter_depth_,
+                 parameters.half_precision_planes_ && !parameters.millimeter_depth_};
+  Eigen::Matrix3d rotation = parameters.rotation_.toRotationMatrix();
+
+  append(flags, sizeof(flags));
+  append(xy_multipliers.first.data(), xy_multipliers.first.size() * sizeof(float));
+  append(xy_multipliers.second.data(), xy_multipliers.second.size() * sizeof(float));
+  append(parameters.ground_plane_offset_.data(), 3 * sizeof(double));
+  append(rotation.data(), 9 * sizeof(double));
+  append(&parameters.max_deviation_, sizeof(double));
+  return key;
+}
+
+void Planes::makePlanes()
+{
+  int plane_count = 2 * pair_count_ + 1;
+
+  x_planes_.resize(floatPlanes() ? plane_count : 0, rows_, cols_);
+  y_planes_.resize(floatPlanes() ? plane_count : 0, rows_, cols_);
+  x_millimeter_planes_.resize(millimeter_depth_ ? plane_count : 0, rows_, cols_);
+  y_millimeter_planes_.resize(millimeter_depth_ ? plane_count : 0, rows_, cols_);
+  x_half_planes_.resize(half_precision_ ? plane_count : 0, rows_, cols_);
+  y_half_planes_.resize(half_precision_ ? plane_count : 0, rows_, cols_);
+
+  if (lazy_)
+  {
+    // value initialized, all empty. The untouched slab pages are not resident
+    slot_states_.reset(new std::atomic<int>[2 * plane_count]());
+    if (prefetch_count_ > 0)
+    {
+      prefetch_thread_ = std::thread(&Planes::runPrefetch, this);
+    }
+    return;
+  }
+
+  // the planes are independent, every worker takes the next index and writes into its slots of the slabs
+  std::atomic<int> next_index(0);
+  auto work = [&]()
+  {
+    // one buffer per worker for all its planes
+    DepthMatrix plane;
+    MillimeterDepthMatrix millimeter_plane;
+
+    for (int index = next_index++; index < plane_count; index = next_index++)
+    {
+      makePlanePair(index, plane, millimeter_plane);
+    }
+  };
+
+  runWorkers(work, plane_count);
+
+  if (millimeter_depth_)
+  {
+    makePairDistances(x_millimeter_planes_, y_millimeter_planes_);
+  }
+  else if (half_precision_)
+  {
+    makePairDistances(x_half_planes_, y_half_planes_);
+  }
+  else
+  {
+    makePairDistances(x_planes_, y_planes_);
+  }
+}
+
+template<typename Scalar>
+void Planes::makePairDistances(const PlaneSlab<Scalar>& x_planes, const PlaneSlab<Scalar>& y_planes)
+{
+  // interpolated planes are never bank planes
+  if (interpolate_planes_)
+  {
+    return;
+  }
+
+  // a job is one upper plane with all its lower planes
+  int plane_count = 2 * pair_count_ + 1;
+  std::atomic<int> next_job(0);
+  auto work = [&]()
+  {
+    for (int job = next_job++; job < 2 * plane_count; job = next_job++)
+    {
+      Axis axis = job < plane_count ? x_axis : y_axis;
+      const PlaneSlab<Scalar>& planes = axis == x_axis ? x_planes : y_planes;
+      int upper_index = job % plane_count;
+
+      for (int lower_index = 0; lower_index <= upper_index; ++lower_index)
+      {
+        pairDistance(axis, upper_index, lower_index).store(
+            squaredDistance(planes.plane(upper_index), planes.plane(lower_index)), std::memory_order_relaxed);
+      }
+    }
+  };
+
+  runWorkers(work, 2 * plane_count);
+}
+
+std::atomic<double>& Planes::pairDistance(const Axis& axis, const int& upper_index, const int& lower_index)
+{
+  int plane_count = 2 * pair_count_ + 1;
+  return pair_distances_[(axis * plane_count + upper_index) * plane_count + lower_index];
+}
+
+void Planes::runWorkers(const std::function<void()>& work, const int& jobs) const
+{
+  int thread_count = std::min(workerCount(build_threads_), jobs);
+  std::vector<std::thread> workers;
+  for (int i = 1; i < thread_count; ++i)
+  {
+    workers.emplace_back(work);
+  }
+
+  work();
+  for (std::thread& worker : workers)
+  {
+    worker.join();
+  }
+}
+
+double Planes::squaredDistance(const MatrixPlane& upper, const MatrixPlane& lower)
+{
+  bool matrix_has_nans = false;
+  return DeviationPlanes::getDistance(upper, lower, matrix_has_nans);
+}
+
+double Planes::squaredDistance(const MillimeterPlane& upper, const MillimeterPlane& lower)
+{
+  return DeviationPlanes::getDistance(upper, lower);
+}
+
+double Planes::squaredDistance(const HalfPlane& upper, const HalfPlane& lower)
+{
+  return DeviationPlanes::getDistance(upper, lower);
+}
+
+template<typename Plane>
+double Planes::fittingTiltDistance(const Axis& axis, const double& angle, const double& deviation,
+                                   const std::pair<Plane, Plane>& planes)
+{
+  if (interpolate_planes_)
+  {
+    return interpolatedDistance(planes.first, planes.second);
+  }
+
+  std::pair<int, int> indices = getDeviationPlaneIndices(angle, deviation);
+  std::atomic<double>& entry = pairDistance(axis, indices.first, indices.second);
+
+  // the same value if two threads fill it at once
+  double distance = entry.load(std::memory_order_relaxed);
+  if (distance != distance)
+  {
+    distance = squaredDistance(planes.first, planes.second);
+    entry.store(distance, std::memory_order_relaxed);
+  }
+
+  return distance;
+}
+
+template<typename Plane>
+double Planes::interpolatedDistance(const Plane& upper, const Plane& lower)
+{
+  return squaredDistance(upper, lower);
+}
+
+double Planes::interpolatedDistance(const HalfPlane& upper, const HalfPlane& lower)
+{
+  return DeviationPlanes::getDistance(upper, lower, half_rows_.row(0));
+}
+
+double Planes::getFittingTiltDistance(const Axis& axis, const double& angle, const double& deviation,
+                                      const std::pair<MatrixPlane, MatrixPlane>& planes)
+{
+  return fittingTiltDistance(axis, angle, deviation, planes);
+}
+
+double Planes::getFittingTiltDistance(const Axis& axis, const double& angle, const double& deviation,
+                                      const std::pair<MillimeterPlane, MillimeterPlane>& planes)
+{
+  return fittingTiltDistance(axis, angle, deviation, planes);
+}
+
+double Planes::getFittingTiltDistance(const Axis& axis, const double& angle, const double& deviation,
+                                      const std::pair<HalfPlane, HalfPlane>& planes)
+{
+  return fittingTiltDistance(axis, angle, deviation, planes);
+}
+
+void Planes::makePlanePair(const int& index, DepthMatrix& plane, MillimeterDepthMatrix& millimeter_plane)
+{
+  makeTiltPlane(x_axis, index, plane, millimeter_plane);
+  makeTiltPlane(y_axis, index, plane, millimeter_plane);
+}
+
+void Planes::makeTiltPlane(const Axis& axis, const int& index, DepthMatrix& plane,
+                           MillimeterDepthMatrix& millimeter_plane)
+{
+  double angle = (index - pair_count_) * angle_step_size_;
+  makePlane(axis == x_axis ? Eigen::Vector2d(angle, 0.0) : Eigen::Vector2d(0.0, angle), plane);
 
-  for (int i = 0; i < pair_count_; ++i)
+  if (millimeter_depth_)
+  {
+    PlaneToDepthImage::quantize(plane, millimeter_plane);
+    (axis == x_axis ? x_millimeter_planes_ : y_millimeter_planes_).plane(index) = millimeter_plane;
+  }
+  else if (half_precision_)
+  {
+    encodeHalf(plane, (axis == x_axis ? x_half_planes_ : y_half_planes_).plane(index));
+  }
+  else
   {
-    addPlanePairs(angle);
-    angle -= angle_step_size;
+    (axis == x_axis ? x_planes_ : y_planes_).plane(index) = plane;
   }
+}
+
+void Planes::ensurePlane(const Axis& axis, const int& index)
+{
+  if (!lazy_ || index < 0 || index > 2 * pair_count_)
+  {
+    return;
+  }
+
+  std::atomic<int>& state = slot_states_[axis * (2 * pair_count_ + 1) + index];
+  while (true)
+  {
+    // the usual case, no locking
+    if (state.load(std::memory_order_acquire) == ready_slot)
+    {
+      return;
+    }
+
+    int expected = empty_slot;
+    if (state.compare_exchange_strong(expected, making_slot, std::memory_order_acq_rel))
+    {
+      try
+      {
+        DepthMatrix plane;
+        MillimeterDepthMatrix millimeter_plane;
+        makeTiltPlane(axis, index, plane, millimeter_plane);
+        state.store(ready_slot, std::memory_order_release);
+        ++made_planes_;
+      }
+      catch (...)
+      {
+        // the next one tries again
+        state.store(empty_slot, std::memory_order_release);
+        std::lock_guard<std::mutex> lock(slot_mutex_);
+        slot_condition_.notify_all();
+        throw;
+      }
 
-  addPlanes(0.0);
+      // waiters check the state with the mutex locked, so they can't miss the notification
+      std::lock_guard<std::mutex> lock(slot_mutex_);
+      slot_condition_.notify_all();
+      return;
+    }
+
+    std::unique_lock<std::mutex> lock(slot_mutex_);
+    slot_condition_.wait(lock, [&state]()
+    { return state.load(std::memory_order_acquire) != making_slot;});
+  }
 }
 
-void Planes::addPlanePairs(const double& angle)
+void Planes::prefetch(const Axis& axis, const int& first_index, const int& last_index)
 {
-  addPlanes(angle);
-  addPlanes(-angle);
+  if (!prefetch_thread_.joinable())
+  {
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(prefetch_mutex_);
+    prefetch_ranges_[axis] = std::make_pair(first_index - prefetch_count_, last_index + prefetch_count_);
+    prefetch_pending_[axis] = true;
+  }
+  prefetch_condition_.notify_all();
 }
 
-void Planes::addPlanes(const double& angle)
+void Planes::runPrefetch()
 {
-  Eigen::Vector2d angles_x(angle, 0.0);
-  MatrixPlanePtr plane_x = std::make_shared<Eigen::MatrixXf>(makePlane(angles_x));
-  x_planes_.insert(std::pair<double, MatrixPlanePtr>(angle, plane_x));
+  while (true)
+  {
+    bool pending[2];
+    std::pair<int, int> ranges[2];
+    {
+      std::unique_lock<std::mutex> lock(prefetch_mutex_);
+      prefetch_condition_.wait(lock, [this]()
+      { return stop_prefetch_ || prefetch_pending_[x_axis] || prefetch_pending_[y_axis];});
+
+      if (stop_prefetch_)
+      {
+        return;
+      }
 
-  Eigen::Vector2d angles_y(0.0, angle);
-  MatrixPlanePtr plane_y = std::make_shared<Eigen::MatrixXf>(makePlane(angles_y));
-  y_planes_.insert(std::pair<double, MatrixPlanePtr>(angle, plane_y));
+      for (int axis = x_axis; axis <= y_axis; ++axis)
+      {
+        pending[axis] = prefetch_pending_[axis];
+        ranges[axis] = prefetch_ranges_[axis];
+        prefetch_pending_[axis] = false;
+      }
+    }
+
+    try
+    {
+      for (int axis = x_axis; axis <= y_axis; ++axis)
+      {
+        for (int index = ranges[axis].first; pending[axis] && index <= ranges[axis].second; ++index)
+        {
+          ensurePlane(static_cast<Axis>(axis), index);
+        }
+      }
+    }
+    catch (const std::bad_alloc&)
+    {
+      // only a prefetch, the calibration makes the plane itself when it needs it
+    }
+  }
 }
 
-Eigen::MatrixXf Planes::makePlane(const Eigen::Vector2d& angles)
+int Planes::workerCount(const int& threads)
+{
+  if (threads > 0)
+  {
+    return threads;
+  }
+
+  // 0 if unknown
+  return std::max(static_cast<int>(std::thread::hardware_concurrency()), 1);
+}
+
+void Planes::makePlane(const Eigen::Vector2d& angles, DepthMatrix& out_plane) const
 {
   Eigen::AngleAxisd tilt_x(angles.x(), Eigen::Vector3d::UnitX());
   Eigen::AngleAxisd tilt_y(angles.y(), Eigen::Vector3d::UnitY());
   Eigen::Affine3d transform = translation_ * base_rotation_ * tilt_x * tilt_y;
 
-  return plane_to_depth_.convert(transform);
+  plane_to_depth_.convert(transform, out_plane);
+}
+
+void Planes::encodeHalf(const DepthMatrix& plane, PlaneSlab<Eigen::half>::PlaneMap out_plane)
+{
+  // both are contiguous row major
+  DepthKernels::floatToHalf(plane.data(), reinterpret_cast<unsigned short*>(out_plane.data()), plane.size());
+}
+
+std::pair<MatrixPlane, MatrixPlane> Planes::getFittingXTiltPlanes(const double& angle, const double& deviation)
+{
+  return getFittingTiltPlanes(x_axis, x_planes_, x_interpolated_planes_, angle, deviation);
 }
 
-std::pair<MatrixPlanePtr, MatrixPlanePtr> Planes::getFittingXTiltPlanes(const double& angle, const double& deviation)
+std::pair<MatrixPlane, MatrixPlane> Planes::getFittingYTiltPlanes(const double& angle, const double& deviation)
 {
-  return getFittingTiltPlanes(x_planes_, angle, deviation);
+  return getFittingTiltPlanes(y_axis, y_planes_, y_interpolated_planes_, angle, deviation);
 }
 
-std::pair<MatrixPlanePtr, MatrixPlanePtr> Planes::getFittingYTiltPlanes(const double& angle, const double& deviation)
+std::pair<MillimeterPlane, MillimeterPlane> Planes::getFittingXTiltMillimeterPlanes(const double& angle,
+                                                                                    const double& deviation)
 {
-  return getFittingTiltPlanes(y_planes_, angle, deviation);
+  return getFittingTiltPlanes(x_axis, x_millimeter_planes_, x_interpolated_millimeter_planes_, angle, deviation);
 }
 
-std::pair<MatrixPlanePtr, MatrixPlanePtr> Planes::getFittingTiltPlanes(const std::map<double, MatrixPlanePtr>& planes,
-                                                                       const double& angle, const double& deviation)
+std::pair<MillimeterPlane, MillimeterPlane> Planes::getFittingYTiltMillimeterPlanes(const double& angle,
+                                                                                    const double& deviation)
 {
-  std::pair<double, double> plane_indicies = getDeviationPlaneKeys(angle, deviation);
+  return getFittingTiltPlanes(y_axis, y_millimeter_planes_, y_interpolated_millimeter_planes_, angle, deviation);
+}
 
-  MatrixPlanePtr first = planes.at(plane_indicies.first);
-  MatrixPlanePtr second = planes.at(plane_indicies.second);
+std::pair<HalfPlane, HalfPlane> Planes::getFittingXTiltHalfPlanes(const double& angle, const double& deviation)
+{
+  return getFittingTiltPlanes(x_axis, x_half_planes_, x_interpolated_half_planes_, angle, deviation);
+}
 
-  return std::pair<MatrixPlanePtr, MatrixPlanePtr>(first, second);
+std::pair<HalfPlane, HalfPlane> Planes::getFittingYTiltHalfPlanes(const double& angle, const double& deviation)
+{
+  return getFittingTiltPlanes(y_axis, y_half_planes_, y_interpolated_half_planes_, angle, deviation);
 }
 
-std::pair<double, double> Planes::getDeviationPlaneKeys(const double& angle, const double& deviation)
+double Planes::buildSeconds() const
 {
-  double upper_angle = angle + deviation;
-  double lower_angle = angle - deviation;
+  return build_seconds_;
+}
 
-  auto upper_it = x_planes_.lower_bound(upper_angle); //maybe confusing, see official docu
-  auto lower_it = x_planes_.lower_bound(lower_angle);
-  --lower_it; //take the value lower than this
+int Planes::madePlanes() const
+{
+  if (!lazy_)
+  {
+    return x_planes_.count() + y_planes_.count() + x_millimeter_planes_.count() + y_millimeter_planes_.count()
+        + x_half_planes_.count() + y_half_planes_.count();
+  }
+
+  return made_planes_;
+}
 
-  if (upper_it == x_planes_.end())
+bool Planes::lazy() const
+{
+  return lazy_;
+}
+
+bool Planes::halfPrecision() const
+{
+  return half_precision_;
+}
+
+bool Planes::fits(const CalibrationParameters::Parameters& parameters) const
+{
+  return sameBaseTransform(parameters_, parameters);
+}
+
+bool Planes::sameBank(const CalibrationParameters::Parameters& parameters_a,
+                      const CalibrationParameters::Parameters& parameters_b)
+{
+  return sameBaseTransform(parameters_a, parameters_b)
+      && parameters_a.precomputed_plane_pairs_count_ == parameters_b.precomputed_plane_pairs_count_
+      && parameters_a.interpolate_planes_ == parameters_b.interpolate_planes_
+      && parameters_a.half_precision_planes_ == parameters_b.half_precision_planes_
+      && parameters_a.lazy_planes_ == parameters_b.lazy_planes_;
+}
+
+BankKey::Key Planes::cacheKey(const CalibrationParameters::Parameters& parameters,
+                              const PlaneToDepthImage& plane_to_depth)
+{
+  BankKey::Key key = BankKey::transform(parameters);
+  BankKey::append(plane_to_depth.getCameraParameters(), key);
+  key.push_back(parameters.precomputed_plane_pairs_count_);
+  key.push_back(parameters.interpolate_planes_);
+  key.push_back(parameters.half_precision_planes_);
+  key.push_back(parameters.lazy_planes_);
+  return key;
+}
+
+bool Planes::sameBaseTransform(const CalibrationParameters::Parameters& parameters_a,
+                               const CalibrationParameters::Parameters& parameters_b)
+{
+  return BankKey::transformKey(parameters_a) == BankKey::transformKey(parameters_b);
+}
+
+std::size_t Planes::bytes() const
+{
+  return x_planes_.bytes() + y_planes_.bytes() + x_millimeter_planes_.bytes() + y_millimeter_planes_.bytes()
+      + x_half_planes_.bytes() + y_half_planes_.bytes() + x_interpolated_planes_.bytes()
+      + y_interpolated_planes_.bytes() + x_interpolated_millimeter_planes_.bytes()
+      + y_interpolated_millimeter_planes_.bytes() + x_interpolated_half_planes_.bytes()
+      + y_interpolated_half_planes_.bytes();
+}
+
+template<typename Scalar>
+Planes::PlanePair<Scalar> Planes::getFittingTiltPlanes(const Axis& axis, const PlaneSlab<Scalar>& planes,
+                                                       PlaneSlab<Scalar>& interpolated_planes, const double& angle,
+                                                       const double& deviation)
+{
+  if (interpolate_planes_)
+  {
+    int first_index = interpolationIndex(angle - deviation);
+    int last_index = interpolationIndex(angle + deviation) + 1;
+    for (int index = first_index; index <= last_index; ++index)
+    {
+      ensurePlane(axis, index);
+    }
+    prefetch(axis, first_index, last_index);
+
+    interpolate(planes, angle + deviation, interpolated_planes.plane(0));
+    interpolate(planes, angle - deviation, interpolated_planes.plane(1));
+
+    const PlaneSlab<Scalar>& result = interpolated_planes;
+    return std::make_pair(result.plane(0), result.plane(1));
+  }
+
+  std::pair<int, int> indices = getDeviationPlaneIndices(angle, deviation);
+  ensurePlane(axis, indices.first);
+  ensurePlane(axis, indices.second);
+  prefetch(axis, indices.second, indices.first);
+
+  return std::make_pair(planes.plane(indices.first), planes.plane(indices.second));
+}
+
+int Planes::interpolationIndex(const double& angle) const
+{
+  if (!(angle_step_size_ > 0.0))
+  {
+    return pair_count_;
+  }
+
+  // outside of the bank the outermost planes are used
+  return std::min(clampIndex(std::floor(angle / angle_step_size_)), 2 * pair_count_ - 1);
+}
+
+template<typename Scalar>
+void Planes::interpolate(const PlaneSlab<Scalar>& planes, const double& angle,
+                         typename PlaneSlab<Scalar>::PlaneMap out_plane)
+{
+  if (!(angle_step_size_ > 0.0))
+  {
+    out_plane = planes.plane(pair_count_);
+    return;
+  }
+
+  // lower bank plane and the weight of the upper one
+  int lower_index = interpolationIndex(angle);
+  double weight = angle / angle_step_size_ - (lower_index - pair_count_);
+  weight = std::min(std::max(weight, 0.0), 1.0);
+
+  blend(planes.plane(lower_index), planes.plane(lower_index + 1), weight, out_plane);
+}
+
+void Planes::blend(const MatrixPlane& lower, const MatrixPlane& upper, const float& weight,
+                   PlaneSlab<float>::PlaneMap out_plane)
+{
+  out_plane = (1.0f - weight) * lower.array() + weight * upper.array();
+}
+
+void Planes::blend(const MillimeterPlane& lower, const MillimeterPlane& upper, const float& weight,
+                   PlaneSlab<unsigned short>::PlaneMap out_plane)
+{
+  // rounded, 0 (invalid) in one of the planes stays invalid
+  const unsigned short invalid = 0;
+  out_plane = (lower.array() == invalid || upper.array() == invalid).select(
+      invalid,
+      ((1.0f - weight) * lower.array().cast<float>() + weight * upper.array().cast<float>() + 0.5f).cast<
+          unsigned short>());
+}
+
+void Planes::blend(const HalfPlane& lower, const HalfPlane& upper, const float& weight,
+                   PlaneSlab<Eigen::half>::PlaneMap out_plane)
+{
+  // blended in float row by row, the full planes would need float buffers of the bank plane size
+  Eigen::Matrix<float, 2, Eigen::Dynamic, Eigen::RowMajor>::RowXpr lower_row = half_rows_.row(0);
+  Eigen::Matrix<float, 2, Eigen::Dynamic, Eigen::RowMajor>::RowXpr upper_row = half_rows_.row(1);
+
+  for (int row = 0; row < lower.rows(); ++row)
+  {
+    DepthKernels::halfToFloat(reinterpret_cast<const unsigned short*>(lower.row(row).data()), lower_row.data(),
+                              lower.cols());
+    DepthKernels::halfToFloat(reinterpret_cast<const unsigned short*>(upper.row(row).data()), upper_row.data(),
+                              upper.cols());
+
+    lower_row.array() = (1.0f - weight) * lower_row.array() + weight * upper_row.array();
+    DepthKernels::floatToHalf(lower_row.data(), reinterpret_cast<unsigned short*>(out_plane.row(row).data()),
+                              out_plane.cols());
+  }
+}
+
+std::pair<int, int> Planes::getDeviationPlaneIndices(const double& angle, const double& deviation) const
+{
+  if (!(angle_step_size_ > 0.0))
+  {
+    return std::make_pair(pair_count_, pair_count_);
+  }
+
+  // smallest step with step * size >= upper angle, largest step with step * size < lower angle
+  double upper_step = std::ceil((angle + deviation) / angle_step_size_);
+  double lower_step = std::ceil((angle - deviation) / angle_step_size_) - 1.0;
+
+  return std::make_pair(clampIndex(upper_step), clampIndex(lower_step));
+}
+
+int Planes::clampIndex(const double& step) const
+{
+  // nan ends up at the lowest plane
+  if (!(step > -pair_count_))
   {
-    upper_it = x_planes_.begin();
+    return 0;
   }
 
-  if (lower_it == x_planes_.end())
+  if (step > pair_count_)
   {
-    --lower_it;
+    return 2 * pair_count_;
   }
 
-  return std::make_pair(upper_it->first, lower_it->first);
+  return static_cast<int>(step) + pair_count_;
 }
 
 } /* end namespace */
@@ -0,0 +1,168 @@
+#include "plane_calibration/planes_builder.hpp"
+
+#include <iostream>
+#include <new>
+
+namespace plane_calibration
+{
+
+PlanesBuilder::PlanesBuilder(const PlaneToDepthImage& plane_to_depth) :
+    plane_to_depth_(plane_to_depth), stop_(false), requested_(false), pending_(false), building_(false),
+    thread_(&PlanesBuilder::run, this)
+{
+}
+
+PlanesBuilder::~PlanesBuilder()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  condition_.notify_all();
+
+  // a running build can not be interrupted and is finished first
+  thread_.join();
+}
+
+void PlanesBuilder::build(const CalibrationParameters::Parameters& parameters)
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (requested_ && Planes::sameBank(last_request_, parameters))
+    {
+      return;
+    }
+
+    requested_ = true;
+    last_request_ = parameters;
+    cache_.setBudget(parameters.bank_cache_megabytes_);
+
+    // with a cached bank a not yet started build is not needed anymore
+    PlanesPtr cached = cache_.find(Planes::cacheKey(parameters, plane_to_depth_));
+    pending_ = !cached;
+    if (cached)
+    {
+      planes_ = cached;
+    }
+    else if (planes_ && !planes_->fits(parameters))
+    {
+      // can not be used anymore, the cache keeps it if there is budget
+      planes_.reset();
+    }
+  }
+  condition_.notify_all();
+}
+
+PlanesPtr PlanesBuilder::getPlanes()
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  return planes_;
+}
+
+BankCacheStatistics PlanesBuilder::getCacheStatistics() const
+{
+  return cache_.getStatistics();
+}
+
+void PlanesBuilder::wait()
+{
+  std::unique_lock<std::mutex> lock(mutex_);
+  condition_.wait(lock, [this]()
+  { return !pending_ && !building_;});
+}
+
+void PlanesBuilder::run()
+{
+  while (true)
+  {
+    CalibrationParameters::Parameters parameters;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      condition_.wait(lock, [this]()
+      { return stop_ || pending_;});
+
+      if (stop_)
+      {
+        return;
+      }
+
+      parameters = last_request_;
+      pending_ = false;
+      building_ = true;
+    }
+
+    PlanesPtr planes;
+    const std::string& directory = parameters.planes_cache_directory_;
+    const std::string& shared_directory = parameters.shared_planes_directory_;
+    // a lazy bank is mostly empty, it is neither worth a file nor sharing
+    bool shared = !shared_directory.empty() && !parameters.lazy_planes_;
+    try
+    {
+      // the first instance makes the shared bank, the others wait here and attach to it
+      std::unique_ptr<PlanesFile::Lock> shared_lock;
+      if (shared)
+      {
+        shared_lock.reset(new PlanesFile::Lock(Planes::filePath(shared_directory, parameters, plane_to_depth_)));
+        planes = Planes::load(shared_directory, parameters, plane_to_depth_, true);
+      }
+
+      if (!planes && !directory.empty())
+      {
+        planes = Planes::load(directory, parameters, plane_to_depth_);
+      }
+
+      if (!planes)
+      {
+        planes = std::make_shared<Planes>(parameters, plane_to_depth_);
+        if (!directory.empty() && !planes->lazy() && !planes->store(directory))
+        {
+          std::cout << "PlanesBuilder/run: could not store the precomputed planes in " << directory << std::endl;
+        }
+      }
+
+      // a bank loaded from the cache directory is already shared by the page cache
+      if (shared && !planes->mapped())
+      {
+        PlanesPtr attached;
+        if (planes->store(shared_directory))
+        {
+          attached = Planes::load(shared_directory, parameters, plane_to_depth_, true);
+        }
+
+        if (attached)
+        {
+          planes = attached;
+        }
+        else
+        {
+          std::cout << "PlanesBuilder/run: could not share the precomputed planes in " << shared_directory
+              << std::endl;
+        }
+      }
+    }
+    catch (const std::bad_alloc&)
+    {
+      std::cout << "PlanesBuilder/run: not enough memory for the precomputed planes, calculating them on the fly"
+          << std::endl;
+    }
+
+    {
+      // the transform might have changed again while building
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (planes && planes->fits(last_request_))
+      {
+        planes_ = planes;
+      }
+
+      // also if it is not the latest request, it might be wanted again
+      if (planes)
+      {
+        cache_.insert(Planes::cacheKey(parameters, plane_to_depth_), planes, planes->bytes());
+      }
+      building_ = false;
+    }
+    condition_.notify_all();
+  }
+}
+
+} /* end namespace */
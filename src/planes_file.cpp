@@ -0,0 +1,299 @@
+#include "plane_calibration/planes_file.hpp"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace plane_calibration
+{
+
+const std::uint32_t PlanesFile::version;
+
+namespace
+{
+const char magic[8] = "PLNBANK";
+const std::uint32_t byte_order = 0x01020304;
+const std::size_t page_size = 4096;
+}
+
+PlanesFile::Lock::Lock(const std::string& path, const bool& wait) :
+    descriptor_(-1), locked_(false)
+{
+  std::size_t separator = path.find_last_of('/');
+  if (separator != std::string::npos && !makeDirectories(path.substr(0, separator)))
+  {
+    return;
+  }
+
+  std::string lock_path = path + ".lock";
+  descriptor_ = ::open(lock_path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0666);
+  if (descriptor_ < 0)
+  {
+    return;
+  }
+
+  int result;
+  do
+  {
+    result = flock(descriptor_, wait ? LOCK_EX : LOCK_EX | LOCK_NB);
+  } while (result != 0 && errno == EINTR);
+  locked_ = result == 0;
+}
+
+PlanesFile::Lock::~Lock()
+{
+  // closing releases the flock
+  if (descriptor_ >= 0)
+  {
+    close(descriptor_);
+  }
+}
+
+bool PlanesFile::Lock::locked() const
+{
+  return locked_;
+}
+
+PlanesFile::PlanesFile() :
+    memory_(nullptr), size_(0), shared_descriptor_(-1)
+{
+}
+
+PlanesFile::~PlanesFile()
+{
+  if (memory_)
+  {
+    munmap(memory_, size_);
+  }
+
+  if (shared_descriptor_ >= 0)
+  {
+    // the exclusive flock on the file only succeeds without other users. A busy Lock means someone is making or
+    // attaching the file right now, it is left for them (and removed by its last user).
+    // Not blocking, the destructor runs in the calibration threads
+    Lock lock(path_, false);
+    if (lock.locked() && flock(shared_descriptor_, LOCK_EX | LOCK_NB) == 0)
+    {
+      unlink(path_.c_str());
+    }
+    close(shared_descriptor_);
+  }
+}
+
+PlanesFilePtr PlanesFile::open(const std::string& path, const std::string& key,
+                               const std::vector<std::size_t>& blob_bytes, const bool& shared)
+{
+  int descriptor = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (descriptor < 0)
+  {
+    return PlanesFilePtr();
+  }
+
+  struct stat file_stat;
+  if (fstat(descriptor, &file_stat) != 0 || file_stat.st_size < static_cast<off_t>(sizeof(Header)))
+  {
+    close(descriptor);
+    return PlanesFilePtr();
+  }
+
+  PlanesFilePtr file(new PlanesFile());
+  file->size_ = file_stat.st_size;
+  file->path_ = path;
+  void* memory = mmap(nullptr, file->size_, PROT_READ, MAP_SHARED, descriptor, 0);
+  if (memory == MAP_FAILED)
+  {
+    close(descriptor);
+    return PlanesFilePtr();
+  }
+  file->memory_ = memory;
+
+  // the mapping keeps the file open, shared files keep the descriptor for the reference count
+  if (!shared)
+  {
+    close(descriptor);
+  }
+  else if (flock(descriptor, LOCK_SH) != 0 || fstat(descriptor, &file_stat) != 0 || file_stat.st_nlink == 0)
+  {
+    // removed by its last user between open and flock
+    close(descriptor);
+    return PlanesFilePtr();
+  }
+  else
+  {
+    file->shared_descriptor_ = descriptor;
+  }
+
+  const unsigned char* bytes = static_cast<const unsigned char*>(memory);
+  Header header;
+  std::memcpy(&header, bytes, sizeof(Header));
+
+  std::size_t blobs_end = sizeof(Header) + key.size() + blob_bytes.size() * sizeof(std::uint64_t);
+  if (std::memcmp(header.magic, magic, sizeof(magic)) != 0 || header.version != version
+      || header.byte_order != byte_order || header.key_bytes != key.size() || header.blob_count != blob_bytes.size()
+      || file->size_ < blobs_end || std::memcmp(bytes + sizeof(Header), key.data(), key.size()) != 0)
+  {
+    return PlanesFilePtr();
+  }
+
+  std::vector<std::uint64_t> stored_blob_bytes(blob_bytes.size());
+  std::memcpy(stored_blob_bytes.data(), bytes + sizeof(Header) + key.size(),
+              stored_blob_bytes.size() * sizeof(std::uint64_t));
+  if (headerChecksum(header, key, stored_blob_bytes) != header.header_checksum)
+  {
+    return PlanesFilePtr();
+  }
+
+  std::size_t offset = header.data_offset;
+  for (std::size_t i = 0; i < blob_bytes.size(); ++i)
+  {
+    if (stored_blob_bytes[i] != blob_bytes[i])
+    {
+      return PlanesFilePtr();
+    }
+    file->blob_offsets_.push_back(offset);
+    offset += blob_bytes[i];
+  }
+
+  // truncated files and flipped bits in the planes
+  if (header.data_offset % page_size != 0 || header.data_offset < blobs_end
+      || offset - header.data_offset != header.data_bytes || offset != file->size_
+      || checksum(bytes + header.data_offset, header.data_bytes) != header.data_checksum)
+  {
+    return PlanesFilePtr();
+  }
+
+  return file;
+}
+
+bool PlanesFile::write(const std::string& path, const std::string& key,
+                       const std::vector<std::pair<const void*, std::size_t> >& blobs)
+{
+  std::size_t separator = path.find_last_of('/');
+  if (separator != std::string::npos && !makeDirectories(path.substr(0, separator)))
+  {
+    return false;
+  }
+
+  Header header;
+  std::memcpy(header.magic, magic, sizeof(magic));
+  header.version = version;
+  header.byte_order = byte_order;
+  header.key_bytes = key.size();
+  header.blob_count = blobs.size();
+
+  std::vector<std::uint64_t> blob_bytes;
+  header.data_bytes = 0;
+  header.data_checksum = checksum(nullptr, 0);
+  for (const std::pair<const void*, std::size_t>& blob : blobs)
+  {
+    blob_bytes.push_back(blob.second);
+    header.data_bytes += blob.second;
+  }
+
+  std::size_t meta_bytes = sizeof(Header) + key.size() + blob_bytes.size() * sizeof(std::uint64_t);
+  header.data_offset = (meta_bytes + page_size - 1) / page_size * page_size;
+
+  // the blob sizes are multiples of 8 bytes, chaining the blobs gives the checksum of the contiguous data
+  for (const std::pair<const void*, std::size_t>& blob : blobs)
+  {
+    header.data_checksum = checksum(blob.first, blob.second, header.data_checksum);
+  }
+  header.header_checksum = headerChecksum(header, key, blob_bytes);
+
+  std::ostringstream temporary_path;
+  temporary_path << path << ".tmp." << getpid();
+  FILE* file = std::fopen(temporary_path.str().c_str(), "wb");
+  if (!file)
+  {
+    return false;
+  }
+
+  std::vector<char> padding(header.data_offset - meta_bytes, 0);
+  bool written = std::fwrite(&header, sizeof(Header), 1, file) == 1
+      && std::fwrite(key.data(), 1, key.size(), file) == key.size()
+      && std::fwrite(blob_bytes.data(), sizeof(std::uint64_t), blob_bytes.size(), file) == blob_bytes.size()
+      && std::fwrite(padding.data(), 1, padding.size(), file) == padding.size();
+
+  for (std::size_t i = 0; written && i < blobs.size(); ++i)
+  {
+    written = std::fwrite(blobs[i].first, 1, blobs[i].second, file) == blobs[i].second;
+  }
+
+  written = written && std::fflush(file) == 0 && fsync(fileno(file)) == 0;
+  written = std::fclose(file) == 0 && written;
+
+  if (!written || std::rename(temporary_path.str().c_str(), path.c_str()) != 0)
+  {
+    std::remove(temporary_path.str().c_str());
+    return false;
+  }
+
+  return true;
+}
+
+std::string PlanesFile::fileName(const std::string& key)
+{
+  std::ostringstream name;
+  name << "planes_" << std::hex << std::setw(16) << std::setfill('0') << checksum(key.data(), key.size()) << ".bin";
+  return name.str();
+}
+
+const void* PlanesFile::blob(const int& index) const
+{
+  return static_cast<const unsigned char*>(memory_) + blob_offsets_[index];
+}
+
+std::uint64_t PlanesFile::checksum(const void* data, const std::size_t& bytes, std::uint64_t hash)
+{
+  const std::uint64_t prime = 1099511628211ULL;
+  const unsigned char* input = static_cast<const unsigned char*>(data);
+
+  std::size_t words = bytes / sizeof(std::uint64_t);
+  for (std::size_t i = 0; i < words; ++i)
+  {
+    std::uint64_t word;
+    std::memcpy(&word, input + i * sizeof(std::uint64_t), sizeof(std::uint64_t));
+    hash = (hash ^ word) * prime;
+  }
+
+  for (std::size_t i = words * sizeof(std::uint64_t); i < bytes; ++i)
+  {
+    hash = (hash ^ input[i]) * prime;
+  }
+
+  return hash;
+}
+
+std::uint64_t PlanesFile::headerChecksum(const Header& header, const std::string& key,
+                                         const std::vector<std::uint64_t>& blob_bytes)
+{
+  std::uint64_t hash = checksum(&header, offsetof(Header, header_checksum));
+  hash = checksum(key.data(), key.size(), hash);
+  return checksum(blob_bytes.data(), blob_bytes.size() * sizeof(std::uint64_t), hash);
+}
+
+bool PlanesFile::makeDirectories(const std::string& directory)
+{
+  for (std::size_t separator = directory.find('/', 1); ; separator = directory.find('/', separator + 1))
+  {
+    std::string parent = directory.substr(0, separator);
+    if (!parent.empty() && mkdir(parent.c_str(), 0755) != 0 && errno != EEXIST)
+    {
+      return false;
+    }
+
+    if (separator == std::string::npos)
+    {
+      return true;
+    }
+  }
+}
+
+} /* end namespace */
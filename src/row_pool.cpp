@@ -0,0 +1,135 @@
+#include "plane_calibration/row_pool.hpp"
+
+namespace plane_calibration
+{
+
+const int RowPool::band_rows;
+
+RowPool::Job::Job(const BandWork& work, const int& rows) :
+    work_(work), rows_(rows), bands_((rows + band_rows - 1) / band_rows), next_band_(0), done_bands_(0), helpers_(0)
+{
+}
+
+bool RowPool::Job::runBand()
+{
+  int band = next_band_.fetch_add(1);
+  if (band >= bands_)
+  {
+    return false;
+  }
+
+  // work_ stays valid until the last band is done, the caller waits for that
+  int begin_row = band * band_rows;
+  work_(begin_row, std::min(begin_row + band_rows, rows_));
+
+  if (done_bands_.fetch_add(1) + 1 == bands_)
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    done_.notify_all();
+  }
+  return true;
+}
+
+RowPool::RowPool() :
+    stop_(false)
+{
+}
+
+RowPool::~RowPool()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  condition_.notify_all();
+
+  for (std::thread& worker : workers_)
+  {
+    worker.join();
+  }
+}
+
+RowPool& RowPool::instance()
+{
+  static RowPool pool;
+  return pool;
+}
+
+int RowPool::threadCount(const int& threads)
+{
+  if (threads > 0)
+  {
+    return threads;
+  }
+
+  return std::max(1u, std::thread::hardware_concurrency());
+}
+
+void RowPool::run(const BandWork& work, const int& rows, const int& threads)
+{
+  Job job(work, rows);
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    // the pool grows to the most threads ever asked for
+    while (static_cast<int>(workers_.size()) < threads - 1)
+    {
+      workers_.emplace_back(&RowPool::workerLoop, this);
+    }
+
+    for (int i = 1; i < threads; ++i)
+    {
+      requests_.push_back(&job);
+    }
+  }
+  condition_.notify_all();
+
+  while (job.runBand())
+  {
+  }
+
+  {
+    // all bands are taken, the requests still waiting have nothing to do anymore
+    std::lock_guard<std::mutex> lock(mutex_);
+    requests_.erase(std::remove(requests_.begin(), requests_.end(), &job), requests_.end());
+  }
+
+  std::unique_lock<std::mutex> lock(job.mutex_);
+  job.done_.wait(lock, [&job]()
+  { return job.done_bands_ == job.bands_ && job.helpers_ == 0;});
+}
+
+void RowPool::workerLoop()
+{
+  while (true)
+  {
+    Job* job;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      condition_.wait(lock, [this]()
+      { return stop_ || !requests_.empty();});
+
+      if (stop_)
+      {
+        return;
+      }
+
+      job = requests_.front();
+      requests_.erase(requests_.begin());
+
+      // still under the pool mutex, so the caller waits for this worker once it removes its requests
+      std::lock_guard<std::mutex> job_lock(job->mutex_);
+      ++job->helpers_;
+    }
+
+    while (job->runBand())
+    {
+    }
+
+    // notified with the lock held, the caller can't return and destroy the job before
+    std::lock_guard<std::mutex> job_lock(job->mutex_);
+    --job->helpers_;
+    job->done_.notify_all();
+  }
+}
+
+} /* end namespace */
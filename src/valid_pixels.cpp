@@ -0,0 +1,127 @@
+#include "plane_calibration/valid_pixels.hpp"
+
+namespace plane_calibration
+{
+
+const int ValidPixels::block_size;
+
+ValidPixels::ValidPixels()
+{
+  size_ = 0;
+  rows_ = 0;
+  cols_ = 0;
+}
+
+void ValidPixels::reserve(const int& image_size)
+{
+  if (u_.size() == image_size)
+  {
+    return;
+  }
+
+  u_.resize(image_size);
+  v_.resize(image_size);
+  depth_.resize(image_size);
+  x_multiplier_.resize(image_size);
+  y_multiplier_.resize(image_size);
+}
+
+void ValidPixels::compact(const DepthConstRef& depth, const PlaneToDepthImage::XYMultipliers& xy_multipliers,
+                          const float& max_depth)
+{
+  rows_ = depth.rows();
+  cols_ = depth.cols();
+
+  // room for every pixel, so no reallocation while filling and between frames
+  reserve(depth.size());
+
+  size_ = 0;
+  for (int row = 0; row < rows_; ++row)
+  {
+    const float* depth_row = depth.row(row).data();
+    const float y_multiplier = xy_multipliers.second(row);
+
+    for (int col = 0; col < cols_; ++col)
+    {
+      // nans fail the comparison
+      if (!(depth_row[col] <= max_depth))
+      {
+        continue;
+      }
+
+      u_[size_] = col;
+      v_[size_] = row;
+      depth_[size_] = depth_row[col];
+      x_multiplier_[size_] = xy_multipliers.first(col);
+      y_multiplier_[size_] = y_multiplier;
+      ++size_;
+    }
+  }
+}
+
+int ValidPixels::size() const
+{
+  return size_;
+}
+
+bool ValidPixels::empty() const
+{
+  return size_ == 0;
+}
+
+int ValidPixels::rows() const
+{
+  return rows_;
+}
+
+int ValidPixels::cols() const
+{
+  return cols_;
+}
+
+int ValidPixels::imageSize() const
+{
+  return rows_ * cols_;
+}
+
+ValidPixels::Indices ValidPixels::u() const
+{
+  return u_.head(size_);
+}
+
+ValidPixels::Indices ValidPixels::v() const
+{
+  return v_.head(size_);
+}
+
+ValidPixels::Values ValidPixels::depth() const
+{
+  return depth_.head(size_);
+}
+
+ValidPixels::Values ValidPixels::xMultiplier() const
+{
+  return x_multiplier_.head(size_);
+}
+
+ValidPixels::Values ValidPixels::yMultiplier() const
+{
+  return y_multiplier_.head(size_);
+}
+
+ValidPixels::Values ValidPixels::depth(const int& start, const int& length) const
+{
+  return depth_.segment(start, length);
+}
+
+ValidPixels::Values ValidPixels::xMultiplier(const int& start, const int& length) const
+{
+  return x_multiplier_.segment(start, length);
+}
+
+ValidPixels::Values ValidPixels::yMultiplier(const int& start, const int& length) const
+{
+  return y_multiplier_.segment(start, length);
+}
+
+} /* end namespace */
@@ -0,0 +1,69 @@
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <Eigen/Dense>
+#include "plane_calibration/depth_downsampler.hpp"
+#include "plane_calibration/plane_to_depth_image.hpp"
+
+using namespace plane_calibration;
+
+TEST(DepthDownsampler, nan_aware_mean)
+{
+  DepthMatrix depth(4, 6);
+  depth << 1.0, 3.0, 5.0, 5.0, NAN, NAN,
+           1.0, 3.0, 5.0, NAN, NAN, NAN,
+           2.0, 2.0, 1.0, 1.0, 7.0, NAN,
+           2.0, 2.0, 1.0, 1.0, NAN, NAN;
+
+  DepthMatrix downsampled;
+  DepthDownsampler::downsample(depth, 2, downsampled);
+
+  ASSERT_EQ(downsampled.rows(), 2);
+  ASSERT_EQ(downsampled.cols(), 3);
+
+  EXPECT_FLOAT_EQ(downsampled(0, 0), 2.0);
+  EXPECT_FLOAT_EQ(downsampled(0, 1), 5.0);
+  EXPECT_TRUE(std::isnan(downsampled(0, 2)));
+  EXPECT_FLOAT_EQ(downsampled(1, 0), 2.0);
+  EXPECT_FLOAT_EQ(downsampled(1, 1), 1.0);
+  EXPECT_FLOAT_EQ(downsampled(1, 2), 7.0);
+
+  MillimeterDepthMatrix millimeter_depth(2, 4);
+  millimeter_depth << 1000, 0, 0, 0,
+                      1003, 1000, 0, 0;
+
+  MillimeterDepthMatrix millimeter_downsampled;
+  DepthDownsampler::downsample(millimeter_depth, 2, millimeter_downsampled);
+
+  EXPECT_EQ(millimeter_downsampled(0, 0), 1001);
+  EXPECT_EQ(millimeter_downsampled(0, 1), 0);
+}
+
+TEST(DepthDownsampler, scaled_camera_model)
+{
+  CameraModel::Parameters parameters(321.3, 212, 570.3422, 570.3422, 640, 480);
+
+  Eigen::AngleAxisd rotation(Eigen::AngleAxisd(-0.6, Eigen::Vector3d::UnitX()));
+  Eigen::Affine3d transform = Eigen::Translation3d(0.0, -0.16, 0.96) * rotation;
+
+  DepthMatrix plane = PlaneToDepthImage::convert(transform, parameters);
+  plane = (plane.array() > 0.0f && plane.array() < 5.0f).select(plane, NAN);
+
+  for (int factor = 2; factor <= 8; factor *= 2)
+  {
+    CameraModel::Parameters downsampled_parameters = DepthDownsampler::downsample(parameters, factor);
+    EXPECT_EQ(downsampled_parameters.width_, 640 / factor);
+    EXPECT_EQ(downsampled_parameters.height_, 480 / factor);
+
+    DepthMatrix downsampled_plane;
+    DepthDownsampler::downsample(plane, factor, downsampled_plane);
+
+    DepthMatrix small_plane = PlaneToDepthImage::convert(transform, downsampled_parameters);
+
+    // the binned plane should be the plane seen by the scaled camera
+    DepthMatrix difference = (downsampled_plane - small_plane).cwiseAbs();
+    difference = difference.unaryExpr([](float v)
+    { return std::isnan(v) ? 0.0f : v;});
+    EXPECT_LT(difference.maxCoeff(), 0.01 * factor);
+  }
+}
@@ -0,0 +1,216 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+#include "plane_calibration/depth_kernels.hpp"
+
+using namespace plane_calibration;
+
+TEST(DepthKernels, millimetersToMetersSimdExact)
+{
+  // odd count to also hit the scalar tails
+  int count = 640 * 3 + 7;
+  float max_range = 3.5;
+
+  std::vector<unsigned short> input(count);
+  std::generate(input.begin(), input.end(), []()
+  { return std::rand() % 5000;});
+  input[0] = 0;
+  input[1] = 3499;
+  input[2] = 3501;
+  input[count - 1] = 0;
+
+  std::vector<float> scalar(count);
+  DepthKernels::millimetersToMetersScalar(&input.front(), &scalar.front(), count, max_range);
+
+  EXPECT_TRUE(std::isnan(scalar[0]));
+  EXPECT_FALSE(std::isnan(scalar[1]));
+  EXPECT_TRUE(std::isnan(scalar[2]));
+  EXPECT_TRUE(std::isnan(scalar[count - 1]));
+
+  std::vector<float> dispatched(count);
+  DepthKernels::millimetersToMeters(&input.front(), &dispatched.front(), count, max_range);
+  EXPECT_EQ(0, memcmp(&scalar.front(), &dispatched.front(), count * sizeof(float)));
+
+  if (DepthKernels::hasSSE41())
+  {
+    std::vector<float> sse(count);
+    DepthKernels::millimetersToMetersSSE41(&input.front(), &sse.front(), count, max_range);
+    EXPECT_EQ(0, memcmp(&scalar.front(), &sse.front(), count * sizeof(float)));
+  }
+
+  if (DepthKernels::hasAVX2())
+  {
+    std::vector<float> avx(count);
+    DepthKernels::millimetersToMetersAVX2(&input.front(), &avx.front(), count, max_range);
+    EXPECT_EQ(0, memcmp(&scalar.front(), &avx.front(), count * sizeof(float)));
+  }
+}
+
+TEST(DepthKernels, halfKernelsSimdExact)
+{
+  int count = 640 * 3 + 7;
+
+  std::vector<float> depth(count);
+  std::generate(depth.begin(), depth.end(), []()
+  { return 0.3f + (std::rand() % 10000) * 0.0005f;});
+  depth[3] = std::numeric_limits<float>::quiet_NaN();
+  depth[count - 2] = std::numeric_limits<float>::quiet_NaN();
+
+  std::vector<unsigned short> scalar_half(count);
+  DepthKernels::floatToHalfScalar(&depth.front(), &scalar_half.front(), count);
+  std::vector<float> decoded(count);
+  DepthKernels::halfToFloatScalar(&scalar_half.front(), &decoded.front(), count);
+  EXPECT_NEAR(depth[0], decoded[0], depth[0] * 0.001f);
+
+  float scalar_distance = DepthKernels::halfSquaredDistanceScalar(&scalar_half.front(), &depth.front(), count);
+  EXPECT_FALSE(std::isnan(scalar_distance));
+
+  if (DepthKernels::hasF16C())
+  {
+    std::vector<unsigned short> half(count);
+    DepthKernels::floatToHalfF16C(&depth.front(), &half.front(), count);
+    EXPECT_EQ(0, memcmp(&scalar_half.front(), &half.front(), count * sizeof(unsigned short)));
+
+    std::vector<float> f16c_decoded(count);
+    DepthKernels::halfToFloatF16C(&half.front(), &f16c_decoded.front(), count);
+    EXPECT_EQ(0, memcmp(&decoded.front(), &f16c_decoded.front(), count * sizeof(float)));
+
+    EXPECT_EQ(scalar_distance, DepthKernels::halfSquaredDistanceF16C(&half.front(), &depth.front(), count));
+  }
+}
+
+static void expectSameStatistics(const DepthKernels::DifferenceStatistics& expected,
+                                 const DepthKernels::DifferenceStatistics& statistics)
+{
+  EXPECT_EQ(expected.sum, statistics.sum);
+  EXPECT_EQ(expected.abs_sum, statistics.abs_sum);
+  EXPECT_EQ(expected.abs_min, statistics.abs_min);
+  EXPECT_EQ(expected.abs_max, statistics.abs_max);
+  EXPECT_EQ(expected.valid_count, statistics.valid_count);
+  EXPECT_EQ(expected.below_count, statistics.below_count);
+  EXPECT_EQ(expected.outside_count, statistics.outside_count);
+}
+
+TEST(DepthKernels, reductionsSimdExact)
+{
+  int count = 640 * 3 + 7;
+
+  std::vector<float> a(count);
+  std::vector<float> b(count);
+  std::generate(a.begin(), a.end(), []()
+  { return 0.3f + (std::rand() % 10000) * 0.0005f;});
+  std::generate(b.begin(), b.end(), []()
+  { return 0.3f + (std::rand() % 10000) * 0.0005f;});
+  a[3] = std::numeric_limits<float>::quiet_NaN();
+  b[17] = std::numeric_limits<float>::quiet_NaN();
+  a[count - 2] = std::numeric_limits<float>::quiet_NaN();
+  a[5] = 0.0f;
+  b[count - 1] = 0.0f;
+  a[9] = b[9];
+
+  float scalar_distance = DepthKernels::squaredDistanceScalar(&a.front(), &b.front(), count);
+  DepthKernels::DifferenceStatistics scalar_statistics = DepthKernels::differenceStatisticsScalar(&a.front(),
+                                                                                                  &b.front(), count,
+                                                                                                  -0.5f, 1.0f);
+  int scalar_nans;
+  int scalar_zeros;
+  DepthKernels::countNansAndZerosScalar(&a.front(), count, scalar_nans, scalar_zeros);
+
+  EXPECT_FALSE(std::isnan(scalar_distance));
+  EXPECT_EQ(scalar_statistics.valid_count, count - 3);
+  EXPECT_EQ(scalar_statistics.abs_min, 0.0f);
+  EXPECT_GT(scalar_statistics.below_count, 0);
+  EXPECT_GT(scalar_statistics.outside_count, 0);
+  EXPECT_EQ(scalar_nans, 2);
+  EXPECT_EQ(scalar_zeros, 1);
+
+  int nans;
+  int zeros;
+  EXPECT_EQ(scalar_distance, DepthKernels::squaredDistance(&a.front(), &b.front(), count));
+  expectSameStatistics(scalar_statistics,
+                       DepthKernels::differenceStatistics(&a.front(), &b.front(), count, -0.5f, 1.0f));
+  DepthKernels::countNansAndZeros(&a.front(), count, nans, zeros);
+  EXPECT_EQ(scalar_nans, nans);
+  EXPECT_EQ(scalar_zeros, zeros);
+
+  if (DepthKernels::hasSSE2())
+  {
+    EXPECT_EQ(scalar_distance, DepthKernels::squaredDistanceSSE2(&a.front(), &b.front(), count));
+    expectSameStatistics(scalar_statistics,
+                         DepthKernels::differenceStatisticsSSE2(&a.front(), &b.front(), count, -0.5f, 1.0f));
+    DepthKernels::countNansAndZerosSSE2(&a.front(), count, nans, zeros);
+    EXPECT_EQ(scalar_nans, nans);
+    EXPECT_EQ(scalar_zeros, zeros);
+  }
+
+  if (DepthKernels::hasAVX2())
+  {
+    EXPECT_EQ(scalar_distance, DepthKernels::squaredDistanceAVX2(&a.front(), &b.front(), count));
+    expectSameStatistics(scalar_statistics,
+                         DepthKernels::differenceStatisticsAVX2(&a.front(), &b.front(), count, -0.5f, 1.0f));
+    DepthKernels::countNansAndZerosAVX2(&a.front(), count, nans, zeros);
+    EXPECT_EQ(scalar_nans, nans);
+    EXPECT_EQ(scalar_zeros, zeros);
+  }
+
+  if (DepthKernels::hasAVX512())
+  {
+    EXPECT_EQ(scalar_distance, DepthKernels::squaredDistanceAVX512(&a.front(), &b.front(), count));
+    expectSameStatistics(scalar_statistics,
+                         DepthKernels::differenceStatisticsAVX512(&a.front(), &b.front(), count, -0.5f, 1.0f));
+    DepthKernels::countNansAndZerosAVX512(&a.front(), count, nans, zeros);
+    EXPECT_EQ(scalar_nans, nans);
+    EXPECT_EQ(scalar_zeros, zeros);
+  }
+}
+
+TEST(DepthKernels, millimeterDistanceSimdExact)
+{
+  int count = 640 * 3 + 7;
+
+  // the whole 16 bit range, the squares of the largest differences don't fit in 32 bit
+  std::vector<unsigned short> a(count);
+  std::vector<unsigned short> b(count);
+  std::generate(a.begin(), a.end(), []()
+  { return static_cast<unsigned short>(std::rand() % 65536);});
+  std::generate(b.begin(), b.end(), []()
+  { return static_cast<unsigned short>(std::rand() % 65536);});
+  a[0] = 65535;
+  b[0] = 1;
+  a[1] = 1;
+  b[1] = 65535;
+  a[5] = 0;
+  b[17] = 0;
+  b[count - 1] = 0;
+
+  std::int64_t expected = 0;
+  for (int i = 0; i < count; ++i)
+  {
+    std::int64_t difference = static_cast<std::int64_t>(a[i]) - b[i];
+    expected += a[i] != 0 && b[i] != 0 ? difference * difference : 0;
+  }
+
+  EXPECT_EQ(expected, DepthKernels::millimeterSquaredDistanceScalar(&a.front(), &b.front(), count));
+  EXPECT_EQ(expected, DepthKernels::millimeterSquaredDistance(&a.front(), &b.front(), count));
+
+  if (DepthKernels::hasSSE2())
+  {
+    EXPECT_EQ(expected, DepthKernels::millimeterSquaredDistanceSSE2(&a.front(), &b.front(), count));
+  }
+
+  if (DepthKernels::hasAVX2())
+  {
+    EXPECT_EQ(expected, DepthKernels::millimeterSquaredDistanceAVX2(&a.front(), &b.front(), count));
+  }
+
+  if (DepthKernels::hasAVX512())
+  {
+    EXPECT_EQ(expected, DepthKernels::millimeterSquaredDistanceAVX512(&a.front(), &b.front(), count));
+  }
+}
@@ -0,0 +1,105 @@
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <Eigen/Dense>
+#include "plane_calibration/fixed_size_kernels.hpp"
+#include "plane_calibration/plane_to_depth_image.hpp"
+
+using namespace plane_calibration;
+
+TEST(FixedSizeKernels, select)
+{
+  EXPECT_EQ(FixedSizeKernels::select(480, 640), FixedSizeKernels::VGA_RESOLUTION);
+  EXPECT_EQ(FixedSizeKernels::select(240, 320), FixedSizeKernels::QVGA_RESOLUTION);
+  EXPECT_EQ(FixedSizeKernels::select(640, 480), FixedSizeKernels::DYNAMIC_RESOLUTION);
+  EXPECT_EQ(FixedSizeKernels::select(120, 160), FixedSizeKernels::DYNAMIC_RESOLUTION);
+}
+
+TEST(FixedSizeKernels, fixedSameAsDynamic)
+{
+  const FixedSizeKernels::Resolution dynamic = FixedSizeKernels::DYNAMIC_RESOLUTION;
+  CameraModel::Parameters parameters(321.3, 212, 570.3422, 570.3422, 640, 480);
+  const FixedSizeKernels::Resolution fixed = FixedSizeKernels::select(parameters);
+
+  Eigen::Affine3d transform = Eigen::Translation3d(0.0, -0.16, 0.96)
+      * Eigen::AngleAxisd(-0.6, Eigen::Vector3d::UnitX());
+
+  PlaneToDepthImage::XYMultipliers xy_multipliers = PlaneToDepthImage::depthCalculationXYMultiplier(parameters);
+  Eigen::RowVectorXf x_multiplier = xy_multipliers.first;
+  Eigen::VectorXf y_multiplier = xy_multipliers.second;
+  Eigen::Vector4f plane_coeffs = PlaneToDepthImage::planeCoefficients(transform);
+
+  DepthMatrix dynamic_plane;
+  DepthMatrix fixed_plane;
+  FixedSizeKernels::planeDepth(dynamic, plane_coeffs, x_multiplier, y_multiplier, dynamic_plane);
+  FixedSizeKernels::planeDepth(fixed, plane_coeffs, x_multiplier, y_multiplier, fixed_plane);
+  EXPECT_TRUE(dynamic_plane.cwiseEqual(fixed_plane).all());
+
+  DepthMatrix plane = PlaneToDepthImage::convert(transform, parameters);
+  DepthMatrix depth = plane + 0.05 * DepthMatrix::Random(plane.rows(), plane.cols());
+  depth.block(100, 100, 20, 30).setConstant(NAN);
+  depth.block(300, 10, 5, 5).setZero();
+
+  double dynamic_distance = FixedSizeKernels::squaredDistance(dynamic, plane, depth);
+  double fixed_distance = FixedSizeKernels::squaredDistance(fixed, plane, depth);
+  EXPECT_FALSE(std::isnan(fixed_distance));
+  EXPECT_NEAR(dynamic_distance, fixed_distance, 1e-5 * dynamic_distance);
+
+  DepthMatrix min_plane = (plane.array() - 0.03f).matrix();
+  DepthMatrix max_plane = (plane.array() + 0.03f).matrix();
+
+  DepthMatrix dynamic_filtered;
+  DepthMatrix fixed_filtered;
+  FixedSizeKernels::filter(dynamic, depth, min_plane, max_plane, dynamic_filtered);
+  FixedSizeKernels::filter(fixed, depth, min_plane, max_plane, fixed_filtered);
+  EXPECT_EQ((dynamic_filtered.array() == dynamic_filtered.array()).count(),
+            (fixed_filtered.array() == fixed_filtered.array()).count());
+  EXPECT_TRUE((dynamic_filtered.array() == fixed_filtered.array() || dynamic_filtered.array().isNaN()).all());
+
+  DepthMatrix dynamic_difference;
+  DepthMatrix fixed_difference;
+  int dynamic_count = FixedSizeKernels::difference(dynamic, plane, depth, dynamic_difference);
+  int fixed_count = FixedSizeKernels::difference(fixed, plane, depth, fixed_difference);
+  EXPECT_EQ(dynamic_count, plane.size() - 20 * 30);
+  EXPECT_EQ(dynamic_count, fixed_count);
+  EXPECT_TRUE(dynamic_difference.cwiseEqual(fixed_difference).all());
+}
+
+TEST(FixedSizeKernels, fusedPlaneDistances)
+{
+  for (int scale = 1; scale <= 3; ++scale)
+  {
+    // 640x480, 320x240 and a dynamic size
+    CameraModel::Parameters parameters(321.3 / scale, 212 / scale, 570.3422 / scale, 570.3422 / scale, 640 / scale,
+                                       480 / scale);
+    PlaneToDepthImage plane_to_depth(parameters);
+
+    Eigen::Affine3d transform = Eigen::Translation3d(0.0, -0.16, 0.96)
+        * Eigen::AngleAxisd(-0.6, Eigen::Vector3d::UnitX());
+    DepthMatrix depth = plane_to_depth.convert(transform);
+    depth += 0.02 * DepthMatrix::Random(depth.rows(), depth.cols());
+    depth.block(10, 10, 5, 5).setConstant(NAN);
+
+    Eigen::Matrix4f plane_coeffs;
+    std::vector<DepthMatrix> planes(4);
+    for (int i = 0; i < 4; ++i)
+    {
+      Eigen::Vector3d axis = i < 2 ? Eigen::Vector3d::UnitX() : Eigen::Vector3d::UnitY();
+      Eigen::Affine3d tilted = transform * Eigen::AngleAxisd(i % 2 == 0 ? 0.05 : -0.05, axis);
+
+      plane_coeffs.col(i) = PlaneToDepthImage::planeCoefficients(tilted);
+      plane_to_depth.convert(tilted, planes[i]);
+    }
+
+    const PlaneToDepthImage::XYMultipliers& xy_multipliers = plane_to_depth.getXYMultipliers();
+    Eigen::Vector4d distances = FixedSizeKernels::planeSquaredDistances(FixedSizeKernels::select(parameters),
+                                                                        plane_coeffs, xy_multipliers.first,
+                                                                        xy_multipliers.second, depth);
+
+    for (int i = 0; i < 4; ++i)
+    {
+      double expected = FixedSizeKernels::squaredDistance(FixedSizeKernels::select(parameters), planes[i], depth);
+      EXPECT_NEAR(distances(i), expected, 1e-6 * expected);
+    }
+  }
+}
@@ -0,0 +1,63 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+#include "plane_calibration/frame_mailbox.hpp"
+
+using namespace plane_calibration;
+
+TEST(FrameMailbox, latestFrameWins)
+{
+  FrameMailbox<std::shared_ptr<int> > mailbox;
+  EXPECT_FALSE(mailbox.post(std::make_shared<int>(1)));
+  EXPECT_TRUE(mailbox.post(std::make_shared<int>(2)));
+  EXPECT_TRUE(mailbox.post(std::make_shared<int>(3)));
+  EXPECT_EQ(mailbox.dropped(), 2);
+
+  std::shared_ptr<int> frame;
+  ASSERT_TRUE(mailbox.take(frame));
+  EXPECT_EQ(*frame, 3);
+
+  // the slot is empty again, the next post is not a drop
+  EXPECT_FALSE(mailbox.post(std::make_shared<int>(4)));
+  EXPECT_EQ(mailbox.dropped(), 2);
+}
+
+TEST(FrameMailbox, worker)
+{
+  FrameMailbox<int> mailbox;
+  std::vector<int> taken;
+  std::atomic<int> last_taken(0);
+  std::thread worker([&]()
+  {
+    int frame;
+    while (mailbox.take(frame))
+    {
+      taken.push_back(frame);
+      last_taken = frame;
+    }
+  });
+
+  for (int i = 1; i <= 1000; ++i)
+  {
+    mailbox.post(i);
+  }
+
+  // nothing replaces the last frame
+  while (last_taken != 1000)
+  {
+    std::this_thread::yield();
+  }
+  mailbox.close();
+  worker.join();
+  EXPECT_FALSE(mailbox.post(1001));
+
+  // newer frames only, every frame was either taken or dropped
+  for (std::size_t i = 1; i < taken.size(); ++i)
+  {
+    EXPECT_GT(taken[i], taken[i - 1]);
+  }
+  EXPECT_EQ(mailbox.dropped() + taken.size(), 1000);
+}
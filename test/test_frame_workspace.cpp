@@ -0,0 +1,291 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <string>
+#include <Eigen/Dense>
+#include <sensor_msgs/image_encodings.h>
+#include "plane_calibration/calibration_parameters.hpp"
+#include "plane_calibration/calibration_validation.hpp"
+#include "plane_calibration/depth_downsampler.hpp"
+#include "plane_calibration/depth_kernels.hpp"
+#include "plane_calibration/frame_workspace.hpp"
+#include "plane_calibration/ground_checks.hpp"
+#include "plane_calibration/image_msg_eigen_converter.hpp"
+#include "plane_calibration/input_filter.hpp"
+#include "plane_calibration/plane_calibration.hpp"
+#include "plane_calibration/plane_to_depth_image.hpp"
+
+using namespace plane_calibration;
+
+#ifdef __GLIBC__
+
+// counting allocator hook: malloc of this binary replaces the one of the c library for everything, operator new and
+// Eigen included, and hands over to the glibc implementation
+static std::atomic<bool> count_allocations(false);
+static std::atomic<int> allocations(0);
+
+extern "C"
+{
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t count, size_t size);
+void* __libc_realloc(void* pointer, size_t size);
+void* __libc_memalign(size_t alignment, size_t size);
+
+void* malloc(size_t size)
+{
+  if (count_allocations)
+  {
+    ++allocations;
+  }
+  return __libc_malloc(size);
+}
+
+void* calloc(size_t count, size_t size)
+{
+  if (count_allocations)
+  {
+    ++allocations;
+  }
+  return __libc_calloc(count, size);
+}
+
+void* realloc(void* pointer, size_t size)
+{
+  if (count_allocations)
+  {
+    ++allocations;
+  }
+  return __libc_realloc(pointer, size);
+}
+
+void* aligned_alloc(size_t alignment, size_t size)
+{
+  if (count_allocations)
+  {
+    ++allocations;
+  }
+  return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void** pointer, size_t alignment, size_t size)
+{
+  if (count_allocations)
+  {
+    ++allocations;
+  }
+  *pointer = __libc_memalign(alignment, size);
+  return *pointer ? 0 : ENOMEM;
+}
+}
+
+// the depth image of the sensor: the ground with an offset and some noise, 16UC1 in [mm] or 32FC1 in [m]
+sensor_msgs::ImagePtr groundImage(const CameraModel::Parameters& camera_parameters,
+                                  const Eigen::Affine3d& ground_transform, const bool& millimeters)
+{
+  PlaneToDepthImage plane_to_depth(camera_parameters);
+  std::srand(1);
+  DepthMatrix depth = plane_to_depth.convert(ground_transform)
+      + 0.01 * DepthMatrix::Random(camera_parameters.height_, camera_parameters.width_);
+  depth.block(100, 200, 50, 100).setConstant(NAN);
+
+  sensor_msgs::ImagePtr image = sensor_msgs::ImagePtr(new sensor_msgs::Image());
+  image->height = depth.rows();
+  image->width = depth.cols();
+  if (millimeters)
+  {
+    image->encoding = sensor_msgs::image_encodings::TYPE_16UC1;
+    image->step = image->width * sizeof(unsigned short);
+    image->data.resize(image->height * image->step);
+    Eigen::Map<MillimeterDepthMatrix> data(reinterpret_cast<unsigned short*>(image->data.data()), depth.rows(),
+                                           depth.cols());
+    data = (depth.array() == depth.array()).select((depth.array() * 1000.0f).round(), 0.0f).cast<unsigned short>();
+  }
+  else
+  {
+    image->encoding = sensor_msgs::image_encodings::TYPE_32FC1;
+    image->step = image->width * sizeof(float);
+    image->data.resize(image->height * image->step);
+    Eigen::Map<DepthMatrix>(reinterpret_cast<float*>(image->data.data()), depth.rows(), depth.cols()) = depth;
+  }
+
+  return image;
+}
+
+class FrameWorkspaceConfig
+{
+public:
+  std::string name;
+  bool millimeters;
+  int downsample_factor;
+  int pyramid_factor;
+  int threads;
+  bool half_precision;
+  bool interpolate_planes;
+};
+
+TEST(FrameWorkspace, noAllocationsPerFrame)
+{
+  CameraModel camera_model(321.3, 212, 570.3422, 570.3422, 640, 480);
+  // z of the ground frame up, towards the camera
+  Eigen::AngleAxisd rotation(M_PI - 0.628319, Eigen::Vector3d::UnitX());
+  Eigen::Vector3d ground_plane_offset(0.0, -0.16, 0.96);
+  const double sensor_height = -rotation.matrix().col(2).dot(ground_plane_offset);
+  const float max_range = 3.5f;
+  const float max_z_by_xy = std::tan(0.1f);
+  const float invalid_height_threshold = 0.04f;
+  const int iterations = 3;
+
+  Eigen::Affine3d offset_transform = Eigen::Translation3d(ground_plane_offset) * rotation
+      * Eigen::AngleAxisd(-0.02, Eigen::Vector3d::UnitX()) * Eigen::AngleAxisd(0.03, Eigen::Vector3d::UnitY());
+
+  // serial and split over the row pool, the downsampling and the pyramid of the float and the [mm] path, the fp16
+  // and the interpolated planes
+  const FrameWorkspaceConfig configs[] = { {"float", false, 1, 1, 1, false, false},
+                                           {"float threads", false, 1, 1, 3, false, false},
+                                           {"float downsampled pyramid", false, 2, 4, 1, false, false},
+                                           {"millimeters", true, 1, 1, 1, false, false},
+                                           {"millimeters downsampled pyramid", true, 2, 4, 3, false, false},
+                                           {"half", false, 1, 1, 1, true, false},
+                                           {"interpolated", false, 1, 1, 1, false, true},
+                                           {"half interpolated", false, 1, 1, 3, true, true},
+                                           {"millimeters interpolated", true, 1, 1, 1, false, true} };
+
+  for (const FrameWorkspaceConfig& config : configs)
+  {
+    sensor_msgs::ImagePtr image = groundImage(camera_model.getParameters(), offset_transform, config.millimeters);
+
+    // the processing objects of the nodelet for the downsampled image
+    CameraModel processing_camera_model;
+    processing_camera_model.update(DepthDownsampler::downsample(camera_model.getParameters(),
+                                                                config.downsample_factor));
+    const CameraModel::Parameters camera_parameters = processing_camera_model.getParameters();
+
+    CalibrationParametersPtr parameters = std::make_shared<CalibrationParameters>();
+    parameters->update(ground_plane_offset, 0.1, rotation);
+    parameters->updateKernelThreads(config.threads);
+    parameters->updateMillimeterDepth(config.millimeters);
+    parameters->updatePyramidFactor(config.pyramid_factor);
+    parameters->updateHalfPrecisionPlanes(config.half_precision);
+    parameters->updatePlaneInterpolation(config.interpolate_planes);
+    PlaneCalibration plane_calibration(processing_camera_model, parameters, VisualizerInterfacePtr());
+    plane_calibration.waitForPlanes();
+
+    InputFilter::Config filter_config;
+    filter_config.max_error = 0.05;
+    filter_config.threshold_from_ground = 0.05;
+    filter_config.max_nan_ratio = 0.9;
+    filter_config.max_zero_ratio = 0.9;
+    filter_config.min_data_ratio = 0.1;
+    InputFilter input_filter(processing_camera_model, parameters, VisualizerInterfacePtr(), filter_config);
+
+    CalibrationValidation::Config validation_config;
+    validation_config.too_low_buffer = 0.05;
+    validation_config.max_too_low_ratio = 0.05;
+    validation_config.max_mean = 0.1;
+    CalibrationValidation validation(processing_camera_model, parameters, validation_config,
+                                     VisualizerInterfacePtr());
+
+    PlaneToDepthImage plane_to_depth(camera_parameters);
+    DepthMatrix last_ground_plane = plane_to_depth.convert(Eigen::Translation3d(ground_plane_offset) * rotation);
+
+    DepthImageView depth_image;
+    DepthImageView downsampled_depth_image;
+    FrameWorkspace workspace;
+    int calibrated_frames = 0;
+    int planarity_points = 0;
+    int invalid_height_points = 0;
+
+    // the stages of the nodelet on one image, the same calls in the same order
+    auto process_frame = [&]()
+    {
+      // ingest
+      ASSERT_TRUE(ImageMsgEigenConverter::convert(image, depth_image, max_range));
+      if (config.downsample_factor > 1)
+      {
+        DepthDownsampler::downsample(depth_image, config.downsample_factor, downsampled_depth_image);
+      }
+      const DepthImageView& processing_image = config.downsample_factor > 1 ? downsampled_depth_image : depth_image;
+      DepthMap raw_depth = processing_image.map();
+      workspace.resize(camera_parameters);
+
+      GroundChecks::PlanarityStatistics planarity = GroundChecks::planarity(raw_depth, camera_parameters, rotation,
+                                                                            max_range, max_z_by_xy,
+                                                                            workspace.planarity_points,
+                                                                            config.threads);
+      planarity_points = planarity.valid_points;
+
+      bool usable;
+      if (config.millimeters)
+      {
+        input_filter.filter(processing_image.millimeterMap(), workspace.filtered_millimeter_depth);
+        usable = input_filter.dataIsUsable(workspace.filtered_millimeter_depth);
+
+        workspace.filtered_depth.resize(workspace.filtered_millimeter_depth.rows(),
+                                        workspace.filtered_millimeter_depth.cols());
+        DepthKernels::millimetersToMeters(workspace.filtered_millimeter_depth.data(),
+                                          workspace.filtered_depth.data(), workspace.filtered_millimeter_depth.size());
+        workspace.valid_pixels.compact(workspace.filtered_depth, plane_to_depth.getXYMultipliers());
+      }
+      else
+      {
+        input_filter.filter(raw_depth, workspace.filtered_depth, workspace.valid_pixels);
+        usable = input_filter.dataIsUsable(workspace.valid_pixels);
+      }
+      if (!usable)
+      {
+        return;
+      }
+
+      // calibration
+      validation.groundPlaneHasDataBelow(last_ground_plane, workspace.valid_pixels);
+      std::pair<double, double> result = config.millimeters ?
+          plane_calibration.calibrate(workspace.filtered_millimeter_depth, iterations) :
+          plane_calibration.calibrate(workspace.valid_pixels, iterations);
+      if (!validation.angleOffsetValid(result))
+      {
+        return;
+      }
+
+      // validation
+      Eigen::AngleAxisd result_rotation;
+      result_rotation = rotation * Eigen::AngleAxisd(result.first, Eigen::Vector3d::UnitX())
+          * Eigen::AngleAxisd(result.second, Eigen::Vector3d::UnitY());
+      plane_to_depth.convert(Eigen::Translation3d(ground_plane_offset) * result_rotation, workspace.ground_plane);
+
+      workspace.range_valid_pixels.compact(raw_depth, plane_to_depth.getXYMultipliers(), max_range);
+      GroundChecks::HeightStatistics heights = GroundChecks::pointHeights(workspace.range_valid_pixels,
+                                                                          result_rotation, sensor_height,
+                                                                          invalid_height_threshold,
+                                                                          workspace.point_heights);
+      invalid_height_points = heights.invalid_points;
+
+      if (validation.groundPlaneFitsData(workspace.ground_plane, workspace.valid_pixels))
+      {
+        last_ground_plane.swap(workspace.ground_plane);
+        ++calibrated_frames;
+      }
+    };
+
+    // the first frames may still set things up
+    process_frame();
+    process_frame();
+
+    allocations = 0;
+    count_allocations = true;
+    for (int frame = 0; frame < 5; ++frame)
+    {
+      process_frame();
+    }
+    count_allocations = false;
+
+    EXPECT_EQ(allocations, 0) << config.name;
+    EXPECT_EQ(calibrated_frames, 7) << config.name;
+    // the calibrated ground is flat and has no obstacles
+    EXPECT_GT(planarity_points, camera_parameters.width_ * camera_parameters.height_ / 2) << config.name;
+    EXPECT_LE(invalid_height_points, 10) << config.name;
+  }
+}
+
+#endif
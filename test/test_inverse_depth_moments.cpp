@@ -0,0 +1,63 @@
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <Eigen/Dense>
+#include "plane_calibration/inverse_depth_moments.hpp"
+#include "plane_calibration/plane_to_depth_image.hpp"
+#include "plane_calibration/valid_pixels.hpp"
+
+using namespace plane_calibration;
+
+TEST(InverseDepthMoments, sameAsPixelSums)
+{
+  CameraModel::Parameters parameters(161.3, 112, 285.1711, 285.1711, 320, 240);
+  PlaneToDepthImage plane_to_depth(parameters);
+
+  Eigen::Affine3d data_transform = Eigen::Translation3d(0.0, -0.16, 0.96)
+      * Eigen::AngleAxisd(-0.6, Eigen::Vector3d::UnitX());
+  DepthMatrix data_plane = plane_to_depth.convert(data_transform);
+  DepthMatrix depth = data_plane;
+  depth += 0.02 * DepthMatrix::Random(depth.rows(), depth.cols());
+  depth.block(50, 60, 40, 70).setConstant(NAN);
+
+  Eigen::Affine3d plane_transform = data_transform * Eigen::AngleAxisd(0.05, Eigen::Vector3d::UnitY());
+  DepthMatrix plane = plane_to_depth.convert(plane_transform);
+
+  double residual = 0.0;
+  double distance = 0.0;
+  int count = 0;
+  for (int row = 0; row < depth.rows(); ++row)
+  {
+    for (int col = 0; col < depth.cols(); ++col)
+    {
+      if (std::isnan(depth(row, col)))
+      {
+        continue;
+      }
+      residual += std::pow(1.0 / depth(row, col) - 1.0 / plane(row, col), 2);
+      distance += std::pow(1.0 / plane(row, col) - 1.0 / data_plane(row, col), 2);
+      ++count;
+    }
+  }
+
+  InverseDepthMoments moments(parameters);
+  Eigen::Vector4d plane_coeffs = InverseDepthMoments::planeCoefficients(plane_transform);
+
+  moments.accumulate(depth);
+  EXPECT_EQ(moments.count(), count);
+  EXPECT_NEAR(moments.squaredResidual(plane_coeffs), residual, 1e-3 * residual);
+  EXPECT_NEAR(moments.squaredDistance(plane_coeffs, InverseDepthMoments::planeCoefficients(data_transform)), distance,
+              1e-3 * distance);
+
+  ValidPixels valid_pixels;
+  valid_pixels.compact(depth, plane_to_depth.getXYMultipliers());
+  moments.accumulate(valid_pixels);
+  EXPECT_EQ(moments.count(), count);
+  EXPECT_NEAR(moments.squaredResidual(plane_coeffs), residual, 1e-3 * residual);
+
+  MillimeterDepthMatrix millimeter_depth;
+  PlaneToDepthImage::quantize(depth, millimeter_depth);
+  moments.accumulate(millimeter_depth);
+  EXPECT_EQ(moments.count(), count);
+  EXPECT_NEAR(moments.squaredResidual(plane_coeffs), residual, 1e-2 * residual);
+}
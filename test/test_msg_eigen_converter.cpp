@@ -1,8 +1,11 @@
 #include <gtest/gtest.h>
 #include <algorithm>
+#include <cmath>
+#include <limits>
 #include <sensor_msgs/image_encodings.h>
 
 #include "plane_calibration/image_msg_eigen_converter.hpp"
+#include "plane_calibration/depth_kernels.hpp"
 
 using namespace plane_calibration;
 
@@ -39,12 +42,90 @@ TEST(MsgEigenConverter, convertShort)
   const unsigned short* short_data_pointer = reinterpret_cast<const unsigned short*>(data_pointer);
   Eigen::Map<const Eigen::Matrix<unsigned short, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>> map(short_data_pointer, height, width);
 
+  // [mm] -> [m], zero is invalid
+  original_image->data[0] = 0;
+  original_image->data[1] = 0;
+
   Eigen::MatrixXf matrix;
   ImageMsgEigenConverter::convert(original_image, matrix);
 
-  EXPECT_EQ(matrix.cast<unsigned short>(), map.cast<unsigned short>());
+  auto expected = (map.array() == 0).select(std::numeric_limits<float>::quiet_NaN(),
+                                            map.cast<float>().array() * 0.001f);
+  EXPECT_TRUE(std::isnan(matrix(0, 0)));
+  EXPECT_TRUE((matrix.array() == expected || (matrix.array().isNaN() && expected.isNaN())).all());
 
+  // a copy, not a view of the msg
   original_image->data.back() += 1;
-  EXPECT_NE(matrix.cast<unsigned short>(), map.cast<unsigned short>());
+  EXPECT_FALSE((matrix.array() == expected || (matrix.array().isNaN() && expected.isNaN())).all());
+}
+
+
+TEST(MsgEigenConverter, viewFloatPadded)
+{
+  unsigned int height = 48;
+  unsigned int width = 64;
+  unsigned int padding = 3;
+
+  sensor_msgs::ImagePtr original_image = sensor_msgs::ImagePtr(new sensor_msgs::Image());
+  original_image->width = width;
+  original_image->height = height;
+  original_image->encoding = sensor_msgs::image_encodings::TYPE_32FC1;
+  original_image->step = (width + padding) * sizeof(float);
+
+  original_image->data.resize(height * original_image->step);
+  float* float_data_pointer = reinterpret_cast<float*>(&(original_image->data.front()));
+  Eigen::Map<Eigen::Matrix<float, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>, 0, Eigen::OuterStride<>> map(
+      float_data_pointer, height, width, Eigen::OuterStride<>(width + padding));
+  map.setRandom();
+
+  DepthImageView view;
+  ImageMsgEigenConverter::convert(original_image, view);
+
+  EXPECT_TRUE(view.isMapped());
+  EXPECT_EQ(view.map().data(), float_data_pointer);
+  EXPECT_EQ(view.map(), map);
+
+  map(height - 1, width - 1) += 1.0f;
+  EXPECT_EQ(view.map(), map);
 }
 
+TEST(MsgEigenConverter, viewShort)
+{
+  unsigned int height = 48;
+  unsigned int width = 67;
+  float max_range = 30.0;
+
+  sensor_msgs::ImagePtr original_image = sensor_msgs::ImagePtr(new sensor_msgs::Image());
+  original_image->width = width;
+  original_image->height = height;
+  original_image->encoding = sensor_msgs::image_encodings::TYPE_16UC1;
+  original_image->step = (width + 1) * sizeof(unsigned short);
+
+  original_image->data.resize(height * original_image->step);
+  std::generate(original_image->data.begin(), original_image->data.end(), std::rand);
+
+  const unsigned short* short_data_pointer = reinterpret_cast<const unsigned short*>(&(original_image->data.front()));
+  Eigen::Map<const Eigen::Matrix<unsigned short, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>, 0,
+      Eigen::OuterStride<>> map(short_data_pointer, height, width, Eigen::OuterStride<>(width + 1));
+
+  DepthImageView view;
+  ImageMsgEigenConverter::convert(original_image, view, max_range);
+
+  EXPECT_FALSE(view.isMapped());
+
+  for (int row = 0; row < map.rows(); ++row)
+  {
+    for (int col = 0; col < map.cols(); ++col)
+    {
+      float meters = map(row, col) * DepthKernels::millimeter_to_meter;
+      if (map(row, col) == 0 || meters > max_range)
+      {
+        EXPECT_TRUE(std::isnan(view.map()(row, col)));
+      }
+      else
+      {
+        EXPECT_EQ(view.map()(row, col), meters);
+      }
+    }
+  }
+}
@@ -1,5 +1,6 @@
 #include <gtest/gtest.h>
 
+#include <cstdlib>
 #include <Eigen/Dense>
 #include <ecl/geometry/angle.hpp>
 #include "plane_calibration/plane_to_depth_image.hpp"
@@ -9,49 +10,217 @@
 
 using namespace plane_calibration;
 
-TEST(PlaneCalibration, one_shot)
+class PlaneCalibrationScenario
 {
-  int width = 640;
-  int height = 480;
-  double c_x = 321.3;
-  double c_y = 212;
-  double f_x = 570.3422;
-  double f_y = 570.3422;
-  CameraModel camera_model(c_x, c_y, f_x, f_y, width, height);
-
-  double max_deviation = 0.1;
-  double px = -0.628319;
-  double py = 0.057;
-  double pz = 0.0;
-  Eigen::AngleAxisd start_rotation;
-  start_rotation = Eigen::AngleAxisd(px, Eigen::Vector3d::UnitX()) * Eigen::AngleAxisd(py, Eigen::Vector3d::UnitY())
-      * Eigen::AngleAxisd(pz, Eigen::Vector3d::UnitZ());
+public:
+  PlaneCalibrationScenario() :
+      camera_model(321.3, 212, 570.3422, 570.3422, 640, 480)
+  {
+    max_deviation = 0.1;
+    double px = -0.628319;
+    double py = 0.057;
+    double pz = 0.0;
+    start_rotation = Eigen::AngleAxisd(px, Eigen::Vector3d::UnitX()) * Eigen::AngleAxisd(py, Eigen::Vector3d::UnitY())
+        * Eigen::AngleAxisd(pz, Eigen::Vector3d::UnitZ());
 
-  double px_offset = -0.023;
-  double py_offset = 0.04;
-  Eigen::AngleAxisd rotation_offset;
-  rotation_offset = Eigen::AngleAxisd(px_offset, Eigen::Vector3d::UnitX())
-      * Eigen::AngleAxisd(py_offset, Eigen::Vector3d::UnitY());
+    px_offset = -0.023;
+    py_offset = 0.04;
+    Eigen::AngleAxisd rotation_offset;
+    rotation_offset = Eigen::AngleAxisd(px_offset, Eigen::Vector3d::UnitX())
+        * Eigen::AngleAxisd(py_offset, Eigen::Vector3d::UnitY());
 
-  Eigen::Vector3d ground_plane_offset(0.0, -0.16, 0.96);
+    ground_plane_offset = Eigen::Vector3d(0.0, -0.16, 0.96);
 
-  Eigen::Affine3d transform = Eigen::Translation3d(ground_plane_offset) * start_rotation * rotation_offset;
-  Eigen::MatrixXf plane = PlaneToDepthImage::convert(transform, camera_model.getParameters());
-  Eigen::MatrixXf noise = Eigen::MatrixXf::Random(plane.rows(), plane.cols());
-  Eigen::MatrixXf random_plane_image = plane + 0.02 * noise;
+    Eigen::Affine3d transform = Eigen::Translation3d(ground_plane_offset) * start_rotation * rotation_offset;
+    DepthMatrix plane = PlaneToDepthImage::convert(transform, camera_model.getParameters());
+    // fixed noise, the comparisons between the plane types must not depend on the time the test runs
+    std::srand(noise_seed);
+    DepthMatrix noise = DepthMatrix::Random(plane.rows(), plane.cols());
+    random_plane_image = plane + 0.02 * noise;
+  }
 
-  CalibrationParametersPtr parameters = std::make_shared<CalibrationParameters>();
-  parameters->update(ground_plane_offset, max_deviation, start_rotation);
+  PlaneCalibrationPtr makeCalibration(const bool& millimeter_depth = false, const int& pyramid_factor = 1)
+  {
+    CalibrationParametersPtr parameters = std::make_shared<CalibrationParameters>();
+    parameters->update(ground_plane_offset, max_deviation, start_rotation);
+    parameters->updateMillimeterDepth(millimeter_depth);
+    parameters->updatePyramidFactor(pyramid_factor);
 
-  VisualizerInterfacePtr dummy_visualizer;
-  PlaneCalibrationPtr plane_calibration = std::make_shared<PlaneCalibration>(camera_model, parameters, dummy_visualizer);
+    VisualizerInterfacePtr dummy_visualizer;
+    PlaneCalibrationPtr plane_calibration = std::make_shared<PlaneCalibration>(camera_model, parameters,
+                                                                               dummy_visualizer);
+    plane_calibration->waitForPlanes();
+    return plane_calibration;
+  }
 
-  std::pair<double, double> one_shot_result = plane_calibration->calibrate(random_plane_image, 3);
+  static const unsigned int noise_seed = 1;
+
+  CameraModel camera_model;
+  double max_deviation;
+  Eigen::AngleAxisd start_rotation;
+  Eigen::Vector3d ground_plane_offset;
+
+  double px_offset;
+  double py_offset;
+
+  DepthMatrix random_plane_image;
+};
+
+TEST(PlaneCalibration, one_shot)
+{
+  PlaneCalibrationScenario scenario;
+  PlaneCalibrationPtr plane_calibration = scenario.makeCalibration();
+
+  std::pair<double, double> one_shot_result = plane_calibration->calibrate(scenario.random_plane_image, 3);
 
   double estimated_px = one_shot_result.first;
   double estimated_py = one_shot_result.second;
 
   double epsilon = ecl::degrees_to_radians(0.5);
-  EXPECT_NEAR(estimated_px, px_offset, epsilon);
-  EXPECT_NEAR(estimated_py, py_offset, epsilon);
+  EXPECT_NEAR(estimated_px, scenario.px_offset, epsilon);
+  EXPECT_NEAR(estimated_py, scenario.py_offset, epsilon);
+}
+
+TEST(PlaneCalibration, one_shot_while_building_planes)
+{
+  PlaneCalibrationScenario scenario;
+  CalibrationParametersPtr parameters = std::make_shared<CalibrationParameters>();
+  parameters->update(scenario.ground_plane_offset, scenario.max_deviation, scenario.start_rotation);
+  PlaneCalibration plane_calibration(scenario.camera_model, parameters, VisualizerInterfacePtr());
+
+  // no waiting, the planes are calculated on the fly until the bank is done
+  std::pair<double, double> result = plane_calibration.calibrate(scenario.random_plane_image, 3);
+
+  double epsilon = ecl::degrees_to_radians(0.5);
+  EXPECT_NEAR(result.first, scenario.px_offset, epsilon);
+  EXPECT_NEAR(result.second, scenario.py_offset, epsilon);
+}
+
+TEST(PlaneCalibration, one_shot_millimeters)
+{
+  PlaneCalibrationScenario scenario;
+  std::pair<double, double> float_result = scenario.makeCalibration()->calibrate(scenario.random_plane_image, 3);
+
+  MillimeterDepthMatrix millimeter_image;
+  PlaneToDepthImage::quantize(scenario.random_plane_image, millimeter_image);
+
+  PlaneCalibrationPtr plane_calibration = scenario.makeCalibration(true);
+  std::pair<double, double> millimeter_result = plane_calibration->calibrate(millimeter_image, 3);
+
+  // quantization to [mm] is way below the sensor noise, the integer results stay within 0.01 degree
+  double tolerance = ecl::degrees_to_radians(0.01);
+  EXPECT_NEAR(millimeter_result.first, float_result.first, tolerance);
+  EXPECT_NEAR(millimeter_result.second, float_result.second, tolerance);
+
+  double epsilon = ecl::degrees_to_radians(0.5);
+  EXPECT_NEAR(millimeter_result.first, scenario.px_offset, epsilon);
+  EXPECT_NEAR(millimeter_result.second, scenario.py_offset, epsilon);
+}
+
+TEST(PlaneCalibration, one_shot_half_planes)
+{
+  PlaneCalibrationScenario scenario;
+  std::pair<double, double> float_result = scenario.makeCalibration()->calibrate(scenario.random_plane_image, 3);
+
+  CalibrationParametersPtr parameters = std::make_shared<CalibrationParameters>();
+  parameters->update(scenario.ground_plane_offset, scenario.max_deviation, scenario.start_rotation);
+  parameters->updateHalfPrecisionPlanes(true);
+  PlaneCalibration plane_calibration(scenario.camera_model, parameters, VisualizerInterfacePtr());
+  plane_calibration.waitForPlanes();
+
+  std::pair<double, double> half_result = plane_calibration.calibrate(scenario.random_plane_image, 3);
+
+  // fp16 has ~1 mm resolution at 2 m, same order as the millimeter planes
+  double tolerance = ecl::degrees_to_radians(0.01);
+  EXPECT_NEAR(half_result.first, float_result.first, tolerance);
+  EXPECT_NEAR(half_result.second, float_result.second, tolerance);
+}
+
+TEST(PlaneCalibration, one_shot_pyramid)
+{
+  PlaneCalibrationScenario scenario;
+
+  for (int pyramid_factor = 4; pyramid_factor <= 8; pyramid_factor *= 2)
+  {
+    PlaneCalibrationPtr plane_calibration = scenario.makeCalibration(false, pyramid_factor);
+    std::pair<double, double> result = plane_calibration->calibrate(scenario.random_plane_image, 3);
+
+    double epsilon = ecl::degrees_to_radians(0.5);
+    EXPECT_NEAR(result.first, scenario.px_offset, epsilon);
+    EXPECT_NEAR(result.second, scenario.py_offset, epsilon);
+  }
+}
+
+TEST(PlaneCalibration, one_shot_valid_pixels)
+{
+  PlaneCalibrationScenario scenario;
+  DepthMatrix image = scenario.random_plane_image;
+  image.block(100, 200, 150, 200).setConstant(NAN);
+
+  PlaneToDepthImage plane_to_depth(scenario.camera_model.getParameters());
+  ValidPixels valid_pixels;
+  valid_pixels.compact(image, plane_to_depth.getXYMultipliers());
+
+  for (int pyramid_factor = 1; pyramid_factor <= 4; pyramid_factor *= 4)
+  {
+    std::pair<double, double> dense_result = scenario.makeCalibration(false, pyramid_factor)->calibrate(image, 3);
+    std::pair<double, double> list_result = scenario.makeCalibration(false, pyramid_factor)->calibrate(valid_pixels, 3);
+
+    // same pixels, only the summation order differs
+    double tolerance = ecl::degrees_to_radians(0.01);
+    EXPECT_NEAR(list_result.first, dense_result.first, tolerance);
+    EXPECT_NEAR(list_result.second, dense_result.second, tolerance);
+  }
+}
+
+TEST(PlaneCalibration, one_shot_moments)
+{
+  PlaneCalibrationScenario scenario;
+
+  CalibrationParametersPtr parameters = std::make_shared<CalibrationParameters>();
+  parameters->update(scenario.ground_plane_offset, scenario.max_deviation, scenario.start_rotation);
+  parameters->updateMomentEstimation(true);
+  PlaneCalibration plane_calibration(scenario.camera_model, parameters, VisualizerInterfacePtr());
+  plane_calibration.waitForPlanes();
+
+  std::pair<double, double> result = plane_calibration.calibrate(scenario.random_plane_image, 3);
+
+  double epsilon = ecl::degrees_to_radians(0.5);
+  EXPECT_NEAR(result.first, scenario.px_offset, epsilon);
+  EXPECT_NEAR(result.second, scenario.py_offset, epsilon);
+}
+
+TEST(PlaneCalibration, one_shot_interpolated_planes)
+{
+  PlaneCalibrationScenario scenario;
+
+  // a tenth of the default bank
+  CalibrationParametersPtr parameters = std::make_shared<CalibrationParameters>(true, 4);
+  parameters->update(scenario.ground_plane_offset, scenario.max_deviation, scenario.start_rotation);
+  parameters->updatePlaneInterpolation(true);
+  PlaneCalibration plane_calibration(scenario.camera_model, parameters, VisualizerInterfacePtr());
+  plane_calibration.waitForPlanes();
+
+  std::pair<double, double> result = plane_calibration.calibrate(scenario.random_plane_image, 3);
+
+  double epsilon = ecl::degrees_to_radians(0.5);
+  EXPECT_NEAR(result.first, scenario.px_offset, epsilon);
+  EXPECT_NEAR(result.second, scenario.py_offset, epsilon);
+}
+
+TEST(PlaneCalibration, one_shot_lazy_planes)
+{
+  PlaneCalibrationScenario scenario;
+  std::pair<double, double> eager_result = scenario.makeCalibration()->calibrate(scenario.random_plane_image, 3);
+
+  CalibrationParametersPtr parameters = std::make_shared<CalibrationParameters>();
+  parameters->update(scenario.ground_plane_offset, scenario.max_deviation, scenario.start_rotation);
+  parameters->updateLazyPlanes(true, 2);
+  PlaneCalibration plane_calibration(scenario.camera_model, parameters, VisualizerInterfacePtr());
+  plane_calibration.waitForPlanes();
+
+  // the same bank planes, only made later
+  std::pair<double, double> lazy_result = plane_calibration.calibrate(scenario.random_plane_image, 3);
+  EXPECT_DOUBLE_EQ(lazy_result.first, eager_result.first);
+  EXPECT_DOUBLE_EQ(lazy_result.second, eager_result.second);
 }
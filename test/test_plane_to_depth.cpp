@@ -8,21 +8,20 @@ TEST(PlaneToDepth, multiplier_positive_only)
 {
   CameraModel::Parameters parameters(0.0, 0.0, 1.0, 1.0, 10, 12);
 
-  std::pair<Eigen::MatrixXd, Eigen::MatrixXd> result_xy_multiplier = PlaneToDepthImage::depthCalculationXYMultiplier(
-      parameters);
+  PlaneToDepthImage::XYMultipliers result_xy_multiplier = PlaneToDepthImage::depthCalculationXYMultiplier(parameters);
 
-  Eigen::MatrixXd x = result_xy_multiplier.first;
-  Eigen::MatrixXd y = result_xy_multiplier.second;
+  Eigen::RowVectorXf x = result_xy_multiplier.first;
+  Eigen::VectorXf y = result_xy_multiplier.second;
 
-  EXPECT_EQ(x(0, 0), 0.0);
-  EXPECT_EQ(x(2, 0), 0.0);
-  EXPECT_EQ(x(0, 4), 4.0);
-  EXPECT_EQ(x(9, 4), 4.0);
+  ASSERT_EQ(x.size(), 10);
+  ASSERT_EQ(y.size(), 12);
 
-  EXPECT_EQ(y(0, 0), 0.0);
-  EXPECT_EQ(y(2, 0), 2.0);
-  EXPECT_EQ(y(0, 4), 0.0);
-  EXPECT_EQ(y(9, 4), 9.0);
+  EXPECT_EQ(x(0), 0.0);
+  EXPECT_EQ(x(4), 4.0);
+
+  EXPECT_EQ(y(0), 0.0);
+  EXPECT_EQ(y(2), 2.0);
+  EXPECT_EQ(y(9), 9.0);
 }
 
 TEST(PlaneToDepth, multiplier_center)
@@ -31,21 +30,17 @@ TEST(PlaneToDepth, multiplier_center)
   double cy = 8.0001;
   CameraModel::Parameters parameters(cx, cy, 1.0, 1.0, 10, 12);
 
-  std::pair<Eigen::MatrixXd, Eigen::MatrixXd> result_xy_multiplier = PlaneToDepthImage::depthCalculationXYMultiplier(
-      parameters);
+  PlaneToDepthImage::XYMultipliers result_xy_multiplier = PlaneToDepthImage::depthCalculationXYMultiplier(parameters);
 
-  Eigen::MatrixXd x = result_xy_multiplier.first;
-  Eigen::MatrixXd y = result_xy_multiplier.second;
+  Eigen::RowVectorXf x = result_xy_multiplier.first;
+  Eigen::VectorXf y = result_xy_multiplier.second;
 
-  EXPECT_EQ(x(0, 0), -cx);
-  EXPECT_EQ(x(2, 0), -cx);
-  EXPECT_EQ(x(0, 4), 4.0 - cx);
-  EXPECT_EQ(x(9, 4), 4.0 - cx);
+  EXPECT_FLOAT_EQ(x(0), -cx);
+  EXPECT_FLOAT_EQ(x(4), 4.0 - cx);
 
-  EXPECT_EQ(y(0, 0), -cy);
-  EXPECT_EQ(y(2, 0), 2.0 - cy);
-  EXPECT_EQ(y(0, 4), -cy);
-  EXPECT_EQ(y(9, 4), 9.0 - cy);
+  EXPECT_FLOAT_EQ(y(0), -cy);
+  EXPECT_FLOAT_EQ(y(2), 2.0 - cy);
+  EXPECT_FLOAT_EQ(y(9), 9.0 - cy);
 }
 
 TEST(PlaneToDepth, multiplier_focal)
@@ -56,21 +51,17 @@ TEST(PlaneToDepth, multiplier_focal)
   double fy = 0.541111;
   CameraModel::Parameters parameters(cx, cy, fx, fy, 10, 12);
 
-  std::pair<Eigen::MatrixXd, Eigen::MatrixXd> result_xy_multiplier = PlaneToDepthImage::depthCalculationXYMultiplier(
-      parameters);
+  PlaneToDepthImage::XYMultipliers result_xy_multiplier = PlaneToDepthImage::depthCalculationXYMultiplier(parameters);
 
-  Eigen::MatrixXd x = result_xy_multiplier.first;
-  Eigen::MatrixXd y = result_xy_multiplier.second;
+  Eigen::RowVectorXf x = result_xy_multiplier.first;
+  Eigen::VectorXf y = result_xy_multiplier.second;
 
-  EXPECT_EQ(x(0, 0), -cx / fx);
-  EXPECT_EQ(x(2, 0), -cx / fx);
-  EXPECT_EQ(x(0, 4), (4.0 - cx)  / fx);
-  EXPECT_EQ(x(9, 4), (4.0 - cx)  / fx);
+  EXPECT_FLOAT_EQ(x(0), -cx / fx);
+  EXPECT_FLOAT_EQ(x(4), (4.0 - cx) / fx);
 
-  EXPECT_EQ(y(0, 0), (-cy) / fy);
-  EXPECT_EQ(y(2, 0), (2.0 - cy) / fy);
-  EXPECT_EQ(y(0, 4), (-cy) / fy);
-  EXPECT_EQ(y(9, 4), (9.0 - cy) / fy);
+  EXPECT_FLOAT_EQ(y(0), (-cy) / fy);
+  EXPECT_FLOAT_EQ(y(2), (2.0 - cy) / fy);
+  EXPECT_FLOAT_EQ(y(9), (9.0 - cy) / fy);
 }
 
 TEST(PlaneToDepth, multiplier_static)
@@ -81,20 +72,55 @@ TEST(PlaneToDepth, multiplier_static)
   double fy = 0.541111;
   CameraModel::Parameters parameters(cx, cy, fx, fy, 10, 12);
 
-  std::pair<Eigen::MatrixXd, Eigen::MatrixXd> result_xy_multiplier = PlaneToDepthImage::depthCalculationXYMultiplier(
-      parameters);
+  PlaneToDepthImage::XYMultipliers result_xy_multiplier = PlaneToDepthImage::depthCalculationXYMultiplier(parameters);
 
-  Eigen::MatrixXd x = result_xy_multiplier.first;
-  Eigen::MatrixXd y = result_xy_multiplier.second;
+  Eigen::RowVectorXf x = result_xy_multiplier.first;
+  Eigen::VectorXf y = result_xy_multiplier.second;
 
   double epsilon = 0.0001;
-  EXPECT_NEAR(x(0, 0),  -9.11765, epsilon);
-  EXPECT_NEAR(x(2, 0),  -9.11765, epsilon);
-  EXPECT_NEAR(x(0, 4), 2.64706, epsilon);
-  EXPECT_NEAR(x(9, 4), 2.64706, epsilon);
-
-  EXPECT_NEAR(y(0, 0), -14.7846, epsilon);
-  EXPECT_NEAR(y(2, 0), -11.0885, epsilon);
-  EXPECT_NEAR(y(0, 4), -14.7846, epsilon);
-  EXPECT_NEAR(y(9, 4), 1.84786, epsilon);
+  EXPECT_NEAR(x(0), -9.11765, epsilon);
+  EXPECT_NEAR(x(4), 2.64706, epsilon);
+
+  EXPECT_NEAR(y(0), -14.7846, epsilon);
+  EXPECT_NEAR(y(2), -11.0885, epsilon);
+  EXPECT_NEAR(y(9), 1.84786, epsilon);
+}
+
+TEST(PlaneToDepth, convert_separable)
+{
+  CameraModel::Parameters parameters(321.3, 212, 570.3422, 570.3422, 640, 480);
+  PlaneToDepthImage plane_to_depth(parameters);
+
+  Eigen::Affine3d transform = Eigen::Translation3d(0.0, -0.16, 0.96)
+      * Eigen::AngleAxisd(-0.6, Eigen::Vector3d::UnitX()) * Eigen::AngleAxisd(0.05, Eigen::Vector3d::UnitY());
+
+  DepthMatrix depth;
+  plane_to_depth.convert(transform, depth);
+  ASSERT_EQ(depth.rows(), 480);
+  ASSERT_EQ(depth.cols(), 640);
+
+  // the buffer gets reused
+  const float* data = depth.data();
+  plane_to_depth.convert(transform.inverse(), depth);
+  plane_to_depth.convert(transform, depth);
+  EXPECT_EQ(depth.data(), data);
+
+  // full matrix double precision reference
+  Eigen::Vector4d coeffs = PlaneToDepthImage::planeCoefficients(transform).cast<double>();
+  double max_relative_error = 0.0;
+  for (int row = 0; row < depth.rows(); ++row)
+  {
+    for (int col = 0; col < depth.cols(); ++col)
+    {
+      double x_multiplier = (col - parameters.center_x_) / parameters.f_x_;
+      double y_multiplier = (row - parameters.center_y_) / parameters.f_y_;
+      double expected = -coeffs(3) / (coeffs(0) * x_multiplier + coeffs(1) * y_multiplier + coeffs(2));
+
+      if (expected > 0.0 && expected < 10.0)
+      {
+        max_relative_error = std::max(max_relative_error, std::abs(depth(row, col) - expected) / expected);
+      }
+    }
+  }
+  EXPECT_LT(max_relative_error, 1e-5);
 }
@@ -0,0 +1,394 @@
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+#include <dirent.h>
+#include <unistd.h>
+#include <Eigen/Dense>
+#include "plane_calibration/deviation_planes.hpp"
+#include "plane_calibration/planes.hpp"
+#include "plane_calibration/planes_builder.hpp"
+#include "plane_calibration/plane_slab.hpp"
+#include "plane_calibration/plane_to_depth_image.hpp"
+
+using namespace plane_calibration;
+
+class PlanesScenario
+{
+public:
+  PlanesScenario() :
+      camera_parameters(161.3, 112, 285.1711, 285.1711, 320, 240), plane_to_depth(camera_parameters)
+  {
+    parameters.ground_plane_offset_ = Eigen::Vector3d(0.0, -0.16, 0.96);
+    parameters.rotation_ = Eigen::AngleAxisd(-0.6, Eigen::Vector3d::UnitX());
+    parameters.max_deviation_ = 0.1;
+    parameters.precomputed_plane_pairs_count_ = 40;
+  }
+
+  DepthMatrix xTiltPlane(const double& angle)
+  {
+    return plane_to_depth.convert(
+        parameters.getTransform() * Eigen::AngleAxisd(angle, Eigen::Vector3d::UnitX()));
+  }
+
+  CameraModel::Parameters camera_parameters;
+  PlaneToDepthImage plane_to_depth;
+  CalibrationParameters::Parameters parameters;
+};
+
+TEST(Planes, indexLookup)
+{
+  PlanesScenario scenario;
+  Planes planes(scenario.parameters, scenario.plane_to_depth);
+  double step = 0.1 * 2.2 / 40;
+
+  // first plane at or above angle + deviation, last plane below angle - deviation
+  std::pair<MatrixPlane, MatrixPlane> fitting = planes.getFittingXTiltPlanes(0.012, 0.02);
+  EXPECT_TRUE(fitting.first.isApprox(scenario.xTiltPlane(6 * step)));
+  EXPECT_TRUE(fitting.second.isApprox(scenario.xTiltPlane(-2 * step)));
+
+  // clamped to the bank
+  std::pair<MatrixPlane, MatrixPlane> above = planes.getFittingXTiltPlanes(1.0, 0.02);
+  EXPECT_TRUE(above.first.isApprox(scenario.xTiltPlane(40 * step)));
+  EXPECT_TRUE(above.second.isApprox(scenario.xTiltPlane(40 * step)));
+
+  std::pair<MatrixPlane, MatrixPlane> below = planes.getFittingXTiltPlanes(-1.0, 0.02);
+  EXPECT_TRUE(below.first.isApprox(scenario.xTiltPlane(-40 * step)));
+  EXPECT_TRUE(below.second.isApprox(scenario.xTiltPlane(-40 * step)));
+
+  // every plane of the slab starts on a cache line
+  std::pair<MatrixPlane, MatrixPlane> y_fitting = planes.getFittingYTiltPlanes(0.003, 0.01);
+  EXPECT_EQ(reinterpret_cast<std::uintptr_t>(y_fitting.first.data()) % 64, 0);
+  EXPECT_EQ(reinterpret_cast<std::uintptr_t>(y_fitting.second.data()) % 64, 0);
+}
+
+TEST(Planes, interpolation)
+{
+  PlanesScenario scenario;
+  scenario.parameters.precomputed_plane_pairs_count_ = 4;
+  scenario.parameters.interpolate_planes_ = true;
+  Planes planes(scenario.parameters, scenario.plane_to_depth);
+
+  // arbitrary angles between the bank planes, the fitting planes are at exactly angle +- deviation
+  const double angles[] = {0.0, 0.0123, -0.0377, 0.081, -0.1};
+  for (double angle : angles)
+  {
+    std::pair<MatrixPlane, MatrixPlane> fitting = planes.getFittingXTiltPlanes(angle, 0.02);
+    DepthMatrix upper = scenario.xTiltPlane(angle + 0.02);
+    DepthMatrix lower = scenario.xTiltPlane(angle - 0.02);
+
+    // ~1 [mm] with 4 pairs (55 mrad between the bank planes), the nearest planes of 40 pairs are off by ~4 [mm]
+    EXPECT_LT((fitting.first - upper).cwiseAbs().maxCoeff(), 2e-3);
+    EXPECT_LT((fitting.second - lower).cwiseAbs().maxCoeff(), 2e-3);
+  }
+}
+
+TEST(PlanesBuilder, swapBank)
+{
+  PlanesScenario scenario;
+  scenario.parameters.precomputed_plane_pairs_count_ = 4;
+
+  PlanesBuilder builder(scenario.plane_to_depth);
+  builder.build(scenario.parameters);
+  builder.wait();
+
+  PlanesPtr planes = builder.getPlanes();
+  ASSERT_TRUE(planes);
+  EXPECT_TRUE(planes->fits(scenario.parameters));
+
+  // same bank again is not rebuilt
+  builder.build(scenario.parameters);
+  EXPECT_EQ(planes, builder.getPlanes());
+
+  // another transform drops the old bank, the user keeps its own pointer
+  CalibrationParameters::Parameters moved = scenario.parameters;
+  moved.ground_plane_offset_.z() += 0.1;
+  builder.build(moved);
+  builder.wait();
+
+  EXPECT_NE(planes, builder.getPlanes());
+  EXPECT_TRUE(builder.getPlanes()->fits(moved));
+  EXPECT_FALSE(planes->fits(moved));
+}
+
+TEST(Planes, buildThreads)
+{
+  PlanesScenario scenario;
+  scenario.parameters.plane_build_threads_ = 1;
+  Planes single_thread(scenario.parameters, scenario.plane_to_depth);
+
+  // the planes are spread unevenly over the threads
+  scenario.parameters.plane_build_threads_ = 3;
+  Planes three_threads(scenario.parameters, scenario.plane_to_depth);
+
+  for (double angle = -0.2; angle <= 0.2; angle += 0.05)
+  {
+    std::pair<MatrixPlane, MatrixPlane> expected = single_thread.getFittingYTiltPlanes(angle, 0.01);
+    std::pair<MatrixPlane, MatrixPlane> planes = three_threads.getFittingYTiltPlanes(angle, 0.01);
+    EXPECT_EQ(expected.first, planes.first);
+    EXPECT_EQ(expected.second, planes.second);
+  }
+
+  EXPECT_GT(three_threads.buildSeconds(), 0.0);
+}
+
+TEST(Planes, storeAndLoad)
+{
+  PlanesScenario scenario;
+  char directory_template[] = "/tmp/plane_calibration_test_XXXXXX";
+  ASSERT_TRUE(mkdtemp(directory_template));
+  // a not yet existing sub directory is created
+  std::string directory = std::string(directory_template) + "/cache";
+
+  Planes planes(scenario.parameters, scenario.plane_to_depth);
+  EXPECT_FALSE(Planes::load(directory, scenario.parameters, scenario.plane_to_depth));
+  ASSERT_TRUE(planes.store(directory));
+
+  PlanesPtr loaded = Planes::load(directory, scenario.parameters, scenario.plane_to_depth);
+  ASSERT_TRUE(loaded);
+  for (double angle = -0.2; angle <= 0.2; angle += 0.05)
+  {
+    std::pair<MatrixPlane, MatrixPlane> expected = planes.getFittingXTiltPlanes(angle, 0.01);
+    std::pair<MatrixPlane, MatrixPlane> mapped = loaded->getFittingXTiltPlanes(angle, 0.01);
+    EXPECT_EQ(expected.first, mapped.first);
+    EXPECT_EQ(expected.second, mapped.second);
+    EXPECT_EQ(reinterpret_cast<std::uintptr_t>(mapped.first.data()) % 64, 0);
+  }
+  EXPECT_EQ(planes.bytes(), loaded->bytes());
+
+  // the pair distances are stored with the planes
+  std::pair<MatrixPlane, MatrixPlane> fitting = planes.getFittingYTiltPlanes(0.02, 0.05);
+  EXPECT_EQ(loaded->getFittingTiltDistance(Planes::y_axis, 0.02, 0.05, loaded->getFittingYTiltPlanes(0.02, 0.05)),
+            planes.getFittingTiltDistance(Planes::y_axis, 0.02, 0.05, fitting));
+
+  // another camera or transform has its own file
+  CameraModel::Parameters other_camera = scenario.camera_parameters;
+  other_camera.f_x_ += 1.0;
+  EXPECT_FALSE(Planes::load(directory, scenario.parameters, PlaneToDepthImage(other_camera)));
+  CalibrationParameters::Parameters other_parameters = scenario.parameters;
+  other_parameters.max_deviation_ = 0.11;
+  EXPECT_FALSE(Planes::load(directory, other_parameters, scenario.plane_to_depth));
+
+  // one flipped byte in the planes is detected, the only file in the directory
+  DIR* directory_stream = opendir(directory.c_str());
+  ASSERT_TRUE(directory_stream);
+  std::string path;
+  for (dirent* entry = readdir(directory_stream); entry; entry = readdir(directory_stream))
+  {
+    if (entry->d_name[0] != '.')
+    {
+      path = directory + "/" + entry->d_name;
+    }
+  }
+  closedir(directory_stream);
+
+  FILE* file = std::fopen(path.c_str(), "r+b");
+  ASSERT_TRUE(file);
+  std::fseek(file, -1000, SEEK_END);
+  int byte = std::fgetc(file);
+  std::fseek(file, -1000, SEEK_END);
+  std::fputc(byte ^ 0x10, file);
+  std::fclose(file);
+  EXPECT_FALSE(Planes::load(directory, scenario.parameters, scenario.plane_to_depth));
+
+  std::remove(path.c_str());
+  rmdir(directory.c_str());
+  rmdir(directory_template);
+}
+
+TEST(PlanesBuilder, cachedBanks)
+{
+  PlanesScenario scenario;
+  scenario.parameters.precomputed_plane_pairs_count_ = 4;
+  scenario.parameters.bank_cache_megabytes_ = 100;
+
+  PlanesBuilder builder(scenario.plane_to_depth);
+  builder.build(scenario.parameters);
+  builder.wait();
+  PlanesPtr planes = builder.getPlanes();
+
+  CalibrationParameters::Parameters moved = scenario.parameters;
+  moved.ground_plane_offset_.z() += 0.1;
+  builder.build(moved);
+  builder.wait();
+  EXPECT_NE(planes, builder.getPlanes());
+
+  // back at the first pose with some tf noise, no build needed
+  CalibrationParameters::Parameters returned = scenario.parameters;
+  returned.ground_plane_offset_.x() += 1e-6;
+  returned.rotation_ = returned.rotation_ * Eigen::AngleAxisd(1e-7, Eigen::Vector3d::UnitY());
+  builder.build(returned);
+  EXPECT_EQ(planes, builder.getPlanes());
+  EXPECT_TRUE(planes->fits(returned));
+
+  BankCacheStatistics statistics = builder.getCacheStatistics();
+  EXPECT_EQ(statistics.hits, 1);
+  EXPECT_EQ(statistics.misses, 2);
+  EXPECT_EQ(statistics.banks, 2);
+  EXPECT_EQ(statistics.bytes, 2 * planes->bytes());
+}
+
+TEST(PlanesBuilder, sharedPlanes)
+{
+  PlanesScenario scenario;
+  scenario.parameters.precomputed_plane_pairs_count_ = 4;
+  char directory[] = "/tmp/plane_calibration_shared_XXXXXX";
+  ASSERT_TRUE(mkdtemp(directory));
+  scenario.parameters.shared_planes_directory_ = directory;
+  std::string path = Planes::filePath(directory, scenario.parameters, scenario.plane_to_depth);
+
+  {
+    // two instances at the same time, one builds and both map the same file
+    PlanesBuilder first(scenario.plane_to_depth);
+    PlanesBuilder second(scenario.plane_to_depth);
+    first.build(scenario.parameters);
+    second.build(scenario.parameters);
+    first.wait();
+    second.wait();
+
+    PlanesPtr first_planes = first.getPlanes();
+    PlanesPtr second_planes = second.getPlanes();
+    ASSERT_TRUE(first_planes && second_planes);
+    EXPECT_TRUE(first_planes->mapped());
+    EXPECT_TRUE(second_planes->mapped());
+    EXPECT_EQ(first_planes->getFittingXTiltPlanes(0.03, 0.01).first,
+              second_planes->getFittingXTiltPlanes(0.03, 0.01).first);
+
+    // the remaining user keeps the file
+    CalibrationParameters::Parameters moved = scenario.parameters;
+    moved.ground_plane_offset_.z() += 0.1;
+    moved.shared_planes_directory_ = "";
+    first_planes.reset();
+    first.build(moved);
+    first.wait();
+    EXPECT_EQ(access(path.c_str(), F_OK), 0);
+  }
+
+  // the last user removed it
+  EXPECT_NE(access(path.c_str(), F_OK), 0);
+
+  std::remove((path + ".lock").c_str());
+  rmdir(directory);
+}
+
+TEST(BankCache, leastRecentlyUsed)
+{
+  BankCache<int> cache;
+  cache.setBudget(1);
+  const std::size_t third = 1024 * 1024 / 3;
+
+  cache.insert(BankKey::Key(1, 1), std::make_shared<int>(1), third);
+  cache.insert(BankKey::Key(1, 2), std::make_shared<int>(2), third);
+  cache.insert(BankKey::Key(1, 3), std::make_shared<int>(3), third);
+  EXPECT_TRUE(cache.find(BankKey::Key(1, 1)));
+
+  // 2 is the least recently used one now
+  cache.insert(BankKey::Key(1, 4), std::make_shared<int>(4), third);
+  EXPECT_FALSE(cache.find(BankKey::Key(1, 2)));
+  EXPECT_EQ(*cache.find(BankKey::Key(1, 3)), 3);
+  EXPECT_EQ(*cache.find(BankKey::Key(1, 4)), 4);
+
+  // larger than the budget
+  cache.insert(BankKey::Key(1, 5), std::make_shared<int>(5), 2 * 1024 * 1024);
+  EXPECT_FALSE(cache.find(BankKey::Key(1, 5)));
+
+  cache.setBudget(0);
+  EXPECT_EQ(cache.getStatistics().banks, 0);
+  EXPECT_EQ(cache.getStatistics().bytes, 0);
+}
+
+TEST(Planes, lazyPlanes)
+{
+  PlanesScenario scenario;
+  Planes eager(scenario.parameters, scenario.plane_to_depth);
+
+  scenario.parameters.lazy_planes_ = true;
+  Planes lazy(scenario.parameters, scenario.plane_to_depth);
+  EXPECT_EQ(lazy.madePlanes(), 0);
+
+  // the same planes from several threads at once, only the used ones are made
+  auto compare = [&](const double& offset)
+  {
+    for (double angle = -0.02; angle <= 0.02; angle += 0.005)
+    {
+      std::pair<MatrixPlane, MatrixPlane> expected = eager.getFittingXTiltPlanes(angle + offset, 0.01);
+      std::pair<MatrixPlane, MatrixPlane> planes = lazy.getFittingXTiltPlanes(angle + offset, 0.01);
+      EXPECT_EQ(expected.first, planes.first);
+      EXPECT_EQ(expected.second, planes.second);
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (int i = 0; i < 4; ++i)
+  {
+    threads.emplace_back(compare, 0.001 * i);
+  }
+  for (std::thread& thread : threads)
+  {
+    thread.join();
+  }
+
+  EXPECT_GT(lazy.madePlanes(), 0);
+  EXPECT_LT(lazy.madePlanes(), 20);
+}
+
+TEST(Planes, lazyPrefetch)
+{
+  PlanesScenario scenario;
+  scenario.parameters.lazy_planes_ = true;
+  scenario.parameters.prefetch_planes_ = 2;
+  Planes planes(scenario.parameters, scenario.plane_to_depth);
+
+  // planes 41 and 39 (+- one step around 0), the background thread adds two on each side
+  double step = 0.1 * 2.2 / 40;
+  planes.getFittingYTiltPlanes(0.0, 0.5 * step);
+
+  for (int i = 0; i < 500 && planes.madePlanes() < 7; ++i)
+  {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  EXPECT_EQ(planes.madePlanes(), 7);
+}
+
+TEST(Planes, pairDistances)
+{
+  PlanesScenario scenario;
+  Planes eager(scenario.parameters, scenario.plane_to_depth);
+  scenario.parameters.lazy_planes_ = true;
+  Planes lazy(scenario.parameters, scenario.plane_to_depth);
+
+  for (double angle = -0.3; angle <= 0.3; angle += 0.01)
+  {
+    for (double deviation = 0.0; deviation <= 0.1; deviation += 0.025)
+    {
+      std::pair<MatrixPlane, MatrixPlane> planes = eager.getFittingXTiltPlanes(angle, deviation);
+      double expected = DeviationPlanes::getDistance(planes.first, planes.second, false);
+      EXPECT_EQ(eager.getFittingTiltDistance(Planes::x_axis, angle, deviation, planes), expected);
+
+      std::pair<MatrixPlane, MatrixPlane> lazy_planes = lazy.getFittingXTiltPlanes(angle, deviation);
+      EXPECT_EQ(lazy.getFittingTiltDistance(Planes::x_axis, angle, deviation, lazy_planes), expected);
+      // from the table the second time
+      EXPECT_EQ(lazy.getFittingTiltDistance(Planes::x_axis, angle, deviation, lazy_planes), expected);
+    }
+  }
+}
+
+TEST(PlaneSlab, resizeKeepsMemoryOnlyForTheSameSize)
+{
+  PlaneSlab<float> slab;
+  slab.resize(2, 1, 13);
+  const void* data = slab.data();
+
+  slab.resize(2, 1, 13);
+  EXPECT_EQ(slab.data(), data);
+
+  // padded to the same plane stride, but the planes are wider now
+  slab.resize(2, 1, 16);
+  EXPECT_EQ(slab.plane(0).cols(), 16);
+  EXPECT_EQ(slab.plane(1).cols(), 16);
+}
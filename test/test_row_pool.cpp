@@ -0,0 +1,136 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <cmath>
+#include <thread>
+#include <vector>
+#include <Eigen/Dense>
+#include "plane_calibration/deviation_planes.hpp"
+#include "plane_calibration/fixed_size_kernels.hpp"
+#include "plane_calibration/row_pool.hpp"
+#include "plane_calibration/valid_pixels.hpp"
+
+using namespace plane_calibration;
+
+TEST(RowPool, everyRowOnce)
+{
+  for (int threads = 1; threads <= 8; threads *= 2)
+  {
+    for (int rows : {1, 15, 16, 17, 481})
+    {
+      std::vector<std::atomic<int> > visits(rows);
+      for (std::atomic<int>& visit : visits)
+      {
+        visit = 0;
+      }
+
+      RowPool::forRows(rows, threads, [&](const int& begin_row, const int& end_row)
+      {
+        EXPECT_EQ(begin_row % RowPool::band_rows, 0);
+        for (int row = begin_row; row < end_row; ++row)
+        {
+          ++visits[row];
+        }
+      });
+
+      for (int row = 0; row < rows; ++row)
+      {
+        EXPECT_EQ(visits[row], 1);
+      }
+    }
+  }
+}
+
+TEST(RowPool, sameResultForAnyThreadCount)
+{
+  for (int scale = 1; scale <= 3; ++scale)
+  {
+    // 640x480, 320x240 and a dynamic size
+    CameraModel::Parameters parameters(321.3 / scale, 212 / scale, 570.3422 / scale, 570.3422 / scale, 640 / scale,
+                                       480 / scale);
+    const FixedSizeKernels::Resolution resolution = FixedSizeKernels::select(parameters);
+    PlaneToDepthImage plane_to_depth(parameters);
+
+    Eigen::Affine3d transform = Eigen::Translation3d(0.0, -0.16, 0.96)
+        * Eigen::AngleAxisd(-0.6, Eigen::Vector3d::UnitX());
+    DepthMatrix plane = plane_to_depth.convert(transform);
+    DepthMatrix depth = plane + 0.05 * DepthMatrix::Random(plane.rows(), plane.cols());
+    depth.block(10, 10, 20, 30).setConstant(NAN);
+
+    Eigen::Matrix4f plane_coeffs;
+    for (int i = 0; i < 4; ++i)
+    {
+      plane_coeffs.col(i) = PlaneToDepthImage::planeCoefficients(transform * Eigen::AngleAxisd(0.01 * i,
+                                                                                               Eigen::Vector3d::UnitX()));
+    }
+    const PlaneToDepthImage::XYMultipliers& xy_multipliers = plane_to_depth.getXYMultipliers();
+
+    DepthMatrix min_plane = (plane.array() - 0.03f).matrix();
+    DepthMatrix max_plane = (plane.array() + 0.03f).matrix();
+    ValidPixels valid_pixels;
+    valid_pixels.compact(depth, xy_multipliers);
+
+    DepthMatrix single_filtered;
+    DepthMatrix single_difference;
+    FixedSizeKernels::filter(resolution, depth, min_plane, max_plane, single_filtered);
+    int single_count = FixedSizeKernels::difference(resolution, plane, depth, single_difference);
+    double single_distance = FixedSizeKernels::squaredDistance(resolution, plane, depth);
+    Eigen::Vector4d single_distances = FixedSizeKernels::planeSquaredDistances(resolution, plane_coeffs,
+                                                                               xy_multipliers.first,
+                                                                               xy_multipliers.second, depth);
+    double single_list_distance = DeviationPlanes::getDistance(plane, valid_pixels);
+    Eigen::Vector4d single_list_distances = DeviationPlanes::getPlaneDistances(plane_coeffs, valid_pixels);
+    double single_dense_distance = DeviationPlanes::getDistance(plane, depth, true);
+
+    for (int threads = 2; threads <= 8; threads *= 2)
+    {
+      DepthMatrix filtered;
+      DepthMatrix difference;
+      FixedSizeKernels::filter(resolution, depth, min_plane, max_plane, filtered, threads);
+      EXPECT_TRUE((filtered.array() == single_filtered.array() || filtered.array().isNaN()).all());
+      EXPECT_EQ(FixedSizeKernels::difference(resolution, plane, depth, difference, threads), single_count);
+      EXPECT_TRUE(difference.cwiseEqual(single_difference).all());
+
+      // bit identical, not only close
+      EXPECT_EQ(FixedSizeKernels::squaredDistance(resolution, plane, depth, threads), single_distance);
+      Eigen::Vector4d distances = FixedSizeKernels::planeSquaredDistances(resolution, plane_coeffs,
+                                                                          xy_multipliers.first,
+                                                                          xy_multipliers.second, depth, threads);
+      EXPECT_TRUE(distances.cwiseEqual(single_distances).all());
+      EXPECT_EQ(DeviationPlanes::getDistance(plane, valid_pixels, threads), single_list_distance);
+      EXPECT_TRUE(DeviationPlanes::getPlaneDistances(plane_coeffs, valid_pixels, threads)
+          .cwiseEqual(single_list_distances).all());
+      EXPECT_EQ(DeviationPlanes::getDistance(plane, depth, true, threads), single_dense_distance);
+    }
+  }
+}
+
+TEST(RowPool, concurrentCallers)
+{
+  // the stages of the pipeline share the pool, every caller gets its own result
+  std::vector<std::thread> callers;
+  std::atomic<int> wrong_sums(0);
+  for (int caller = 1; caller <= 3; ++caller)
+  {
+    callers.emplace_back([caller, &wrong_sums]()
+    {
+      for (int repeat = 0; repeat < 200; ++repeat)
+      {
+        int sum = RowPool::sumRows(480, 4, 0, [caller](const int& begin_row, const int& end_row, int* row_sums)
+        {
+          for (int row = begin_row; row < end_row; ++row)
+          {
+            row_sums[row - begin_row] = caller * row;
+          }
+        });
+        wrong_sums += sum != caller * 479 * 480 / 2;
+      }
+    });
+  }
+
+  for (std::thread& caller : callers)
+  {
+    caller.join();
+  }
+  EXPECT_EQ(wrong_sums, 0);
+}
@@ -0,0 +1,76 @@
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <thread>
+#include "plane_calibration/stage_queue.hpp"
+
+using namespace plane_calibration;
+
+TEST(StageQueue, bounded)
+{
+  StageQueue<std::unique_ptr<int> > queue(2);
+  std::unique_ptr<int> value(new int(1));
+  EXPECT_TRUE(queue.tryPush(value));
+  EXPECT_FALSE(value);
+  value.reset(new int(2));
+  EXPECT_TRUE(queue.tryPush(value));
+  value.reset(new int(3));
+  EXPECT_FALSE(queue.tryPush(value));
+  EXPECT_TRUE(value);
+  EXPECT_EQ(queue.size(), 2);
+  EXPECT_EQ(queue.takeMaxSize(), 2);
+
+  ASSERT_TRUE(queue.tryPop(value));
+  EXPECT_EQ(*value, 1);
+  ASSERT_TRUE(queue.tryPop(value));
+  EXPECT_EQ(*value, 2);
+  EXPECT_FALSE(queue.tryPop(value));
+  // the size at the last call
+  EXPECT_EQ(queue.takeMaxSize(), 2);
+  EXPECT_EQ(queue.takeMaxSize(), 0);
+}
+
+TEST(StageQueue, threeStages)
+{
+  // the numbers go through two queues and back, in order and without loss
+  StageQueue<int> first(1);
+  StageQueue<int> second(1);
+  StageQueue<int> results(1000);
+
+  std::thread middle([&]()
+  {
+    int value;
+    while (first.pop(value))
+    {
+      value *= 2;
+      second.push(value);
+    }
+  });
+  std::thread last([&]()
+  {
+    int value;
+    while (second.pop(value))
+    {
+      results.push(value);
+    }
+  });
+
+  for (int i = 0; i < 1000; ++i)
+  {
+    int value = i;
+    ASSERT_TRUE(first.push(value));
+  }
+
+  int value;
+  for (int i = 0; i < 1000; ++i)
+  {
+    ASSERT_TRUE(results.pop(value));
+    EXPECT_EQ(value, 2 * i);
+  }
+
+  first.close();
+  second.close();
+  middle.join();
+  last.join();
+  EXPECT_FALSE(first.pop(value));
+}
@@ -0,0 +1,112 @@
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <Eigen/Dense>
+#include "plane_calibration/calibration_validation.hpp"
+#include "plane_calibration/depth_downsampler.hpp"
+#include "plane_calibration/deviation_planes.hpp"
+#include "plane_calibration/plane_to_depth_image.hpp"
+#include "plane_calibration/valid_pixels.hpp"
+
+using namespace plane_calibration;
+
+class ValidPixelsScenario
+{
+public:
+  ValidPixelsScenario() :
+      parameters(321.3, 212, 570.3422, 570.3422, 640, 480), plane_to_depth(parameters)
+  {
+    transform = Eigen::Translation3d(0.0, -0.16, 0.96) * Eigen::AngleAxisd(-0.6, Eigen::Vector3d::UnitX());
+    plane = plane_to_depth.convert(transform);
+
+    depth = plane + 0.02 * DepthMatrix::Random(plane.rows(), plane.cols());
+    depth.block(100, 100, 200, 300).setConstant(NAN);
+    depth.block(400, 10, 5, 5).setConstant(NAN);
+
+    valid_pixels.compact(depth, plane_to_depth.getXYMultipliers());
+  }
+
+  CameraModel::Parameters parameters;
+  PlaneToDepthImage plane_to_depth;
+  Eigen::Affine3d transform;
+  DepthMatrix plane;
+  DepthMatrix depth;
+  ValidPixels valid_pixels;
+};
+
+TEST(ValidPixels, compact)
+{
+  ValidPixelsScenario scenario;
+  const ValidPixels& valid_pixels = scenario.valid_pixels;
+
+  EXPECT_EQ(valid_pixels.imageSize(), scenario.depth.size());
+  EXPECT_EQ(valid_pixels.size(), scenario.depth.size() - 200 * 300 - 5 * 5);
+
+  // row major order, values and multipliers of the pixel
+  const PlaneToDepthImage::XYMultipliers& xy_multipliers = scenario.plane_to_depth.getXYMultipliers();
+  for (int i = 1; i < valid_pixels.size(); ++i)
+  {
+    ASSERT_LT(valid_pixels.v()[i - 1] * valid_pixels.cols() + valid_pixels.u()[i - 1],
+              valid_pixels.v()[i] * valid_pixels.cols() + valid_pixels.u()[i]);
+    ASSERT_EQ(valid_pixels.depth()[i], scenario.depth(valid_pixels.v()[i], valid_pixels.u()[i]));
+    ASSERT_EQ(valid_pixels.xMultiplier()[i], xy_multipliers.first(valid_pixels.u()[i]));
+    ASSERT_EQ(valid_pixels.yMultiplier()[i], xy_multipliers.second(valid_pixels.v()[i]));
+  }
+
+  ValidPixels in_range;
+  in_range.compact(scenario.depth, xy_multipliers, 1.0f);
+  EXPECT_EQ(in_range.size(), (scenario.depth.array() <= 1.0f).count());
+}
+
+TEST(ValidPixels, sameAsDense)
+{
+  ValidPixelsScenario scenario;
+  const ValidPixels& valid_pixels = scenario.valid_pixels;
+
+  double dense_distance = DeviationPlanes::getDistance(scenario.plane, scenario.depth, true);
+  double list_distance = DeviationPlanes::getDistance(scenario.plane, valid_pixels);
+  double plane_distance = DeviationPlanes::getPlaneDistance(PlaneToDepthImage::planeCoefficients(scenario.transform),
+                                                            valid_pixels);
+  EXPECT_NEAR(list_distance, dense_distance, 1e-4 * dense_distance);
+  EXPECT_NEAR(plane_distance, dense_distance, 1e-4 * dense_distance);
+
+  // the fused version sums in the same order
+  Eigen::Matrix4f plane_coeffs;
+  for (int i = 0; i < 4; ++i)
+  {
+    plane_coeffs.col(i) = PlaneToDepthImage::planeCoefficients(scenario.transform
+        * Eigen::AngleAxisd(0.01 * i, Eigen::Vector3d::UnitX()));
+  }
+  Eigen::Vector4d plane_distances = DeviationPlanes::getPlaneDistances(plane_coeffs, valid_pixels);
+  for (int i = 0; i < 4; ++i)
+  {
+    EXPECT_EQ(plane_distances(i), DeviationPlanes::getPlaneDistance(plane_coeffs.col(i), valid_pixels));
+  }
+
+  for (int factor = 2; factor <= 8; factor *= 2)
+  {
+    DepthMatrix dense_downsampled;
+    DepthMatrix list_downsampled;
+    DepthDownsampler::downsample(scenario.depth, factor, dense_downsampled);
+    DepthDownsampler::downsample(valid_pixels, factor, list_downsampled);
+    EXPECT_TRUE((dense_downsampled.array() == list_downsampled.array() || dense_downsampled.array().isNaN()).all());
+    EXPECT_TRUE((dense_downsampled.array().isNaN() == list_downsampled.array().isNaN()).all());
+  }
+
+  CalibrationParametersPtr calibration_parameters = std::make_shared<CalibrationParameters>();
+  CalibrationValidation::Config config;
+  config.too_low_buffer = 0.02;
+  config.max_too_low_ratio = 0.1;
+  config.max_mean = 0.01;
+  CameraModel camera_model;
+  camera_model.update(scenario.parameters);
+  CalibrationValidation validation(camera_model, calibration_parameters, config, VisualizerInterfacePtr());
+
+  DepthMatrix low_plane = (scenario.plane.array() - 0.05f).matrix();
+  EXPECT_TRUE(validation.groundPlaneFitsData(scenario.plane, valid_pixels));
+  EXPECT_EQ(validation.groundPlaneFitsData(scenario.plane, valid_pixels),
+            validation.groundPlaneFitsData(scenario.plane, scenario.depth));
+  EXPECT_EQ(validation.groundPlaneHasDataBelow(low_plane, valid_pixels),
+            validation.groundPlaneHasDataBelow(low_plane, scenario.depth));
+  EXPECT_TRUE(validation.groundPlaneHasDataBelow(low_plane, valid_pixels));
+}